@@ -0,0 +1,737 @@
+#include "compiler.h"
+
+/* Alias analysis and redundant load elimination on SSA form.
+ *
+ * alias_analyze() traces every register that may hold an address back to
+ * the object it points into: a variable whose address was taken with
+ * IR_ADDR, or a restrict parameter. The offset into the object is kept
+ * when it is constant. Registers that may point anywhere (pointers loaded
+ * from memory, returned by calls or passed in parameters without
+ * restrict) have no object; registers that hold no pointer at all
+ * (constants, loaded ints) are told apart so that a[i] keeps the object
+ * of a. An object escapes when a pointer into it is stored, passed to a
+ * call, returned or mixed with other pointers.
+ *
+ * Two accesses may alias unless
+ * - they have the same base register or variable and constant offsets
+ *   that do not overlap,
+ * - they are into different objects, or into an object that does not
+ *   escape and through a pointer that may point anywhere,
+ * - their types are incompatible: int and enum values are never stored
+ *   where pointers are read and the other way round, while char accesses
+ *   and untyped memory alias everything.
+ * Calls may write any memory except objects that do not escape.
+ *
+ * load_elim() then finds, for every block, the memory locations whose
+ * value is in a register on entry, by forward dataflow over the CFG. A
+ * load from such a location becomes a copy of the register: either the
+ * result of an earlier load, or the value stored there, sign-extended
+ * from the access size where needed. Stores, calls and va_start forget
+ * the locations they may write. */
+
+/* Objects registers point into, and the other states while they are
+ * being worked out */
+#define ROOT_UNSEEN -1     /* No definition seen yet */
+#define ROOT_NONE -2       /* Not a pointer */
+#define ROOT_ANY -3        /* May point anywhere */
+
+/* An offset that is not known */
+#define OFF_UNKNOWN (-2147483647 - 1)
+
+/* Locations tracked by load_elim() in one function, at most */
+#define MAX_LOCATIONS 256
+
+/* A location that no path into a block has reached yet, in load_elim() */
+#define AVAIL_TOP (-2147483647 - 1)
+
+static IRFunc *alias_func;
+static int alias_nreg;     /* Registers analyzed are 1..alias_nreg-1 */
+static int *alias_def;     /* Instruction defining each register, or -1 */
+
+/* Objects: a variable, or restrict parameter obj_param when obj_var is
+ * NULL */
+static Symbol **obj_var;
+static int *obj_param;
+static bool *obj_escaped;
+static int nobjs;
+static int obj_cap;
+
+static int *reg_obj;       /* Object each register points into, or one of
+                            * the ROOT_ values */
+static int *reg_obj_off;   /* Offset into the object, if known */
+static int *reg_base;      /* The register, or the register or variable
+                            * (-1 - object) it adds a constant to */
+static int *reg_base_off;  /* That constant */
+
+/* Index of the object of a variable (param -1) or restrict parameter */
+static int object_index(Symbol *var, int param) {
+    for (int k = 0; k < nobjs; k++) {
+        if (obj_var[k] == var && obj_param[k] == param) {
+            return k;
+        }
+    }
+    if (nobjs == obj_cap) {
+        obj_cap = obj_cap * 2 + 16;
+        obj_var = realloc(obj_var, sizeof(Symbol *) * obj_cap);
+        obj_param = realloc(obj_param, sizeof(int) * obj_cap);
+        obj_escaped = realloc(obj_escaped, sizeof(bool) * obj_cap);
+    }
+    obj_var[nobjs] = var;
+    obj_param[nobjs] = param;
+    obj_escaped[nobjs] = var && !var->is_local;
+    return nobjs++;
+}
+
+/* Is register r the constant defined by an IR_MOV? */
+static bool alias_is_const(int r) {
+    return r > 0 && r < alias_nreg && alias_def[r] >= 0 &&
+           alias_func->code[alias_def[r]].kind == IR_MOV;
+}
+
+/* The constant in register r, which alias_is_const() */
+static int alias_const(int r) {
+    return alias_func->code[alias_def[r]].imm;
+}
+
+/* Offset off moved by d, unless either is not known or the sum would
+ * not fit */
+static int move_offset(int off, int d, bool known) {
+    if (off == OFF_UNKNOWN || !known || d > 1000000000 || d < -1000000000 ||
+        off > 1000000000 || off < -1000000000) {
+        return OFF_UNKNOWN;
+    }
+    return off + d;
+}
+
+/* What IR_PARAM argument k points into */
+static int param_object(int k) {
+    Symbol *param = alias_func->fn->params;
+    for (int i = 0; i < k && param; i++) {
+        param = param->next;
+    }
+    if (!param || !param->ty) {
+        return ROOT_ANY;
+    }
+    if (param->ty->kind != TY_PTR) {
+        return ROOT_NONE;
+    }
+    if (param->ty->is_restrict) {
+        return object_index(NULL, k);
+    }
+    return ROOT_ANY;
+}
+
+/* What the result of ir points into, from what its operands point into.
+ * The offset of the result is left in *off. */
+static int object_result(IR *ir, int *off) {
+    *off = OFF_UNKNOWN;
+    switch (ir->kind) {
+        case IR_ADDR:
+            *off = 0;
+            return object_index(ir->var, -1);
+        case IR_PARAM:
+            *off = 0;
+            return param_object(ir->imm);
+        case IR_MOV:
+            return ROOT_NONE;
+        case IR_LOAD:
+            if (ir->ty && ir->ty->kind != TY_PTR) {
+                return ROOT_NONE;
+            }
+            return ROOT_ANY;
+        case IR_CALL:
+        case IR_VASTART:
+            return ROOT_ANY;
+        case IR_COPY:
+            *off = reg_obj_off[ir->lhs];
+            return reg_obj[ir->lhs];
+        case IR_PHI: {
+            int obj = ROOT_UNSEEN;
+            for (int k = 0; k < ir->nargs; k++) {
+                int r = ir->args[k];
+                int o = reg_obj[r];
+                if (o == ROOT_UNSEEN) {
+                    continue;
+                }
+                if (obj == ROOT_UNSEEN) {
+                    obj = o;
+                    *off = reg_obj_off[r];
+                } else if (obj != o) {
+                    *off = OFF_UNKNOWN;
+                    return ROOT_ANY;
+                } else if (*off != reg_obj_off[r]) {
+                    *off = OFF_UNKNOWN;
+                }
+            }
+            return obj;
+        }
+        case IR_ADD:
+        case IR_SUB: {
+            int a = reg_obj[ir->lhs];
+            int b = reg_obj[ir->rhs];
+            if (a == ROOT_UNSEEN || b == ROOT_UNSEEN) {
+                return ROOT_UNSEEN;
+            }
+            if (b == ROOT_NONE) {
+                int d = 0;
+                if (alias_is_const(ir->rhs)) {
+                    d = alias_const(ir->rhs);
+                }
+                if (ir->kind == IR_SUB) {
+                    d = -d;
+                }
+                *off = move_offset(reg_obj_off[ir->lhs], d, alias_is_const(ir->rhs));
+                return a;
+            }
+            if (a == ROOT_NONE && ir->kind == IR_ADD) {
+                int d = 0;
+                if (alias_is_const(ir->lhs)) {
+                    d = alias_const(ir->lhs);
+                }
+                *off = move_offset(reg_obj_off[ir->rhs], d, alias_is_const(ir->lhs));
+                return b;
+            }
+            return ROOT_ANY;
+        }
+        default: {
+            /* A pointer mixed into any other computation may come out as
+             * a pointer anywhere */
+            int *uses[6];
+            int nuses = ir_uses(ir, uses);
+            for (int k = 0; k < nuses; k++) {
+                int o = reg_obj[*uses[k]];
+                if (o == ROOT_UNSEEN) {
+                    return ROOT_UNSEEN;
+                }
+                if (o != ROOT_NONE) {
+                    return ROOT_ANY;
+                }
+            }
+            return ROOT_NONE;
+        }
+    }
+}
+
+/* Work out what each register points into. Phis may see their operands
+ * only on a later round. */
+static void find_objects(void) {
+    IRFunc *f = alias_func;
+    for (int r = 0; r < alias_nreg; r++) {
+        reg_obj[r] = ROOT_UNSEEN;
+        reg_obj_off[r] = OFF_UNKNOWN;
+    }
+    reg_obj[0] = ROOT_NONE;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int k = 0; k < f->nrpo; k++) {
+            BasicBlock *bb = &f->blocks[f->rpo[k]];
+            for (int i = bb->start; i < bb->end; i++) {
+                IR *ir = &f->code[i];
+                if (!ir->dst) {
+                    continue;
+                }
+                int off;
+                int obj = object_result(ir, &off);
+                if (obj == ROOT_UNSEEN) {
+                    continue;
+                }
+                int old = reg_obj[ir->dst];
+                if (old == obj && reg_obj_off[ir->dst] == off) {
+                    continue;
+                }
+                if (old != ROOT_UNSEEN && old != obj) {
+                    /* Only phis change their minds, and they only move
+                     * towards pointing anywhere */
+                    obj = ROOT_ANY;
+                    off = OFF_UNKNOWN;
+                } else if (old != ROOT_UNSEEN && reg_obj_off[ir->dst] != off) {
+                    off = OFF_UNKNOWN;
+                }
+                if (old == obj && reg_obj_off[ir->dst] == off) {
+                    continue;
+                }
+                reg_obj[ir->dst] = obj;
+                reg_obj_off[ir->dst] = off;
+                changed = true;
+            }
+        }
+    }
+    for (int r = 0; r < alias_nreg; r++) {
+        if (reg_obj[r] == ROOT_UNSEEN) {
+            reg_obj[r] = ROOT_ANY;
+        }
+    }
+}
+
+/* Mark the object register r points into as escaping */
+static void alias_escape(int r) {
+    int obj = reg_obj[r];
+    if (obj >= 0) {
+        obj_escaped[obj] = true;
+    }
+}
+
+/* Find the objects that escape: pointers into them used other than to
+ * address memory, to compare, or to derive pointers into them */
+static void find_escapes(void) {
+    IRFunc *f = alias_func;
+    int *uses[6];
+    for (int k = 0; k < f->nrpo; k++) {
+        BasicBlock *bb = &f->blocks[f->rpo[k]];
+        for (int i = bb->start; i < bb->end; i++) {
+            IR *ir = &f->code[i];
+            switch (ir->kind) {
+                case IR_LOAD:
+                case IR_EQ:
+                case IR_NE:
+                case IR_LT:
+                case IR_LE:
+                case IR_GT:
+                case IR_GE:
+                case IR_JZ:
+                case IR_JNZ:
+                    continue;
+                case IR_STORE:
+                    alias_escape(ir->rhs);
+                    continue;
+                case IR_VASTART:
+                    /* Variadic arguments are found relative to the frame */
+                    for (int obj = 0; obj < nobjs; obj++) {
+                        if (obj_var[obj]) {
+                            obj_escaped[obj] = true;
+                        }
+                    }
+                    continue;
+                case IR_PHI:
+                    for (int a = 0; a < ir->nargs; a++) {
+                        if (reg_obj[ir->args[a]] != reg_obj[ir->dst]) {
+                            alias_escape(ir->args[a]);
+                        }
+                    }
+                    continue;
+                case IR_ADD:
+                case IR_SUB:
+                case IR_COPY:
+                    if (reg_obj[ir->lhs] != reg_obj[ir->dst]) {
+                        alias_escape(ir->lhs);
+                    }
+                    if (ir->rhs && reg_obj[ir->rhs] != reg_obj[ir->dst]) {
+                        alias_escape(ir->rhs);
+                    }
+                    continue;
+                default:
+                    break;
+            }
+            int nuses = ir_uses(ir, uses);
+            for (int u = 0; u < nuses; u++) {
+                alias_escape(*uses[u]);
+            }
+        }
+    }
+}
+
+/* Give every register its base: itself, or the register or variable it
+ * adds a constant to. Operands are defined in blocks earlier in reverse
+ * postorder, except for phis, which are bases of their own. */
+static void find_bases(void) {
+    IRFunc *f = alias_func;
+    for (int r = 0; r < alias_nreg; r++) {
+        reg_base[r] = r;
+        reg_base_off[r] = 0;
+    }
+    for (int k = 0; k < f->nrpo; k++) {
+        BasicBlock *bb = &f->blocks[f->rpo[k]];
+        for (int i = bb->start; i < bb->end; i++) {
+            IR *ir = &f->code[i];
+            int d = OFF_UNKNOWN;
+            int from = 0;
+            if (ir->kind == IR_ADDR) {
+                reg_base[ir->dst] = -1 - object_index(ir->var, -1);
+                continue;
+            }
+            if (ir->kind == IR_COPY) {
+                from = ir->lhs;
+                d = 0;
+            } else if (ir->kind == IR_ADD && alias_is_const(ir->rhs)) {
+                from = ir->lhs;
+                d = alias_const(ir->rhs);
+            } else if (ir->kind == IR_ADD && alias_is_const(ir->lhs)) {
+                from = ir->rhs;
+                d = alias_const(ir->lhs);
+            } else if (ir->kind == IR_SUB && alias_is_const(ir->rhs)) {
+                from = ir->lhs;
+                d = -alias_const(ir->rhs);
+            }
+            d = move_offset(reg_base_off[from], d, from != 0);
+            if (d != OFF_UNKNOWN) {
+                reg_base[ir->dst] = reg_base[from];
+                reg_base_off[ir->dst] = d;
+            }
+        }
+    }
+}
+
+/* Analyze the pointers of f, which must be in SSA form with its CFG
+ * built, for alias_may_clobber() and load_elim() */
+void alias_analyze(IRFunc *f) {
+    alias_func = f;
+    alias_nreg = f->nreg;
+    nobjs = 0;
+    alias_def = calloc(alias_nreg, sizeof(int));
+    reg_obj = calloc(alias_nreg, sizeof(int));
+    reg_obj_off = calloc(alias_nreg, sizeof(int));
+    reg_base = calloc(alias_nreg, sizeof(int));
+    reg_base_off = calloc(alias_nreg, sizeof(int));
+    for (int r = 0; r < alias_nreg; r++) {
+        alias_def[r] = -1;
+    }
+    for (int i = 0; i < f->ncode; i++) {
+        if (f->code[i].dst) {
+            alias_def[f->code[i].dst] = i;
+        }
+    }
+    find_objects();
+    find_escapes();
+    find_bases();
+}
+
+/* Free what alias_analyze() found */
+void alias_free(void) {
+    free(alias_def);
+    free(reg_obj);
+    free(reg_obj_off);
+    free(reg_base);
+    free(reg_base_off);
+    alias_def = NULL;
+    reg_obj = NULL;
+    reg_obj_off = NULL;
+    reg_base = NULL;
+    reg_base_off = NULL;
+}
+
+/* Type class of an access: 1 for int and enum, 2 for pointers, and 0
+ * for char and untyped memory, which alias every type */
+static int type_class(Type *ty) {
+    if (!ty) {
+        return 0;
+    }
+    if (ty->kind == TY_INT || ty->kind == TY_ENUM) {
+        return 1;
+    }
+    if (ty->kind == TY_PTR) {
+        return 2;
+    }
+    return 0;
+}
+
+/* Do [a, a + asize) and [b, b + bsize) overlap? */
+static bool ranges_overlap(int a, int asize, int b, int bsize) {
+    if (a == OFF_UNKNOWN || b == OFF_UNKNOWN) {
+        return true;
+    }
+    return a < b + bsize && b < a + asize;
+}
+
+/* May the accesses of asize bytes at register a and bsize bytes at
+ * register b, of type classes aclass and bclass, overlap? */
+static bool may_alias(int a, int asize, int aclass, int b, int bsize, int bclass) {
+    if (a >= alias_nreg || b >= alias_nreg) {
+        return true;
+    }
+    if (reg_base[a] == reg_base[b]) {
+        return ranges_overlap(reg_base_off[a], asize, reg_base_off[b], bsize);
+    }
+    if (aclass && bclass && aclass != bclass) {
+        return false;
+    }
+    int ao = reg_obj[a];
+    int bo = reg_obj[b];
+    if (ao >= 0 && bo >= 0) {
+        if (ao != bo) {
+            return false;
+        }
+        return ranges_overlap(reg_obj_off[a], asize, reg_obj_off[b], bsize);
+    }
+    if (ao >= 0) {
+        return obj_escaped[ao];
+    }
+    if (bo >= 0) {
+        return obj_escaped[bo];
+    }
+    return true;
+}
+
+/* May a call write to memory at address register addr? */
+static bool call_clobbers(int addr) {
+    if (addr >= alias_nreg) {
+        return true;
+    }
+    int obj = reg_obj[addr];
+    return obj < 0 || obj_escaped[obj];
+}
+
+/* May write, a store, call or va_start, change what the load or store
+ * access reads or writes? */
+bool alias_may_clobber(IR *write, IR *access) {
+    switch (write->kind) {
+        case IR_STORE:
+            return may_alias(write->lhs, write->size, type_class(write->ty),
+                             access->lhs, access->size, type_class(access->ty));
+        case IR_CALL:
+            return call_clobbers(access->lhs);
+        case IR_COUNT:
+            return false;
+        default:
+            return true;
+    }
+}
+
+/* Locations of load_elim(): a base, an offset from it and a size. The
+ * register the first access used stands for the address. */
+static int *loc_base;
+static int *loc_off;
+static int *loc_size;
+static int *loc_addr;
+static int *loc_class;     /* Type class, 0 if accessed as different ones */
+static int nlocs;
+static int *loc_of;        /* Location of each load and store, or -1 */
+
+static int *avail;         /* Register with the value of each location at
+                            * the current point, see avail_step() */
+static int *avail_out;     /* At the end of each block, nlocs per block */
+static int loads_removed;
+
+/* Location accessed by ir, adding it if there is room; -1 if none */
+static int location_of(IR *ir) {
+    int addr = ir->lhs;
+    int base = reg_base[addr];
+    int off = reg_base_off[addr];
+    for (int l = 0; l < nlocs; l++) {
+        if (loc_base[l] == base && loc_off[l] == off && loc_size[l] == ir->size) {
+            if (loc_class[l] != type_class(ir->ty)) {
+                loc_class[l] = 0;
+            }
+            return l;
+        }
+    }
+    if (nlocs == MAX_LOCATIONS) {
+        return -1;
+    }
+    loc_base[nlocs] = base;
+    loc_off[nlocs] = off;
+    loc_size[nlocs] = ir->size;
+    loc_addr[nlocs] = addr;
+    loc_class[nlocs] = type_class(ir->ty);
+    return nlocs++;
+}
+
+/* Smallest size whose sign extension yields the value of register r,
+ * as far as its definition tells */
+static int value_size(int r) {
+    if (r >= alias_nreg || alias_def[r] < 0) {
+        return 8;
+    }
+    IR *def = &alias_func->code[alias_def[r]];
+    switch (def->kind) {
+        case IR_LOAD:
+        case IR_CAST:
+        case IR_PARAM:
+            return def->size;
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+            return 1;
+        case IR_MOV:
+            if (def->imm >= -128 && def->imm <= 127) {
+                return 1;
+            }
+            return 4;
+        default:
+            return 8;
+    }
+}
+
+/* Forget the locations a store, call or va_start may write */
+static void clobber(IR *write) {
+    for (int l = 0; l < nlocs; l++) {
+        if (avail[l] == 0) {
+            continue;
+        }
+        bool hit;
+        if (write->kind == IR_STORE) {
+            hit = may_alias(write->lhs, write->size, type_class(write->ty),
+                            loc_addr[l], loc_size[l], loc_class[l]);
+        } else if (write->kind == IR_CALL) {
+            hit = call_clobbers(loc_addr[l]);
+        } else {
+            hit = true;
+        }
+        if (hit) {
+            avail[l] = 0;
+        }
+    }
+}
+
+/* Step avail over code[i]. With rewrite set, a load whose value is
+ * available becomes a copy of it. avail[l] is 0 when location l is not
+ * known, the register holding its value, or minus the register stored
+ * there when the value must be sign-extended from the location's size. */
+static void avail_step(int i, bool rewrite) {
+    IR *ir = &alias_func->code[i];
+    int l = loc_of[i];
+    if (ir->kind == IR_LOAD) {
+        if (l < 0) {
+            return;
+        }
+        int v = avail[l];
+        if (rewrite && v > 0) {
+            ir->kind = IR_COPY;
+            ir->lhs = v;
+            ir->ty = NULL;
+            loads_removed++;
+        } else if (rewrite && v < 0) {
+            ir->kind = IR_CAST;
+            ir->lhs = -v;
+            ir->ty = NULL;
+            loads_removed++;
+        }
+        avail[l] = ir->dst;
+        return;
+    }
+    if (ir->kind == IR_STORE) {
+        clobber(ir);
+        if (l >= 0) {
+            if (ir->size == 8 || value_size(ir->rhs) <= ir->size) {
+                avail[l] = ir->rhs;
+            } else {
+                avail[l] = -ir->rhs;
+            }
+        }
+        return;
+    }
+    if (ir->kind == IR_CALL || ir->kind == IR_VASTART) {
+        clobber(ir);
+    }
+}
+
+/* Set avail to the locations known on entry to block b: those every
+ * predecessor seen so far leaves in the same register */
+static void avail_in(int b) {
+    IRFunc *f = alias_func;
+    BasicBlock *bb = &f->blocks[b];
+    for (int l = 0; l < nlocs; l++) {
+        avail[l] = AVAIL_TOP;
+    }
+    if (b == f->rpo[0]) {
+        for (int l = 0; l < nlocs; l++) {
+            avail[l] = 0;
+        }
+    }
+    for (int k = 0; k < bb->npreds; k++) {
+        int p = bb->preds[k];
+        if (f->blocks[p].rpo < 0) {
+            continue;
+        }
+        int *out = &avail_out[p * nlocs];
+        for (int l = 0; l < nlocs; l++) {
+            if (out[l] == AVAIL_TOP) {
+                continue;
+            }
+            if (avail[l] == AVAIL_TOP) {
+                avail[l] = out[l];
+            } else if (avail[l] != out[l]) {
+                avail[l] = 0;
+            }
+        }
+    }
+    for (int l = 0; l < nlocs; l++) {
+        if (avail[l] == AVAIL_TOP) {
+            avail[l] = 0;
+        }
+    }
+}
+
+/* Replace loads whose value is already in a register in f, which must
+ * be in SSA form */
+void load_elim(IRFunc *f) {
+    build_cfg(f);
+    if (f->nblocks == 0) {
+        return;
+    }
+    alias_analyze(f);
+
+    int n = f->ncode;
+    int nb = f->nblocks;
+    loc_base = calloc(MAX_LOCATIONS, sizeof(int));
+    loc_off = calloc(MAX_LOCATIONS, sizeof(int));
+    loc_size = calloc(MAX_LOCATIONS, sizeof(int));
+    loc_addr = calloc(MAX_LOCATIONS, sizeof(int));
+    loc_class = calloc(MAX_LOCATIONS, sizeof(int));
+    loc_of = calloc(n + 1, sizeof(int));
+    nlocs = 0;
+    bool loads = false;
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        loc_of[i] = -1;
+        if (ir->kind == IR_LOAD || ir->kind == IR_STORE) {
+            loc_of[i] = location_of(ir);
+        }
+        if (ir->kind == IR_LOAD) {
+            loads = true;
+        }
+    }
+
+    if (loads && nlocs > 0) {
+        avail = calloc(nlocs, sizeof(int));
+        avail_out = calloc(nb * nlocs, sizeof(int));
+        for (int k = 0; k < nb * nlocs; k++) {
+            avail_out[k] = AVAIL_TOP;
+        }
+
+        /* Solve, then rewrite with the final sets */
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int k = 0; k < f->nrpo; k++) {
+                int b = f->rpo[k];
+                BasicBlock *bb = &f->blocks[b];
+                avail_in(b);
+                for (int i = bb->start; i < bb->end; i++) {
+                    avail_step(i, false);
+                }
+                int *out = &avail_out[b * nlocs];
+                for (int l = 0; l < nlocs; l++) {
+                    if (out[l] != avail[l]) {
+                        out[l] = avail[l];
+                        changed = true;
+                    }
+                }
+            }
+        }
+        loads_removed = 0;
+        for (int k = 0; k < f->nrpo; k++) {
+            int b = f->rpo[k];
+            BasicBlock *bb = &f->blocks[b];
+            avail_in(b);
+            for (int i = bb->start; i < bb->end; i++) {
+                avail_step(i, true);
+            }
+        }
+        f->loads_removed += loads_removed;
+        free(avail);
+        free(avail_out);
+    }
+
+    free(loc_base);
+    free(loc_off);
+    free(loc_size);
+    free(loc_addr);
+    free(loc_class);
+    free(loc_of);
+    alias_free();
+}
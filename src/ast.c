@@ -35,6 +35,102 @@ ASTNode *copy_node(ASTNode *node) {
     return copy;
 }
 
+/* Switch lowering: a run of at least this many cases may become a jump
+ * table, if it fills at least one entry in this many of the table */
+#define SWITCH_TABLE_MIN 4
+#define SWITCH_TABLE_SPREAD 3
+
+static ASTNode **found_cases;
+static int nfound_cases;
+static int found_cases_cap;
+static ASTNode *found_default;
+
+/* Collect the case labels of a switch body. Cases of nested switch
+ * statements belong to those and are skipped. */
+static void find_cases(ASTNode *node) {
+    if (!node) {
+        return;
+    }
+    switch (node->kind) {
+        case ND_CASE:
+            if (node->is_default) {
+                if (found_default) {
+                    error("multiple default labels in one switch");
+                }
+                found_default = node;
+            } else {
+                if (nfound_cases == found_cases_cap) {
+                    found_cases_cap = found_cases_cap * 2 + 16;
+                    found_cases = realloc(found_cases, sizeof(ASTNode *) * found_cases_cap);
+                }
+                found_cases[nfound_cases++] = node;
+            }
+            find_cases(node->lhs);
+            return;
+        case ND_BLOCK:
+            for (ASTNode *n = node->body; n; n = n->next) {
+                find_cases(n);
+            }
+            return;
+        case ND_IF:
+            find_cases(node->then);
+            find_cases(node->els);
+            return;
+        case ND_WHILE:
+        case ND_FOR:
+            find_cases(node->then);
+            return;
+        default:
+            break;
+    }
+}
+
+/* The case labels of a switch body other than default, sorted by value,
+ * in a new array of *ncases entries. The default label is stored in
+ * *dflt, or NULL if there is none. */
+ASTNode **switch_cases(ASTNode *body, int *ncases, ASTNode **dflt) {
+    found_cases = NULL;
+    nfound_cases = 0;
+    found_cases_cap = 0;
+    found_default = NULL;
+    find_cases(body);
+
+    /* Insertion sort: the labels are usually in order already */
+    for (int i = 1; i < nfound_cases; i++) {
+        ASTNode *c = found_cases[i];
+        int j = i;
+        while (j > 0 && found_cases[j - 1]->val > c->val) {
+            found_cases[j] = found_cases[j - 1];
+            j--;
+        }
+        if (j > 0 && found_cases[j - 1]->val == c->val) {
+            error("duplicate case value %d", c->val);
+        }
+        found_cases[j] = c;
+    }
+
+    *ncases = nfound_cases;
+    *dflt = found_default;
+    return found_cases;
+}
+
+/* Should the sorted cases[lo..hi] be dispatched through a jump table
+ * indexed by value? Only if there are enough of them and they are close
+ * enough together that the table stays mostly full. */
+bool case_table_fits(ASTNode **cases, int lo, int hi) {
+    int n = hi - lo + 1;
+    if (n < SWITCH_TABLE_MIN) {
+        return false;
+    }
+    /* Spans that would overflow are never dense */
+    int first = cases[lo]->val;
+    int last = cases[hi]->val;
+    if (first < 0 && last > first + 2147483647) {
+        return false;
+    }
+    return last - first < n * SWITCH_TABLE_SPREAD;
+}
+
 /* Create new type */
 Type *new_type(TypeKind kind, int size, int align) {
     Type *ty = calloc(1, sizeof(Type));
@@ -81,7 +177,14 @@ static int get_type_size(Type *ty) {
 
 /* Add type information to AST nodes */
 void add_type(ASTNode *node) {
-    if (!node || node->ty) {
+    if (!node) {
+        return;
+    }
+    if (node->ty) {
+        /* The parser types a cast but not its operand */
+        if (node->kind == ND_CAST) {
+            add_type(node->lhs);
+        }
         return;
     }
     
@@ -0,0 +1,237 @@
+#include "compiler.h"
+
+/* Control-flow graph construction. A function's IR is split into basic
+ * blocks: a block starts at the first instruction, at every label and
+ * after every jump or return, and ends before the next such point. */
+
+/* Does this instruction end a basic block? */
+static bool is_terminator(IRKind kind) {
+    return kind == IR_JMP || kind == IR_JZ || kind == IR_JNZ || kind == IR_RET ||
+           kind == IR_SWITCH;
+}
+
+/* Add edge from -> to */
+static void add_edge(IRFunc *f, int from, int to) {
+    BasicBlock *bb = &f->blocks[from];
+    for (int i = 0; i < bb->nsuccs; i++) {
+        if (bb->succs[i] == to) {
+            return;
+        }
+    }
+    bb->succs[bb->nsuccs++] = to;
+    f->blocks[to].npreds++;
+}
+
+/* Number the blocks reachable from the entry in reverse postorder */
+static void compute_rpo(IRFunc *f) {
+    int n = f->nblocks;
+    int *stack = calloc(n, sizeof(int));
+    int *next_succ = calloc(n, sizeof(int));
+    bool *visited = calloc(n, sizeof(bool));
+    int *post = calloc(n, sizeof(int));
+    int npost = 0;
+    int sp = 0;
+
+    /* Depth-first search with an explicit stack; a block is finished
+     * once all its successors have been visited */
+    stack[sp++] = 0;
+    visited[0] = true;
+    while (sp > 0) {
+        int b = stack[sp - 1];
+        BasicBlock *bb = &f->blocks[b];
+        if (next_succ[b] < bb->nsuccs) {
+            int s = bb->succs[next_succ[b]];
+            next_succ[b]++;
+            if (!visited[s]) {
+                visited[s] = true;
+                stack[sp++] = s;
+            }
+            continue;
+        }
+        post[npost++] = b;
+        sp--;
+    }
+
+    f->rpo = calloc(n, sizeof(int));
+    f->nrpo = npost;
+    for (int i = 0; i < n; i++) {
+        f->blocks[i].rpo = -1;
+    }
+    for (int i = 0; i < npost; i++) {
+        int b = post[npost - 1 - i];
+        f->rpo[i] = b;
+        f->blocks[b].rpo = i;
+    }
+
+    free(stack);
+    free(next_succ);
+    free(visited);
+    free(post);
+}
+
+/* Release the CFG of f, e.g. before the IR is changed */
+void free_cfg(IRFunc *f) {
+    for (int b = 0; b < f->nblocks; b++) {
+        free(f->blocks[b].succs);
+        free(f->blocks[b].preds);
+    }
+    free(f->blocks);
+    free(f->rpo);
+    f->blocks = NULL;
+    f->nblocks = 0;
+    f->rpo = NULL;
+    f->nrpo = 0;
+}
+
+/* Build the basic blocks of f with their predecessor and successor
+ * edges, and the reverse postorder of the reachable blocks */
+void build_cfg(IRFunc *f) {
+    int n = f->ncode;
+    free_cfg(f);
+
+    /* Find block leaders */
+    bool *leader = calloc(n + 1, sizeof(bool));
+    int max_label = 0;
+    int nblocks = 0;
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (i == 0 || ir->kind == IR_LABEL || is_terminator(f->code[i - 1].kind)) {
+            leader[i] = true;
+        }
+        if (leader[i]) {
+            nblocks++;
+        }
+        if (ir->kind == IR_LABEL && ir->imm > max_label) {
+            max_label = ir->imm;
+        }
+    }
+
+    /* Create blocks and map each label to the block it starts */
+    f->blocks = calloc(nblocks, sizeof(BasicBlock));
+    f->nblocks = nblocks;
+    int *label_block = calloc(max_label + 1, sizeof(int));
+    int b = -1;
+    for (int i = 0; i < n; i++) {
+        if (leader[i]) {
+            b++;
+            f->blocks[b].id = b;
+            f->blocks[b].start = i;
+        }
+        f->blocks[b].end = i + 1;
+        if (f->code[i].kind == IR_LABEL) {
+            label_block[f->code[i].imm] = b;
+        }
+    }
+
+    /* Successor edges from each block's last instruction */
+    for (b = 0; b < nblocks; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        IR *last = &f->code[bb->end - 1];
+        if (last->kind == IR_SWITCH) {
+            bb->succs = calloc(last->nargs + 1, sizeof(int));
+            for (int k = 0; k < last->nargs; k++) {
+                add_edge(f, b, label_block[last->args[k]]);
+            }
+            add_edge(f, b, label_block[last->imm]);
+            continue;
+        }
+        bb->succs = calloc(2, sizeof(int));
+        if (last->kind == IR_JMP || last->kind == IR_JZ || last->kind == IR_JNZ) {
+            add_edge(f, b, label_block[last->imm]);
+        }
+        if (last->kind != IR_JMP && last->kind != IR_RET && b + 1 < nblocks) {
+            add_edge(f, b, b + 1);
+        }
+    }
+
+    /* Predecessor lists */
+    for (b = 0; b < nblocks; b++) {
+        f->blocks[b].preds = calloc(f->blocks[b].npreds, sizeof(int));
+        f->blocks[b].npreds = 0;
+    }
+    for (b = 0; b < nblocks; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        for (int i = 0; i < bb->nsuccs; i++) {
+            BasicBlock *succ = &f->blocks[bb->succs[i]];
+            succ->preds[succ->npreds++] = b;
+        }
+    }
+
+    if (nblocks > 0) {
+        compute_rpo(f);
+    }
+
+    free(leader);
+    free(label_block);
+}
+
+/* Walk up the dominator tree from a and b until the paths meet (Cooper,
+ * Harvey and Kennedy, "A Simple, Fast Dominance Algorithm") */
+static int intersect(IRFunc *f, int *doms, int a, int b) {
+    while (a != b) {
+        while (f->blocks[a].rpo > f->blocks[b].rpo) {
+            a = doms[a];
+        }
+        while (f->blocks[b].rpo > f->blocks[a].rpo) {
+            b = doms[b];
+        }
+    }
+    return a;
+}
+
+/* Compute the immediate dominator of every reachable block. Requires
+ * build_cfg(). */
+void compute_dominators(IRFunc *f) {
+    int n = f->nblocks;
+    if (n == 0) {
+        return;
+    }
+    int *doms = calloc(n, sizeof(int));
+    for (int b = 0; b < n; b++) {
+        doms[b] = -1;
+    }
+    int entry = f->rpo[0];
+    doms[entry] = entry;
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 1; i < f->nrpo; i++) {
+            int b = f->rpo[i];
+            BasicBlock *bb = &f->blocks[b];
+            int new_idom = -1;
+            for (int k = 0; k < bb->npreds; k++) {
+                int p = bb->preds[k];
+                if (doms[p] < 0) {
+                    continue;
+                }
+                if (new_idom < 0) {
+                    new_idom = p;
+                } else {
+                    new_idom = intersect(f, doms, p, new_idom);
+                }
+            }
+            if (doms[b] != new_idom) {
+                doms[b] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (int b = 0; b < n; b++) {
+        f->blocks[b].idom = doms[b];
+    }
+    f->blocks[entry].idom = -1;
+    free(doms);
+}
+
+/* Does block a dominate block b? Requires compute_dominators(). */
+bool dominates(IRFunc *f, int a, int b) {
+    while (b >= 0) {
+        if (a == b) {
+            return true;
+        }
+        b = f->blocks[b].idom;
+    }
+    return false;
+}
@@ -4,47 +4,32 @@ static FILE *output;
 static int stack_depth;
 static Symbol *current_function;
 static int label_count = 0;
+static bool tail_calls_ok;    /* No local of the current function can be
+                               * reached through a pointer */
 
-/* Forward declaration */
+/* Forward declarations */
 static void gen_expr_asm(ASTNode *node);
+static void gen_branch_asm(ASTNode *node, bool when, char *label);
 
-/* Emit assembly code */
+/* Emit a line of assembly code. Lines are buffered for the peephole
+ * optimizer until asm_flush(). */
 static void emit(char *fmt, ...) {
+    char buf[1024];
     va_list ap;
     va_start(ap, fmt);
-    vfprintf(output, fmt, ap);
-    fprintf(output, "\n");
+    vsnprintf(buf, sizeof(buf), fmt, ap);
     va_end(ap);
+    asm_append(buf);
 }
 
 /* Escape a string for assembly .string directive */
 static void emit_escaped_string(char *s) {
-    fprintf(output, "  .string \"");
-    for (char *p = s; *p; p++) {
-        int c = *p;
-        /* Convert to unsigned range 0-255 */
-        if (c < 0) {
-            c = c + 256;
-        }
-        if (c == 10) {  /* \n */
-            fprintf(output, "\\n");
-        } else if (c == 9) {  /* \t */
-            fprintf(output, "\\t");
-        } else if (c == 13) {  /* \r */
-            fprintf(output, "\\r");
-        } else if (c == 92) {  /* \\ */
-            fprintf(output, "\\\\");
-        } else if (c == 34) {  /* \" */
-            fprintf(output, "\\\"");
-        } else if (c >= 32 && c < 127) {
-            /* Printable ASCII */
-            fprintf(output, "%c", c);
-        } else {
-            /* Non-printable - use octal escape */
-            fprintf(output, "\\%03o", c);
-        }
-    }
-    fprintf(output, "\"\n");
+    char *quoted = asm_quote(s);
+    char *buf = calloc(strlen(quoted) + 16, 1);
+    sprintf(buf, "  .string %s", quoted);
+    asm_append(buf);
+    free(buf);
+    free(quoted);
 }
 
 /* Register name lookup tables (global for self-hosting compatibility) */
@@ -52,6 +37,21 @@ static char *regs64[] = {"rax", "rdi", "rsi", "rdx", "rcx", "r8", "r9", "r10", "
 static char *regs32[] = {"eax", "edi", "esi", "edx", "ecx", "r8d", "r9d", "r10d", "r11d"};
 static char *regs8[] = {"al", "dil", "sil", "dl", "cl", "r8b", "r9b", "r10b", "r11b"};
 static char *argregs[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+static char *argregs32[] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
+static char *argregs8[] = {"dil", "sil", "dl", "cl", "r8b", "r9b"};
+
+/* Temporary registers for expression evaluation, as indices into regs64[]
+ * (r10, r11, r8, r9, rsi, rdi). rdx and rcx are left out because cqo/idiv
+ * and variable shifts clobber them, which also makes them free scratch
+ * registers. The order is chosen so that temporary i can be moved into
+ * argregs[i] without clobbering another argument (see ND_CALL). */
+#define NUM_TMPREGS 6
+#define RCX 4
+static int tmpregs[] = {7, 8, 5, 6, 2, 1};
+static int tmp_depth;
+
+/* Order in which argument registers are written from temporaries */
+static int argmove_order[] = {2, 3, 4, 5, 1, 0};
 
 /* Get register name */
 static char *reg_name(int r, int size) {
@@ -80,6 +80,366 @@ static void pop(char *reg) {
     stack_depth -= 8;
 }
 
+/* Take the next free temporary register, or -1 if all are in use */
+static int alloc_tmp(void) {
+    if (tmp_depth >= NUM_TMPREGS) {
+        return -1;
+    }
+    return tmpregs[tmp_depth++];
+}
+
+/* Release the most recently allocated temporary register */
+static void free_tmp(int r) {
+    if (r >= 0) {
+        tmp_depth--;
+    }
+}
+
+/* Store register `val` of the given size to the address in register `addr` */
+static void store(int addr, int val, int size) {
+    emit("  mov [%s], %s", regs64[addr], reg_name(val, size == 1 || size == 4 ? size : 8));
+}
+
+/* k if n is 2 to the k-th power, else -1 */
+static int exact_log2(int n) {
+    if (n <= 0) {
+        return -1;
+    }
+    int k = 0;
+    while (n % 2 == 0) {
+        n = n / 2;
+        k++;
+    }
+    return n == 1 ? k : -1;
+}
+
+/* Can a division or remainder by the constant d skip idiv? Not by 0,
+ * which must still trap, nor by the most negative int, whose magnitude
+ * is not an int */
+static bool div_const_ok(int d) {
+    return pass_enabled(PASS_DIV_CONST) && d != 0 && d != -2147483647 - 1;
+}
+
+/* The multiplier m for dividing by d, where 3 <= d < 2^31 is not a power
+ * of two (Granlund and Montgomery): with 2^(s-1) < d < 2^s, m is
+ * 2^k / d + 1 rounded down, and n * m shifted right by k is n / d rounded
+ * down for every int n >= 0 (one less for n < 0). k = 31 + s always
+ * works; k = 30 + s works when m * d - 2^k < 2^(s-1), and then m fits an
+ * immediate. m takes up to 32 bits, more than an int holds, so it comes
+ * back in 16-bit halves; *shift is k, less a bit per factor of 2 taken
+ * out of m. */
+static void div_magic(int d, int *hi, int *lo, int *shift) {
+    int s = 1;
+    int half = 1;
+    while (half <= d / 2) {
+        half = half * 2;
+        s++;
+    }
+
+    /* Long division of 2^k by d, a bit at a time. The remainder is
+     * doubled as r - (d - r) when that is not negative, which stays in
+     * range where r + r might not. */
+    int r = 1;
+    int qhi = 0;
+    int qlo = 0;
+    int k = 0;
+    while (k < 31 + s) {
+        if (k == 30 + s && d - r < half) {
+            break;
+        }
+        k++;
+        int bit = 0;
+        if (r >= d - r) {
+            r = r - (d - r);
+            bit = 1;
+        } else {
+            r = r + r;
+        }
+        qhi = qhi * 2 + qlo / 32768;
+        qlo = qlo % 32768 * 2 + bit;
+    }
+    qlo++;
+    if (qlo == 65536) {
+        qlo = 0;
+        qhi++;
+    }
+
+    *shift = k;
+    while (qlo % 2 == 0) {
+        qlo = qlo / 2 + qhi % 2 * 32768;
+        qhi = qhi / 2;
+        *shift = *shift - 1;
+    }
+    *hi = qhi;
+    *lo = qlo;
+}
+
+/* Divide rax by the constant d, or take the remainder, rounding toward
+ * zero like idiv but with shifts and a multiply. Clobbers rcx and rdx,
+ * as idiv would. rax holds an int unless d is a power of two or 1 or -1,
+ * which also divide 64-bit values. */
+static void emit_div_const(int d, bool mod) {
+    if (d == 1 || d == -1) {
+        if (mod) {
+            emit("  mov rax, 0");
+        } else if (d < 0) {
+            emit("  neg rax");
+        }
+        return;
+    }
+    int ad = d < 0 ? -d : d;
+    int k = exact_log2(ad);
+    if (k > 0) {
+        /* A shift rounds down, so negative n is first raised by 2^k - 1 */
+        emit("  mov rcx, rax");
+        if (k > 1) {
+            emit("  sar rcx, 63");
+        }
+        emit("  shr rcx, %d", 64 - k);
+        if (mod) {
+            emit("  lea rdx, [rax+rcx]");
+            emit("  and rdx, %d", -ad);
+            emit("  sub rax, rdx");
+            return;
+        }
+        emit("  add rax, rcx");
+        emit("  sar rax, %d", k);
+    } else {
+        int hi;
+        int lo;
+        int shift;
+        div_magic(ad, &hi, &lo, &shift);
+        emit("  movsxd rax, eax");
+        emit("  mov rdx, rax");
+        if (hi < 32768) {
+            emit("  imul rax, rax, %d", hi * 65536 + lo);
+        } else {
+            /* Too wide for an immediate: mov to ecx zero-extends it */
+            emit("  mov ecx, %d", (hi - 65536) * 65536 + lo);
+            emit("  imul rax, rcx");
+        }
+        emit("  sar rax, %d", shift);
+        emit("  mov rcx, rdx");
+        emit("  shr rcx, 63");
+        emit("  add rax, rcx");
+        if (mod) {
+            emit("  imul rax, rax, %d", ad);
+            emit("  sub rdx, rax");
+            emit("  mov rax, rdx");
+            return;
+        }
+    }
+    if (d < 0) {
+        emit("  neg rax");
+    }
+}
+
+/* Multiply reg by an element size, shifting when it is a power of two */
+static void emit_scale(char *reg, int size) {
+    int shift = exact_log2(size);
+    if (shift > 0) {
+        emit("  shl %s, %d", reg, shift);
+    } else if (shift < 0) {
+        emit("  imul %s, %d", reg, size);
+    }
+}
+
+/* Sethi-Ullman number: how many temporary registers evaluating node into
+ * rax needs. Subtrees containing calls get at least NUM_TMPREGS, since a
+ * call clobbers every temporary and should run before others are live. */
+static int reg_need(ASTNode *node);
+
+static int addr_need(ASTNode *node) {
+    if (node->kind == ND_DEREF) {
+        return reg_need(node->lhs);
+    }
+    if (node->kind == ND_MEMBER) {
+        return addr_need(node->lhs);
+    }
+    return 0;
+}
+
+static int reg_need(ASTNode *node) {
+    if (!node) {
+        return 0;
+    }
+    switch (node->kind) {
+        case ND_NUM:
+        case ND_VAR:
+            return 0;
+        case ND_ADDR:
+            return addr_need(node->lhs);
+        case ND_MEMBER:
+            return addr_need(node);
+        case ND_DEREF:
+        case ND_CAST:
+        case ND_NOT:
+        case ND_LNOT:
+        case ND_VA_START:
+        case ND_VA_ARG:
+        case ND_VA_END:
+            return reg_need(node->lhs);
+        case ND_CALL:
+            return NUM_TMPREGS;
+        case ND_COMMA:
+        case ND_LAND:
+        case ND_LOR: {
+            int l = reg_need(node->lhs);
+            int r = reg_need(node->rhs);
+            return l > r ? l : r;
+        }
+        case ND_COND: {
+            int n = reg_need(node->cond);
+            int t = reg_need(node->then);
+            int e = reg_need(node->els);
+            if (t > n) n = t;
+            if (e > n) n = e;
+            return n;
+        }
+        default:
+            break;
+    }
+    
+    int l;
+    if (node->kind == ND_ASSIGN) {
+        l = addr_need(node->lhs);
+    } else {
+        l = reg_need(node->lhs);
+    }
+    int r = reg_need(node->rhs);
+    if (l == r) {
+        return l + 1;
+    }
+    return l > r ? l : r;
+}
+
+/* Condition codes of the comparisons (global for self-hosting
+ * compatibility), with the code of the negated comparison and of the one
+ * with its operands exchanged */
+static char *cc_names[] = {"e", "ne", "l", "le", "g", "ge"};
+static int cc_negated[] = {1, 0, 5, 4, 3, 2};
+static int cc_swapped[] = {0, 1, 4, 5, 2, 3};
+
+/* Index into cc_names of a comparison node, or -1 */
+static int node_cc(NodeKind kind) {
+    switch (kind) {
+        case ND_EQ: return 0;
+        case ND_NE: return 1;
+        case ND_LT: return 2;
+        case ND_LE: return 3;
+        case ND_GT: return 4;
+        case ND_GE: return 5;
+        default: return -1;
+    }
+}
+
+/* Evaluate both operands of a binary node, the more register-hungry one
+ * first. On return the left operand is in rax and the right operand is in
+ * the returned register. If `commutative`, the operands may come back
+ * swapped. */
+static int gen_operands(ASTNode *lhs, ASTNode *rhs, bool commutative) {
+    bool lhs_first = reg_need(lhs) > reg_need(rhs);
+    
+    if (lhs_first) {
+        gen_expr_asm(lhs);
+    } else {
+        gen_expr_asm(rhs);
+    }
+    
+    int t = alloc_tmp();
+    if (t < 0) {
+        push("rax");
+    } else {
+        emit("  mov %s, rax", regs64[t]);
+    }
+    
+    if (lhs_first) {
+        gen_expr_asm(rhs);
+    } else {
+        gen_expr_asm(lhs);
+    }
+    
+    if (t < 0) {
+        /* Out of temporaries: the first operand was spilled to the stack */
+        if (lhs_first) {
+            emit("  mov rcx, rax");
+            pop("rax");
+        } else {
+            pop("rcx");
+        }
+        return RCX;
+    }
+    
+    free_tmp(t);
+    if (lhs_first && !commutative) {
+        emit("  mov rcx, rax");
+        emit("  mov rax, %s", regs64[t]);
+        return RCX;
+    }
+    return t;
+}
+
+/* Jump to label if the value of node is non-zero (when is true) or zero
+ * (when is false), and fall through otherwise. A comparison becomes a cmp
+ * and a conditional jump, which the CPU fuses into one operation, with an
+ * immediate operand for a constant; && and || become chains of such
+ * branches, and the right side is evaluated only when it decides. */
+static void gen_branch_asm(ASTNode *node, bool when, char *label) {
+    int cc = node_cc(node->kind);
+    if (cc >= 0) {
+        if (!when) {
+            cc = cc_negated[cc];
+        }
+        if (node->rhs->kind == ND_NUM) {
+            gen_expr_asm(node->lhs);
+            emit("  cmp rax, %d", node->rhs->val);
+        } else if (node->lhs->kind == ND_NUM) {
+            gen_expr_asm(node->rhs);
+            emit("  cmp rax, %d", node->lhs->val);
+            cc = cc_swapped[cc];
+        } else {
+            int r = gen_operands(node->lhs, node->rhs, false);
+            emit("  cmp rax, %s", regs64[r]);
+        }
+        emit("  j%s %s", cc_names[cc], label);
+        return;
+    }
+
+    switch (node->kind) {
+        case ND_NUM:
+            if ((node->val != 0) == when) {
+                emit("  jmp %s", label);
+            }
+            return;
+        case ND_LNOT:
+            gen_branch_asm(node->lhs, !when, label);
+            return;
+        case ND_LAND:
+        case ND_LOR: {
+            /* Jumping when && is false or || is true, either side can
+             * decide alone; otherwise the left side may skip the right */
+            bool is_and = node->kind == ND_LAND;
+            if (is_and != when) {
+                gen_branch_asm(node->lhs, when, label);
+                gen_branch_asm(node->rhs, when, label);
+                return;
+            }
+            char skip[32];
+            sprintf(skip, ".L.skip.%d", label_count++);
+            gen_branch_asm(node->lhs, !when, skip);
+            gen_branch_asm(node->rhs, when, label);
+            emit("%s:", skip);
+            return;
+        }
+        default:
+            break;
+    }
+
+    gen_expr_asm(node);
+    emit("  test rax, rax");
+    emit("  j%s %s", when ? "ne" : "e", label);
+}
+
 /* Assign local variable offsets */
 static void assign_lvar_offsets(Symbol *fn) {
     int offset = 0;
@@ -101,6 +461,138 @@ static void assign_lvar_offsets(Symbol *fn) {
     }
 }
 
+/* Locals kept in registers instead of the frame by the AST code
+ * generator (the mem2reg pass). The registers are callee-saved, so calls
+ * leave them alone, and none of them is a temporary. */
+#define NUM_REG_VARS 5
+static char *varregs[] = {"rbx", "r12", "r13", "r14", "r15"};
+static Symbol *reg_vars[NUM_REG_VARS];  /* Local held by each register, or NULL */
+static int reg_var_save;                /* Frame offset below the registers' save slots */
+
+/* Index of the register holding var, or -1 if it lives in the frame */
+static int var_reg(Symbol *var) {
+    for (int i = 0; i < NUM_REG_VARS; i++) {
+        if (reg_vars[i] && reg_vars[i] == var) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Set register variable r to a register holding a value of the given
+ * size, named at each width. Register variables are kept sign-extended
+ * to 64 bits, as loads from the frame would leave them. */
+static void set_reg_var(int r, int size, char *reg8, char *reg32, char *reg64) {
+    if (size == 1) {
+        emit("  movsx %s, %s", varregs[r], reg8);
+    } else if (size == 4) {
+        emit("  movsxd %s, %s", varregs[r], reg32);
+    } else {
+        emit("  mov %s, %s", varregs[r], reg64);
+    }
+}
+
+/* Reload the registers the register variables took from the caller */
+static void restore_reg_vars(void) {
+    for (int i = 0; i < NUM_REG_VARS; i++) {
+        if (reg_vars[i]) {
+            emit("  mov %s, [rbp-%d]", varregs[i], reg_var_save + 8 * (i + 1));
+        }
+    }
+}
+
+/* Spill incoming parameters to their stack slots */
+static void store_params(Symbol *fn) {
+    int i = 0;
+    for (Symbol *param = fn->params; param && i < 6; param = param->next, i++) {
+        /* Find this parameter in locals to get its offset */
+        Symbol *local = NULL;
+        for (Symbol *l = fn->locals; l; l = l->next) {
+            if (strcmp(l->name, param->name) == 0) {
+                local = l;
+                break;
+            }
+        }
+        if (local && var_reg(local) >= 0) {
+            set_reg_var(var_reg(local), local->ty->size, argregs8[i], argregs32[i], argregs[i]);
+        } else if (local) {
+            /* Use appropriate register size based on parameter type */
+            if (param->ty && param->ty->size == 4) {
+                /* int parameter - use 32-bit register */
+                emit("  mov [rbp-%d], %s", local->offset, argregs32[i]);
+            } else {
+                /* pointer or other 64-bit parameter */
+                emit("  mov [rbp-%d], %s", local->offset, argregs[i]);
+            }
+        }
+    }
+    
+    /* For variadic functions, save ALL register arguments to a register save area
+     * This allows va_start/va_arg to access them from the stack
+     * The register save area is at the end of the stack frame, after local variables
+     * Since we already added 48 bytes to stack_size, the locals end at their original offset
+     * and the register area starts after that */
+    if (fn->is_variadic) {
+        emit("  /* Register save area for variadic function */");
+        
+        /* Calculate where local variables end (before we added the 48 bytes)
+         * We can determine this by subtracting 48 from stack_size and rounding */
+        int locals_end = fn->stack_size - 48;
+        
+        /* Save all 6 argument registers after the local variables
+         * In order so that incrementing the pointer moves through them */
+        emit("  mov [rbp-%d], rdi", locals_end + 48);
+        emit("  mov [rbp-%d], rsi", locals_end + 40);
+        emit("  mov [rbp-%d], rdx", locals_end + 32);
+        emit("  mov [rbp-%d], rcx", locals_end + 24);
+        emit("  mov [rbp-%d], r8", locals_end + 16);
+        emit("  mov [rbp-%d], r9", locals_end + 8);
+    }
+}
+
+/* Offset below rbp of the first anonymous argument of a variadic
+ * function. The register save area occupies the last 48 bytes of the
+ * locals, with rdi at the lowest address. */
+static int va_start_offset(Symbol *fn) {
+    int named = 0;
+    for (Symbol *param = fn->params; param && named < 6; param = param->next) {
+        named++;
+    }
+    return fn->stack_size - 8 * named;
+}
+
+/* Start a function: its section with -ffunction-sections, and a global
+ * symbol unless it is static. Functions the profile says never ran go
+ * to .text.unlikely, which the linker places apart from the rest. */
+static void emit_function_label(Symbol *fn) {
+    char *unlikely = "";
+    if (fn->profiled && fn->count == 0) {
+        unlikely = ".unlikely";
+    }
+    if (compiler_state->function_sections) {
+        emit(".section .text%s.%s,\"ax\",@progbits", unlikely, fn->name);
+    } else if (compiler_state->profile_use) {
+        emit(".section .text%s,\"ax\",@progbits", unlikely);
+    }
+    if (!fn->is_static) {
+        emit(".globl %s", fn->name);
+    }
+    emit("%s:", fn->name);
+}
+
+/* Add one to profile counter n */
+static void emit_count(int n) {
+    emit("  add QWORD PTR .L.prof.cnt[rip+%d], 1", 8 * n);
+}
+
+/* With -fprofile-generate, count an event of node: slot 1 is its
+ * second counter */
+static void gen_count_asm(ASTNode *node, int slot) {
+    if (compiler_state->profile_generate && node->prof_id) {
+        emit_count(node->prof_id - 1 + slot);
+    }
+}
+
 /* Load variable address */
 static void gen_addr(ASTNode *node) {
     if (node->kind == ND_VAR) {
@@ -131,6 +623,44 @@ static void gen_addr(ASTNode *node) {
     error("not an lvalue");
 }
 
+/* Evaluate the arguments of a call into the argument registers, with no
+ * temporaries live. Returns the number passed. */
+static int gen_args(ASTNode *node) {
+    int nargs = 0;
+    for (ASTNode *arg = node->args; arg; arg = arg->next) {
+        nargs++;
+    }
+    
+    ASTNode **args = calloc(nargs, sizeof(ASTNode*));
+    int i = 0;
+    for (ASTNode *arg = node->args; arg; arg = arg->next) {
+        args[i++] = arg;
+    }
+    
+    /* Evaluate argument i into temporary i */
+    if (nargs > 6) {
+        nargs = 6;
+    }
+    for (i = 0; i < nargs; i++) {
+        gen_expr_asm(args[i]);
+        emit("  mov %s, rax", regs64[alloc_tmp()]);
+    }
+    
+    /* Move temporaries into argument registers. Writing rdx and rcx
+     * first, then r8/r9, then rsi/rdi, reads every temporary before
+     * the argument register it lives in is overwritten. */
+    for (int k = 0; k < 6; k++) {
+        i = argmove_order[k];
+        if (i < nargs) {
+            emit("  mov %s, %s", argregs[i], regs64[tmpregs[i]]);
+        }
+    }
+    tmp_depth = 0;
+    
+    free(args);
+    return nargs;
+}
+
 /* Generate assembly for expression */
 static void gen_expr_asm(ASTNode *node) {
     if (!node) {
@@ -141,6 +671,10 @@ static void gen_expr_asm(ASTNode *node) {
             emit("  mov rax, %d", node->val);
             return;
         case ND_VAR:
+            if (var_reg(node->var) >= 0) {
+                emit("  mov rax, %s", varregs[var_reg(node->var)]);
+                return;
+            }
             gen_addr(node);
             /* Arrays decay to pointers - don't dereference */
             if (node->var->ty->kind != TY_ARRAY) {
@@ -159,6 +693,10 @@ static void gen_expr_asm(ASTNode *node) {
             return;
         case ND_DEREF:
             gen_expr_asm(node->lhs);
+            /* Arrays decay to pointers - don't dereference */
+            if (node->ty && node->ty->kind == TY_ARRAY) {
+                return;
+            }
             /* Load with correct size based on type */
             if (node->ty && node->ty->size == 1) {
                 emit("  movsx rax, byte ptr [rax]");
@@ -173,7 +711,9 @@ static void gen_expr_asm(ASTNode *node) {
             gen_addr(node);
             /* Load with correct size based on member type */
             if (node->member && node->member->ty) {
-                if (node->member->ty->size == 1) {
+                if (node->member->ty->kind == TY_ARRAY) {
+                    /* Array member decays to its address */
+                } else if (node->member->ty->size == 1) {
                     emit("  movsx rax, byte ptr [rax]");
                 } else if (node->member->ty->size == 4) {
                     emit("  movsxd rax, dword ptr [rax]");
@@ -208,49 +748,60 @@ static void gen_expr_asm(ASTNode *node) {
             }
             /* For pointer casts, rax already contains the value */
             return;
-        case ND_ASSIGN:
-            gen_addr(node->lhs);
-            push("rax");
-            gen_expr_asm(node->rhs);
-            pop("rdi");
-            /* Store with correct size based on type */
-            if (node->lhs->ty->size == 1) {
-                emit("  mov [rdi], al");
-            } else if (node->lhs->ty->size == 4) {
-                emit("  mov [rdi], eax");
-            } else {
-                emit("  mov [rdi], rax");
-            }
-            return;
-        case ND_CALL: {
-            /* Save caller-saved registers */
-            int nargs = 0;
-            for (ASTNode *arg = node->args; arg; arg = arg->next) {
-                nargs++;
+        case ND_ASSIGN: {
+            int size = node->lhs->ty->size;
+            if (node->lhs->kind == ND_VAR && var_reg(node->lhs->var) >= 0) {
+                gen_expr_asm(node->rhs);
+                set_reg_var(var_reg(node->lhs->var), size, "al", "eax", "rax");
+                return;
             }
-            
-            /* Evaluate arguments in reverse order */
-            ASTNode **args = calloc(nargs, sizeof(ASTNode*));
-            int i = 0;
-            for (ASTNode *arg = node->args; arg; arg = arg->next) {
-                args[i++] = arg;
+            if (reg_need(node->rhs) > addr_need(node->lhs)) {
+                /* Value first, then the address */
+                gen_expr_asm(node->rhs);
+                int t = alloc_tmp();
+                if (t < 0) {
+                    push("rax");
+                } else {
+                    emit("  mov %s, rax", regs64[t]);
+                }
+                gen_addr(node->lhs);
+                if (t < 0) {
+                    pop("rcx");
+                    t = RCX;
+                } else {
+                    free_tmp(t);
+                }
+                store(0, t, size);
+                emit("  mov rax, %s", regs64[t]);
+                return;
             }
             
-            /* Generate code for arguments */
-            for (i = 0; i < nargs && i < 6; i++) {
-                gen_expr_asm(args[i]);
+            gen_addr(node->lhs);
+            int t = alloc_tmp();
+            if (t < 0) {
                 push("rax");
+            } else {
+                emit("  mov %s, rax", regs64[t]);
             }
-            
-            int end_i;
-            if (nargs < 6) {
-                end_i = nargs - 1;
+            gen_expr_asm(node->rhs);
+            if (t < 0) {
+                pop("rcx");
+                t = RCX;
             } else {
-                end_i = 5;
+                free_tmp(t);
             }
-            for (i = end_i; i >= 0; i--) {
-                pop(argregs[i]);
+            store(t, 0, size);
+            return;
+        }
+        case ND_CALL: {
+            /* The call clobbers every temporary register: save live ones */
+            int saved = tmp_depth;
+            for (int i = 0; i < saved; i++) {
+                push(regs64[tmpregs[i]]);
             }
+            tmp_depth = 0;
+            
+            int nargs = gen_args(node);
             
             /* Align stack to 16 bytes */
             int seq = stack_depth / 8;
@@ -259,7 +810,9 @@ static void gen_expr_asm(ASTNode *node) {
                 stack_depth += 8;
             }
             
+            gen_count_asm(node, 0);
             emit("  call %s", node->funcname);
+            asm_call_args(nargs);
             
             /* Restore stack alignment */
             if (seq % 2 == 1) {
@@ -267,33 +820,59 @@ static void gen_expr_asm(ASTNode *node) {
                 stack_depth -= 8;
             }
             
-            free(args);
+            /* Restore the caller's temporaries (rax holds the result) */
+            for (int i = saved - 1; i >= 0; i--) {
+                pop(regs64[tmpregs[i]]);
+            }
+            tmp_depth = saved;
             return;
         }
         case ND_COMMA:
             gen_expr_asm(node->lhs);
             gen_expr_asm(node->rhs);
             return;
+        case ND_LAND:
+        case ND_LOR: {
+            /* Branch on each side in turn, so the right side only runs
+             * when the left one does not decide the result */
+            int c = label_count++;
+            bool is_or = node->kind == ND_LOR;
+            char lshort[32];
+            sprintf(lshort, ".L.short.%d", c);
+            gen_branch_asm(node, is_or, lshort);
+            emit("  mov rax, %d", is_or ? 0 : 1);
+            emit("  jmp .L.end.%d", c);
+            emit("%s:", lshort);
+            emit("  mov rax, %d", is_or ? 1 : 0);
+            emit(".L.end.%d:", c);
+            return;
+        }
+        case ND_COND: {
+            /* Conditional expression: cond ? then : els */
+            int c = label_count++;
+            char lelse[32];
+            sprintf(lelse, ".L.else.%d", c);
+            gen_count_asm(node, 0);
+            gen_branch_asm(node->cond, false, lelse);
+            gen_count_asm(node, 1);
+            gen_expr_asm(node->then);
+            emit("  jmp .L.end.%d", c);
+            emit(".L.else.%d:", c);
+            gen_expr_asm(node->els);
+            emit(".L.end.%d:", c);
+            return;
+        }
         case ND_VA_START: {
             /* va_start(ap, last_param)
-             * Set ap to point to the first variadic argument in the register save area
-             * For a function with 1 named parameter (in rdi), variadic args start at rsi
-             * The register save area starts after local variables */
+             * Set ap to point to the first variadic argument in the register save area */
             gen_addr(node->lhs); /* Get address of ap */
             push("rax");
             
-            int stack_size;
-            if (current_function) {
-                stack_size = current_function->stack_size;
-            } else {
-                stack_size = 0;
-            }
-            int locals_end = stack_size - 48; /* Where locals end (before register area) */
-            int vararg_offset = locals_end + 40; /* Offset to rsi in register save area */
+            int vararg_offset = va_start_offset(current_function);
             
             emit("  lea rax, [rbp-%d]", vararg_offset);
-            pop("rdi");
-            emit("  mov [rdi], rax"); /* Store in ap */
+            pop("rcx");
+            emit("  mov [rcx], rax"); /* Store in ap */
             return;
         }
         case ND_VA_ARG: {
@@ -327,13 +906,13 @@ static void gen_expr_asm(ASTNode *node) {
             
             /* Update ap: get its address, load old value, add size, store back */
             gen_addr(node->lhs); /* Get address of ap - rax = &ap */
-            emit("  mov rdi, [rax]"); /* rdi = old ap value */
-            emit("  add rdi, %d", aligned_size); /* rdi = ap + aligned_size */
-            emit("  mov [rax], rdi"); /* *(&ap) = new ap value */
+            emit("  mov rcx, [rax]"); /* rcx = old ap value */
+            emit("  add rcx, %d", aligned_size); /* rcx = ap + aligned_size */
+            emit("  mov [rax], rcx"); /* *(&ap) = new ap value */
             
             /* Pop the loaded value - it's the return value */
             pop("rax"); /* Stack: [ap_value], rax = loaded_value */
-            pop("rdi"); /* Stack: [], rdi = old ap value (discard) */
+            pop("rcx"); /* Stack: [], rcx = old ap value (discard) */
             
             /* Return value is in rax */
             return;
@@ -346,125 +925,362 @@ static void gen_expr_asm(ASTNode *node) {
             return;
     }
     
+    if ((node->kind == ND_DIV || node->kind == ND_MOD) && node->rhs->kind == ND_NUM &&
+        div_const_ok(node->rhs->val)) {
+        gen_expr_asm(node->lhs);
+        emit_div_const(node->rhs->val, node->kind == ND_MOD);
+        return;
+    }
+
     /* Binary operations */
-    gen_expr_asm(node->rhs);
-    push("rax");
-    gen_expr_asm(node->lhs);
-    pop("rdi");
-    
+    bool commutative = false;
     switch (node->kind) {
         case ND_ADD:
-            /* Handle pointer arithmetic - scale the right operand if left is a pointer */
-            if (node->lhs->ty && (node->lhs->ty->kind == TY_PTR || node->lhs->ty->kind == TY_ARRAY)) {
+            /* Pointer arithmetic scales the right operand, so keep the order */
+            commutative = !(node->lhs->ty && (node->lhs->ty->kind == TY_PTR || node->lhs->ty->kind == TY_ARRAY));
+            break;
+        case ND_MUL:
+        case ND_EQ:
+        case ND_NE:
+        case ND_AND:
+        case ND_OR:
+        case ND_XOR:
+            commutative = true;
+            break;
+        default:
+            break;
+    }
+    
+    int r = gen_operands(node->lhs, node->rhs, commutative);
+    char *rd = regs64[r];
+    
+    switch (node->kind) {
+        case ND_ADD:
+            /* Handle pointer arithmetic - scale the right operand if left is a pointer */
+            if (node->lhs->ty && (node->lhs->ty->kind == TY_PTR || node->lhs->ty->kind == TY_ARRAY)) {
                 int size = 1;
                 if (node->lhs->ty->base) {
                     size = node->lhs->ty->base->size;
                 }
-                if (size > 1) {
-                    emit("  imul rdi, %d", size);
+                if (size == 2 || size == 4 || size == 8) {
+                    /* Scaled index addressing does the multiply */
+                    emit("  lea rax, [rax+%s*%d]", rd, size);
+                    return;
                 }
+                emit_scale(rd, size);
             }
-            emit("  add rax, rdi");
+            emit("  add rax, %s", rd);
             return;
         case ND_SUB:
-            emit("  sub rax, rdi");
+            if (node->lhs->ty && (node->lhs->ty->kind == TY_PTR || node->lhs->ty->kind == TY_ARRAY)) {
+                int size = 1;
+                if (node->lhs->ty->base) {
+                    size = node->lhs->ty->base->size;
+                }
+                if (node->rhs->ty && (node->rhs->ty->kind == TY_PTR || node->rhs->ty->kind == TY_ARRAY)) {
+                    /* Pointer difference counts elements */
+                    emit("  sub rax, %s", rd);
+                    if (size > 1) {
+                        emit("  mov rcx, %d", size);
+                        emit("  cqo");
+                        emit("  idiv rcx");
+                    }
+                    return;
+                }
+                emit_scale(rd, size);
+            }
+            emit("  sub rax, %s", rd);
             return;
         case ND_MUL:
-            emit("  imul rax, rdi");
+            emit("  imul rax, %s", rd);
             return;
         case ND_DIV:
             emit("  cqo");
-            emit("  idiv rdi");
+            emit("  idiv %s", rd);
             return;
         case ND_MOD:
             emit("  cqo");
-            emit("  idiv rdi");
+            emit("  idiv %s", rd);
             emit("  mov rax, rdx");
             return;
         case ND_EQ:
-            emit("  cmp rax, rdi");
+            emit("  cmp rax, %s", rd);
             emit("  sete al");
             emit("  movzb rax, al");
             return;
         case ND_NE:
-            emit("  cmp rax, rdi");
+            emit("  cmp rax, %s", rd);
             emit("  setne al");
             emit("  movzb rax, al");
             return;
         case ND_LT:
-            emit("  cmp rax, rdi");
+            emit("  cmp rax, %s", rd);
             emit("  setl al");
             emit("  movzb rax, al");
             return;
         case ND_LE:
-            emit("  cmp rax, rdi");
+            emit("  cmp rax, %s", rd);
             emit("  setle al");
             emit("  movzb rax, al");
             return;
         case ND_GT:
-            emit("  cmp rax, rdi");
+            emit("  cmp rax, %s", rd);
             emit("  setg al");
             emit("  movzb rax, al");
             return;
         case ND_GE:
-            emit("  cmp rax, rdi");
+            emit("  cmp rax, %s", rd);
             emit("  setge al");
             emit("  movzb rax, al");
             return;
-        case ND_LAND:
-            emit("  test rax, rax");
-            emit("  setne al");
-            emit("  test rdi, rdi");
-            emit("  setne dil");
-            emit("  and al, dil");
-            emit("  movzb rax, al");
-            return;
-        case ND_LOR:
-            emit("  or rax, rdi");
-            emit("  setne al");
-            emit("  movzb rax, al");
-            return;
         case ND_AND:
-            emit("  and rax, rdi");
+            emit("  and rax, %s", rd);
             return;
         case ND_OR:
-            emit("  or rax, rdi");
+            emit("  or rax, %s", rd);
             return;
         case ND_XOR:
-            emit("  xor rax, rdi");
+            emit("  xor rax, %s", rd);
             return;
         case ND_SHL:
-            emit("  mov rcx, rdi");
+            if (r != RCX) {
+                emit("  mov rcx, %s", rd);
+            }
             emit("  shl rax, cl");
             return;
         case ND_SHR:
-            emit("  mov rcx, rdi");
+            if (r != RCX) {
+                emit("  mov rcx, %s", rd);
+            }
             emit("  shr rax, cl");
             return;
-        case ND_COND: {
-            /* Conditional expression: cond ? then : els */
-            int c = label_count++;
-            gen_expr_asm(node->cond);
-            emit("  cmp rax, 0");
-            emit("  je .L.else.%d", c);
-            gen_expr_asm(node->then);
-            emit("  jmp .L.end.%d", c);
-            emit(".L.else.%d:", c);
-            gen_expr_asm(node->els);
-            emit(".L.end.%d:", c);
-            return;
-        }
     }
     
     error("invalid expression");
 }
 
+/* Could the expression or statement take the address of a local? */
+static bool takes_address(ASTNode *node) {
+    for (; node; node = node->next) {
+        if (node->kind == ND_ADDR || node->kind == ND_VA_START) {
+            return true;
+        }
+        if (takes_address(node->lhs) || takes_address(node->rhs) ||
+            takes_address(node->cond) || takes_address(node->then) ||
+            takes_address(node->els) || takes_address(node->init) ||
+            takes_address(node->inc) || takes_address(node->body) ||
+            takes_address(node->args)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Can the locals of fn be reached through a pointer? Arrays decay to
+ * pointers wherever they are used. */
+static bool frame_escapes(Symbol *fn) {
+    if (fn->is_variadic) {
+        return true;
+    }
+    for (Symbol *var = fn->locals; var; var = var->next) {
+        if (var->ty && var->ty->kind == TY_ARRAY) {
+            return true;
+        }
+    }
+    return takes_address(fn->body);
+}
+
+/* Is the returned expression a call that can be made as a jump? */
+static bool is_tail_call(ASTNode *node) {
+    if (!tail_calls_ok || node->kind != ND_CALL) {
+        return false;
+    }
+    int nargs = 0;
+    for (ASTNode *arg = node->args; arg; arg = arg->next) {
+        nargs++;
+    }
+    return nargs <= 6;
+}
+
+/* Is the returned expression a tail call, or a ?: with one in either
+ * arm? The IR finds the same calls by following the arms' jumps to the
+ * return. */
+static bool returns_tail_call(ASTNode *node) {
+    if (node->kind == ND_COND) {
+        return returns_tail_call(node->then) || returns_tail_call(node->els);
+    }
+    return is_tail_call(node);
+}
+
+/* Return the value of a call in tail position. A call of the function
+ * itself jumps back to where the prologue stores the parameters; other
+ * calls pop the frame and jump to the callee, which returns to our
+ * caller. */
+static void gen_tail_call(ASTNode *node) {
+    int nargs = gen_args(node);
+    gen_count_asm(node, 0);
+    if (strcmp(node->funcname, current_function->name) == 0) {
+        emit("  jmp .L.tail.%s", current_function->name);
+        return;
+    }
+    restore_reg_vars();
+    emit("  mov rsp, rbp");
+    emit("  pop rbp");
+    emit("  jmp %s", node->funcname);
+    asm_call_args(nargs);
+}
+
+/* Return the value of node, making calls in tail position as jumps. A
+ * ?: branches and returns from each arm. */
+static void gen_return_asm(ASTNode *node) {
+    if (is_tail_call(node)) {
+        gen_tail_call(node);
+        return;
+    }
+    if (node->kind == ND_COND && returns_tail_call(node)) {
+        int c = label_count++;
+        char lelse[32];
+        sprintf(lelse, ".L.else.%d", c);
+        gen_count_asm(node, 0);
+        gen_branch_asm(node->cond, false, lelse);
+        gen_count_asm(node, 1);
+        gen_return_asm(node->then);
+        emit(".L.else.%d:", c);
+        gen_return_asm(node->els);
+        return;
+    }
+    gen_expr_asm(node);
+    emit("  jmp .L.return.%s", current_function->name);
+}
+
+/* Jump to the label at index rcx of a table of n labels named prefix
+ * followed by a number. The index must be in range. The table holds
+ * offsets from its own address, so it needs no relocation, and is placed
+ * in .rodata. */
+static int jump_table_count;
+
+static void emit_table_jump(char *prefix, int *labels, int n) {
+    int t = jump_table_count++;
+    emit("  lea rdx, .L.jt.%d[rip]", t);
+    emit("  movsxd rcx, dword ptr [rdx+rcx*4]");
+    emit("  add rcx, rdx");
+    emit("  jmp rcx");
+    emit("  .section .rodata");
+    emit("  .p2align 2");
+    emit(".L.jt.%d:", t);
+    for (int i = 0; i < n; i++) {
+        emit("  .long %s%d-.L.jt.%d", prefix, labels[i], t);
+    }
+    emit("  .previous");
+}
+
+/* Case labels of the switch statement being generated, the number of
+ * the .L.case label of each, and that of the label the dispatch jumps to,
+ * which differs with -fprofile-generate: it counts the case first */
+static ASTNode **asm_case_nodes;
+static int *asm_case_labels;
+static int *asm_case_targets;
+static int nasm_cases;
+static int case_label_count;
+
+/* The index of a case of the current switch */
+static int asm_case_index(ASTNode *node) {
+    for (int i = 0; i < nasm_cases; i++) {
+        if (asm_case_nodes[i] == node) {
+            return i;
+        }
+    }
+    error("case label not within a switch statement");
+    return 0;
+}
+
+/* The number of the label of a case of the current switch */
+static int asm_case_label(ASTNode *node) {
+    return asm_case_labels[asm_case_index(node)];
+}
+
+/* The number of the label the dispatch jumps to for a case */
+static int asm_case_target(ASTNode *node) {
+    return asm_case_targets[asm_case_index(node)];
+}
+
+/* Compare first with the cases the profile says are usual, removing
+ * them from sorted as for the IR; the value is in rax */
+static int gen_hot_cases_asm(ASTNode **sorted, int ncases, int total, bool wide) {
+    for (int k = 0; k < 2; k++) {
+        int best = -1;
+        for (int i = 0; i < ncases; i++) {
+            if (sorted[i]->profiled && (best < 0 || sorted[i]->count > sorted[best]->count)) {
+                best = i;
+            }
+        }
+        if (best < 0 || !profile_dominant(sorted[best]->count, total)) {
+            break;
+        }
+        emit("  cmp %s, %d", wide ? "rax" : "eax", sorted[best]->val);
+        emit("  je .L.case.%d", asm_case_target(sorted[best]));
+        total -= sorted[best]->count;
+        ncases--;
+        for (int i = best; i < ncases; i++) {
+            sorted[i] = sorted[i + 1];
+        }
+    }
+    return ncases;
+}
+
+/* Jump to the case among sorted[lo..hi], in order of value, whose value
+ * is in rax, or to case label ldefault. wide is set for an 8-byte value;
+ * otherwise eax is compared. As for the IR, a dense run of cases goes
+ * through a jump table and the rest are split into a balanced tree of
+ * compares. */
+static void gen_case_dispatch_asm(ASTNode **sorted, int lo, int hi, int ldefault, bool wide) {
+    char *ax = wide ? "rax" : "eax";
+    if (case_table_fits(sorted, lo, hi)) {
+        int first = sorted[lo]->val;
+        int n = sorted[hi]->val - first + 1;
+        emit("  mov %s, %s", wide ? "rcx" : "ecx", ax);
+        if (first != 0) {
+            emit("  sub %s, %d", wide ? "rcx" : "ecx", first);
+        }
+        emit("  cmp %s, %d", wide ? "rcx" : "ecx", n);
+        emit("  jae .L.case.%d", ldefault);
+        int *labels = calloc(n, sizeof(int));
+        for (int k = 0; k < n; k++) {
+            labels[k] = ldefault;
+        }
+        for (int i = lo; i <= hi; i++) {
+            labels[sorted[i]->val - first] = asm_case_target(sorted[i]);
+        }
+        emit_table_jump(".L.case.", labels, n);
+        free(labels);
+        return;
+    }
+
+    if (hi - lo < 3) {
+        for (int i = lo; i <= hi; i++) {
+            emit("  cmp %s, %d", ax, sorted[i]->val);
+            emit("  je .L.case.%d", asm_case_target(sorted[i]));
+        }
+        emit("  jmp .L.case.%d", ldefault);
+        return;
+    }
+
+    int mid = (lo + hi + 1) / 2;
+    int below = case_label_count++;
+    emit("  cmp %s, %d", ax, sorted[mid]->val);
+    emit("  jl .L.case.%d", below);
+    gen_case_dispatch_asm(sorted, mid, hi, ldefault, wide);
+    emit(".L.case.%d:", below);
+    gen_case_dispatch_asm(sorted, lo, mid - 1, ldefault, wide);
+}
+
 /* Generate assembly for statement */
 static void gen_stmt_asm(ASTNode *node) {
     switch (node->kind) {
         case ND_RETURN:
             if (node->lhs) {
-                gen_expr_asm(node->lhs);
+                gen_return_asm(node->lhs);
+                return;
             }
             emit("  jmp .L.return.%s", current_function->name);
             return;
@@ -475,9 +1291,11 @@ static void gen_stmt_asm(ASTNode *node) {
             return;
         case ND_IF: {
             int c = label_count++;
-            gen_expr_asm(node->cond);
-            emit("  cmp rax, 0");
-            emit("  je .L.else.%d", c);
+            char lelse[32];
+            sprintf(lelse, ".L.else.%d", c);
+            gen_count_asm(node, 0);
+            gen_branch_asm(node->cond, false, lelse);
+            gen_count_asm(node, 1);
             gen_stmt_asm(node->then);
             emit("  jmp .L.end.%d", c);
             emit(".L.else.%d:", c);
@@ -488,30 +1306,47 @@ static void gen_stmt_asm(ASTNode *node) {
             return;
         }
         case ND_WHILE: {
-            emit("%s:", node->cont_label);
-            gen_expr_asm(node->cond);
-            emit("  cmp rax, 0");
-            emit("  je %s", node->brk_label);
-            gen_stmt_asm(node->then);
+            /* The test is placed after the body, so each iteration ends
+             * in a single compare and branch back */
+            int c = label_count++;
+            char lbody[32];
+            sprintf(lbody, ".L.begin.%d", c);
+            gen_count_asm(node, 0);
             emit("  jmp %s", node->cont_label);
+            emit("%s:", lbody);
+            gen_count_asm(node, 1);
+            gen_stmt_asm(node->then);
+            emit("%s:", node->cont_label);
+            gen_branch_asm(node->cond, true, lbody);
             emit("%s:", node->brk_label);
             return;
         }
         case ND_FOR: {
+            /* Tested after the body, as for while */
+            int c = label_count++;
+            char lbody[32];
+            sprintf(lbody, ".L.begin.%d", c);
             if (node->init) {
                 gen_stmt_asm(node->init);
             }
-            emit("%s:", node->cont_label);
+            gen_count_asm(node, 0);
             if (node->cond) {
-                gen_expr_asm(node->cond);
-                emit("  cmp rax, 0");
-                emit("  je %s", node->brk_label);
+                emit("  jmp .L.test.%d", c);
             }
+            emit("%s:", lbody);
+            gen_count_asm(node, 1);
             gen_stmt_asm(node->then);
+            /* continue jumps here so that the increment still runs */
+            emit("%s:", node->cont_label);
             if (node->inc) {
                 gen_expr_asm(node->inc);
             }
-            emit("  jmp %s", node->cont_label);
+            if (node->cond) {
+                emit(".L.test.%d:", c);
+                gen_branch_asm(node->cond, true, lbody);
+            } else {
+                emit("  jmp %s", lbody);
+            }
             emit("%s:", node->brk_label);
             return;
         }
@@ -521,79 +1356,73 @@ static void gen_stmt_asm(ASTNode *node) {
             }
             return;
         case ND_SWITCH: {
-            /* Evaluate switch expression */
             gen_expr_asm(node->cond);
-            
-            /* Switch body must be a compound statement */
-            if (!node->then || node->then->kind != ND_BLOCK) {
-                error("switch statement body must be a compound statement");
-            }
-            
-            /* Track case values and their labels */
-            #define MAX_CASES 256
-            static struct { int val; int label; } case_map[MAX_CASES];
-            int num_cases = 0;
-            int default_label = -1;
-            static int case_label_base = 0;
-            int my_label_base = case_label_base;
-            
-            /* First pass: assign labels to all cases */
-            for (ASTNode *stmt = node->then->body; stmt; stmt = stmt->next) {
-                if (stmt->kind == ND_CASE) {
-                    if (stmt->val >= 0) {
-                        if (num_cases < MAX_CASES) {
-                            case_map[num_cases].val = stmt->val;
-                            case_map[num_cases].label = case_label_base++;
-                            num_cases++;
-                        }
-                    } else {
-                        default_label = case_label_base++;
-                    }
+            gen_count_asm(node, 0);
+            ASTNode **old_nodes = asm_case_nodes;
+            int *old_labels = asm_case_labels;
+            int *old_targets = asm_case_targets;
+            int old_ncases = nasm_cases;
+
+            /* Number the case labels; without a default, the default
+             * label is placed at the end */
+            int ncases;
+            ASTNode *dflt;
+            ASTNode **sorted = switch_cases(node->then, &ncases, &dflt);
+            asm_case_nodes = calloc(ncases + 1, sizeof(ASTNode *));
+            asm_case_labels = calloc(ncases + 1, sizeof(int));
+            asm_case_targets = calloc(ncases + 1, sizeof(int));
+            nasm_cases = 0;
+            for (int i = 0; i < ncases; i++) {
+                asm_case_nodes[nasm_cases] = sorted[i];
+                asm_case_labels[nasm_cases] = case_label_count++;
+                asm_case_targets[nasm_cases] = asm_case_labels[nasm_cases];
+                if (compiler_state->profile_generate && sorted[i]->prof_id) {
+                    asm_case_targets[nasm_cases] = case_label_count++;
                 }
+                nasm_cases++;
             }
-            
-            /* Generate jump table */
-            for (int i = 0; i < num_cases; i++) {
-                emit("  cmp rax, %d", case_map[i].val);
-                emit("  je .L.case.%d", case_map[i].label);
+            int ldefault = case_label_count++;
+            if (dflt) {
+                asm_case_nodes[nasm_cases] = dflt;
+                asm_case_labels[nasm_cases] = ldefault;
+                asm_case_targets[nasm_cases++] = ldefault;
             }
-            
-            /* Jump to default or break */
-            if (default_label >= 0) {
-                emit("  jmp .L.case.%d", default_label);
-            } else {
-                emit("  jmp %s", node->brk_label);
+            bool wide = node->cond->ty && node->cond->ty->size == 8;
+            if (node->profiled) {
+                ncases = gen_hot_cases_asm(sorted, ncases, node->count, wide);
             }
-            
-            /* Second pass: generate case bodies with labels */
-            for (ASTNode *stmt = node->then->body; stmt; stmt = stmt->next) {
-                if (stmt->kind == ND_CASE) {
-                    /* Emit label for this case */
-                    if (stmt->val >= 0) {
-                        /* Find label for this case value */
-                        for (int i = 0; i < num_cases; i++) {
-                            if (case_map[i].val == stmt->val) {
-                                emit(".L.case.%d:", case_map[i].label);
-                                break;
-                            }
-                        }
-                    } else {
-                        emit(".L.case.%d:", default_label);
-                    }
-                    if (stmt->lhs) {
-                        gen_stmt_asm(stmt->lhs);
-                    }
-                } else {
-                    gen_stmt_asm(stmt);
+            gen_case_dispatch_asm(sorted, 0, ncases - 1, ldefault, wide);
+            free(sorted);
+
+            /* The stubs that count each case */
+            for (int i = 0; i < nasm_cases; i++) {
+                if (asm_case_targets[i] != asm_case_labels[i]) {
+                    emit(".L.case.%d:", asm_case_targets[i]);
+                    gen_count_asm(asm_case_nodes[i], 0);
+                    emit("  jmp .L.case.%d", asm_case_labels[i]);
                 }
             }
-            
+
+            gen_stmt_asm(node->then);
+            if (!dflt) {
+                emit(".L.case.%d:", ldefault);
+            }
             emit("%s:", node->brk_label);
+
+            free(asm_case_nodes);
+            free(asm_case_labels);
+            free(asm_case_targets);
+            asm_case_nodes = old_nodes;
+            asm_case_labels = old_labels;
+            asm_case_targets = old_targets;
+            nasm_cases = old_ncases;
             return;
         }
         case ND_CASE:
-            /* Case labels are handled by ND_SWITCH */
-            gen_stmt_asm(node->lhs);
+            emit(".L.case.%d:", asm_case_label(node));
+            if (node->lhs) {
+                gen_stmt_asm(node->lhs);
+            }
             return;
         case ND_BREAK:
             if (node->brk_label) {
@@ -605,68 +1434,147 @@ static void gen_stmt_asm(ASTNode *node) {
                 emit("  jmp %s", node->cont_label);
             }
             return;
+        default:
+            break;
     }
     
     error("invalid statement");
 }
 
+/* Candidates for register variables: the function's locals, whether
+ * their address is taken, and how often they are used */
+static Symbol **rv_vars;
+static int rv_nvars;
+static bool *rv_escaped;
+static int *rv_weight;
+
+/* Largest weight of one use, reached four loops deep */
+#define RV_MAX_WEIGHT 4096
+
+/* Index of var among the candidates, or -1 */
+static int rv_index(Symbol *var) {
+    for (int i = 0; i < rv_nvars; i++) {
+        if (rv_vars[i] == var) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Weigh the uses of the candidates in a tree, each counting weight, and
+ * find the ones whose address is taken. va_start, va_arg and va_end
+ * take the address of their va_list. */
+static void scan_reg_vars(ASTNode *node, int weight) {
+    for (; node; node = node->next) {
+        if (node->kind == ND_VAR && rv_index(node->var) >= 0) {
+            rv_weight[rv_index(node->var)] += weight;
+        }
+        if ((node->kind == ND_ADDR || node->kind == ND_VA_START || node->kind == ND_VA_ARG ||
+             node->kind == ND_VA_END) && node->lhs && node->lhs->kind == ND_VAR &&
+            rv_index(node->lhs->var) >= 0) {
+            rv_escaped[rv_index(node->lhs->var)] = true;
+        }
+
+        /* Uses inside a loop count eight times as much */
+        int inner = weight;
+        if ((node->kind == ND_FOR || node->kind == ND_WHILE) && weight < RV_MAX_WEIGHT) {
+            inner = weight * 8;
+        }
+        scan_reg_vars(node->lhs, weight);
+        scan_reg_vars(node->rhs, weight);
+        scan_reg_vars(node->init, weight);
+        scan_reg_vars(node->cond, inner);
+        scan_reg_vars(node->then, inner);
+        scan_reg_vars(node->els, weight);
+        scan_reg_vars(node->inc, inner);
+        scan_reg_vars(node->body, weight);
+        scan_reg_vars(node->args, weight);
+    }
+}
+
+/* Give the most used scalar locals of fn whose address is never taken a
+ * register each. Variadic functions keep everything in the frame, where
+ * va_start expects the parameters. */
+static void choose_reg_vars(Symbol *fn) {
+    for (int i = 0; i < NUM_REG_VARS; i++) {
+        reg_vars[i] = NULL;
+    }
+    if (!pass_enabled(PASS_MEM2REG) || fn->is_variadic) {
+        return;
+    }
+
+    rv_nvars = 0;
+    for (Symbol *var = fn->locals; var; var = var->next) {
+        rv_nvars++;
+    }
+    rv_vars = calloc(rv_nvars + 1, sizeof(Symbol *));
+    rv_escaped = calloc(rv_nvars + 1, sizeof(bool));
+    rv_weight = calloc(rv_nvars + 1, sizeof(int));
+    int i = 0;
+    for (Symbol *var = fn->locals; var; var = var->next) {
+        rv_vars[i++] = var;
+    }
+    scan_reg_vars(fn->body, 1);
+
+    for (int r = 0; r < NUM_REG_VARS; r++) {
+        int best = -1;
+        for (i = 0; i < rv_nvars; i++) {
+            Symbol *var = rv_vars[i];
+            Type *ty = var->ty;
+            if (var->is_static || rv_escaped[i] || rv_weight[i] == 0 || !ty ||
+                (ty->kind != TY_INT && ty->kind != TY_CHAR && ty->kind != TY_PTR &&
+                 ty->kind != TY_ENUM) ||
+                (ty->size != 1 && ty->size != 4 && ty->size != 8)) {
+                continue;
+            }
+            if (best < 0 || rv_weight[i] > rv_weight[best]) {
+                best = i;
+            }
+        }
+        if (best < 0) {
+            break;
+        }
+        reg_vars[r] = rv_vars[best];
+        rv_weight[best] = 0;
+    }
+    free(rv_vars);
+    free(rv_escaped);
+    free(rv_weight);
+}
+
 /* Generate assembly for function */
 static void gen_function_asm(Symbol *fn) {
     current_function = fn;
     assign_lvar_offsets(fn);
+    choose_reg_vars(fn);
     
-    emit(".globl %s", fn->name);
-    emit("%s:", fn->name);
+    /* The registers of the register variables are saved below the locals */
+    reg_var_save = fn->stack_size;
+    int frame_size = fn->stack_size;
+    for (int i = 0; i < NUM_REG_VARS; i++) {
+        if (reg_vars[i]) {
+            frame_size = reg_var_save + 8 * (i + 1);
+        }
+    }
+    frame_size = ((frame_size + 15) / 16) * 16;
+    
+    emit_function_label(fn);
     
     /* Prologue */
     push("rbp");
     emit("  mov rbp, rsp");
-    emit("  sub rsp, %d", fn->stack_size);
-    
-    /* Save parameters to stack */
-    int i = 0;
-    for (Symbol *param = fn->params; param && i < 6; param = param->next, i++) {
-        /* Find this parameter in locals to get its offset */
-        Symbol *local = NULL;
-        for (Symbol *l = fn->locals; l; l = l->next) {
-            if (strcmp(l->name, param->name) == 0) {
-                local = l;
-                break;
-            }
-        }
-        if (local) {
-            /* Use appropriate register size based on parameter type */
-            if (param->ty && param->ty->size == 4) {
-                /* int parameter - use 32-bit register */
-                char *regs32_args[] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
-                emit("  mov [rbp-%d], %s", local->offset, regs32_args[i]);
-            } else {
-                /* pointer or other 64-bit parameter */
-                emit("  mov [rbp-%d], %s", local->offset, argregs[i]);
-            }
+    emit("  sub rsp, %d", frame_size);
+    for (int i = 0; i < NUM_REG_VARS; i++) {
+        if (reg_vars[i]) {
+            emit("  mov [rbp-%d], %s", reg_var_save + 8 * (i + 1), varregs[i]);
         }
     }
     
-    /* For variadic functions, save ALL register arguments to a register save area
-     * This allows va_start/va_arg to access them from the stack
-     * The register save area is at the end of the stack frame, after local variables
-     * Since we already added 48 bytes to stack_size, the locals end at their original offset
-     * and the register area starts after that */
-    if (fn->is_variadic) {
-        emit("  /* Register save area for variadic function */");
-        
-        /* Calculate where local variables end (before we added the 48 bytes)
-         * We can determine this by subtracting 48 from stack_size and rounding */
-        int locals_end = fn->stack_size - 48;
-        
-        /* Save all 6 argument registers after the local variables
-         * In order so that incrementing the pointer moves through them */
-        emit("  mov [rbp-%d], rdi", locals_end + 48);
-        emit("  mov [rbp-%d], rsi", locals_end + 40);
-        emit("  mov [rbp-%d], rdx", locals_end + 32);
-        emit("  mov [rbp-%d], rcx", locals_end + 24);
-        emit("  mov [rbp-%d], r8", locals_end + 16);
-        emit("  mov [rbp-%d], r9", locals_end + 8);
+    tail_calls_ok = pass_enabled(PASS_TAILCALL) && !frame_escapes(fn);
+    emit(".L.tail.%s:", fn->name);
+    store_params(fn);
+    if (compiler_state->profile_generate && fn->prof_id) {
+        emit_count(fn->prof_id - 1);
     }
     
     stack_depth = 0;
@@ -676,30 +1584,25 @@ static void gen_function_asm(Symbol *fn) {
     
     /* Epilogue */
     emit(".L.return.%s:", fn->name);
+    restore_reg_vars();
     emit("  mov rsp, rbp");
     pop("rbp");
     emit("  ret");
-}
-
-/* Generate assembly code */
-void codegen(Symbol *prog, FILE *out) {
-    output = out;
-    
-    emit(".intel_syntax noprefix");
-    emit(".text");
     
-    /* Generate code for functions */
-    for (Symbol *fn = prog; fn; fn = fn->next) {
-        if (fn->is_function && fn->body) {
-            /* Only generate code for functions with bodies (not declarations) */
-            gen_function_asm(fn);
-        }
+    /* store_params is shared with the IR code generator */
+    for (int i = 0; i < NUM_REG_VARS; i++) {
+        reg_vars[i] = NULL;
     }
-    
-    /* Generate data section */
+}
+
+/* Emit the data section for global variables */
+static void emit_data(Symbol *prog) {
     emit(".data");
     for (Symbol *var = prog; var; var = var->next) {
-        if (!var->is_function && !var->is_local && !var->is_extern) {
+        if (!var->is_function && !var->is_local && !var->is_extern && var->is_live) {
+            if (compiler_state->data_sections) {
+                emit(".section .data.%s,\"aw\",@progbits", var->name);
+            }
             /* Only emit .globl for non-static, non-string-literal globals */
             if (!var->is_static && (var->name[0] != '.' || var->name[1] != 'L' || var->name[2] != 'C')) {
                 emit(".globl %s", var->name);
@@ -778,3 +1681,489 @@ void codegen(Symbol *prog, FILE *out) {
         }
     }
 }
+
+/* Generate assembly code */
+void codegen(Symbol *prog, FILE *out) {
+    output = out;
+    
+    emit(".intel_syntax noprefix");
+    emit(".text");
+    
+    /* Generate code for functions */
+    for (Symbol *fn = prog; fn; fn = fn->next) {
+        if (fn->is_function && fn->body && fn->is_live) {
+            /* Only generate code for functions with bodies (not declarations) */
+            gen_function_asm(fn);
+            asm_flush(output);
+        }
+    }
+    
+    emit_data(prog);
+    asm_flush(output);
+    emit_vector_helpers(output);
+    emit_profile_data(output);
+}
+
+/* ===== IR backend ===== */
+
+/* Physical registers handed out by regalloc(), callee-saved first */
+static char *allocregs[] = {"rbx", "r12", "r13", "r14", "r15", "r10", "r11"};
+
+static IRFunc *current_ir;
+static bool *is_const_reg;               /* Registers whose only definition is an IR_MOV */
+static int *const_of;                    /* Value of such a register */
+static int *use_count;                   /* Number of instructions reading each register */
+static int *imm_uses;                    /* How many of them take its constant as an immediate */
+static int save_offset[NUM_ALLOC_REGS];  /* Frame slots of callee-saved registers */
+static int spill_base;                   /* Frame offset below the spill slots */
+
+/* Frame offset of the spill slot of vreg r */
+static int spill_offset(int r) {
+    return spill_base + 8 * (current_ir->slot_of[r] + 1);
+}
+
+/* Move vreg r into register reg */
+static void load_vreg(char *reg, int r) {
+    int p = current_ir->reg_of[r];
+    if (p >= 0) {
+        emit("  mov %s, %s", reg, allocregs[p]);
+    } else {
+        emit("  mov %s, [rbp-%d]", reg, spill_offset(r));
+    }
+}
+
+/* Move register reg into vreg r */
+static void store_vreg(int r, char *reg) {
+    int p = current_ir->reg_of[r];
+    if (p >= 0) {
+        emit("  mov %s, %s", allocregs[p], reg);
+    } else {
+        emit("  mov [rbp-%d], %s", spill_offset(r), reg);
+    }
+}
+
+/* Find the registers that hold one constant throughout f */
+static void find_constants(IRFunc *f) {
+    int *ndefs = calloc(f->nreg + 1, sizeof(int));
+    is_const_reg = calloc(f->nreg + 1, sizeof(bool));
+    const_of = calloc(f->nreg + 1, sizeof(int));
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        if (ir->dst) {
+            ndefs[ir->dst]++;
+        }
+        if (ir->kind == IR_MOV) {
+            is_const_reg[ir->dst] = true;
+            const_of[ir->dst] = ir->imm;
+        }
+    }
+    for (int r = 0; r < f->nreg; r++) {
+        if (ndefs[r] != 1) {
+            is_const_reg[r] = false;
+        }
+    }
+    free(ndefs);
+}
+
+/* Index into cc_names of a comparison instruction, or -1 */
+static int ir_cc(IRKind kind) {
+    switch (kind) {
+        case IR_EQ: return 0;
+        case IR_NE: return 1;
+        case IR_LT: return 2;
+        case IR_LE: return 3;
+        case IR_GT: return 4;
+        case IR_GE: return 5;
+        default: return -1;
+    }
+}
+
+/* Is ir a comparison used only by the conditional jump next after it? */
+static bool fuses_with_jump(IR *ir, IR *next) {
+    return ir_cc(ir->kind) >= 0 && (next->kind == IR_JZ || next->kind == IR_JNZ) &&
+           next->lhs == ir->dst && use_count[ir->dst] == 1;
+}
+
+/* The operand of a fused comparison given as an immediate, or 0 */
+static int compare_imm(IR *cmp) {
+    if (is_const_reg[cmp->rhs]) {
+        return cmp->rhs;
+    }
+    if (is_const_reg[cmp->lhs]) {
+        return cmp->lhs;
+    }
+    return 0;
+}
+
+/* The constant operand a multiply, shift or division takes as an
+ * immediate, or 0 */
+static int arith_imm(IR *ir) {
+    switch (ir->kind) {
+        case IR_MUL:
+            return compare_imm(ir);
+        case IR_SHL:
+        case IR_SHR:
+            if (is_const_reg[ir->rhs] && const_of[ir->rhs] >= 0 && const_of[ir->rhs] < 64) {
+                return ir->rhs;
+            }
+            return 0;
+        case IR_DIV:
+        case IR_MOD:
+            /* The multiply only divides ints; shifts divide 64-bit values
+             * as well */
+            if (is_const_reg[ir->rhs] && div_const_ok(const_of[ir->rhs]) &&
+                (ir->size < 8 || exact_log2(const_of[ir->rhs]) >= 0)) {
+                return ir->rhs;
+            }
+            return 0;
+        default:
+            break;
+    }
+    return 0;
+}
+
+/* Count the uses of each register, and those that take it as an
+ * immediate: a constant used only that way need not be loaded */
+static void count_uses(IRFunc *f) {
+    use_count = calloc(f->nreg + 1, sizeof(int));
+    imm_uses = calloc(f->nreg + 1, sizeof(int));
+    int *uses[6];
+    for (int i = 0; i < f->ncode; i++) {
+        int n = ir_uses(&f->code[i], uses);
+        for (int k = 0; k < n; k++) {
+            use_count[*uses[k]]++;
+        }
+        imm_uses[arith_imm(&f->code[i])]++;
+    }
+    for (int i = 0; i + 1 < f->ncode; i++) {
+        if (fuses_with_jump(&f->code[i], &f->code[i + 1])) {
+            imm_uses[compare_imm(&f->code[i])]++;
+        }
+    }
+}
+
+/* Generate a comparison and the conditional jump on its result as a cmp
+ * and a jcc, which the CPU fuses, without materializing the boolean */
+static void gen_compare_jump(IR *cmp, IR *jump) {
+    int cc = ir_cc(cmp->kind);
+    if (jump->kind == IR_JZ) {
+        cc = cc_negated[cc];
+    }
+    int imm = compare_imm(cmp);
+    if (imm && imm == cmp->rhs) {
+        load_vreg("rax", cmp->lhs);
+        emit("  cmp rax, %d", const_of[cmp->rhs]);
+    } else if (imm) {
+        load_vreg("rax", cmp->rhs);
+        emit("  cmp rax, %d", const_of[cmp->lhs]);
+        cc = cc_swapped[cc];
+    } else {
+        load_vreg("rax", cmp->lhs);
+        load_vreg("rcx", cmp->rhs);
+        emit("  cmp rax, rcx");
+    }
+    emit("  j%s .L.ir.%d", cc_names[cc], jump->imm);
+}
+
+/* Multiply rax by a constant, with a shift or lea where one will do */
+static void emit_mul_const(int c) {
+    int shift = exact_log2(c);
+    if (shift > 0) {
+        emit("  shl rax, %d", shift);
+    } else if (c == 3 || c == 5 || c == 9) {
+        emit("  lea rax, [rax+rax*%d]", c - 1);
+    } else if (shift < 0) {
+        emit("  imul rax, rax, %d", c);
+    }
+}
+
+/* Emit a compare of rax with rcx and set rax to the condition */
+static void emit_setcc(char *cc) {
+    emit("  cmp rax, rcx");
+    emit("  set%s al", cc);
+    emit("  movzb rax, al");
+}
+
+/* Reload the callee-saved registers the function uses */
+static void restore_saved_regs(void) {
+    for (int p = 0; p < NUM_CALLEE_SAVED; p++) {
+        if (current_ir->used_regs[p]) {
+            emit("  mov %s, [rbp-%d]", allocregs[p], save_offset[p]);
+        }
+    }
+}
+
+/* Generate assembly for one IR instruction */
+static void gen_ir_insn(IR *ir) {
+    switch (ir->kind) {
+        case IR_NOP:
+            return;
+        case IR_LABEL:
+            emit(".L.ir.%d:", ir->imm);
+            return;
+        case IR_JMP:
+            emit("  jmp .L.ir.%d", ir->imm);
+            return;
+        case IR_JZ:
+        case IR_JNZ:
+            load_vreg("rax", ir->lhs);
+            emit("  cmp rax, 0");
+            emit("  %s .L.ir.%d", ir->kind == IR_JZ ? "je" : "jne", ir->imm);
+            return;
+        case IR_SWITCH:
+            load_vreg("rcx", ir->lhs);
+            emit("  cmp rcx, %d", ir->nargs);
+            emit("  jae .L.ir.%d", ir->imm);
+            emit_table_jump(".L.ir.", ir->args, ir->nargs);
+            return;
+        case IR_COUNT:
+            emit_count(ir->imm);
+            return;
+        case IR_RET:
+            if (ir->lhs) {
+                load_vreg("rax", ir->lhs);
+            }
+            emit("  jmp .L.return.%s", current_function->name);
+            return;
+        case IR_MOV:
+            /* Every reader takes the constant as an immediate */
+            if (is_const_reg[ir->dst] && imm_uses[ir->dst] == use_count[ir->dst]) {
+                return;
+            }
+            if (current_ir->reg_of[ir->dst] >= 0) {
+                emit("  mov %s, %d", allocregs[current_ir->reg_of[ir->dst]], ir->imm);
+            } else {
+                emit("  mov QWORD PTR [rbp-%d], %d", spill_offset(ir->dst), ir->imm);
+            }
+            return;
+        case IR_COPY:
+            load_vreg("rax", ir->lhs);
+            store_vreg(ir->dst, "rax");
+            return;
+        case IR_ADDR:
+            if (ir->var->is_local) {
+                emit("  lea rax, [rbp-%d]", ir->var->offset);
+            } else {
+                emit("  lea rax, %s[rip]", ir->var->name);
+            }
+            store_vreg(ir->dst, "rax");
+            return;
+        case IR_VASTART:
+            emit("  lea rax, [rbp-%d]", va_start_offset(current_function));
+            store_vreg(ir->dst, "rax");
+            return;
+        case IR_PARAM:
+            if (ir->size == 1) {
+                emit("  movsx rax, %s", argregs8[ir->imm]);
+            } else if (ir->size == 4) {
+                emit("  movsxd rax, %s", argregs32[ir->imm]);
+            } else {
+                emit("  mov rax, %s", argregs[ir->imm]);
+            }
+            store_vreg(ir->dst, "rax");
+            return;
+        case IR_LOAD:
+            load_vreg("rax", ir->lhs);
+            if (ir->size == 1) {
+                emit("  movsx rax, byte ptr [rax]");
+            } else if (ir->size == 4) {
+                emit("  movsxd rax, dword ptr [rax]");
+            } else {
+                emit("  mov rax, [rax]");
+            }
+            store_vreg(ir->dst, "rax");
+            return;
+        case IR_STORE:
+            load_vreg("rax", ir->lhs);
+            load_vreg("rcx", ir->rhs);
+            store(0, RCX, ir->size);
+            return;
+        case IR_CAST:
+            load_vreg("rax", ir->lhs);
+            if (ir->size == 1) {
+                emit("  movsx rax, al");
+            } else {
+                emit("  movsxd rax, eax");
+            }
+            store_vreg(ir->dst, "rax");
+            return;
+        case IR_CALL:
+            /* Allocated registers are never argument registers, so the
+             * arguments can be loaded in any order */
+            for (int i = 0; i < ir->nargs; i++) {
+                load_vreg(argregs[i], ir->args[i]);
+            }
+            if (ir->tail) {
+                /* The callee returns straight to our caller */
+                restore_saved_regs();
+                emit("  mov rsp, rbp");
+                emit("  pop rbp");
+                emit("  jmp %s", ir->name);
+                asm_call_args(ir->nargs);
+                return;
+            }
+            emit("  call %s", ir->name);
+            asm_call_args(ir->nargs);
+            store_vreg(ir->dst, "rax");
+            return;
+        default:
+            break;
+    }
+
+    /* Multiplies, shifts and divisions by a constant need no second
+     * register */
+    int imm = arith_imm(ir);
+    if (imm) {
+        int other = imm == ir->lhs ? ir->rhs : ir->lhs;
+        load_vreg("rax", other);
+        if (ir->kind == IR_MUL) {
+            emit_mul_const(const_of[imm]);
+        } else if (ir->kind == IR_SHL || ir->kind == IR_SHR) {
+            emit("  %s rax, %d", ir->kind == IR_SHL ? "shl" : "sar", const_of[imm]);
+        } else {
+            emit_div_const(const_of[imm], ir->kind == IR_MOD);
+        }
+        store_vreg(ir->dst, "rax");
+        return;
+    }
+
+    /* Binary operations: lhs in rax, rhs in rcx */
+    load_vreg("rax", ir->lhs);
+    load_vreg("rcx", ir->rhs);
+    switch (ir->kind) {
+        case IR_ADD:
+            emit("  add rax, rcx");
+            break;
+        case IR_SUB:
+            emit("  sub rax, rcx");
+            break;
+        case IR_MUL:
+            emit("  imul rax, rcx");
+            break;
+        case IR_DIV:
+            emit("  cqo");
+            emit("  idiv rcx");
+            break;
+        case IR_MOD:
+            emit("  cqo");
+            emit("  idiv rcx");
+            emit("  mov rax, rdx");
+            break;
+        case IR_EQ:
+            emit_setcc("e");
+            break;
+        case IR_NE:
+            emit_setcc("ne");
+            break;
+        case IR_LT:
+            emit_setcc("l");
+            break;
+        case IR_LE:
+            emit_setcc("le");
+            break;
+        case IR_GT:
+            emit_setcc("g");
+            break;
+        case IR_GE:
+            emit_setcc("ge");
+            break;
+        case IR_AND:
+            emit("  and rax, rcx");
+            break;
+        case IR_OR:
+            emit("  or rax, rcx");
+            break;
+        case IR_XOR:
+            emit("  xor rax, rcx");
+            break;
+        case IR_SHL:
+            emit("  shl rax, cl");
+            break;
+        case IR_SHR:
+            emit("  sar rax, cl");
+            break;
+        default:
+            error("invalid IR instruction");
+    }
+    store_vreg(ir->dst, "rax");
+}
+
+/* Generate assembly for a function from its IR */
+static void gen_function_ir(IRFunc *f) {
+    Symbol *fn = f->fn;
+    current_function = fn;
+    current_ir = f;
+    assign_lvar_offsets(fn);
+    regalloc(f);
+    find_constants(f);
+    count_uses(f);
+
+    /* Frame: locals (and the vararg save area), then callee-saved
+     * registers, then spill slots */
+    int offset = fn->stack_size;
+    for (int p = 0; p < NUM_CALLEE_SAVED; p++) {
+        if (f->used_regs[p]) {
+            offset += 8;
+            save_offset[p] = offset;
+        }
+    }
+    spill_base = offset;
+    offset += 8 * f->nslots;
+    int frame_size = ((offset + 15) / 16) * 16;
+
+    emit_function_label(fn);
+
+    /* Prologue */
+    emit("  push rbp");
+    emit("  mov rbp, rsp");
+    emit("  sub rsp, %d", frame_size);
+    for (int p = 0; p < NUM_CALLEE_SAVED; p++) {
+        if (f->used_regs[p]) {
+            emit("  mov [rbp-%d], %s", save_offset[p], allocregs[p]);
+        }
+    }
+    /* Other functions read their parameters with IR_PARAM */
+    if (fn->is_variadic) {
+        store_params(fn);
+    }
+
+    for (int i = 0; i < f->ncode; i++) {
+        if (i + 1 < f->ncode && fuses_with_jump(&f->code[i], &f->code[i + 1])) {
+            gen_compare_jump(&f->code[i], &f->code[i + 1]);
+            i++;
+            continue;
+        }
+        gen_ir_insn(&f->code[i]);
+    }
+
+    /* Epilogue */
+    emit(".L.return.%s:", fn->name);
+    restore_saved_regs();
+    emit("  mov rsp, rbp");
+    emit("  pop rbp");
+    emit("  ret");
+    free(is_const_reg);
+    free(const_of);
+    free(use_count);
+    free(imm_uses);
+}
+
+/* Generate assembly code from IR */
+void codegen_ir(Symbol *prog, IRFunc *fns, FILE *out) {
+    output = out;
+
+    emit(".intel_syntax noprefix");
+    emit(".text");
+
+    for (IRFunc *f = fns; f; f = f->next) {
+        if (f->fn->is_live) {
+            gen_function_ir(f);
+            asm_flush(output);
+        }
+    }
+
+    emit_data(prog);
+    asm_flush(output);
+    emit_vector_helpers(output);
+    emit_profile_data(output);
+}
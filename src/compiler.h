@@ -16,6 +16,9 @@ typedef struct ASTNode ASTNode;
 typedef struct Type Type;
 typedef struct Symbol Symbol;
 typedef struct IR IR;
+typedef struct IRFunc IRFunc;
+typedef struct BasicBlock BasicBlock;
+typedef struct Loop Loop;
 typedef struct Initializer Initializer;
 
 /* Token types for lexical analysis */
@@ -24,7 +27,7 @@ typedef enum {
     TK_INT, TK_CHAR, TK_VOID, TK_IF, TK_ELSE, TK_WHILE, TK_FOR, 
     TK_RETURN, TK_SIZEOF, TK_STRUCT, TK_TYPEDEF, TK_ENUM,
     TK_STATIC, TK_EXTERN, TK_CONST, TK_BREAK, TK_CONTINUE,
-    TK_SWITCH, TK_CASE, TK_DEFAULT,
+    TK_SWITCH, TK_CASE, TK_DEFAULT, TK_INLINE, TK_RESTRICT,
     
     /* Identifiers and literals */
     TK_IDENT, TK_NUM, TK_STR, TK_CHAR_LIT,
@@ -56,6 +59,8 @@ struct Token {
     char *loc;         /* Source location */
     char *filename;    /* Source filename */
     int line;          /* Line number */
+    int unroll;        /* Loop hint from a #pragma just before the token,
+                        * as in ASTNode */
 };
 
 /* AST node types */
@@ -85,6 +90,7 @@ struct Type {
     int size;
     int align;
     Type *base;        /* Pointer or array base type */
+    bool is_restrict;  /* Pointer declared restrict */
     int array_len;     /* Array length */
     struct Member *members; /* Struct members */
     Type *return_ty;   /* Function return type */
@@ -134,10 +140,26 @@ struct ASTNode {
     Member *member;
     
     /* For ND_SWITCH, ND_CASE */
-    ASTNode *case_next;  /* Next case in switch */
-    ASTNode *default_case; /* Default case */
+    bool is_default;     /* ND_CASE for the default label */
     char *brk_label;     /* Break label for switch/loop */
     char *cont_label;    /* Continue label for loop */
+    
+    /* For ND_FOR and ND_WHILE: 0 without a hint, the count of
+     * #pragma unroll N, 1 for #pragma nounroll, -1 for #pragma unroll
+     * with no count (unroll completely) */
+    int unroll;
+
+    /* Profile counters (see profile.c): prof_id is the index of the
+     * node's first counter plus one, or 0 if it has none. With
+     * -fprofile-use, profiled is set once the counts are read:
+     *   ND_IF, ND_COND      count executions, count2 of the then side
+     *   ND_WHILE, ND_FOR    count entries, count2 iterations
+     *   ND_SWITCH           count executions
+     *   ND_CASE, ND_CALL    count times reached or made */
+    int prof_id;
+    bool profiled;
+    int count;
+    int count2;
 };
 
 /* Initializer for variables */
@@ -166,10 +188,15 @@ struct Symbol {
     bool is_typedef;   /* Is this a typedef? */
     bool is_static;    /* Static storage class */
     bool is_extern;    /* External linkage */
+    bool is_inline;    /* Declared inline */
     int enum_val;      /* For enum constants */
     bool is_variadic;  /* Is this a variadic function? */
     Initializer *init; /* Variable initializer */
     char *str_data;    /* String literal content (for string literals) */
+    bool is_live;      /* Global emitted by the code generator (see reach.c) */
+    int prof_id;       /* Function entry counter, as in ASTNode */
+    bool profiled;
+    int count;         /* Entries, with profiled */
 };
 
 /* Intermediate representation */
@@ -179,19 +206,120 @@ typedef enum {
     IR_CALL, IR_RET, IR_LABEL, IR_JMP, IR_JZ, IR_JNZ,
     IR_EQ, IR_NE, IR_LT, IR_LE, IR_GT, IR_GE,
     IR_AND, IR_OR, IR_XOR, IR_SHL, IR_SHR,
-    IR_ADDR, IR_NOP
+    IR_ADDR, IR_NOP,
+    IR_COPY, IR_CAST, IR_VASTART, IR_PHI, IR_PARAM, IR_SWITCH,
+    IR_COUNT
 } IRKind;
 
+/* Virtual registers are numbered from 1; 0 means "no register".
+ *   IR_MOV      dst = imm
+ *   IR_COPY     dst = lhs
+ *   IR_ADDR     dst = &var
+ *   IR_LOAD     dst = *lhs (size bytes, sign-extended)
+ *   IR_STORE    *lhs = rhs (size bytes)
+ *   IR_CAST     dst = lhs sign-extended from size bytes
+ *   IR_DIV      dst = lhs / rhs, IR_MOD dst = lhs % rhs: of ints, or of
+ *               64-bit values when size is 8 (pointer differences)
+ *   IR_CALL     dst = name(args[0..nargs-1]); if tail is set, the
+ *               function returns dst and the call is made as a jump
+ *   IR_RET      return lhs (if non-zero)
+ *   IR_LABEL    label imm; IR_JMP/IR_JZ/IR_JNZ jump to label imm
+ *   IR_VASTART  dst = address of the first variadic argument
+ *   IR_PHI      dst = args[i] when entered from the i-th predecessor of
+ *               its block; only present while the function is in SSA form
+ *   IR_PARAM    dst = argument imm as passed in its register, sign-extended
+ *               from size bytes; the parameters are read at the start of
+ *               the function, before anything else
+ *   IR_SWITCH   jump to label args[lhs] if 0 <= lhs < nargs, taken as
+ *               unsigned, and to label imm otherwise
+ *   IR_COUNT    add one to profile counter imm (-fprofile-generate)
+ */
 struct IR {
     IRKind kind;
     int dst;           /* Destination register */
     int lhs;           /* Left operand */
     int rhs;           /* Right operand */
     int imm;           /* Immediate value */
+    int size;          /* Access size for loads, stores and casts */
+    Type *ty;          /* IR_LOAD, IR_STORE: type of the value accessed,
+                        * or NULL for memory of no particular type */
     char *name;        /* For labels and function calls */
-    IR *next;
+    Symbol *var;       /* For IR_ADDR */
+    int *args;         /* For IR_CALL, IR_PHI and IR_SWITCH */
+    int nargs;
+    bool tail;         /* IR_CALL in tail position */
+    int count;         /* IR_CALL: times the call was made in the profile,
+                        * or -1 if not known */
+};
+
+/* Basic block: the instructions code[start..end-1] of its function.
+ * Edges are stored as block indices. */
+struct BasicBlock {
+    int id;
+    int start;
+    int end;
+    int *succs;        /* At most two successors, except after IR_SWITCH */
+    int nsuccs;
+    int *preds;
+    int npreds;
+    int rpo;           /* Position in reverse postorder, -1 if unreachable */
+    int idom;          /* Immediate dominator, -1 for the entry and
+                        * unreachable blocks */
+};
+
+/* Natural loop: the blocks that reach one of the header's back edges
+ * without passing through the header */
+struct Loop {
+    Loop *next;
+    int header;        /* Header block */
+    int preheader;     /* The header's only predecessor outside the loop,
+                        * if that block has no other successor; else -1 */
+    bool *in_loop;     /* Membership, indexed by block */
+    int nblocks;       /* Number of blocks in the loop */
+};
+
+/* IR of one function. Instructions live in one growable array and are
+ * addressed by index; a range of indices delimits a block. */
+struct IRFunc {
+    IRFunc *next;
+    Symbol *fn;
+    IR *code;          /* code[0..ncode-1] */
+    int ncode;
+    int capacity;
+    int nreg;          /* Registers in use are 1..nreg-1 */
+    
+    /* Control-flow graph, filled in by build_cfg() */
+    BasicBlock *blocks;
+    int nblocks;
+    int *rpo;          /* Reachable blocks in reverse postorder */
+    int nrpo;
+    
+    /* Filled in by the register allocator */
+    int *reg_of;       /* Physical register of each vreg, or -1 if spilled */
+    int *slot_of;      /* Spill slot of each vreg, or -1 */
+    int nslots;        /* Number of spill slots */
+    bool *used_regs;   /* Which physical registers are used */
+
+    /* Counts printed by -stats */
+    int dead_code;     /* Instructions deleted by dce() */
+    int dead_stores;   /* Stores deleted by dce() */
+    int loads_removed; /* Loads replaced by load_elim() */
 };
 
+/* Physical registers handed out by the register allocator. The first
+ * NUM_CALLEE_SAVED are callee-saved (rbx, r12-r15), the rest are
+ * caller-saved (r10, r11) and never hold a value across a call. */
+#define NUM_ALLOC_REGS 7
+#define NUM_CALLEE_SAVED 5
+
+/* Optimization passes, turned on and off by name (see passes.c) */
+typedef enum {
+    PASS_IR, PASS_INLINE, PASS_TAILCALL, PASS_DCE, PASS_SSA, PASS_SCCP, PASS_GVN,
+    PASS_LOAD_ELIM, PASS_LICM, PASS_CONSTPROP, PASS_STRENGTH_REDUCE, PASS_UNROLL, PASS_VECTORIZE,
+    PASS_MEM2REG, PASS_DEAD_SYMBOLS, PASS_DIV_CONST, PASS_PEEPHOLE,
+    NUM_PASSES
+} PassKind;
+
 /* Global compilation state */
 typedef struct {
     Token *token;      /* Current token */
@@ -200,6 +328,17 @@ typedef struct {
     char **include_paths; /* Include search paths */
     int include_count;
     char *current_file;
+    char *no_gvn;      /* -fno-gvn: functions to skip GVN in, separated
+                        * by commas, or "" for all */
+    bool stats;        /* -stats: report what the optimizer removed */
+    bool *passes;      /* Which of the NUM_PASSES passes run */
+    bool function_sections; /* -ffunction-sections: each function in a
+                             * section of its own */
+    bool data_sections;     /* -fdata-sections: the same for global data */
+    char *profile_generate; /* -fprofile-generate: the file the program
+                             * adds its counts to, or NULL */
+    char *profile_use;      /* -fprofile-use: the file counts are read
+                             * from, or NULL */
 } CompilerState;
 
 /* Lexer functions */
@@ -216,6 +355,8 @@ ASTNode *new_node(NodeKind kind);
 ASTNode *new_binary(NodeKind kind, ASTNode *lhs, ASTNode *rhs);
 ASTNode *new_num(int val);
 ASTNode *copy_node(ASTNode *node);
+ASTNode **switch_cases(ASTNode *body, int *ncases, ASTNode **dflt);
+bool case_table_fits(ASTNode **cases, int lo, int hi);
 
 /* Type functions */
 Type *new_type(TypeKind kind, int size, int align);
@@ -224,13 +365,75 @@ Type *array_of(Type *base, int len);
 void add_type(ASTNode *node);
 
 /* IR generation */
-IR *gen_ir(Symbol *prog);
+IRFunc *gen_ir(Symbol *prog);
+void dump_ir(IRFunc *fns, FILE *out);
+int new_ir_label(void);
+IR *ir_append(IRFunc *f, IRKind kind);
+void ir_insert_before(IRFunc *f, IR **before, int *nbefore);
+void ir_remove_nops(IRFunc *f);
+int ir_uses(IR *ir, int **uses);
+
+/* Control-flow graph */
+void build_cfg(IRFunc *f);
+void free_cfg(IRFunc *f);
+void compute_dominators(IRFunc *f);
+bool dominates(IRFunc *f, int a, int b);
+
+/* Loops */
+Loop *find_loops(IRFunc *f);
+void free_loops(Loop *loops);
+void insert_preheaders(IRFunc *f);
+void licm(IRFunc *f);
+void strength_reduce(IRFunc *f);
+
+/* Alias analysis */
+void alias_analyze(IRFunc *f);
+void alias_free(void);
+bool alias_may_clobber(IR *write, IR *access);
+void load_elim(IRFunc *f);
+
+/* SSA form */
+void to_ssa(IRFunc *f);
+void from_ssa(IRFunc *f);
+
+/* Pass manager */
+void set_opt_level(int level, bool size);
+bool set_pass(char *name, bool on);
+bool set_pass_list(char *list);
+bool pass_enabled(PassKind pass);
+void print_passes(FILE *out);
 
 /* Optimization */
-IR *optimize(IR *ir);
+void optimize(IRFunc *fns);
+void inline_functions(IRFunc *fns);
+void gvn(IRFunc *f);
+void dce(IRFunc *f);
+void tail_recursion(IRFunc *f);
+void mark_tail_calls(IRFunc *f);
+void fold_ast(Symbol *prog);
+void unroll_loops(Symbol *prog);
+void vectorize_loops(Symbol *prog);
+void mark_live_symbols(Symbol *prog, IRFunc *fns);
+bool mul_fits(int a, int b);
+
+/* Profile-guided optimization */
+void assign_counters(Symbol *prog);
+void read_profile(void);
+void emit_profile_data(FILE *out);
+bool profile_hot(int count);
+bool profile_cold(int part, int total);
+bool profile_dominant(int part, int total);
+
+/* Register allocation */
+void regalloc(IRFunc *f);
 
 /* Code generation */
 void codegen(Symbol *prog, FILE *out);
+void codegen_ir(Symbol *prog, IRFunc *fns, FILE *out);
+void asm_append(char *line);
+void asm_call_args(int nargs);
+void asm_flush(FILE *out);
+void emit_vector_helpers(FILE *out);
 
 /* Preprocessor */
 char *preprocess(char *filename);
@@ -249,6 +452,7 @@ bool equal(Token *tok, char *op);
 Token *skip(Token *tok, char *op);
 char *strndup_custom(const char *s, int n);
 char *strdup_custom(const char *s);
+char *asm_quote(char *s);
 
 /* Global state */
 extern CompilerState *compiler_state;
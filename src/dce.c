@@ -0,0 +1,505 @@
+#include "compiler.h"
+
+/* Liveness-based dead code elimination on a function outside SSA form.
+ *
+ * Backward dataflow finds, for each block, the virtual registers and the
+ * parts of local variables whose current value may still be read. A
+ * computation whose result is not live is deleted, and so is a store to a
+ * local that is not read again before it is overwritten or the function
+ * returns.
+ *
+ * Only locals whose address never escapes are tracked: every pointer into
+ * them must be used to load, store, compare, or form another pointer into
+ * the same local. Calls and stores through other pointers cannot touch
+ * such a local, so its loads are the only reads. Accesses at constant
+ * offsets that never partly overlap (the members of a struct, the
+ * elements of an array indexed by constants) are tracked as separate
+ * slots; otherwise the whole local is one slot.
+ *
+ * Deleting code can make more code dead, so the analysis is repeated
+ * until nothing changes. */
+
+/* What a register points into, while it is being worked out */
+#define PTR_UNSEEN -1      /* No definition seen yet */
+#define PTR_NONE -2        /* Not a pointer into a tracked local */
+#define PTR_MIXED -3       /* Into different locals on different paths */
+
+static IRFunc *dce_func;
+static Symbol **local_vars; /* Candidate locals, indexed by variable */
+static int nlocal_vars;
+static bool *escaped;      /* Variable whose address escapes */
+static bool *overlap;      /* Variable accessed by partly overlapping slots */
+static int *ptr_var;       /* Variable each register points into, or one of
+                            * the values above */
+static int *ptr_off;       /* Constant offset into it, or -1 if unknown */
+static bool *whole;        /* Register always holds the variable's address */
+static bool *is_const;     /* Register with a single constant definition */
+static int *const_val;
+
+/* Slots of the tracked variables. Slot offset -1 stands for the parts of
+ * a variable accessed at unknown offsets, or for all of it when it has
+ * overlapping slots. */
+static int *slot_var;
+static int *slot_off;
+static int *slot_size;
+static int nslots;
+static int *acc_var;       /* Tracked variable loaded or stored by each
+                            * instruction, or -1 */
+static int *acc_slot;      /* Its slot, or -1 if the offset is unknown */
+
+static int nlive;          /* Registers, then slots */
+static bool *live_in;      /* Live on entry, nlive entries per block */
+static bool *live;         /* Live at the current point of a block */
+
+/* Index of a local in local_vars[], adding it if needed */
+static int var_index(Symbol *var) {
+    for (int v = 0; v < nlocal_vars; v++) {
+        if (local_vars[v] == var) {
+            return v;
+        }
+    }
+    local_vars[nlocal_vars] = var;
+    return nlocal_vars++;
+}
+
+/* Mark the variable of a pointer value as escaping */
+static void escape(int p) {
+    if (p >= 0) {
+        escaped[p] = true;
+    }
+}
+
+/* Offset off moved by the constant in register r, or -1 if unknown */
+static int add_offset(int off, int r, bool negate) {
+    if (off < 0 || !is_const[r]) {
+        return -1;
+    }
+    int d = const_val[r];
+    if (negate) {
+        d = -d;
+    }
+    if (off + d < 0) {
+        return -1;
+    }
+    return off + d;
+}
+
+/* What the result of ir points into, from what its operands point into.
+ * The offset of the result is left in *off. */
+static int ptr_result(IR *ir, int *off) {
+    int a = ptr_var[ir->lhs];
+    int b = ptr_var[ir->rhs];
+    *off = -1;
+    switch (ir->kind) {
+        case IR_ADDR:
+            if (ir->var->is_local) {
+                *off = 0;
+                return var_index(ir->var);
+            }
+            return PTR_NONE;
+        case IR_COPY:
+            *off = ptr_off[ir->lhs];
+            return a;
+        case IR_ADD:
+        case IR_SUB:
+            if (a == PTR_UNSEEN || b == PTR_UNSEEN) {
+                return PTR_UNSEEN;
+            }
+            if (b == PTR_NONE) {
+                *off = add_offset(ptr_off[ir->lhs], ir->rhs, ir->kind == IR_SUB);
+                return a;
+            }
+            if (a == PTR_NONE && ir->kind == IR_ADD) {
+                *off = add_offset(ptr_off[ir->rhs], ir->lhs, false);
+                return b;
+            }
+            /* Two pointers, or an offset minus a pointer */
+            escape(a);
+            escape(b);
+            return PTR_MIXED;
+        default:
+            return PTR_NONE;
+    }
+}
+
+/* Work out what each register points into and which variables escape */
+static void find_pointers(void) {
+    IRFunc *f = dce_func;
+    int *ndefs = calloc(f->nreg, sizeof(int));
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        if (ir->dst) {
+            ndefs[ir->dst]++;
+            const_val[ir->dst] = ir->imm;
+        }
+    }
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind == IR_MOV && ir->dst && ndefs[ir->dst] == 1) {
+            is_const[ir->dst] = true;
+        }
+    }
+    free(ndefs);
+
+    for (int r = 0; r < f->nreg; r++) {
+        ptr_var[r] = PTR_UNSEEN;
+        ptr_off[r] = -1;
+        whole[r] = true;
+    }
+    ptr_var[0] = PTR_NONE;
+
+    /* Registers may be defined more than once; a register defined as
+     * pointers into different variables points into neither */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < f->ncode; i++) {
+            IR *ir = &f->code[i];
+            if (!ir->dst) {
+                continue;
+            }
+            int off;
+            int p = ptr_result(ir, &off);
+            int old = ptr_var[ir->dst];
+            if (ir->kind != IR_ADDR) {
+                whole[ir->dst] = false;
+            }
+            if (p == PTR_UNSEEN) {
+                continue;
+            }
+            if (old == PTR_UNSEEN) {
+                ptr_var[ir->dst] = p;
+                ptr_off[ir->dst] = off;
+            } else if (old == p) {
+                if (ptr_off[ir->dst] == off || ptr_off[ir->dst] < 0) {
+                    continue;
+                }
+                ptr_off[ir->dst] = -1;
+            } else if (old != PTR_MIXED) {
+                escape(old);
+                escape(p);
+                ptr_var[ir->dst] = PTR_MIXED;
+            } else {
+                escape(p);
+                continue;
+            }
+            changed = true;
+        }
+    }
+
+    /* Uses other than addressing memory or deriving pointers leak the
+     * address */
+    int *uses[6];
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        switch (ir->kind) {
+            case IR_LOAD:
+            case IR_ADD:
+            case IR_SUB:
+            case IR_COPY:
+            case IR_EQ:
+            case IR_NE:
+            case IR_LT:
+            case IR_LE:
+            case IR_GT:
+            case IR_GE:
+                continue;
+            case IR_STORE:
+                escape(ptr_var[ir->rhs]);
+                continue;
+            case IR_VASTART:
+                /* Variadic arguments are found relative to the frame */
+                for (int v = 0; v < nlocal_vars; v++) {
+                    escaped[v] = true;
+                }
+                continue;
+            default:
+                break;
+        }
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            escape(ptr_var[*uses[k]]);
+        }
+    }
+}
+
+/* The tracked variable addressed by register r, or -1 */
+static int tracked(int r) {
+    int v = ptr_var[r];
+    if (v >= 0 && !escaped[v]) {
+        return v;
+    }
+    return -1;
+}
+
+/* The slot of variable v at off, size bytes long, or -1 */
+static int find_slot(int v, int off, int size) {
+    for (int s = 0; s < nslots; s++) {
+        if (slot_var[s] == v && slot_off[s] == off && slot_size[s] == size) {
+            return s;
+        }
+    }
+    return -1;
+}
+
+/* Add a slot, unless it is already there */
+static void add_slot(int v, int off, int size) {
+    if (find_slot(v, off, size) >= 0) {
+        return;
+    }
+    slot_var[nslots] = v;
+    slot_off[nslots] = off;
+    slot_size[nslots] = size;
+    nslots++;
+}
+
+/* Divide the tracked variables into slots and find the slot of every
+ * load and store */
+static void find_slots(void) {
+    IRFunc *f = dce_func;
+    nslots = 0;
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        acc_var[i] = -1;
+        acc_slot[i] = -1;
+        if (ir->kind != IR_LOAD && ir->kind != IR_STORE) {
+            continue;
+        }
+        int v = tracked(ir->lhs);
+        if (v < 0) {
+            continue;
+        }
+        acc_var[i] = v;
+        int off = ptr_off[ir->lhs];
+        if (off < 0) {
+            add_slot(v, -1, -1);
+            continue;
+        }
+        if (overlap[v] || find_slot(v, off, ir->size) >= 0) {
+            continue;
+        }
+        for (int s = 0; s < nslots; s++) {
+            if (slot_var[s] == v && off < slot_off[s] + slot_size[s] &&
+                slot_off[s] < off + ir->size) {
+                overlap[v] = true;
+            }
+        }
+        add_slot(v, off, ir->size);
+    }
+
+    /* A variable with partly overlapping slots becomes a single slot */
+    int n = 0;
+    for (int s = 0; s < nslots; s++) {
+        if (!overlap[slot_var[s]] || slot_off[s] < 0) {
+            slot_var[n] = slot_var[s];
+            slot_off[n] = slot_off[s];
+            slot_size[n] = slot_size[s];
+            n++;
+        }
+    }
+    nslots = n;
+    for (int v = 0; v < nlocal_vars; v++) {
+        if (overlap[v]) {
+            add_slot(v, -1, -1);
+        }
+    }
+
+    for (int i = 0; i < f->ncode; i++) {
+        int v = acc_var[i];
+        int off = ptr_off[f->code[i].lhs];
+        if (v < 0) {
+            continue;
+        }
+        if (overlap[v]) {
+            acc_slot[i] = find_slot(v, -1, -1);
+        } else if (off >= 0) {
+            acc_slot[i] = find_slot(v, off, f->code[i].size);
+        }
+    }
+}
+
+/* Can ir be deleted when its result is not live? */
+static bool removable(IR *ir) {
+    switch (ir->kind) {
+        case IR_CALL:
+        case IR_VASTART:
+            return false;
+        default:
+            return ir->dst != 0;
+    }
+}
+
+/* Is code[i] a store nothing reads, given the live set after it? */
+static bool dead_store(int i) {
+    int v = acc_var[i];
+    if (v < 0) {
+        return false;
+    }
+    int nreg = dce_func->nreg;
+    if (acc_slot[i] >= 0) {
+        return !live[nreg + acc_slot[i]];
+    }
+    for (int s = 0; s < nslots; s++) {
+        if (slot_var[s] == v && live[nreg + s]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Does the store code[i] overwrite all of its slot? */
+static bool kills_slot(int i) {
+    IR *ir = &dce_func->code[i];
+    int s = acc_slot[i];
+    if (slot_off[s] >= 0) {
+        return true;
+    }
+    return whole[ir->lhs] && ir->size == local_vars[slot_var[s]]->ty->size;
+}
+
+/* Step the live set backwards over code[i] */
+static void transfer(int i) {
+    IR *ir = &dce_func->code[i];
+    int nreg = dce_func->nreg;
+    if (ir->dst) {
+        live[ir->dst] = false;
+    }
+    if (ir->kind == IR_STORE && acc_slot[i] >= 0 && kills_slot(i)) {
+        live[nreg + acc_slot[i]] = false;
+    }
+    if (ir->kind == IR_LOAD && acc_var[i] >= 0) {
+        if (acc_slot[i] >= 0) {
+            live[nreg + acc_slot[i]] = true;
+        } else {
+            for (int s = 0; s < nslots; s++) {
+                if (slot_var[s] == acc_var[i]) {
+                    live[nreg + s] = true;
+                }
+            }
+        }
+    }
+    int *uses[6];
+    int nuses = ir_uses(ir, uses);
+    for (int k = 0; k < nuses; k++) {
+        live[*uses[k]] = true;
+    }
+}
+
+/* Set live to what is live on exit from block b */
+static void live_out(int b) {
+    BasicBlock *bb = &dce_func->blocks[b];
+    memset(live, 0, nlive * sizeof(bool));
+    for (int k = 0; k < bb->nsuccs; k++) {
+        bool *in = &live_in[bb->succs[k] * nlive];
+        for (int x = 0; x < nlive; x++) {
+            if (in[x]) {
+                live[x] = true;
+            }
+        }
+    }
+}
+
+/* Solve for the live-in sets of every block */
+static void compute_liveness(void) {
+    IRFunc *f = dce_func;
+    memset(live_in, 0, f->nblocks * nlive * sizeof(bool));
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = f->nblocks - 1; b >= 0; b--) {
+            BasicBlock *bb = &f->blocks[b];
+            live_out(b);
+            for (int i = bb->end - 1; i >= bb->start; i--) {
+                transfer(i);
+            }
+            bool *in = &live_in[b * nlive];
+            for (int x = 0; x < nlive; x++) {
+                if (in[x] != live[x]) {
+                    in[x] = live[x];
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+/* Delete dead instructions, walking each block backwards. Returns true
+ * if anything was deleted. */
+static bool sweep(void) {
+    IRFunc *f = dce_func;
+    bool changed = false;
+    for (int b = 0; b < f->nblocks; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        live_out(b);
+        for (int i = bb->end - 1; i >= bb->start; i--) {
+            IR *ir = &f->code[i];
+            if (ir->kind == IR_STORE && dead_store(i)) {
+                f->dead_stores++;
+            } else if (removable(ir) && !live[ir->dst]) {
+                f->dead_code++;
+            } else {
+                transfer(i);
+                continue;
+            }
+            ir->kind = IR_NOP;
+            ir->dst = 0;
+            ir->lhs = 0;
+            ir->rhs = 0;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+/* Remove dead computations and dead stores to locals from f */
+void dce(IRFunc *f) {
+    dce_func = f;
+    bool changed = true;
+    while (changed) {
+        int n = f->ncode + 1;
+        build_cfg(f);
+        local_vars = calloc(n, sizeof(Symbol *));
+        nlocal_vars = 0;
+        escaped = calloc(n, sizeof(bool));
+        overlap = calloc(n, sizeof(bool));
+        ptr_var = calloc(f->nreg, sizeof(int));
+        ptr_off = calloc(f->nreg, sizeof(int));
+        whole = calloc(f->nreg, sizeof(bool));
+        is_const = calloc(f->nreg, sizeof(bool));
+        const_val = calloc(f->nreg, sizeof(int));
+        find_pointers();
+
+        slot_var = calloc(n * 2, sizeof(int));
+        slot_off = calloc(n * 2, sizeof(int));
+        slot_size = calloc(n * 2, sizeof(int));
+        acc_var = calloc(n, sizeof(int));
+        acc_slot = calloc(n, sizeof(int));
+        find_slots();
+
+        nlive = f->nreg + nslots;
+        live_in = calloc(f->nblocks * nlive + 1, sizeof(bool));
+        live = calloc(nlive + 1, sizeof(bool));
+        compute_liveness();
+        changed = sweep();
+
+        free(local_vars);
+        free(escaped);
+        free(overlap);
+        free(ptr_var);
+        free(ptr_off);
+        free(whole);
+        free(is_const);
+        free(const_val);
+        free(slot_var);
+        free(slot_off);
+        free(slot_size);
+        free(acc_var);
+        free(acc_slot);
+        free(live_in);
+        free(live);
+        if (changed) {
+            ir_remove_nops(f);
+        }
+    }
+    build_cfg(f);
+}
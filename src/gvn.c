@@ -0,0 +1,303 @@
+#include "compiler.h"
+
+/* Global value numbering over SSA form. The dominator tree is walked
+ * with a scoped hash table of the expressions computed so far, keyed by
+ * opcode and the value numbers of the operands. An expression already
+ * computed in a dominating block is redundant: its result is replaced by
+ * the earlier one.
+ *
+ * Loads are keyed by a memory version as well. Every store, call and
+ * va_start starts a new version, as does every block that may be entered
+ * from somewhere other than the end of its immediate dominator. */
+
+typedef struct ValueEntry ValueEntry;
+struct ValueEntry {
+    int kind;
+    int a;
+    int b;
+    int c;
+    Symbol *var;       /* For IR_ADDR */
+    int reg;           /* Register holding the value */
+    int next;          /* Next entry in the same bucket, or -1 */
+};
+
+static IRFunc *func;
+static ValueEntry *entries;    /* Stack of entries in scope */
+static int nentries;
+static int *bucket;            /* First entry of each bucket, or -1 */
+static int nbuckets;
+static int *vn;                /* Value number of each register */
+static int *repl;              /* Earlier register with the same value */
+static int *mem_out;           /* Memory version at the end of each block */
+static int mem_version;
+static int *first_child;       /* Dominator tree */
+static int *next_sibling;
+
+/* Bucket of a key */
+static int hash(int kind, int a, int b, int c) {
+    int h = kind;
+    h = (h * 31 + (a % 100003)) % nbuckets;
+    h = (h * 31 + (b % 100003)) % nbuckets;
+    h = (h * 31 + (c % 100003)) % nbuckets;
+    if (h < 0) {
+        h = h + nbuckets;
+    }
+    return h;
+}
+
+/* Register holding the value of key, or 0 */
+static int lookup(int kind, int a, int b, int c, Symbol *var) {
+    for (int e = bucket[hash(kind, a, b, c)]; e >= 0; e = entries[e].next) {
+        ValueEntry *ent = &entries[e];
+        if (ent->kind == kind && ent->a == a && ent->b == b && ent->c == c &&
+            ent->var == var) {
+            return ent->reg;
+        }
+    }
+    return 0;
+}
+
+/* Record that reg holds the value of key until the scope ends */
+static void insert(int kind, int a, int b, int c, Symbol *var, int reg) {
+    int h = hash(kind, a, b, c);
+    ValueEntry *ent = &entries[nentries];
+    ent->kind = kind;
+    ent->a = a;
+    ent->b = b;
+    ent->c = c;
+    ent->var = var;
+    ent->reg = reg;
+    ent->next = bucket[h];
+    bucket[h] = nentries;
+    nentries++;
+}
+
+/* Remove the entries added after mark */
+static void pop_scope(int mark) {
+    while (nentries > mark) {
+        nentries--;
+        ValueEntry *ent = &entries[nentries];
+        bucket[hash(ent->kind, ent->a, ent->b, ent->c)] = ent->next;
+    }
+}
+
+/* Is a op b the same as b op a? */
+static bool is_commutative(IRKind kind) {
+    return kind == IR_ADD || kind == IR_MUL || kind == IR_EQ || kind == IR_NE ||
+           kind == IR_AND || kind == IR_OR || kind == IR_XOR;
+}
+
+/* Can a binary operation be reused? Division is left alone: it traps,
+ * and is costly enough to deserve its own pass. */
+static bool is_numbered_binary(IRKind kind) {
+    switch (kind) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_AND:
+        case IR_OR:
+        case IR_XOR:
+        case IR_SHL:
+        case IR_SHR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Register an operand refers to after earlier replacements */
+static int gvn_resolve(int r) {
+    while (repl[r]) {
+        r = repl[r];
+    }
+    return r;
+}
+
+/* Hash of a name, to key addresses by */
+static int name_hash(char *name) {
+    int h = 0;
+    for (char *p = name; *p; p++) {
+        h = (h * 31 + *p) % 1000003;
+    }
+    return h;
+}
+
+/* Give every constant and address a value number. They are cheap to
+ * recompute, so the instructions stay and only their value numbers are
+ * shared; the entries stay in scope for the whole function. */
+static void number_leaves(IRFunc *f) {
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        int prev;
+        if (ir->kind == IR_MOV) {
+            prev = lookup(IR_MOV, ir->imm, 0, 0, NULL);
+            if (prev) {
+                vn[ir->dst] = vn[prev];
+            } else {
+                insert(IR_MOV, ir->imm, 0, 0, NULL, ir->dst);
+            }
+        } else if (ir->kind == IR_ADDR) {
+            prev = lookup(IR_ADDR, name_hash(ir->var->name), 0, 0, ir->var);
+            if (prev) {
+                vn[ir->dst] = vn[prev];
+            } else {
+                insert(IR_ADDR, name_hash(ir->var->name), 0, 0, ir->var, ir->dst);
+            }
+        }
+    }
+}
+
+/* Number the values in block b and the blocks it dominates */
+static void number_block(int b) {
+    IRFunc *f = func;
+    BasicBlock *bb = &f->blocks[b];
+    int mark = nentries;
+    int *uses[6];
+
+    if (bb->npreds == 1 && bb->preds[0] == bb->idom) {
+        mem_version = mem_out[bb->idom];
+    } else {
+        mem_version = mem_version + 1;
+    }
+
+    for (int i = bb->start; i < bb->end; i++) {
+        IR *ir = &f->code[i];
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            *uses[k] = gvn_resolve(*uses[k]);
+        }
+
+        int kind = ir->kind;
+        int a = 0;
+        int c = 0;
+        int key_b = 0;
+        bool numbered = false;
+        switch (ir->kind) {
+            case IR_MOV:
+            case IR_ADDR:
+                continue;
+            case IR_COPY:
+                vn[ir->dst] = vn[ir->lhs];
+                continue;
+            case IR_CAST:
+                a = vn[ir->lhs];
+                key_b = ir->size;
+                numbered = true;
+                break;
+            case IR_LOAD:
+                a = vn[ir->lhs];
+                key_b = ir->size;
+                c = mem_version;
+                numbered = true;
+                break;
+            case IR_STORE:
+            case IR_CALL:
+            case IR_VASTART:
+                mem_version = mem_version + 1;
+                break;
+            default:
+                if (is_numbered_binary(ir->kind)) {
+                    a = vn[ir->lhs];
+                    key_b = vn[ir->rhs];
+                    if (is_commutative(ir->kind) && a > key_b) {
+                        int t = a;
+                        a = key_b;
+                        key_b = t;
+                    }
+                    numbered = true;
+                }
+                break;
+        }
+
+        if (!numbered) {
+            continue;
+        }
+        int prev = lookup(kind, a, key_b, c, NULL);
+        if (prev) {
+            repl[ir->dst] = prev;
+            vn[ir->dst] = vn[prev];
+            ir->kind = IR_NOP;
+            ir->dst = 0;
+        } else {
+            insert(kind, a, key_b, c, NULL, ir->dst);
+        }
+    }
+    mem_out[b] = mem_version;
+
+    for (int child = first_child[b]; child >= 0; child = next_sibling[child]) {
+        number_block(child);
+    }
+    pop_scope(mark);
+}
+
+/* Remove redundant computations from f, which must be in SSA form */
+void gvn(IRFunc *f) {
+    build_cfg(f);
+    if (f->nblocks == 0) {
+        return;
+    }
+    compute_dominators(f);
+
+    func = f;
+    int nb = f->nblocks;
+    int n = f->ncode;
+    int nreg = f->nreg;
+    entries = calloc(n + 1, sizeof(ValueEntry));
+    nentries = 0;
+    nbuckets = n * 2 + 1;
+    bucket = calloc(nbuckets, sizeof(int));
+    for (int h = 0; h < nbuckets; h++) {
+        bucket[h] = -1;
+    }
+    vn = calloc(nreg, sizeof(int));
+    repl = calloc(nreg, sizeof(int));
+    for (int r = 0; r < nreg; r++) {
+        vn[r] = r;
+    }
+    mem_out = calloc(nb, sizeof(int));
+    mem_version = 0;
+
+    first_child = calloc(nb, sizeof(int));
+    next_sibling = calloc(nb, sizeof(int));
+    for (int b = 0; b < nb; b++) {
+        first_child[b] = -1;
+        next_sibling[b] = -1;
+    }
+    for (int b = nb - 1; b >= 0; b--) {
+        int d = f->blocks[b].idom;
+        if (d >= 0) {
+            next_sibling[b] = first_child[d];
+            first_child[d] = b;
+        }
+    }
+
+    number_leaves(f);
+    number_block(f->rpo[0]);
+
+    /* Phi operands may name registers numbered after the phi was seen */
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind == IR_PHI) {
+            for (int k = 0; k < ir->nargs; k++) {
+                ir->args[k] = gvn_resolve(ir->args[k]);
+            }
+        }
+    }
+
+    ir_remove_nops(f);
+    build_cfg(f);
+
+    free(entries);
+    free(bucket);
+    free(vn);
+    free(repl);
+    free(mem_out);
+    free(first_child);
+    free(next_sibling);
+}
@@ -0,0 +1,338 @@
+#include "compiler.h"
+
+/* Function inlining. Before the per-function passes run, calls to small
+ * functions defined in the same file are replaced by a copy of the
+ * callee's IR: its reads of the parameter registers become copies of the
+ * arguments, its locals become locals of the caller, and each return
+ * turns into a jump
+ * past the copy. The later passes then optimize the callee's body in the
+ * context of the call.
+ *
+ * Functions are visited callees first, so a callee is inlined with its
+ * own calls already expanded. A function still being visited is part of
+ * a cycle in the call graph and is not inlined into the cycle.
+ *
+ * With -fprofile-use, calls the profile says are hot get the limit of
+ * functions declared inline, and calls that were never made are left
+ * alone, unless they are the only call of a static function. */
+
+/* Largest callee, in instructions, inlined at any call site */
+#define INLINE_SMALL 12
+
+/* Limit for functions declared inline */
+#define INLINE_HINTED 40
+
+/* Limit for static functions called from a single place */
+#define INLINE_ONCE 200
+
+/* Callers are not grown beyond this many instructions */
+#define INLINE_MAX_CALLER 4000
+
+static IRFunc **funcs;     /* All functions with a body */
+static int nfuncs;
+static int *state;         /* 0 unvisited, 1 being visited, 2 done */
+static int *ncalls;        /* Call sites naming each function */
+static int ninlined;       /* Copies made so far, to name locals */
+
+/* Index of the function called name, or -1 if it has no body here */
+static int find_func(char *name) {
+    for (int k = 0; k < nfuncs; k++) {
+        if (strcmp(funcs[k]->fn->name, name) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/* Number of instructions in f that generate code, not counting the
+ * reading of the parameters and their stores to the parameters' locals,
+ * which take the place of passing the arguments, nor profile counters */
+static int inline_cost(IRFunc *f) {
+    int cost = 0;
+    int nparams = 0;
+    for (int i = 0; i < f->ncode; i++) {
+        if (f->code[i].kind == IR_PARAM) {
+            nparams++;
+        } else if (f->code[i].kind != IR_LABEL && f->code[i].kind != IR_NOP &&
+                   f->code[i].kind != IR_COUNT) {
+            cost++;
+        }
+    }
+    return cost - 2 * nparams;
+}
+
+/* Number of parameters of fn */
+static int count_params(Symbol *fn) {
+    int n = 0;
+    for (Symbol *p = fn->params; p; p = p->next) {
+        n++;
+    }
+    return n;
+}
+
+/* Should the call in f be replaced by the body of funcs[k]? */
+static bool should_inline(IRFunc *f, IR *call, int k) {
+    IRFunc *g = funcs[k];
+    if (g == f || state[k] != 2 || g->fn->is_variadic) {
+        return false;
+    }
+    if (call->nargs != count_params(g->fn)) {
+        return false;
+    }
+    for (int i = 0; i < g->ncode; i++) {
+        IR *ir = &g->code[i];
+        if (ir->kind == IR_VASTART) {
+            return false;
+        }
+        if (ir->kind == IR_CALL && strcmp(ir->name, g->fn->name) == 0) {
+            return false;
+        }
+    }
+
+    int limit = INLINE_SMALL;
+    if (g->fn->is_inline || profile_hot(call->count)) {
+        limit = INLINE_HINTED;
+    }
+    if (g->fn->is_static && ncalls[k] == 1) {
+        limit = INLINE_ONCE;
+    } else if (call->count == 0) {
+        return false;
+    }
+    int cost = inline_cost(g);
+    return cost <= limit && f->ncode + cost <= INLINE_MAX_CALLER;
+}
+
+/* Append ir to a growable list */
+static IR *push_ir(IR **list, int *len, int *cap, IRKind kind) {
+    if (*len == *cap) {
+        *cap = *cap * 2 + 16;
+        *list = realloc(*list, sizeof(IR) * *cap);
+    }
+    IR *ir = &(*list)[(*len)++];
+    memset(ir, 0, sizeof(IR));
+    ir->kind = kind;
+    return ir;
+}
+
+/* Build the code replacing call, a call from f to g, in *out. Returns
+ * the number of instructions. */
+static int expand_call(IRFunc *f, IR *call, IRFunc *g, IR **out) {
+    IR *code = NULL;
+    int n = 0;
+    int cap = 0;
+
+    /* Registers of g are shifted past those of f */
+    int base = f->nreg - 1;
+    f->nreg = f->nreg + g->nreg - 1;
+
+    /* Each local of g gets a copy in f */
+    int nvars = 0;
+    for (Symbol *var = g->fn->locals; var; var = var->next) {
+        nvars++;
+    }
+    Symbol **old_vars = calloc(nvars + 1, sizeof(Symbol *));
+    Symbol **new_vars = calloc(nvars + 1, sizeof(Symbol *));
+    Symbol *tail = f->fn->locals;
+    while (tail && tail->next) {
+        tail = tail->next;
+    }
+    int v = 0;
+    ninlined++;
+    for (Symbol *var = g->fn->locals; var; var = var->next) {
+        Symbol *copy = calloc(1, sizeof(Symbol));
+        memcpy(copy, var, sizeof(Symbol));
+        copy->next = NULL;
+        copy->name = calloc(strlen(g->fn->name) + strlen(var->name) + 16, 1);
+        sprintf(copy->name, "%s.%s.%d", g->fn->name, var->name, ninlined);
+        if (tail) {
+            tail->next = copy;
+        } else {
+            f->fn->locals = copy;
+        }
+        tail = copy;
+        old_vars[v] = var;
+        new_vars[v] = copy;
+        v++;
+    }
+
+    /* Labels of g are renamed */
+    int *old_labels = calloc(g->ncode + 1, sizeof(int));
+    int *new_labels = calloc(g->ncode + 1, sizeof(int));
+    int nlabels = 0;
+    for (int i = 0; i < g->ncode; i++) {
+        if (g->code[i].kind == IR_LABEL) {
+            old_labels[nlabels] = g->code[i].imm;
+            new_labels[nlabels] = new_ir_label();
+            nlabels++;
+        }
+    }
+    int end = new_ir_label();
+
+    /* Copy the body */
+    for (int i = 0; i < g->ncode; i++) {
+        IR *src = &g->code[i];
+        if (src->kind == IR_NOP) {
+            continue;
+        }
+        if (src->kind == IR_PARAM) {
+            IR *copy = push_ir(&code, &n, &cap, IR_COPY);
+            copy->dst = src->dst + base;
+            copy->lhs = call->args[src->imm];
+            continue;
+        }
+        if (src->kind == IR_RET) {
+            if (call->dst && src->lhs) {
+                IR *copy = push_ir(&code, &n, &cap, IR_COPY);
+                copy->dst = call->dst;
+                copy->lhs = src->lhs + base;
+            } else if (call->dst) {
+                IR *mov = push_ir(&code, &n, &cap, IR_MOV);
+                mov->dst = call->dst;
+            }
+            IR *jmp = push_ir(&code, &n, &cap, IR_JMP);
+            jmp->imm = end;
+            continue;
+        }
+
+        IR *ir = push_ir(&code, &n, &cap, src->kind);
+        memcpy(ir, src, sizeof(IR));
+        if (ir->dst) {
+            ir->dst = ir->dst + base;
+        }
+        if (ir->lhs) {
+            ir->lhs = ir->lhs + base;
+        }
+        if (ir->rhs) {
+            ir->rhs = ir->rhs + base;
+        }
+        if (ir->kind == IR_CALL) {
+            ir->args = calloc(ir->nargs + 1, sizeof(int));
+            for (int a = 0; a < ir->nargs; a++) {
+                ir->args[a] = src->args[a] + base;
+            }
+        }
+        if (ir->kind == IR_ADDR && ir->var->is_local) {
+            for (v = 0; v < nvars; v++) {
+                if (old_vars[v] == ir->var) {
+                    ir->var = new_vars[v];
+                    ir->name = new_vars[v]->name;
+                }
+            }
+        }
+        if (ir->kind == IR_LABEL || ir->kind == IR_JMP || ir->kind == IR_JZ ||
+            ir->kind == IR_JNZ || ir->kind == IR_SWITCH) {
+            for (int l = 0; l < nlabels; l++) {
+                if (old_labels[l] == ir->imm) {
+                    ir->imm = new_labels[l];
+                }
+            }
+        }
+        if (ir->kind == IR_SWITCH) {
+            ir->args = calloc(ir->nargs, sizeof(int));
+            for (int a = 0; a < ir->nargs; a++) {
+                ir->args[a] = src->args[a];
+                for (int l = 0; l < nlabels; l++) {
+                    if (old_labels[l] == src->args[a]) {
+                        ir->args[a] = new_labels[l];
+                    }
+                }
+            }
+        }
+    }
+    IR *label = push_ir(&code, &n, &cap, IR_LABEL);
+    label->imm = end;
+
+    free(old_vars);
+    free(new_vars);
+    free(old_labels);
+    free(new_labels);
+    *out = code;
+    return n;
+}
+
+/* Inline the calls of funcs[k] that are worth it */
+static void inline_calls(int k) {
+    IRFunc *f = funcs[k];
+    int n = f->ncode;
+    IR **before = calloc(n + 1, sizeof(IR *));
+    int *nbefore = calloc(n + 1, sizeof(int));
+    bool changed = false;
+
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind != IR_CALL) {
+            continue;
+        }
+        int callee = find_func(ir->name);
+        if (callee < 0 || !should_inline(f, ir, callee)) {
+            continue;
+        }
+        nbefore[i] = expand_call(f, ir, funcs[callee], &before[i]);
+        ir->kind = IR_NOP;
+        ir->dst = 0;
+        changed = true;
+    }
+
+    if (changed) {
+        ir_insert_before(f, before, nbefore);
+        ir_remove_nops(f);
+    }
+    for (int i = 0; i <= n; i++) {
+        free(before[i]);
+    }
+    free(before);
+    free(nbefore);
+}
+
+/* Visit the callees of funcs[k], then inline into it */
+static void visit_func(int k) {
+    state[k] = 1;
+    IRFunc *f = funcs[k];
+    for (int i = 0; i < f->ncode; i++) {
+        if (f->code[i].kind == IR_CALL) {
+            int callee = find_func(f->code[i].name);
+            if (callee >= 0 && state[callee] == 0) {
+                visit_func(callee);
+            }
+        }
+    }
+    inline_calls(k);
+    state[k] = 2;
+}
+
+/* Inline calls throughout the program */
+void inline_functions(IRFunc *fns) {
+    nfuncs = 0;
+    for (IRFunc *f = fns; f; f = f->next) {
+        nfuncs++;
+    }
+    funcs = calloc(nfuncs + 1, sizeof(IRFunc *));
+    state = calloc(nfuncs + 1, sizeof(int));
+    ncalls = calloc(nfuncs + 1, sizeof(int));
+    int k = 0;
+    for (IRFunc *f = fns; f; f = f->next) {
+        funcs[k++] = f;
+    }
+
+    for (k = 0; k < nfuncs; k++) {
+        IRFunc *f = funcs[k];
+        for (int i = 0; i < f->ncode; i++) {
+            if (f->code[i].kind == IR_CALL) {
+                int callee = find_func(f->code[i].name);
+                if (callee >= 0) {
+                    ncalls[callee]++;
+                }
+            }
+        }
+    }
+
+    for (k = 0; k < nfuncs; k++) {
+        if (state[k] == 0) {
+            visit_func(k);
+        }
+    }
+
+    free(funcs);
+    free(state);
+    free(ncalls);
+}
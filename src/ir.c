@@ -1,14 +1,32 @@
 #include "compiler.h"
 
-static IR *code;
+static IRFunc *func;    /* Function being lowered */
 static int nreg = 1;
 static int nlabel = 1;
 
-/* Create new IR instruction */
+/* Jump targets for break/continue in the statement being lowered */
+static int brk_label;
+static int cont_label;
+
+/* Case labels of the switch statement being lowered. The dispatch jumps
+ * to target, which with -fprofile-generate is a stub that counts the
+ * case before jumping on to its label. */
+typedef struct CaseLabel CaseLabel;
+struct CaseLabel {
+    CaseLabel *next;
+    ASTNode *node;
+    int label;
+    int target;
+};
+static CaseLabel *cases;
+
+/* Code moved out of line because the profile says it rarely runs; it
+ * is placed after the rest of the function */
+static IRFunc *cold_code;
+
+/* Append a new instruction to the current function */
 static IR *new_ir(IRKind kind) {
-    IR *ir = calloc(1, sizeof(IR));
-    ir->kind = kind;
-    return ir;
+    return ir_append(func, kind);
 }
 
 /* Allocate new register */
@@ -21,66 +39,274 @@ static int new_label(void) {
     return nlabel++;
 }
 
-/* Add IR instruction */
-static void add_ir(IR *ir) {
-    if (!code) {
-        code = ir;
-    } else {
-        IR *last = code;
-        while (last->next) {
-            last = last->next;
-        }
-        last->next = ir;
+/* Emit dst = imm */
+static int emit_imm(int val) {
+    IR *ir = new_ir(IR_MOV);
+    ir->dst = new_reg();
+    ir->imm = val;
+    return ir->dst;
+}
+
+/* Emit dst = lhs <kind> rhs */
+static int emit_binop(IRKind kind, int lhs, int rhs) {
+    IR *ir = new_ir(kind);
+    ir->lhs = lhs;
+    ir->rhs = rhs;
+    ir->dst = new_reg();
+    return ir->dst;
+}
+
+/* Emit dst = imm into an existing register */
+static void emit_mov(int dst, int val) {
+    IR *ir = new_ir(IR_MOV);
+    ir->dst = dst;
+    ir->imm = val;
+}
+
+/* Emit dst = lhs */
+static void emit_copy(int dst, int src) {
+    IR *ir = new_ir(IR_COPY);
+    ir->dst = dst;
+    ir->lhs = src;
+}
+
+/* Emit a load of the given size from the address in addr. ty is the
+ * type of the value for alias analysis, or NULL. */
+static int emit_load(int addr, int size, Type *ty) {
+    IR *ir = new_ir(IR_LOAD);
+    ir->dst = new_reg();
+    ir->lhs = addr;
+    ir->size = size;
+    ir->ty = ty;
+    return ir->dst;
+}
+
+/* Emit a store of the given size, as emit_load() */
+static void emit_store(int addr, int val, int size, Type *ty) {
+    IR *ir = new_ir(IR_STORE);
+    ir->lhs = addr;
+    ir->rhs = val;
+    ir->size = size;
+    ir->ty = ty;
+}
+
+/* Emit a label */
+static void emit_label(int label) {
+    IR *ir = new_ir(IR_LABEL);
+    ir->imm = label;
+}
+
+/* Emit a jump; kind is IR_JMP, IR_JZ or IR_JNZ */
+static void emit_jump(IRKind kind, int cond, int label) {
+    IR *ir = new_ir(kind);
+    ir->lhs = cond;
+    ir->imm = label;
+}
+
+/* With -fprofile-generate, count an event of node: slot 1 is its
+ * second counter */
+static void gen_count(ASTNode *node, int slot) {
+    if (compiler_state->profile_generate && node->prof_id) {
+        IR *ir = new_ir(IR_COUNT);
+        ir->imm = node->prof_id - 1 + slot;
+    }
+}
+
+/* Move the code generated from index start on out of line */
+static void move_cold(int start) {
+    for (int i = start; i < func->ncode; i++) {
+        IR *ir = ir_append(cold_code, IR_NOP);
+        memcpy(ir, &func->code[i], sizeof(IR));
+    }
+    func->ncode = start;
+}
+
+/* Width of a memory access for a value of the given type. Anything that
+ * is not a char or int is moved as a full 8-byte word. */
+static int access_size(Type *ty) {
+    if (ty && (ty->size == 1 || ty->size == 4)) {
+        return ty->size;
+    }
+    return 8;
+}
+
+/* Is this type an array or pointer? */
+static bool is_pointer(Type *ty) {
+    return ty && (ty->kind == TY_PTR || ty->kind == TY_ARRAY);
+}
+
+/* Size of the element a pointer or array type points to */
+static int pointee_size(Type *ty) {
+    if (ty->base && ty->base->size > 0) {
+        return ty->base->size;
+    }
+    return 1;
+}
+
+/* Scale an integer register by the pointee size of ty */
+static int scale(int reg, Type *ty) {
+    int size = pointee_size(ty);
+    if (size == 1) {
+        return reg;
     }
+    return emit_binop(IR_MUL, reg, emit_imm(size));
 }
 
 /* Generate IR for expression */
 static int gen_expr(ASTNode *node);
 
+/* Generate IR computing the address of an lvalue */
+static int gen_lvalue(ASTNode *node) {
+    switch (node->kind) {
+        case ND_VAR: {
+            IR *ir = new_ir(IR_ADDR);
+            ir->dst = new_reg();
+            ir->var = node->var;
+            ir->name = node->var->name;
+            return ir->dst;
+        }
+        case ND_DEREF:
+            return gen_expr(node->lhs);
+        case ND_MEMBER: {
+            int addr = gen_lvalue(node->lhs);
+            if (node->member && node->member->offset > 0) {
+                addr = emit_binop(IR_ADD, addr, emit_imm(node->member->offset));
+            }
+            return addr;
+        }
+        default:
+            break;
+    }
+    error("not an lvalue");
+    return 0;
+}
+
+/* Load a value of type ty from addr. Arrays decay to their address. */
+static int load(int addr, Type *ty) {
+    if (ty && ty->kind == TY_ARRAY) {
+        return addr;
+    }
+    return emit_load(addr, access_size(ty), ty);
+}
+
 /* Generate IR for binary operation */
 static int gen_binop(IRKind kind, ASTNode *node) {
     int lhs = gen_expr(node->lhs);
     int rhs = gen_expr(node->rhs);
-    
-    IR *ir = new_ir(kind);
-    ir->lhs = lhs;
-    ir->rhs = rhs;
+    return emit_binop(kind, lhs, rhs);
+}
+
+/* Jump to label if the condition is true (when set) or false. && and ||
+ * become chains of jumps and ! swaps the sense, so no boolean is built;
+ * a comparison left right before its jump is fused with it later. */
+static void gen_cond(ASTNode *node, bool when, int label) {
+    if (node->kind == ND_LNOT) {
+        gen_cond(node->lhs, !when, label);
+        return;
+    }
+    if (node->kind == ND_LAND || node->kind == ND_LOR) {
+        /* The left side alone decides when it is false for && (true for
+         * ||); whether that outcome jumps depends on when */
+        bool decides = node->kind == ND_LOR;
+        if (decides == when) {
+            gen_cond(node->lhs, when, label);
+            gen_cond(node->rhs, when, label);
+        } else {
+            int lskip = new_label();
+            gen_cond(node->lhs, decides, lskip);
+            gen_cond(node->rhs, when, label);
+            emit_label(lskip);
+        }
+        return;
+    }
+    emit_jump(when ? IR_JNZ : IR_JZ, gen_expr(node), label);
+}
+
+/* Generate IR for the value of && and ||, evaluating the right side only
+ * if the left one does not decide it */
+static int gen_logical(ASTNode *node) {
+    bool is_or = node->kind == ND_LOR;
+    int dst = new_reg();
+    int lshort = new_label();
+    int lend = new_label();
+
+    gen_cond(node, is_or, lshort);
+    emit_mov(dst, is_or ? 0 : 1);
+    emit_jump(IR_JMP, 0, lend);
+    emit_label(lshort);
+    emit_mov(dst, is_or ? 1 : 0);
+    emit_label(lend);
+    return dst;
+}
+
+/* Generate IR for function call */
+static int gen_call(ASTNode *node) {
+    /* Only the first six arguments are passed, all in registers */
+    int *args = calloc(6, sizeof(int));
+    int nargs = 0;
+    for (ASTNode *arg = node->args; arg && nargs < 6; arg = arg->next) {
+        args[nargs++] = gen_expr(arg);
+    }
+
+    gen_count(node, 0);
+    IR *ir = new_ir(IR_CALL);
+    ir->name = node->funcname;
+    ir->args = args;
+    ir->nargs = nargs;
     ir->dst = new_reg();
-    add_ir(ir);
-    
+    ir->count = -1;
+    if (node->profiled) {
+        ir->count = node->count;
+    }
     return ir->dst;
 }
 
 /* Generate IR for expression */
 static int gen_expr(ASTNode *node) {
     switch (node->kind) {
-        case ND_NUM: {
-            IR *ir = new_ir(IR_MOV);
-            ir->dst = new_reg();
-            ir->imm = node->val;
-            add_ir(ir);
-            return ir->dst;
+        case ND_NUM:
+            return emit_imm(node->val);
+        case ND_VAR:
+        case ND_MEMBER:
+            return load(gen_lvalue(node), node->ty);
+        case ND_DEREF:
+            return load(gen_expr(node->lhs), node->ty);
+        case ND_ADDR:
+            return gen_lvalue(node->lhs);
+        case ND_ADD: {
+            int lhs = gen_expr(node->lhs);
+            int rhs = gen_expr(node->rhs);
+            if (is_pointer(node->lhs->ty)) {
+                rhs = scale(rhs, node->lhs->ty);
+            } else if (is_pointer(node->rhs->ty)) {
+                lhs = scale(lhs, node->rhs->ty);
+            }
+            return emit_binop(IR_ADD, lhs, rhs);
         }
-        case ND_VAR: {
-            IR *ir = new_ir(IR_MOV);
-            ir->dst = new_reg();
-            ir->name = node->var->name;
-            add_ir(ir);
-            
-            if (node->var->is_local) {
-                /* Load local variable */
-                IR *load = new_ir(IR_LOAD);
-                load->dst = new_reg();
-                load->lhs = ir->dst;
-                add_ir(load);
-                return load->dst;
+        case ND_SUB: {
+            int lhs = gen_expr(node->lhs);
+            int rhs = gen_expr(node->rhs);
+            if (is_pointer(node->lhs->ty) && is_pointer(node->rhs->ty)) {
+                /* Pointer difference counts elements */
+                int diff = emit_binop(IR_SUB, lhs, rhs);
+                int size = pointee_size(node->lhs->ty);
+                if (size == 1) {
+                    return diff;
+                }
+                int rhs_size = emit_imm(size);
+                /* A division of the whole 64-bit difference */
+                IR *ir = new_ir(IR_DIV);
+                ir->lhs = diff;
+                ir->rhs = rhs_size;
+                ir->size = 8;
+                ir->dst = new_reg();
+                return ir->dst;
             }
-            return ir->dst;
+            if (is_pointer(node->lhs->ty)) {
+                rhs = scale(rhs, node->lhs->ty);
+            }
+            return emit_binop(IR_SUB, lhs, rhs);
         }
-        case ND_ADD:
-            return gen_binop(IR_ADD, node);
-        case ND_SUB:
-            return gen_binop(IR_SUB, node);
         case ND_MUL:
             return gen_binop(IR_MUL, node);
         case ND_DIV:
@@ -111,153 +337,215 @@ static int gen_expr(ASTNode *node) {
             return gen_binop(IR_SHR, node);
         case ND_LAND:
         case ND_LOR:
+            return gen_logical(node);
         case ND_LNOT:
+            return emit_binop(IR_EQ, gen_expr(node->lhs), emit_imm(0));
         case ND_NOT:
-            /* For now, treat logical operators as expressions that will be handled in codegen */
-            /* This is a simplified approach - just evaluate both sides */
-            if (node->lhs) gen_expr(node->lhs);
-            if (node->rhs) gen_expr(node->rhs);
-            return new_reg();
+            return emit_binop(IR_XOR, gen_expr(node->lhs), emit_imm(-1));
         case ND_ASSIGN: {
-            int rhs = gen_expr(node->rhs);
-            int lhs = gen_expr(node->lhs);
-            
-            IR *ir = new_ir(IR_STORE);
-            ir->lhs = lhs;
-            ir->rhs = rhs;
-            add_ir(ir);
-            
-            return rhs;
-        }
-        case ND_ADDR: {
-            IR *ir = new_ir(IR_ADDR);
-            ir->dst = new_reg();
-            if (node->lhs->kind == ND_VAR) {
-                ir->name = node->lhs->var->name;
-            }
-            add_ir(ir);
-            return ir->dst;
-        }
-        case ND_DEREF: {
-            int addr = gen_expr(node->lhs);
-            IR *ir = new_ir(IR_LOAD);
-            ir->dst = new_reg();
-            ir->lhs = addr;
-            add_ir(ir);
-            return ir->dst;
-        }
-        case ND_CALL: {
-            /* Generate code for arguments */
-            int nargs = 0;
-            for (ASTNode *arg = node->args; arg; arg = arg->next) {
-                gen_expr(arg);
-                nargs++;
-            }
-            
-            IR *ir = new_ir(IR_CALL);
-            ir->name = node->funcname;
-            ir->dst = new_reg();
-            ir->imm = nargs;
-            add_ir(ir);
-            return ir->dst;
+            int addr = gen_lvalue(node->lhs);
+            int val = gen_expr(node->rhs);
+            emit_store(addr, val, access_size(node->lhs->ty), node->lhs->ty);
+            return val;
         }
+        case ND_CALL:
+            return gen_call(node);
         case ND_COMMA: {
             gen_expr(node->lhs);
             return gen_expr(node->rhs);
         }
         case ND_CAST: {
-            /* For casts, just evaluate the expression */
-            /* Type conversion is handled at code generation */
-            return gen_expr(node->lhs);
+            int val = gen_expr(node->lhs);
+            if (node->ty && (node->ty->size == 1 || node->ty->size == 4)) {
+                IR *ir = new_ir(IR_CAST);
+                ir->dst = new_reg();
+                ir->lhs = val;
+                ir->size = node->ty->size;
+                return ir->dst;
+            }
+            return val;
         }
-        case ND_MEMBER: {
-            /* Generate address of struct member */
-            /* struct_addr = address of lhs (the struct) */
-            int struct_reg = gen_expr(node->lhs);
-            
-            /* For member access, we need to:
-             * 1. Get the address of the struct
-             * 2. Add the member offset to get member address
-             * 3. Load the value from that address
-             */
-            
-            /* If lhs is not already an address, we need special handling */
-            /* For now, assume lhs gives us a value and we need to get its address */
-            /* This is tricky - for x.member, x might be a variable (need address) */
-            /* Let's handle the common case where lhs is ND_VAR or ND_DEREF */
-            
-            int member_addr;
-            if (node->lhs->kind == ND_VAR) {
-                /* Get address of the variable */
-                IR *addr_ir = new_ir(IR_ADDR);
-                addr_ir->dst = new_reg();
-                addr_ir->name = node->lhs->var->name;
-                add_ir(addr_ir);
-                member_addr = addr_ir->dst;
-            } else if (node->lhs->kind == ND_DEREF) {
-                /* For ptr->member (which becomes (*ptr).member), 
-                 * lhs is ND_DEREF, so we want the address that would be dereferenced */
-                member_addr = gen_expr(node->lhs->lhs);
-            } else {
-                /* For other cases, use the evaluated result as an address */
-                member_addr = struct_reg;
+        case ND_COND: {
+            /* Both arms write the same destination register */
+            int dst = new_reg();
+            int lelse = new_label();
+            int lend = new_label();
+            gen_count(node, 0);
+            gen_cond(node->cond, false, lelse);
+            gen_count(node, 1);
+            emit_copy(dst, gen_expr(node->then));
+            emit_jump(IR_JMP, 0, lend);
+            emit_label(lelse);
+            emit_copy(dst, gen_expr(node->els));
+            emit_label(lend);
+            return dst;
+        }
+        case ND_SIZEOF:
+            if (node->lhs && node->lhs->ty) {
+                return emit_imm(node->lhs->ty->size);
             }
-            
-            /* Add member offset */
-            if (node->member && node->member->offset > 0) {
-                IR *offset_ir = new_ir(IR_MOV);
-                offset_ir->dst = new_reg();
-                offset_ir->imm = node->member->offset;
-                add_ir(offset_ir);
-                
-                IR *add_ir_inst = new_ir(IR_ADD);
-                add_ir_inst->lhs = member_addr;
-                add_ir_inst->rhs = offset_ir->dst;
-                add_ir_inst->dst = new_reg();
-                add_ir(add_ir_inst);
-                member_addr = add_ir_inst->dst;
-            }
-            
-            /* Load value from member address */
-            IR *load = new_ir(IR_LOAD);
-            load->dst = new_reg();
-            load->lhs = member_addr;
-            add_ir(load);
-            return load->dst;
-        }
-        case ND_VA_START:
-        case ND_VA_ARG:
+            return emit_imm(node->ty->size);
+        case ND_VA_START: {
+            /* ap = address of the first anonymous argument in the
+             * register save area */
+            int ap = new_reg();
+            IR *ir = new_ir(IR_VASTART);
+            ir->dst = ap;
+            emit_store(gen_lvalue(node->lhs), ap, 8, NULL);
+            return ap;
+        }
+        case ND_VA_ARG: {
+            /* val = *ap; ap += 8 */
+            int ap_addr = gen_lvalue(node->lhs);
+            int ap = emit_load(ap_addr, 8, NULL);
+            int val = emit_load(ap, access_size(node->ty), node->ty);
+            int size = 8;
+            if (node->ty && node->ty->size > 8) {
+                size = node->ty->size;
+            }
+            emit_store(ap_addr, emit_binop(IR_ADD, ap, emit_imm(size)), 8, NULL);
+            return val;
+        }
         case ND_VA_END:
-            /* Variadic function built-ins are handled directly in codegen */
-            /* Just return a placeholder register for now */
-            return new_reg();
-        case ND_COND:
-            /* Conditional expression (a ? b : c) */
-            /* For now, just evaluate all parts and return last */
-            if (node->cond) gen_expr(node->cond);
-            if (node->then) gen_expr(node->then);
-            if (node->els) gen_expr(node->els);
-            return new_reg();
-        case ND_SIZEOF:
-            /* sizeof is evaluated at compile time, just return a constant */
-            return new_reg();
+            /* va_end(ap) is a no-op on x86_64 */
+            gen_expr(node->lhs);
+            return emit_imm(0);
         default:
             error("unsupported expression in IR generation");
             return 0;
     }
 }
 
+/* Find the labels assigned to a case of the switch being lowered */
+static CaseLabel *find_case(ASTNode *node) {
+    for (CaseLabel *c = cases; c; c = c->next) {
+        if (c->node == node) {
+            return c;
+        }
+    }
+    error("case label not within a switch statement");
+    return NULL;
+}
+
+/* The label of a case, placed at the case */
+static int case_label(ASTNode *node) {
+    CaseLabel *c = find_case(node);
+    return c->label;
+}
+
+/* The label the dispatch jumps to for a case */
+static int case_target(ASTNode *node) {
+    CaseLabel *c = find_case(node);
+    return c->target;
+}
+
+/* Give a case of the switch being lowered a label of its own, and a
+ * stub to count it if it has a counter */
+static int add_case_label(ASTNode *node) {
+    CaseLabel *c = calloc(1, sizeof(CaseLabel));
+    c->node = node;
+    c->label = new_label();
+    c->target = c->label;
+    if (compiler_state->profile_generate && node->prof_id) {
+        c->target = new_label();
+    }
+    c->next = cases;
+    cases = c;
+    return c->label;
+}
+
+/* Emit the counting stubs of the cases of the switch being lowered */
+static void gen_case_counts(void) {
+    for (CaseLabel *c = cases; c; c = c->next) {
+        if (c->target != c->label) {
+            emit_label(c->target);
+            gen_count(c->node, 0);
+            emit_jump(IR_JMP, 0, c->label);
+        }
+    }
+}
+
+/* With a profile, compare first with the case that takes most of the
+ * dispatches left, and then maybe with a second one, so that the usual
+ * cases are found without a table or a tree of compares. total is the
+ * number of times the switch ran. The cases compared are removed from
+ * sorted[0..ncases-1]; returns how many are left. */
+static int gen_hot_cases(int val, ASTNode **sorted, int ncases, int total) {
+    for (int k = 0; k < 2; k++) {
+        int best = -1;
+        for (int i = 0; i < ncases; i++) {
+            if (sorted[i]->profiled && (best < 0 || sorted[i]->count > sorted[best]->count)) {
+                best = i;
+            }
+        }
+        if (best < 0 || !profile_dominant(sorted[best]->count, total)) {
+            break;
+        }
+        int eq = emit_binop(IR_EQ, val, emit_imm(sorted[best]->val));
+        emit_jump(IR_JNZ, eq, case_target(sorted[best]));
+        total -= sorted[best]->count;
+        ncases--;
+        for (int i = best; i < ncases; i++) {
+            sorted[i] = sorted[i + 1];
+        }
+    }
+    return ncases;
+}
+
+/* Jump to the case among sorted[lo..hi], in order of value, whose value
+ * is in register val, or to ldefault. A dense run of cases is dispatched
+ * through a jump table. Otherwise the cases are split at the middle one,
+ * so that finding one of n cases takes about log2(n) compares, down to a
+ * few that are compared in turn. */
+static void gen_case_dispatch(int val, ASTNode **sorted, int lo, int hi, int ldefault) {
+    if (case_table_fits(sorted, lo, hi)) {
+        int first = sorted[lo]->val;
+        int index = val;
+        if (first != 0) {
+            index = emit_binop(IR_SUB, val, emit_imm(first));
+        }
+        IR *ir = new_ir(IR_SWITCH);
+        ir->lhs = index;
+        ir->imm = ldefault;
+        ir->nargs = sorted[hi]->val - first + 1;
+        ir->args = calloc(ir->nargs, sizeof(int));
+        for (int k = 0; k < ir->nargs; k++) {
+            ir->args[k] = ldefault;
+        }
+        for (int i = lo; i <= hi; i++) {
+            ir->args[sorted[i]->val - first] = case_target(sorted[i]);
+        }
+        return;
+    }
+
+    if (hi - lo < 3) {
+        for (int i = lo; i <= hi; i++) {
+            int eq = emit_binop(IR_EQ, val, emit_imm(sorted[i]->val));
+            emit_jump(IR_JNZ, eq, case_target(sorted[i]));
+        }
+        emit_jump(IR_JMP, 0, ldefault);
+        return;
+    }
+
+    int mid = (lo + hi + 1) / 2;
+    int lbelow = new_label();
+    int lt = emit_binop(IR_LT, val, emit_imm(sorted[mid]->val));
+    emit_jump(IR_JNZ, lt, lbelow);
+    gen_case_dispatch(val, sorted, mid, hi, ldefault);
+    emit_label(lbelow);
+    gen_case_dispatch(val, sorted, lo, mid - 1, ldefault);
+}
+
 /* Generate IR for statement */
 static void gen_stmt(ASTNode *node) {
     switch (node->kind) {
         case ND_RETURN: {
-            IR *ir = new_ir(IR_RET);
+            int val = 0;  /* No return value */
             if (node->lhs) {
-                ir->lhs = gen_expr(node->lhs);
-            } else {
-                ir->lhs = 0;  /* No return value */
+                val = gen_expr(node->lhs);
             }
-            add_ir(ir);
+            IR *ir = new_ir(IR_RET);
+            ir->lhs = val;
             return;
         }
         case ND_EXPR_STMT: {
@@ -265,97 +553,101 @@ static void gen_stmt(ASTNode *node) {
             return;
         }
         case ND_IF: {
-            int r = gen_expr(node->cond);
             int lelse = new_label();
             int lend = new_label();
-            
-            IR *ir = new_ir(IR_JZ);
-            ir->lhs = r;
-            ir->imm = lelse;
-            add_ir(ir);
-            
+            gen_count(node, 0);
+
+            /* A side the profile says is rarely taken is moved out of
+             * line, so the usual path runs straight through */
+            if (node->profiled && profile_cold(node->count2, node->count)) {
+                int lthen = new_label();
+                gen_cond(node->cond, true, lthen);
+                if (node->els) {
+                    gen_stmt(node->els);
+                }
+                emit_label(lend);
+                int start = func->ncode;
+                emit_label(lthen);
+                gen_count(node, 1);
+                gen_stmt(node->then);
+                emit_jump(IR_JMP, 0, lend);
+                move_cold(start);
+                return;
+            }
+
+            gen_cond(node->cond, false, lelse);
+            gen_count(node, 1);
             gen_stmt(node->then);
-            
-            if (node->els) {
-                IR *jmp = new_ir(IR_JMP);
-                jmp->imm = lend;
-                add_ir(jmp);
-                
-                IR *label = new_ir(IR_LABEL);
-                label->imm = lelse;
-                add_ir(label);
-                
+
+            if (node->els && node->profiled &&
+                profile_cold(node->count - node->count2, node->count)) {
+                emit_label(lend);
+                int start = func->ncode;
+                emit_label(lelse);
+                gen_stmt(node->els);
+                emit_jump(IR_JMP, 0, lend);
+                move_cold(start);
+            } else if (node->els) {
+                emit_jump(IR_JMP, 0, lend);
+                emit_label(lelse);
                 gen_stmt(node->els);
-                
-                label = new_ir(IR_LABEL);
-                label->imm = lend;
-                add_ir(label);
+                emit_label(lend);
             } else {
-                IR *label = new_ir(IR_LABEL);
-                label->imm = lelse;
-                add_ir(label);
+                emit_label(lelse);
             }
             return;
         }
         case ND_WHILE: {
             int lbegin = new_label();
             int lend = new_label();
-            
-            IR *label = new_ir(IR_LABEL);
-            label->imm = lbegin;
-            add_ir(label);
-            
-            int r = gen_expr(node->cond);
-            
-            IR *ir = new_ir(IR_JZ);
-            ir->lhs = r;
-            ir->imm = lend;
-            add_ir(ir);
-            
+            int old_brk = brk_label;
+            int old_cont = cont_label;
+            brk_label = lend;
+            cont_label = lbegin;
+
+            gen_count(node, 0);
+            emit_label(lbegin);
+            gen_cond(node->cond, false, lend);
+            gen_count(node, 1);
             gen_stmt(node->then);
-            
-            IR *jmp = new_ir(IR_JMP);
-            jmp->imm = lbegin;
-            add_ir(jmp);
-            
-            label = new_ir(IR_LABEL);
-            label->imm = lend;
-            add_ir(label);
+            emit_jump(IR_JMP, 0, lbegin);
+            emit_label(lend);
+
+            brk_label = old_brk;
+            cont_label = old_cont;
             return;
         }
         case ND_FOR: {
             int lbegin = new_label();
+            int lnext = new_label();
             int lend = new_label();
-            
+            int old_brk = brk_label;
+            int old_cont = cont_label;
+            brk_label = lend;
+            cont_label = lnext;
+
             if (node->init) {
                 gen_stmt(node->init);
             }
-            
-            IR *label = new_ir(IR_LABEL);
-            label->imm = lbegin;
-            add_ir(label);
-            
+
+            gen_count(node, 0);
+            emit_label(lbegin);
             if (node->cond) {
-                int r = gen_expr(node->cond);
-                IR *ir = new_ir(IR_JZ);
-                ir->lhs = r;
-                ir->imm = lend;
-                add_ir(ir);
+                gen_cond(node->cond, false, lend);
             }
-            
+            gen_count(node, 1);
             gen_stmt(node->then);
-            
+
+            /* continue jumps here so that the increment still runs */
+            emit_label(lnext);
             if (node->inc) {
                 gen_expr(node->inc);
             }
-            
-            IR *jmp = new_ir(IR_JMP);
-            jmp->imm = lbegin;
-            add_ir(jmp);
-            
-            label = new_ir(IR_LABEL);
-            label->imm = lend;
-            add_ir(label);
+            emit_jump(IR_JMP, 0, lbegin);
+            emit_label(lend);
+
+            brk_label = old_brk;
+            cont_label = old_cont;
             return;
         }
         case ND_BLOCK: {
@@ -366,55 +658,366 @@ static void gen_stmt(ASTNode *node) {
         }
         case ND_NULL_STMT:
             return;
-        case ND_SWITCH:
-            /* Switch statements are handled directly in codegen, not IR */
-            /* For now, just generate the body */
+        case ND_SWITCH: {
+            int val = gen_expr(node->cond);
+            int lend = new_label();
+            gen_count(node, 0);
+            int old_brk = brk_label;
+            CaseLabel *old_cases = cases;
+            brk_label = lend;
+            cases = NULL;
+
+            int ncases;
+            ASTNode *dflt;
+            ASTNode **sorted = switch_cases(node->then, &ncases, &dflt);
+            int ldefault = lend;
+            if (dflt) {
+                ldefault = add_case_label(dflt);
+            }
+            for (int i = 0; i < ncases; i++) {
+                add_case_label(sorted[i]);
+            }
+            if (node->profiled) {
+                ncases = gen_hot_cases(val, sorted, ncases, node->count);
+            }
+            gen_case_dispatch(val, sorted, 0, ncases - 1, ldefault);
+            gen_case_counts();
+            free(sorted);
+
             gen_stmt(node->then);
+            emit_label(lend);
+
+            while (cases) {
+                CaseLabel *next = cases->next;
+                free(cases);
+                cases = next;
+            }
+            brk_label = old_brk;
+            cases = old_cases;
             return;
+        }
         case ND_CASE:
-            /* Case labels are handled by switch */
+            emit_label(case_label(node));
             if (node->lhs) {
                 gen_stmt(node->lhs);
             }
             return;
         case ND_BREAK:
+            if (!brk_label) {
+                error("break statement not within loop or switch");
+            }
+            emit_jump(IR_JMP, 0, brk_label);
+            return;
         case ND_CONTINUE:
-            /* Break/continue are handled directly in codegen */
+            if (!cont_label) {
+                error("continue statement not within loop");
+            }
+            emit_jump(IR_JMP, 0, cont_label);
             return;
         default:
             error("unsupported statement in IR generation");
     }
 }
 
+/* Read the register arguments and store them to the parameters' locals,
+ * where promotion to SSA form can find them like any other local. Every
+ * argument register is read before anything else runs. Variadic
+ * functions keep their parameters in the frame, stored by the prologue
+ * next to the register save area. */
+static void gen_params(Symbol *fn) {
+    if (fn->is_variadic) {
+        return;
+    }
+    int *regs = calloc(6, sizeof(int));
+    int n = 0;
+    for (Symbol *param = fn->params; param && n < 6; param = param->next) {
+        IR *ir = new_ir(IR_PARAM);
+        ir->dst = new_reg();
+        ir->imm = n;
+        ir->size = access_size(param->ty);
+        regs[n++] = ir->dst;
+    }
+    n = 0;
+    for (Symbol *param = fn->params; param && n < 6; param = param->next) {
+        for (Symbol *var = fn->locals; var; var = var->next) {
+            if (strcmp(var->name, param->name) == 0) {
+                IR *addr = new_ir(IR_ADDR);
+                addr->dst = new_reg();
+                addr->var = var;
+                addr->name = var->name;
+                emit_store(addr->dst, regs[n], access_size(param->ty), param->ty);
+                break;
+            }
+        }
+        n++;
+    }
+    free(regs);
+}
+
 /* Generate IR for function */
-static void gen_function(Symbol *fn) {
+static IRFunc *gen_function(Symbol *fn) {
+    func = calloc(1, sizeof(IRFunc));
+    func->fn = fn;
     nreg = 1;
-    
-    IR *ir = new_ir(IR_LABEL);
-    ir->name = fn->name;
-    add_ir(ir);
-    
+    brk_label = 0;
+    cont_label = 0;
+    cases = NULL;
+    if (!cold_code) {
+        cold_code = calloc(1, sizeof(IRFunc));
+    }
+    cold_code->ncode = 0;
+
+    gen_params(fn);
+    if (compiler_state->profile_generate && fn->prof_id) {
+        IR *ir = new_ir(IR_COUNT);
+        ir->imm = fn->prof_id - 1;
+    }
+
     /* Generate function body */
     gen_stmt(fn->body);
-    
+
     /* Add implicit return */
-    ir = new_ir(IR_RET);
-    ir->lhs = 0;
-    add_ir(ir);
+    new_ir(IR_RET);
+
+    /* Then the code moved out of line */
+    for (int i = 0; i < cold_code->ncode; i++) {
+        IR *ir = new_ir(IR_NOP);
+        memcpy(ir, &cold_code->code[i], sizeof(IR));
+    }
+
+    func->nreg = nreg;
+    return func;
 }
 
 /* Generate IR for program */
-IR *gen_ir(Symbol *prog) {
-    code = NULL;
-    nreg = 1;
+IRFunc *gen_ir(Symbol *prog) {
+    IRFunc *head = NULL;
+    IRFunc *tail = NULL;
     nlabel = 1;
-    
+
     for (Symbol *fn = prog; fn; fn = fn->next) {
         if (fn->is_function && fn->body) {
             /* Only generate IR for functions with bodies (not declarations) */
-            gen_function(fn);
+            IRFunc *f = gen_function(fn);
+            if (tail) {
+                tail->next = f;
+            } else {
+                head = f;
+            }
+            tail = f;
+        }
+    }
+
+    return head;
+}
+
+/* Allocate a label that is unique in the whole program */
+int new_ir_label(void) {
+    return nlabel++;
+}
+
+/* Append an instruction to f, growing its buffer as needed. The
+ * returned pointer is only valid until the next append. */
+IR *ir_append(IRFunc *f, IRKind kind) {
+    if (f->ncode == f->capacity) {
+        if (f->capacity) {
+            f->capacity = f->capacity * 2;
+        } else {
+            f->capacity = 64;
+        }
+        f->code = realloc(f->code, sizeof(IR) * f->capacity);
+    }
+    IR *ir = &f->code[f->ncode++];
+    memset(ir, 0, sizeof(IR));
+    ir->kind = kind;
+    return ir;
+}
+
+/* Copy f->code into a new buffer, inserting extra instructions. For each
+ * position i, the instructions before[i] are placed ahead of code[i];
+ * before[ncode] are appended at the end. */
+void ir_insert_before(IRFunc *f, IR **before, int *nbefore) {
+    int total = 1;
+    for (int i = 0; i <= f->ncode; i++) {
+        total += nbefore[i] + 1;
+    }
+
+    IR *code = calloc(total, sizeof(IR));
+    int n = 0;
+    for (int i = 0; i <= f->ncode; i++) {
+        for (int k = 0; k < nbefore[i]; k++) {
+            memcpy(&code[n++], &before[i][k], sizeof(IR));
+        }
+        if (i < f->ncode) {
+            memcpy(&code[n++], &f->code[i], sizeof(IR));
+        }
+    }
+
+    free(f->code);
+    f->code = code;
+    f->ncode = n;
+    f->capacity = total;
+}
+
+/* Remove IR_NOP instructions. One is kept where a conditional jump would
+ * otherwise be followed by its own target: the two edges into the target
+ * stay distinct, each with its own phi operand. */
+void ir_remove_nops(IRFunc *f) {
+    int n = 0;
+    for (int i = 0; i < f->ncode; i++) {
+        if (f->code[i].kind == IR_NOP) {
+            if (n == 0 || (f->code[n - 1].kind != IR_JZ && f->code[n - 1].kind != IR_JNZ)) {
+                continue;
+            }
+            int j = i;
+            while (j < f->ncode && f->code[j].kind == IR_NOP) {
+                j++;
+            }
+            if (j == f->ncode || f->code[j].kind != IR_LABEL ||
+                f->code[j].imm != f->code[n - 1].imm) {
+                i = j - 1;
+                continue;
+            }
+        }
+        if (n != i) {
+            memcpy(&f->code[n], &f->code[i], sizeof(IR));
+        }
+        n++;
+    }
+    f->ncode = n;
+}
+
+/* Collect pointers to the registers an instruction reads into uses[]
+ * (at most 6) and return how many there are. Phi operands are not
+ * included: a phi can have any number of them, in ir->args. */
+int ir_uses(IR *ir, int **uses) {
+    int n = 0;
+    switch (ir->kind) {
+        case IR_MOV:
+        case IR_ADDR:
+        case IR_VASTART:
+        case IR_LABEL:
+        case IR_JMP:
+        case IR_NOP:
+        case IR_PHI:
+        case IR_PARAM:
+        case IR_COUNT:
+            return 0;
+        case IR_CALL:
+            for (int i = 0; i < ir->nargs; i++) {
+                uses[n++] = &ir->args[i];
+            }
+            return n;
+        default:
+            break;
+    }
+    if (ir->lhs) {
+        uses[n++] = &ir->lhs;
+    }
+    if (ir->rhs) {
+        uses[n++] = &ir->rhs;
+    }
+    return n;
+}
+
+/* Instruction names for dump_ir (global for self-hosting compatibility) */
+static char *ir_names[] = {
+    "add", "sub", "mul", "div", "mod",
+    "mov", "load", "store",
+    "call", "ret", "label", "jmp", "jz", "jnz",
+    "eq", "ne", "lt", "le", "gt", "ge",
+    "and", "or", "xor", "shl", "shr",
+    "addr", "nop",
+    "copy", "cast", "vastart", "phi", "param", "switch",
+    "count"
+};
+
+/* Print IR in a human-readable form */
+void dump_ir(IRFunc *fns, FILE *out) {
+    for (IRFunc *f = fns; f; f = f->next) {
+        fprintf(out, "%s:\n", f->fn->name);
+        int b = 0;
+        for (int i = 0; i < f->ncode; i++) {
+            IR *ir = &f->code[i];
+
+            /* Annotate block boundaries when the CFG is built */
+            if (b < f->nblocks && f->blocks[b].start == i) {
+                BasicBlock *bb = &f->blocks[b];
+                fprintf(out, "  ; bb%d preds:", b);
+                for (int k = 0; k < bb->npreds; k++) {
+                    fprintf(out, " bb%d", bb->preds[k]);
+                }
+                fprintf(out, " succs:");
+                for (int k = 0; k < bb->nsuccs; k++) {
+                    fprintf(out, " bb%d", bb->succs[k]);
+                }
+                fprintf(out, "\n");
+                b++;
+            }
+
+            switch (ir->kind) {
+                case IR_LABEL:
+                    fprintf(out, ".L%d:\n", ir->imm);
+                    continue;
+                case IR_JMP:
+                    fprintf(out, "  jmp .L%d\n", ir->imm);
+                    continue;
+                case IR_JZ:
+                case IR_JNZ:
+                    fprintf(out, "  %s v%d, .L%d\n", ir_names[ir->kind], ir->lhs, ir->imm);
+                    continue;
+                case IR_SWITCH:
+                    fprintf(out, "  switch v%d, [", ir->lhs);
+                    for (int k = 0; k < ir->nargs; k++) {
+                        fprintf(out, "%s.L%d", k > 0 ? ", " : "", ir->args[k]);
+                    }
+                    fprintf(out, "], .L%d\n", ir->imm);
+                    continue;
+                case IR_NOP:
+                    continue;
+                default:
+                    break;
+            }
+
+            fprintf(out, "  ");
+            if (ir->dst) {
+                fprintf(out, "v%d = ", ir->dst);
+            }
+            fprintf(out, "%s", ir_names[ir->kind]);
+            if (ir->kind == IR_LOAD || ir->kind == IR_STORE || ir->kind == IR_CAST ||
+                ir->kind == IR_PARAM) {
+                fprintf(out, "%d", ir->size);
+            }
+
+            if (ir->kind == IR_MOV || ir->kind == IR_PARAM || ir->kind == IR_COUNT) {
+                fprintf(out, " %d", ir->imm);
+            } else if (ir->kind == IR_ADDR) {
+                fprintf(out, " %s", ir->name);
+            } else if (ir->kind == IR_PHI) {
+                for (int i = 0; i < ir->nargs; i++) {
+                    fprintf(out, "%s v%d", i > 0 ? "," : "", ir->args[i]);
+                }
+            } else if (ir->kind == IR_CALL) {
+                fprintf(out, " %s(", ir->name);
+                for (int i = 0; i < ir->nargs; i++) {
+                    if (i > 0) {
+                        fprintf(out, ", ");
+                    }
+                    fprintf(out, "v%d", ir->args[i]);
+                }
+                fprintf(out, ")");
+                if (ir->tail) {
+                    fprintf(out, " tail");
+                }
+            } else {
+                if (ir->lhs) {
+                    fprintf(out, " v%d", ir->lhs);
+                }
+                if (ir->rhs) {
+                    fprintf(out, ", v%d", ir->rhs);
+                }
+            }
+            fprintf(out, "\n");
         }
     }
-    
-    return code;
 }
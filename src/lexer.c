@@ -3,6 +3,7 @@
 static char *current_input;
 static char *current_filename;
 static int current_line = 1;
+static int pending_unroll;    /* Loop hint for the next token */
 
 /* Check if character starts identifier */
 static bool is_ident_start(char c) {
@@ -19,6 +20,12 @@ static bool startswith(char *p, char *q) {
     return strncmp(p, q, strlen(q)) == 0;
 }
 
+/* Check if string starts with the word q, not followed by more of an
+ * identifier */
+static bool startswith_word(char *p, char *q) {
+    return startswith(p, q) && !is_ident_cont(p[strlen(q)]);
+}
+
 /* Read number */
 static int read_number(char **p) {
     char *start = *p;
@@ -113,6 +120,8 @@ static Token *new_token(TokenKind kind, char *str, int len) {
     tok->loc = str;
     tok->filename = current_filename;
     tok->line = current_line;
+    tok->unroll = pending_unroll;
+    pending_unroll = 0;
     return tok;
 }
 
@@ -121,14 +130,16 @@ static char *keyword_names[] = {
     "int", "char", "void", "if", "else", "while",
     "for", "return", "sizeof", "struct", "typedef", "enum",
     "static", "extern", "const", "break", "continue",
-    "switch", "case", "default"
+    "switch", "case", "default", "inline", "__inline", "__inline__",
+    "restrict", "__restrict", "__restrict__"
 };
 
 static TokenKind keyword_kinds[] = {
     TK_INT, TK_CHAR, TK_VOID, TK_IF, TK_ELSE, TK_WHILE,
     TK_FOR, TK_RETURN, TK_SIZEOF, TK_STRUCT, TK_TYPEDEF, TK_ENUM,
     TK_STATIC, TK_EXTERN, TK_CONST, TK_BREAK, TK_CONTINUE,
-    TK_SWITCH, TK_CASE, TK_DEFAULT
+    TK_SWITCH, TK_CASE, TK_DEFAULT, TK_INLINE, TK_INLINE, TK_INLINE,
+    TK_RESTRICT, TK_RESTRICT, TK_RESTRICT
 };
 
 /* Check if identifier is keyword */
@@ -184,6 +195,34 @@ Token *tokenize(char *input, char *filename) {
             continue;
         }
         
+        /* #pragma lines left by the preprocessor. Loop hints are kept
+         * for the next token; other pragmas are ignored. */
+        if (startswith(p, "#pragma")) {
+            char *q = p + 7;
+            while (*q == ' ' || *q == '\t') q++;
+            if (startswith_word(q, "GCC")) {
+                q += 3;
+                while (*q == ' ' || *q == '\t') q++;
+            }
+            if (startswith_word(q, "nounroll")) {
+                pending_unroll = 1;
+            } else if (startswith_word(q, "unroll")) {
+                q += 6;
+                while (*q == ' ' || *q == '\t') q++;
+                pending_unroll = -1;
+                if (isdigit(*q)) {
+                    pending_unroll = read_number(&q);
+                    if (pending_unroll == 0) {
+                        pending_unroll = 1;
+                    }
+                }
+            }
+            while (*p && *p != '\n') {
+                p++;
+            }
+            continue;
+        }
+        
         /* Multi-character operators */
         if (startswith(p, "==")) {
             cur = cur->next = new_token(TK_EQ, p, 2);
@@ -0,0 +1,816 @@
+#include "compiler.h"
+
+/* Loop analysis, loop-invariant code motion and strength reduction of
+ * induction variables. A natural loop has a header that dominates a block
+ * branching back to it; the loop is the header plus every block that
+ * reaches such a back edge without passing through the header. */
+
+/* Find the natural loops of f, innermost (smallest) first. Loops sharing
+ * a header are merged. Requires build_cfg() and compute_dominators(). */
+Loop *find_loops(IRFunc *f) {
+    int nb = f->nblocks;
+    Loop *loops = NULL;
+    int *work = calloc(nb + 1, sizeof(int));
+
+    for (int h = 0; h < nb; h++) {
+        BasicBlock *hb = &f->blocks[h];
+        if (hb->rpo < 0) {
+            continue;
+        }
+
+        Loop *loop = NULL;
+        for (int k = 0; k < hb->npreds; k++) {
+            int latch = hb->preds[k];
+            if (f->blocks[latch].rpo < 0 || !dominates(f, h, latch)) {
+                continue;
+            }
+            if (!loop) {
+                loop = calloc(1, sizeof(Loop));
+                loop->header = h;
+                loop->in_loop = calloc(nb, sizeof(bool));
+                loop->in_loop[h] = true;
+                loop->nblocks = 1;
+            }
+
+            /* Walk backwards from the latch up to the header */
+            int nwork = 0;
+            if (!loop->in_loop[latch]) {
+                loop->in_loop[latch] = true;
+                loop->nblocks++;
+                work[nwork++] = latch;
+            }
+            while (nwork > 0) {
+                BasicBlock *bb = &f->blocks[work[--nwork]];
+                for (int i = 0; i < bb->npreds; i++) {
+                    int p = bb->preds[i];
+                    if (f->blocks[p].rpo >= 0 && !loop->in_loop[p]) {
+                        loop->in_loop[p] = true;
+                        loop->nblocks++;
+                        work[nwork++] = p;
+                    }
+                }
+            }
+        }
+        if (!loop) {
+            continue;
+        }
+
+        int outside = -1;
+        int noutside = 0;
+        for (int k = 0; k < hb->npreds; k++) {
+            if (!loop->in_loop[hb->preds[k]]) {
+                outside = hb->preds[k];
+                noutside++;
+            }
+        }
+        loop->preheader = -1;
+        if (noutside == 1 && f->blocks[outside].nsuccs == 1 &&
+            f->code[f->blocks[outside].end - 1].kind != IR_SWITCH) {
+            loop->preheader = outside;
+        }
+
+        /* Keep the list ordered by size */
+        Loop **pos = &loops;
+        while (*pos && (*pos)->nblocks <= loop->nblocks) {
+            pos = &(*pos)->next;
+        }
+        loop->next = *pos;
+        *pos = loop;
+    }
+
+    free(work);
+    return loops;
+}
+
+/* Release a list returned by find_loops() */
+void free_loops(Loop *loops) {
+    while (loops) {
+        Loop *next = loops->next;
+        free(loops->in_loop);
+        free(loops);
+        loops = next;
+    }
+}
+
+/* Give every loop a preheader: an empty block that falls through into
+ * the header and through which the loop is entered from outside. Code
+ * hoisted out of the loop goes there. */
+void insert_preheaders(IRFunc *f) {
+    build_cfg(f);
+    if (f->nblocks == 0) {
+        return;
+    }
+    compute_dominators(f);
+    Loop *loops = find_loops(f);
+
+    int ncode = f->ncode;
+    IR **before = calloc(ncode + 1, sizeof(IR *));
+    int *nbefore = calloc(ncode + 1, sizeof(int));
+    for (Loop *loop = loops; loop; loop = loop->next) {
+        if (loop->preheader >= 0) {
+            continue;
+        }
+        BasicBlock *hb = &f->blocks[loop->header];
+        IR *first = &f->code[hb->start];
+        if (first->kind != IR_LABEL) {
+            continue;
+        }
+
+        /* Entries from outside the loop now jump to the preheader */
+        int label = new_ir_label();
+        for (int k = 0; k < hb->npreds; k++) {
+            int p = hb->preds[k];
+            IR *last = &f->code[f->blocks[p].end - 1];
+            bool jumps = last->kind == IR_JMP || last->kind == IR_JZ || last->kind == IR_JNZ ||
+                         last->kind == IR_SWITCH;
+            if (loop->in_loop[p] || !jumps) {
+                continue;
+            }
+            if (last->imm == first->imm) {
+                last->imm = label;
+            }
+            for (int a = 0; last->kind == IR_SWITCH && a < last->nargs; a++) {
+                if (last->args[a] == first->imm) {
+                    last->args[a] = label;
+                }
+            }
+        }
+
+        /* A block of the loop placed just above the header must now jump
+         * over the preheader */
+        int at = hb->start;
+        before[at] = calloc(2, sizeof(IR));
+        int prev = loop->header - 1;
+        if (prev >= 0 && loop->in_loop[prev]) {
+            IR *last = &f->code[f->blocks[prev].end - 1];
+            if (last->kind != IR_JMP && last->kind != IR_RET && last->kind != IR_SWITCH) {
+                IR *jmp = &before[at][nbefore[at]++];
+                jmp->kind = IR_JMP;
+                jmp->imm = first->imm;
+            }
+        }
+        IR *lab = &before[at][nbefore[at]++];
+        lab->kind = IR_LABEL;
+        lab->imm = label;
+    }
+
+    ir_insert_before(f, before, nbefore);
+    for (int i = 0; i <= ncode; i++) {
+        free(before[i]);
+    }
+    free(before);
+    free(nbefore);
+    free_loops(loops);
+    build_cfg(f);
+}
+
+/* Is ir a candidate for hoisting once its operands are invariant? It
+ * must not trap or depend on memory that the loop writes; clobbered
+ * tells whether a store or call in the loop may write what a load reads. */
+static bool can_hoist(IR *ir, bool clobbered, bool *is_addr, bool *is_const, int *const_val) {
+    switch (ir->kind) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_AND:
+        case IR_OR:
+        case IR_XOR:
+        case IR_SHL:
+        case IR_SHR:
+        case IR_CAST:
+        case IR_COPY:
+        case IR_ADDR:
+            return true;
+        case IR_DIV:
+        case IR_MOD:
+            return is_const[ir->rhs] && const_val[ir->rhs] != 0 && const_val[ir->rhs] != -1;
+        case IR_LOAD:
+            /* A variable's address cannot fault */
+            return !clobbered && is_addr[ir->lhs];
+        default:
+            return false;
+    }
+}
+
+/* Move the invariant computations of a loop to its preheader. f must be
+ * in SSA form, so an operand is invariant when it is defined outside the
+ * loop. Constants are cheap to rematerialize: they stay in the loop, and
+ * hoisted code gets its own copy. */
+static void hoist_loop(IRFunc *f, Loop *loop) {
+    int n = f->ncode;
+    int cap = f->nreg + n + 1;
+    bool *variant = calloc(cap, sizeof(bool));  /* Defined in the loop */
+    int *mov_at = calloc(cap, sizeof(int));     /* 1 + index of the
+                                                 * in-loop IR_MOV defining
+                                                 * a register */
+    bool *is_addr = calloc(cap, sizeof(bool));
+    bool *is_const = calloc(cap, sizeof(bool));
+    int *const_val = calloc(cap, sizeof(int));
+    int *clone = calloc(cap, sizeof(int));      /* Hoisted copy of a
+                                                 * constant */
+    int *writes = calloc(n + 1, sizeof(int));      /* Stores and calls in
+                                                 * the loop */
+    int nwrites = 0;
+    alias_analyze(f);
+
+    for (int b = 0; b < f->nblocks; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        for (int i = bb->start; i < bb->end; i++) {
+            IR *ir = &f->code[i];
+            if (ir->kind == IR_ADDR) {
+                is_addr[ir->dst] = true;
+            }
+            if (ir->kind == IR_MOV) {
+                is_const[ir->dst] = true;
+                const_val[ir->dst] = ir->imm;
+            }
+            if (!loop->in_loop[b]) {
+                continue;
+            }
+            if (ir->dst) {
+                variant[ir->dst] = true;
+            }
+            if (ir->kind == IR_MOV) {
+                mov_at[ir->dst] = i + 1;
+            }
+            if (ir->kind == IR_STORE || ir->kind == IR_CALL || ir->kind == IR_VASTART) {
+                writes[nwrites++] = i;
+            }
+        }
+    }
+
+    /* Hoisting one instruction can make its users invariant: repeat */
+    IR *hoisted = NULL;
+    int nhoisted = 0;
+    int cap_hoisted = 0;
+    int *uses[6];
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int b = 0; b < f->nblocks; b++) {
+            if (!loop->in_loop[b]) {
+                continue;
+            }
+            BasicBlock *bb = &f->blocks[b];
+            for (int i = bb->start; i < bb->end; i++) {
+                IR *ir = &f->code[i];
+                bool clobbered = false;
+                for (int w = 0; w < nwrites && ir->kind == IR_LOAD && !clobbered; w++) {
+                    clobbered = alias_may_clobber(&f->code[writes[w]], ir);
+                }
+                if (!can_hoist(ir, clobbered, is_addr, is_const, const_val)) {
+                    continue;
+                }
+                int nuses = ir_uses(ir, uses);
+                bool invariant = true;
+                for (int k = 0; k < nuses; k++) {
+                    if (variant[*uses[k]] && !mov_at[*uses[k]]) {
+                        invariant = false;
+                    }
+                }
+                if (!invariant) {
+                    continue;
+                }
+
+                if (nhoisted + nuses + 1 > cap_hoisted) {
+                    cap_hoisted = cap_hoisted * 2 + nuses + 8;
+                    hoisted = realloc(hoisted, sizeof(IR) * cap_hoisted);
+                }
+                for (int k = 0; k < nuses; k++) {
+                    int r = *uses[k];
+                    if (!variant[r]) {
+                        continue;
+                    }
+                    if (!clone[r]) {
+                        clone[r] = f->nreg++;
+                        IR *mov = &hoisted[nhoisted++];
+                        memset(mov, 0, sizeof(IR));
+                        mov->kind = IR_MOV;
+                        mov->dst = clone[r];
+                        mov->imm = f->code[mov_at[r] - 1].imm;
+                    }
+                    *uses[k] = clone[r];
+                }
+                memcpy(&hoisted[nhoisted++], ir, sizeof(IR));
+                variant[ir->dst] = false;
+                ir->kind = IR_NOP;
+                changed = true;
+            }
+        }
+    }
+
+    if (nhoisted > 0) {
+        /* Place the code before the preheader's jump, if any */
+        BasicBlock *pb = &f->blocks[loop->preheader];
+        int at = pb->end;
+        if (f->code[pb->end - 1].kind == IR_JMP) {
+            at = pb->end - 1;
+        }
+        IR **before = calloc(n + 1, sizeof(IR *));
+        int *nbefore = calloc(n + 1, sizeof(int));
+        before[at] = hoisted;
+        nbefore[at] = nhoisted;
+        ir_insert_before(f, before, nbefore);
+        ir_remove_nops(f);
+        free(before);
+        free(nbefore);
+    }
+
+    alias_free();
+    free(writes);
+    free(variant);
+    free(mov_at);
+    free(is_addr);
+    free(is_const);
+    free(const_val);
+    free(clone);
+    free(hoisted);
+}
+
+/* Labels of the headers of f's loops, innermost first, or -1 for a
+ * header without one. Passes that move code renumber the blocks, so
+ * loops are looked up again by label after each change. */
+static int *loop_labels(IRFunc *f, int *nloops) {
+    compute_dominators(f);
+    Loop *loops = find_loops(f);
+    int n = 0;
+    for (Loop *loop = loops; loop; loop = loop->next) {
+        n++;
+    }
+    int *labels = calloc(n + 1, sizeof(int));
+    n = 0;
+    for (Loop *loop = loops; loop; loop = loop->next) {
+        IR *first = &f->code[f->blocks[loop->header].start];
+        labels[n++] = first->kind == IR_LABEL ? first->imm : -1;
+    }
+    free_loops(loops);
+    *nloops = n;
+    return labels;
+}
+
+/* Rebuild the CFG of f and find the loop headed by label. The list of
+ * all loops is returned in *all, for the caller to free. */
+static Loop *find_loop(IRFunc *f, int label, Loop **all) {
+    build_cfg(f);
+    compute_dominators(f);
+    *all = find_loops(f);
+    for (Loop *loop = *all; loop; loop = loop->next) {
+        IR *first = &f->code[f->blocks[loop->header].start];
+        if (first->kind == IR_LABEL && first->imm == label) {
+            return loop;
+        }
+    }
+    return NULL;
+}
+
+/* Loop-invariant code motion on a function in SSA form. Inner loops are
+ * processed first, so code can travel out of a nest one level at a time. */
+void licm(IRFunc *f) {
+    build_cfg(f);
+    if (f->nblocks == 0) {
+        return;
+    }
+    int nloops;
+    int *labels = loop_labels(f, &nloops);
+    for (int k = 0; k < nloops; k++) {
+        if (labels[k] < 0) {
+            continue;
+        }
+        Loop *all;
+        Loop *loop = find_loop(f, labels[k], &all);
+        if (loop && loop->preheader >= 0) {
+            hoist_loop(f, loop);
+        }
+        free_loops(all);
+    }
+    free(labels);
+    build_cfg(f);
+}
+
+/* Induction variables. A basic induction variable is a phi in the loop
+ * header that each iteration steps by a constant; a derived one equals
+ * scale * basic + offset. Derived variables get a phi of their own,
+ * stepped alongside the basic one, so a[i] becomes a pointer that moves
+ * by the element size instead of a multiply on every access. */
+typedef struct IndVar IndVar;
+struct IndVar {
+    int reg;           /* Value in the current iteration */
+    int basic;         /* Index of the basic variable this one follows */
+    int init;          /* Value on entry, available in the preheader */
+    int scale;
+    int offset;        /* Register added to the scaled value, or 0 */
+    int step;          /* Change per iteration */
+    int update;        /* Basic variables: instruction computing the
+                        * value for the next iteration */
+};
+
+static IndVar *ivs;
+static int nivs;
+static int *iv_of;         /* 1 + index of the variable a register
+                            * holds, or 0 */
+static IR **new_code;      /* Instructions to insert before each position */
+static int *nnew_code;
+static int *new_code_cap;
+
+/* Add an instruction to be inserted before position at */
+static IR *emit_before(int at, IRKind kind) {
+    if (nnew_code[at] == new_code_cap[at]) {
+        new_code_cap[at] = new_code_cap[at] * 2 + 4;
+        new_code[at] = realloc(new_code[at], sizeof(IR) * new_code_cap[at]);
+    }
+    IR *ir = &new_code[at][nnew_code[at]++];
+    memset(ir, 0, sizeof(IR));
+    ir->kind = kind;
+    return ir;
+}
+
+/* Emit reg = val before position at */
+static int emit_const(IRFunc *f, int at, int val) {
+    IR *ir = emit_before(at, IR_MOV);
+    ir->dst = f->nreg++;
+    ir->imm = val;
+    return ir->dst;
+}
+
+/* Emit reg = lhs <kind> rhs before position at */
+static int emit_op(IRFunc *f, int at, IRKind kind, int lhs, int rhs) {
+    IR *ir = emit_before(at, kind);
+    ir->dst = f->nreg++;
+    ir->lhs = lhs;
+    ir->rhs = rhs;
+    return ir->dst;
+}
+
+/* Create a derived variable: a new header phi, its entry value in the
+ * preheader and its next value after the basic variable's update */
+static int add_derived(IRFunc *f, int basic, int init, int scale, int offset, int step,
+                       int phi_at, int from_pre, int from_latch) {
+    IndVar *base = &ivs[basic];
+    int reg = f->nreg++;
+    int next_at = base->update + 1;
+    int next = emit_op(f, next_at, IR_ADD, reg, emit_const(f, next_at, step));
+
+    IR *phi = emit_before(phi_at, IR_PHI);
+    phi->dst = reg;
+    phi->args = calloc(2, sizeof(int));
+    phi->nargs = 2;
+    phi->args[from_pre] = init;
+    phi->args[from_latch] = next;
+
+    IndVar *iv = &ivs[nivs];
+    iv->reg = reg;
+    iv->basic = basic;
+    iv->init = init;
+    iv->scale = scale;
+    iv->offset = offset;
+    iv->step = step;
+    iv->update = -1;
+    return nivs++;
+}
+
+/* Turn ir into dst = src */
+static void replace_by_copy(IR *ir, int src) {
+    ir->kind = IR_COPY;
+    ir->lhs = src;
+    ir->rhs = 0;
+}
+
+/* Strength-reduce the induction variables of a loop. Exit tests on a
+ * basic variable that has no other use are rewritten in terms of a
+ * derived one, so the basic variable can be removed afterwards. */
+static void reduce_loop(IRFunc *f, Loop *loop) {
+    BasicBlock *hb = &f->blocks[loop->header];
+    if (hb->npreds != 2 || f->code[hb->start].kind != IR_LABEL) {
+        return;
+    }
+    int from_pre = hb->preds[0] == loop->preheader ? 0 : 1;
+    int from_latch = 1 - from_pre;
+    BasicBlock *pb = &f->blocks[loop->preheader];
+    int pre_at = pb->end;
+    if (f->code[pb->end - 1].kind == IR_JMP) {
+        pre_at = pb->end - 1;
+    }
+    int phi_at = hb->start + 1;
+
+    int n = f->ncode;
+    int cap = f->nreg + 8 * n + 16;
+    int *def_at = calloc(cap, sizeof(int));
+    bool *is_const = calloc(cap, sizeof(bool));
+    int *const_val = calloc(cap, sizeof(int));
+    bool *inside = calloc(n + 1, sizeof(bool));
+    int *nuse = calloc(cap, sizeof(int));
+    int *uses[6];
+    iv_of = calloc(cap, sizeof(int));
+    ivs = calloc(n + 1, sizeof(IndVar));
+    nivs = 0;
+    new_code = calloc(n + 1, sizeof(IR *));
+    nnew_code = calloc(n + 1, sizeof(int));
+    new_code_cap = calloc(n + 1, sizeof(int));
+
+    for (int r = 0; r < cap; r++) {
+        def_at[r] = -1;
+    }
+    for (int b = 0; b < f->nblocks; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        for (int i = bb->start; i < bb->end; i++) {
+            IR *ir = &f->code[i];
+            inside[i] = loop->in_loop[b];
+            if (ir->dst) {
+                def_at[ir->dst] = i;
+            }
+            if (ir->kind == IR_MOV) {
+                is_const[ir->dst] = true;
+                const_val[ir->dst] = ir->imm;
+            }
+        }
+    }
+
+    /* Basic variables: x = phi(x0, x'), x' = x + c, possibly narrowed
+     * back to int, which cannot change the value of a program without
+     * signed overflow */
+    for (int i = phi_at; i < hb->end && f->code[i].kind == IR_PHI; i++) {
+        IR *phi = &f->code[i];
+        int x = phi->dst;
+        int update = def_at[phi->args[from_latch]];
+        if (update < 0 || !inside[update]) {
+            continue;
+        }
+        IR *def = &f->code[update];
+        if (def->kind == IR_CAST && def->size == 4 && def_at[def->lhs] >= 0) {
+            def = &f->code[def_at[def->lhs]];
+        }
+        int step;
+        if (def->kind == IR_ADD && def->lhs == x && is_const[def->rhs]) {
+            step = const_val[def->rhs];
+        } else if (def->kind == IR_ADD && def->rhs == x && is_const[def->lhs]) {
+            step = const_val[def->lhs];
+        } else if (def->kind == IR_SUB && def->lhs == x && is_const[def->rhs] &&
+                   const_val[def->rhs] > -2147483647) {
+            step = -const_val[def->rhs];
+        } else {
+            continue;
+        }
+        IndVar *iv = &ivs[nivs];
+        iv->reg = x;
+        iv->basic = nivs;
+        iv->init = phi->args[from_pre];
+        iv->scale = 1;
+        iv->step = step;
+        iv->update = update;
+        iv_of[x] = ++nivs;
+    }
+    int nbasic = nivs;
+
+    /* x * c, where x is a basic variable */
+    for (int i = 0; i < n && nbasic > 0; i++) {
+        IR *ir = &f->code[i];
+        if (!inside[i] || ir->kind != IR_MUL) {
+            continue;
+        }
+        int x = ir->lhs;
+        int c = ir->rhs;
+        if (!is_const[c]) {
+            x = ir->rhs;
+            c = ir->lhs;
+        }
+        if (!is_const[c] || !iv_of[x] || iv_of[x] > nbasic) {
+            continue;
+        }
+        IndVar *base = &ivs[iv_of[x] - 1];
+        int scale = const_val[c];
+        if (!mul_fits(base->step, scale)) {
+            continue;
+        }
+        int init = emit_op(f, pre_at, IR_MUL, base->init, emit_const(f, pre_at, scale));
+        int k = add_derived(f, iv_of[x] - 1, init, scale, 0, base->step * scale,
+                            phi_at, from_pre, from_latch);
+        replace_by_copy(ir, ivs[k].reg);
+        iv_of[ir->dst] = k + 1;
+    }
+
+    /* y + b, where y is an induction variable without an offset and b
+     * is a loop-invariant address or other non-constant value */
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (!inside[i] || ir->kind != IR_ADD) {
+            continue;
+        }
+        int y = ir->lhs;
+        int b = ir->rhs;
+        if (!iv_of[y]) {
+            y = ir->rhs;
+            b = ir->lhs;
+        }
+        if (!iv_of[y] || ivs[iv_of[y] - 1].offset || is_const[b] ||
+            def_at[b] < 0 || inside[def_at[b]]) {
+            continue;
+        }
+        IndVar *src = &ivs[iv_of[y] - 1];
+        int init = emit_op(f, pre_at, IR_ADD, b, src->init);
+        int k = add_derived(f, src->basic, init, src->scale, b, src->step,
+                            phi_at, from_pre, from_latch);
+        replace_by_copy(ir, ivs[k].reg);
+        iv_of[ir->dst] = k + 1;
+    }
+
+    /* Rewrite exit tests. x < n becomes p < n * scale + offset for a
+     * derived p with a positive scale, preferring one with an offset,
+     * which is usually a pointer the loop needs anyway. */
+    for (int i = 0; i < n; i++) {
+        int nuses = ir_uses(&f->code[i], uses);
+        for (int k = 0; k < nuses; k++) {
+            nuse[*uses[k]]++;
+        }
+        if (f->code[i].kind == IR_PHI) {
+            for (int k = 0; k < f->code[i].nargs; k++) {
+                nuse[f->code[i].args[k]]++;
+            }
+        }
+    }
+    for (int k = 0; k < nbasic; k++) {
+        IndVar *iv = &ivs[k];
+        int best = -1;
+        for (int j = nbasic; j < nivs; j++) {
+            if (ivs[j].basic == k && ivs[j].scale > 0 &&
+                (best < 0 || (ivs[j].offset && !ivs[best].offset))) {
+                best = j;
+            }
+        }
+        if (best < 0) {
+            continue;
+        }
+
+        /* Every use but the update must be a comparison with an
+         * invariant */
+        int ntests = 0;
+        for (int i = 0; i < n; i++) {
+            IR *ir = &f->code[i];
+            bool test = ir->kind == IR_EQ || ir->kind == IR_NE || ir->kind == IR_LT ||
+                        ir->kind == IR_LE || ir->kind == IR_GT || ir->kind == IR_GE;
+            if (!test || !inside[i] || ir->lhs == ir->rhs) {
+                continue;
+            }
+            int other = ir->lhs == iv->reg ? ir->rhs : ir->lhs;
+            if ((ir->lhs == iv->reg || ir->rhs == iv->reg) && def_at[other] >= 0 &&
+                !inside[def_at[other]]) {
+                ntests++;
+            }
+        }
+        if (ntests == 0 || nuse[iv->reg] != ntests + 1) {
+            continue;
+        }
+
+        IndVar *p = &ivs[best];
+        for (int i = 0; i < n; i++) {
+            IR *ir = &f->code[i];
+            bool test = ir->kind == IR_EQ || ir->kind == IR_NE || ir->kind == IR_LT ||
+                        ir->kind == IR_LE || ir->kind == IR_GT || ir->kind == IR_GE;
+            if (!test || !inside[i] || (ir->lhs != iv->reg && ir->rhs != iv->reg)) {
+                continue;
+            }
+            int *bound = ir->lhs == iv->reg ? &ir->rhs : &ir->lhs;
+            int *var = ir->lhs == iv->reg ? &ir->lhs : &ir->rhs;
+            int limit = *bound;
+            if (p->scale != 1) {
+                limit = emit_op(f, pre_at, IR_MUL, limit, emit_const(f, pre_at, p->scale));
+            }
+            if (p->offset) {
+                limit = emit_op(f, pre_at, IR_ADD, p->offset, limit);
+            }
+            *bound = limit;
+            *var = p->reg;
+        }
+    }
+
+    bool changed = nivs > nbasic;
+    if (changed) {
+        ir_insert_before(f, new_code, nnew_code);
+    }
+    for (int i = 0; i <= n; i++) {
+        free(new_code[i]);
+    }
+    free(new_code);
+    free(nnew_code);
+    free(new_code_cap);
+    free(def_at);
+    free(is_const);
+    free(const_val);
+    free(inside);
+    free(nuse);
+    free(iv_of);
+    free(ivs);
+}
+
+/* Remove header phis that only feed their own update, directly or
+ * through copies nothing reads */
+static void remove_dead_ivs(IRFunc *f, Loop *loop) {
+    BasicBlock *hb = &f->blocks[loop->header];
+    if (hb->npreds != 2) {
+        return;
+    }
+    int from_latch = hb->preds[0] == loop->preheader ? 1 : 0;
+    int n = f->ncode;
+    int *def_at = calloc(f->nreg + 1, sizeof(int));
+    int *nuse = calloc(f->nreg + 1, sizeof(int));
+    int *uses[6];
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (ir->dst) {
+            def_at[ir->dst] = i;
+        }
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            nuse[*uses[k]]++;
+        }
+        if (ir->kind == IR_PHI) {
+            for (int k = 0; k < ir->nargs; k++) {
+                nuse[ir->args[k]]++;
+            }
+        }
+    }
+
+    bool changed = false;
+    for (int i = hb->start; i < hb->end; i++) {
+        IR *phi = &f->code[i];
+        if (phi->kind != IR_PHI || phi->nargs != 2) {
+            continue;
+        }
+        int x = phi->dst;
+        int next = phi->args[from_latch];
+        int update = def_at[next];
+        int step = update;
+        if (f->code[update].kind == IR_CAST) {
+            step = def_at[f->code[update].lhs];
+            if (nuse[f->code[update].lhs] != 1) {
+                continue;
+            }
+        }
+        IR *op = &f->code[step];
+        if (nuse[next] != 1 || (op->kind != IR_ADD && op->kind != IR_SUB) ||
+            (op->lhs != x && op->rhs != x) || op->lhs == op->rhs) {
+            continue;
+        }
+
+        int dead = 1;
+        for (int j = 0; j < n; j++) {
+            IR *ir = &f->code[j];
+            if (ir->kind == IR_COPY && ir->lhs == x && nuse[ir->dst] == 0) {
+                dead++;
+            }
+        }
+        if (nuse[x] != dead) {
+            continue;
+        }
+        for (int j = 0; j < n; j++) {
+            IR *ir = &f->code[j];
+            if (ir->kind == IR_COPY && ir->lhs == x && nuse[ir->dst] == 0) {
+                ir->kind = IR_NOP;
+            }
+        }
+        phi->kind = IR_NOP;
+        f->code[update].kind = IR_NOP;
+        op->kind = IR_NOP;
+        changed = true;
+    }
+
+    if (changed) {
+        ir_remove_nops(f);
+    }
+    free(def_at);
+    free(nuse);
+}
+
+/* Strength reduction of induction variables on a function in SSA form */
+void strength_reduce(IRFunc *f) {
+    build_cfg(f);
+    if (f->nblocks == 0) {
+        return;
+    }
+    int nloops;
+    int *labels = loop_labels(f, &nloops);
+    for (int k = 0; k < nloops; k++) {
+        if (labels[k] < 0) {
+            continue;
+        }
+        Loop *all;
+        Loop *loop = find_loop(f, labels[k], &all);
+        if (loop && loop->preheader >= 0) {
+            reduce_loop(f, loop);
+        }
+        free_loops(all);
+
+        loop = find_loop(f, labels[k], &all);
+        if (loop && loop->preheader >= 0) {
+            remove_dead_ivs(f, loop);
+        }
+        free_loops(all);
+    }
+    free(labels);
+    build_cfg(f);
+}
@@ -1,6 +1,25 @@
+/* For readlink() */
+#define _DEFAULT_SOURCE
 #include "compiler.h"
 #include <unistd.h>
 
+/* The profiling runtime, which the Makefile builds next to the
+ * compiler */
+static char *runtime_object(void) {
+    char *path = calloc(1, 1024);
+    int len = readlink("/proc/self/exe", path, 1000);
+    char *slash = NULL;
+    if (len > 0) {
+        path[len] = 0;
+        slash = strrchr(path, '/');
+    }
+    if (!slash) {
+        error("cannot find the profiling runtime");
+    }
+    strcpy(slash + 1, "runtime.o");
+    return path;
+}
+
 /* Print usage */
 static void usage(void) {
     fprintf(stderr, "Usage: mycc [options] file\n");
@@ -9,7 +28,20 @@ static void usage(void) {
     fprintf(stderr, "  -S         Generate assembly only\n");
     fprintf(stderr, "  -c         Compile only (do not link)\n");
     fprintf(stderr, "  -I <dir>   Add directory to include search path\n");
+    fprintf(stderr, "  -O0 -O1 -O2 -Os  Optimization level (default -O2)\n");
+    fprintf(stderr, "  -f<pass>, -fno-<pass>  Run or skip one pass\n");
+    fprintf(stderr, "  -fpass=<p,q>  Run exactly the passes listed\n");
+    fprintf(stderr, "  -fno-gvn=f,g  Skip value numbering in functions f and g\n");
+    fprintf(stderr, "  -ffunction-sections, -fdata-sections  Put each function, or each\n");
+    fprintf(stderr, "             global, in a section of its own for the linker to drop\n");
+    fprintf(stderr, "  -fprofile-generate[=<file>]  Count how often branches, loops, cases\n");
+    fprintf(stderr, "             and calls run, adding the counts to <file> (mycc.prof) at exit\n");
+    fprintf(stderr, "  -fprofile-use[=<file>]  Optimize with the counts in <file> (mycc.prof)\n");
+    fprintf(stderr, "  -dump-ir   Print the optimized IR to stdout\n");
+    fprintf(stderr, "  -stats     Print what the optimizer removed from each function\n");
     fprintf(stderr, "  -h         Display this help\n");
+    fprintf(stderr, "Passes (and the level that turns them on):\n");
+    print_passes(stderr);
     exit(1);
 }
 
@@ -22,6 +54,17 @@ int main(int argc, char **argv) {
     char *output_file = NULL;
     bool asm_only = false;
     bool compile_only = false;
+    bool dump = false;
+    char *no_gvn = NULL;
+    bool stats = false;
+    bool function_sections = false;
+    bool data_sections = false;
+    char *profile_generate = NULL;
+    char *profile_use = NULL;
+    int opt_level = 2;
+    bool opt_size = false;
+    char **pass_flags = calloc(argc, sizeof(char *));
+    int npass_flags = 0;
     char *include_dirs[10] = {0};
     int include_dir_count = 0;
     
@@ -43,6 +86,40 @@ int main(int argc, char **argv) {
             if (include_dir_count < 10) {
                 include_dirs[include_dir_count++] = argv[++i];
             }
+        } else if (strcmp(argv[i], "-dump-ir") == 0) {
+            dump = true;
+        } else if (strncmp(argv[i], "-fno-gvn=", 9) == 0) {
+            no_gvn = argv[i] + 9;
+        } else if (strcmp(argv[i], "-ffunction-sections") == 0) {
+            function_sections = true;
+        } else if (strcmp(argv[i], "-fdata-sections") == 0) {
+            data_sections = true;
+        } else if (strcmp(argv[i], "-fprofile-generate") == 0) {
+            profile_generate = "mycc.prof";
+        } else if (strncmp(argv[i], "-fprofile-generate=", 19) == 0) {
+            profile_generate = argv[i] + 19;
+        } else if (strcmp(argv[i], "-fprofile-use") == 0) {
+            profile_use = "mycc.prof";
+        } else if (strncmp(argv[i], "-fprofile-use=", 14) == 0) {
+            profile_use = argv[i] + 14;
+        } else if (strcmp(argv[i], "-O0") == 0) {
+            opt_level = 0;
+            opt_size = false;
+        } else if (strcmp(argv[i], "-O1") == 0 || strcmp(argv[i], "-O") == 0) {
+            opt_level = 1;
+            opt_size = false;
+        } else if (strncmp(argv[i], "-O", 2) == 0 && argv[i][2] >= '2' && argv[i][2] <= '9' &&
+                   argv[i][3] == 0) {
+            opt_level = 2;
+            opt_size = false;
+        } else if (strcmp(argv[i], "-Os") == 0) {
+            opt_level = 2;
+            opt_size = true;
+        } else if (strncmp(argv[i], "-f", 2) == 0) {
+            /* Applied once the level is known, whatever the order */
+            pass_flags[npass_flags++] = argv[i];
+        } else if (strcmp(argv[i], "-stats") == 0) {
+            stats = true;
         } else if (strcmp(argv[i], "-h") == 0) {
             usage();
         } else if (argv[i][0] == '-') {
@@ -59,6 +136,33 @@ int main(int argc, char **argv) {
     /* Initialize compiler state */
     compiler_state = calloc(1, sizeof(CompilerState));
     compiler_state->current_file = input_file;
+    compiler_state->no_gvn = no_gvn;
+    compiler_state->stats = stats;
+    compiler_state->function_sections = function_sections;
+    compiler_state->data_sections = data_sections;
+    compiler_state->profile_generate = profile_generate;
+    compiler_state->profile_use = profile_use;
+    set_opt_level(opt_level, opt_size);
+    for (int i = 0; i < npass_flags; i++) {
+        char *flag = pass_flags[i];
+        bool known;
+        if (strncmp(flag, "-fpass=", 7) == 0) {
+            known = set_pass_list(flag + 7);
+        } else if (strncmp(flag, "-fno-", 5) == 0) {
+            known = set_pass(flag + 5, false);
+        } else {
+            known = set_pass(flag + 2, true);
+        }
+        if (!known) {
+            error("unknown pass in option: %s", flag);
+        }
+    }
+    /* Copies of a loop would share its counters */
+    if (profile_generate) {
+        set_pass("unroll", false);
+        set_pass("vectorize", false);
+    }
+    bool use_ir = pass_enabled(PASS_IR);
     compiler_state->include_paths = malloc(sizeof(char*) * (include_dir_count + 3));
     compiler_state->include_count = 0;
     
@@ -91,12 +195,29 @@ int main(int argc, char **argv) {
             add_type(fn->body);
         }
     }
+    if (profile_generate || profile_use) {
+        assign_counters(prog);
+    }
+    if (profile_use) {
+        read_profile();
+    }
+    fold_ast(prog);
+    if (pass_enabled(PASS_VECTORIZE)) {
+        vectorize_loops(prog);
+    }
+    if (pass_enabled(PASS_UNROLL)) {
+        unroll_loops(prog);
+    }
     
-    /* Generate IR */
-    IR *ir = gen_ir(prog);
-    
-    /* Optimize */
-    ir = optimize(ir);
+    /* Generate and optimize IR */
+    IRFunc *ir = NULL;
+    if (use_ir) {
+        ir = gen_ir(prog);
+        optimize(ir);
+        if (dump) {
+            dump_ir(ir, stdout);
+        }
+    }
     
     /* Determine output file name */
     if (!output_file) {
@@ -128,14 +249,22 @@ int main(int argc, char **argv) {
         error("cannot open output file: %s", asm_file);
     }
     
-    codegen(prog, out);
+    mark_live_symbols(prog, ir);
+    if (use_ir) {
+        codegen_ir(prog, ir, out);
+    } else {
+        codegen(prog, out);
+    }
     fclose(out);
     
     /* Assemble and link if needed */
     if (!asm_only) {
-        char cmd[1024];
+        char cmd[2048];
         if (compile_only) {
             snprintf(cmd, sizeof(cmd), "gcc -c %s -o %s", asm_file, output_file);
+        } else if (profile_generate) {
+            snprintf(cmd, sizeof(cmd), "gcc %s %s -o %s", asm_file, runtime_object(),
+                     output_file);
         } else {
             snprintf(cmd, sizeof(cmd), "gcc %s -o %s", asm_file, output_file);
         }
@@ -1,79 +1,1032 @@
 #include "compiler.h"
 
-/* Constant folding */
-static IR *constant_fold(IR *ir) {
-    IR *new_head = NULL;
-    IR *new_tail = NULL;
-    
-    for (IR *cur = ir; cur; cur = cur->next) {
-        /* Skip NOPs */
-        if (cur->kind == IR_NOP) {
-            continue;
+/* Range of an immediate */
+#define IMM_MAX 2147483647
+#define IMM_MIN (-2147483647 - 1)
+
+/* a & b, a | b or a ^ b, computed bit by bit as the compiler's own
+ * subset of C has no bitwise operators */
+static int fold_bitwise(IRKind kind, int a, int b) {
+    int result = 0;
+    int weight = 1;
+    for (int i = 0; i < 32; i++) {
+        int abit = ((a % 2) + 2) % 2;
+        int bbit = ((b % 2) + 2) % 2;
+        a = (a - abit) / 2;
+        b = (b - bbit) / 2;
+
+        int bit;
+        if (kind == IR_AND) {
+            bit = abit * bbit;
+        } else if (kind == IR_OR) {
+            bit = abit + bbit - abit * bbit;
+        } else {
+            bit = (abit + bbit) % 2;
         }
-        
-        /* Add instruction to new list */
-        if (!new_head) {
-            new_head = new_tail = cur;
+        if (i == 31) {
+            if (bit) {
+                result = result + IMM_MIN;
+            }
         } else {
-            new_tail->next = cur;
-            new_tail = cur;
+            result = result + bit * weight;
+            weight = weight * 2;
+        }
+    }
+    return result;
+}
+
+/* Does a * b fit in an immediate? */
+bool mul_fits(int a, int b) {
+    if (a == 0 || b == 0) {
+        return true;
+    }
+    if (a > 0) {
+        return b > 0 ? a <= IMM_MAX / b : b >= IMM_MIN / a;
+    }
+    return b > 0 ? a >= IMM_MIN / b : b >= IMM_MAX / a;
+}
+
+/* Evaluate a binary operation on constants into *result. Fails where the
+ * value would not fit in an immediate, since the generated code computes
+ * in 64 bits, and where the operation would trap. */
+static bool fold_binary(IRKind kind, int a, int b, int *result) {
+    switch (kind) {
+        case IR_ADD:
+            if ((b > 0 && a > IMM_MAX - b) || (b < 0 && a < IMM_MIN - b)) {
+                return false;
+            }
+            *result = a + b;
+            return true;
+        case IR_SUB:
+            if ((b < 0 && a > IMM_MAX + b) || (b > 0 && a < IMM_MIN + b)) {
+                return false;
+            }
+            *result = a - b;
+            return true;
+        case IR_MUL:
+            if (!mul_fits(a, b)) {
+                return false;
+            }
+            *result = a * b;
+            return true;
+        case IR_DIV:
+        case IR_MOD:
+            if (b == 0 || (a == IMM_MIN && b == -1)) {
+                return false;
+            }
+            *result = kind == IR_DIV ? a / b : a % b;
+            return true;
+        case IR_EQ:
+            *result = a == b;
+            return true;
+        case IR_NE:
+            *result = a != b;
+            return true;
+        case IR_LT:
+            *result = a < b;
+            return true;
+        case IR_LE:
+            *result = a <= b;
+            return true;
+        case IR_GT:
+            *result = a > b;
+            return true;
+        case IR_GE:
+            *result = a >= b;
+            return true;
+        case IR_AND:
+        case IR_OR:
+        case IR_XOR:
+            *result = fold_bitwise(kind, a, b);
+            return true;
+        case IR_SHL:
+            if (b < 0 || b > 31) {
+                return false;
+            }
+            for (int i = 0; i < b; i++) {
+                if (!mul_fits(a, 2)) {
+                    return false;
+                }
+                a = a * 2;
+            }
+            *result = a;
+            return true;
+        case IR_SHR:
+            if (b < 0 || b > 31) {
+                return false;
+            }
+            /* Arithmetic shift: halve, rounding towards minus infinity */
+            for (int i = 0; i < b; i++) {
+                if (a < 0 && a % 2 != 0) {
+                    a = a / 2 - 1;
+                } else {
+                    a = a / 2;
+                }
+            }
+            *result = a;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Value of a constant after sign extension from size bytes */
+static int fold_cast(int val, int size) {
+    if (size == 1) {
+        val = ((val % 256) + 256) % 256;
+        if (val > 127) {
+            val = val - 256;
+        }
+    }
+    return val;
+}
+
+/* Is this a binary operation on lhs and rhs? */
+static bool is_binary(IRKind kind) {
+    switch (kind) {
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_MOD:
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+        case IR_GT:
+        case IR_GE:
+        case IR_AND:
+        case IR_OR:
+        case IR_XOR:
+        case IR_SHL:
+        case IR_SHR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Can this instruction be deleted when its result is unused? */
+static bool is_pure(IRKind kind) {
+    return is_binary(kind) || kind == IR_MOV || kind == IR_COPY ||
+           kind == IR_ADDR || kind == IR_CAST || kind == IR_PHI;
+}
+
+/* Turn ir into dst = imm */
+static void make_mov(IR *ir, int imm) {
+    ir->kind = IR_MOV;
+    ir->imm = imm;
+    ir->lhs = 0;
+    ir->rhs = 0;
+    ir->nargs = 0;
+}
+
+/* Turn ir into dst = src */
+static void make_copy(IR *ir, int src) {
+    ir->kind = IR_COPY;
+    ir->lhs = src;
+    ir->rhs = 0;
+    ir->nargs = 0;
+}
+
+/* Simplify an operation with one constant operand, e.g. x + 0 or x * 1.
+ * Returns true if ir was changed. */
+static bool simplify(IR *ir, bool *known, int *val) {
+    int l = ir->lhs;
+    int r = ir->rhs;
+    bool lk = known[l];
+    bool rk = known[r];
+
+    switch (ir->kind) {
+        case IR_ADD:
+        case IR_OR:
+        case IR_XOR:
+            if (rk && val[r] == 0) {
+                make_copy(ir, l);
+                return true;
+            }
+            if (lk && val[l] == 0) {
+                make_copy(ir, r);
+                return true;
+            }
+            return false;
+        case IR_SUB:
+        case IR_SHL:
+        case IR_SHR:
+            if (rk && val[r] == 0) {
+                make_copy(ir, l);
+                return true;
+            }
+            if (ir->kind == IR_SUB && l == r) {
+                make_mov(ir, 0);
+                return true;
+            }
+            return false;
+        case IR_MUL:
+            if ((rk && val[r] == 0) || (lk && val[l] == 0)) {
+                make_mov(ir, 0);
+                return true;
+            }
+            if (rk && val[r] == 1) {
+                make_copy(ir, l);
+                return true;
+            }
+            if (lk && val[l] == 1) {
+                make_copy(ir, r);
+                return true;
+            }
+            return false;
+        case IR_DIV:
+            if (rk && val[r] == 1) {
+                make_copy(ir, l);
+                return true;
+            }
+            return false;
+        case IR_MOD:
+            if (rk && (val[r] == 1 || val[r] == -1)) {
+                make_mov(ir, 0);
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+/* Constant folding and propagation over a function in SSA form, where
+ * every register has a single definition. A register defined by an
+ * IR_MOV has a known value; operations whose operands are all known are
+ * replaced by an IR_MOV of the result, which in turn makes their users
+ * foldable. Copies are then propagated into their uses, and definitions
+ * left without uses are deleted. */
+static void constant_fold(IRFunc *f) {
+    int nreg = f->nreg;
+    bool *known = calloc(nreg, sizeof(bool));
+    int *val = calloc(nreg, sizeof(int));
+
+    /* Definitions may follow their uses in the instruction order (e.g.
+     * phis at loop headers), so repeat until nothing changes */
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < f->ncode; i++) {
+            IR *ir = &f->code[i];
+            int result;
+
+            if (is_binary(ir->kind)) {
+                if (known[ir->lhs] && known[ir->rhs] &&
+                    fold_binary(ir->kind, val[ir->lhs], val[ir->rhs], &result)) {
+                    make_mov(ir, result);
+                } else if (simplify(ir, known, val)) {
+                    changed = true;
+                }
+            } else if (ir->kind == IR_CAST && known[ir->lhs]) {
+                make_mov(ir, fold_cast(val[ir->lhs], ir->size));
+            } else if (ir->kind == IR_COPY && known[ir->lhs]) {
+                make_mov(ir, val[ir->lhs]);
+            } else if (ir->kind == IR_PHI) {
+                /* A phi whose operands all agree is that operand. Operands
+                 * naming the phi itself come round a loop unchanged. */
+                int same = 0;
+                bool agree = true;
+                for (int k = 0; k < ir->nargs && agree; k++) {
+                    int a = ir->args[k];
+                    if (a == ir->dst || a == same) {
+                        continue;
+                    }
+                    if (same == 0) {
+                        same = a;
+                    } else if (!known[a] || !known[same] || val[a] != val[same]) {
+                        agree = false;
+                    }
+                }
+                if (agree && same) {
+                    if (known[same]) {
+                        make_mov(ir, val[same]);
+                    } else {
+                        make_copy(ir, same);
+                        changed = true;
+                    }
+                }
+            }
+
+            if (ir->kind == IR_MOV && ir->dst && !known[ir->dst]) {
+                known[ir->dst] = true;
+                val[ir->dst] = ir->imm;
+                changed = true;
+            }
+        }
+    }
+
+    /* Copy propagation: replace each use of a copy with its source */
+    int *alias = calloc(nreg, sizeof(int));
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind == IR_COPY) {
+            alias[ir->dst] = ir->lhs;
+        }
+    }
+    int *uses[6];
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            while (alias[*uses[k]]) {
+                *uses[k] = alias[*uses[k]];
+            }
+        }
+        if (ir->kind == IR_PHI) {
+            for (int k = 0; k < ir->nargs; k++) {
+                while (alias[ir->args[k]]) {
+                    ir->args[k] = alias[ir->args[k]];
+                }
+            }
+        }
+    }
+
+    /* Delete definitions that are no longer used */
+    int *nuse = calloc(nreg, sizeof(int));
+    int *def_at = calloc(nreg, sizeof(int));
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            nuse[*uses[k]]++;
+        }
+        if (ir->kind == IR_PHI) {
+            for (int k = 0; k < ir->nargs; k++) {
+                nuse[ir->args[k]]++;
+            }
+        }
+        if (ir->dst) {
+            def_at[ir->dst] = i;
+        }
+    }
+    int *work = calloc(nreg + 1, sizeof(int));
+    int nwork = 0;
+    for (int r = 1; r < nreg; r++) {
+        if (nuse[r] == 0) {
+            work[nwork++] = r;
+        }
+    }
+    while (nwork > 0) {
+        int r = work[--nwork];
+        IR *ir = &f->code[def_at[r]];
+        if (ir->dst != r || !is_pure(ir->kind)) {
+            continue;
+        }
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            nuse[*uses[k]]--;
+            if (nuse[*uses[k]] == 0) {
+                work[nwork++] = *uses[k];
+            }
+        }
+        if (ir->kind == IR_PHI) {
+            for (int k = 0; k < ir->nargs; k++) {
+                nuse[ir->args[k]]--;
+                if (nuse[ir->args[k]] == 0) {
+                    work[nwork++] = ir->args[k];
+                }
+            }
+        }
+        ir->kind = IR_NOP;
+        ir->dst = 0;
+    }
+
+    ir_remove_nops(f);
+
+    free(known);
+    free(val);
+    free(alias);
+    free(nuse);
+    free(def_at);
+    free(work);
+}
+
+/* Lattice values of sparse conditional constant propagation */
+#define LAT_TOP 0      /* No value seen yet */
+#define LAT_CONST 1    /* A single known value */
+#define LAT_BOTTOM 2   /* Not constant */
+
+static IRFunc *sccp_func;
+static int *lat;           /* Lattice value of each register */
+static int *lat_val;       /* Value of constant registers */
+static bool *block_exec;   /* Block known to be reachable */
+static int *edge_base;     /* Index of the first successor edge of each block */
+static int *edge_to;       /* Block each edge leads to */
+static bool *edge_exec;    /* Edge b -> succs[k] at index edge_base[b] + k */
+static int *block_of;      /* Block of each instruction */
+static int *flow_work;     /* Pending edges, by index */
+static int nflow;
+static int *ssa_work;      /* Registers whose value was lowered */
+static int nssa;
+
+/* Lower register r to the given lattice value */
+static void lower(int r, int state, int v) {
+    if (lat[r] == LAT_BOTTOM || (lat[r] == state && (state != LAT_CONST || lat_val[r] == v))) {
+        return;
+    }
+    if (lat[r] == LAT_CONST && state == LAT_CONST) {
+        state = LAT_BOTTOM;
+    }
+    lat[r] = state;
+    lat_val[r] = v;
+    ssa_work[nssa++] = r;
+}
+
+/* Mark the k-th successor edge of block b reachable */
+static void mark_edge(int b, int k) {
+    int e = edge_base[b] + k;
+    if (!edge_exec[e]) {
+        edge_exec[e] = true;
+        flow_work[nflow++] = e;
+    }
+}
+
+/* Mark the edge from block b to the block starting with label */
+static void mark_edge_to_label(int b, int label) {
+    BasicBlock *bb = &sccp_func->blocks[b];
+    for (int k = 0; k < bb->nsuccs; k++) {
+        IR *first = &sccp_func->code[sccp_func->blocks[bb->succs[k]].start];
+        if (first->kind == IR_LABEL && first->imm == label) {
+            mark_edge(b, k);
+        }
+    }
+}
+
+/* Mark the fall-through edge of block b */
+static void mark_fallthrough(int b) {
+    BasicBlock *bb = &sccp_func->blocks[b];
+    for (int k = 0; k < bb->nsuccs; k++) {
+        if (bb->succs[k] == b + 1) {
+            mark_edge(b, k);
+        }
+    }
+}
+
+/* Is the edge from block p into block s reachable? */
+static bool edge_reachable(int p, int s) {
+    BasicBlock *pb = &sccp_func->blocks[p];
+    for (int k = 0; k < pb->nsuccs; k++) {
+        if (pb->succs[k] == s && edge_exec[edge_base[p] + k]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Label a switch jumps to when its index is v */
+static int switch_target(IR *ir, int v) {
+    if (v >= 0 && v < ir->nargs) {
+        return ir->args[v];
+    }
+    return ir->imm;
+}
+
+/* Evaluate instruction i over the lattice */
+static void visit(int i) {
+    IR *ir = &sccp_func->code[i];
+    int b = block_of[i];
+    int result;
+
+    switch (ir->kind) {
+        case IR_MOV:
+            lower(ir->dst, LAT_CONST, ir->imm);
+            return;
+        case IR_COPY:
+            if (lat[ir->lhs] != LAT_TOP) {
+                lower(ir->dst, lat[ir->lhs], lat_val[ir->lhs]);
+            }
+            return;
+        case IR_CAST:
+            if (lat[ir->lhs] == LAT_CONST) {
+                lower(ir->dst, LAT_CONST, fold_cast(lat_val[ir->lhs], ir->size));
+            } else if (lat[ir->lhs] == LAT_BOTTOM) {
+                lower(ir->dst, LAT_BOTTOM, 0);
+            }
+            return;
+        case IR_PHI: {
+            /* Meet of the operands on reachable incoming edges */
+            BasicBlock *bb = &sccp_func->blocks[b];
+            for (int k = 0; k < ir->nargs; k++) {
+                int a = ir->args[k];
+                if (edge_reachable(bb->preds[k], b) && lat[a] != LAT_TOP) {
+                    lower(ir->dst, lat[a], lat_val[a]);
+                }
+            }
+            return;
+        }
+        case IR_JMP:
+            mark_edge_to_label(b, ir->imm);
+            return;
+        case IR_JZ:
+        case IR_JNZ: {
+            int c = lat[ir->lhs];
+            if (c == LAT_TOP) {
+                return;
+            }
+            bool taken = (lat_val[ir->lhs] == 0) == (ir->kind == IR_JZ);
+            if (c == LAT_BOTTOM || taken) {
+                mark_edge_to_label(b, ir->imm);
+            }
+            if (c == LAT_BOTTOM || !taken) {
+                mark_fallthrough(b);
+            }
+            return;
+        }
+        case IR_SWITCH: {
+            int c = lat[ir->lhs];
+            if (c == LAT_TOP) {
+                return;
+            }
+            if (c == LAT_CONST) {
+                mark_edge_to_label(b, switch_target(ir, lat_val[ir->lhs]));
+                return;
+            }
+            for (int k = 0; k < sccp_func->blocks[b].nsuccs; k++) {
+                mark_edge(b, k);
+            }
+            return;
+        }
+        case IR_RET:
+        case IR_STORE:
+        case IR_LABEL:
+        case IR_NOP:
+            return;
+        default:
+            break;
+    }
+
+    if (is_binary(ir->kind)) {
+        int l = lat[ir->lhs];
+        int r = lat[ir->rhs];
+        if (l == LAT_TOP || r == LAT_TOP) {
+            return;
+        }
+        if (l == LAT_CONST && r == LAT_CONST &&
+            fold_binary(ir->kind, lat_val[ir->lhs], lat_val[ir->rhs], &result)) {
+            lower(ir->dst, LAT_CONST, result);
+            return;
         }
-        new_tail->next = NULL;
     }
-    
-    if (new_head) {
-        return new_head;
-    } else {
-        return ir;
+    if (ir->dst) {
+        lower(ir->dst, LAT_BOTTOM, 0);
     }
 }
 
+/* Does a phi follow the label at code[i]? */
+static bool label_has_phi(IRFunc *f, int i) {
+    for (int k = i + 1; k < f->ncode; k++) {
+        IRKind kind = f->code[k].kind;
+        if (kind == IR_PHI) {
+            return true;
+        }
+        if (kind != IR_NOP) {
+            return false;
+        }
+    }
+    return false;
+}
+
+/* Sparse conditional constant propagation (Wegman and Zadeck) on SSA
+ * form. Registers start out unknown and are only evaluated in blocks
+ * found to be reachable, so constants flowing around loops and into
+ * branches are discovered together. Conditional jumps on constants
+ * become unconditional and blocks never reached are deleted. */
+static void sccp(IRFunc *f) {
+    build_cfg(f);
+    int nb = f->nblocks;
+    int n = f->ncode;
+    int nreg = f->nreg;
+    if (nb == 0) {
+        return;
+    }
+
+    sccp_func = f;
+    lat = calloc(nreg, sizeof(int));
+    lat_val = calloc(nreg, sizeof(int));
+    block_exec = calloc(nb, sizeof(bool));
+    edge_base = calloc(nb + 1, sizeof(int));
+    for (int b = 0; b < nb; b++) {
+        edge_base[b + 1] = edge_base[b] + f->blocks[b].nsuccs;
+    }
+    int nedges = edge_base[nb];
+    edge_to = calloc(nedges + 1, sizeof(int));
+    for (int b = 0; b < nb; b++) {
+        for (int k = 0; k < f->blocks[b].nsuccs; k++) {
+            edge_to[edge_base[b] + k] = f->blocks[b].succs[k];
+        }
+    }
+    edge_exec = calloc(nedges + 1, sizeof(bool));
+    block_of = calloc(n + 1, sizeof(int));
+    flow_work = calloc(nedges + 1, sizeof(int));
+    nflow = 0;
+    ssa_work = calloc(nreg * 2 + 1, sizeof(int));
+    nssa = 0;
+
+    for (int b = 0; b < nb; b++) {
+        for (int i = f->blocks[b].start; i < f->blocks[b].end; i++) {
+            block_of[i] = b;
+        }
+    }
+
+    /* Instructions using each register, grouped by register */
+    int *count = calloc(nreg + 1, sizeof(int));
+    int *uses[6];
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            count[*uses[k] + 1]++;
+        }
+        for (int k = 0; ir->kind == IR_PHI && k < ir->nargs; k++) {
+            count[ir->args[k] + 1]++;
+        }
+    }
+    for (int r = 0; r < nreg; r++) {
+        count[r + 1] = count[r + 1] + count[r];
+    }
+    int *user = calloc(count[nreg] + 1, sizeof(int));
+    int *fill = calloc(nreg + 1, sizeof(int));
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            int r = *uses[k];
+            user[count[r] + fill[r]++] = i;
+        }
+        for (int k = 0; ir->kind == IR_PHI && k < ir->nargs; k++) {
+            int r = ir->args[k];
+            user[count[r] + fill[r]++] = i;
+        }
+    }
+
+    /* Visit the entry block, then follow reachable edges and lowered
+     * registers until neither has pending work */
+    int pending_block = f->rpo[0];
+    while (pending_block >= 0 || nflow > 0 || nssa > 0) {
+        int b = -1;
+        if (pending_block >= 0) {
+            b = pending_block;
+            pending_block = -1;
+        } else if (nflow > 0) {
+            b = edge_to[flow_work[--nflow]];
+            if (block_exec[b]) {
+                /* Another way into a reachable block: only its phis can
+                 * change */
+                for (int i = f->blocks[b].start; i < f->blocks[b].end; i++) {
+                    if (f->code[i].kind == IR_PHI) {
+                        visit(i);
+                    }
+                }
+                continue;
+            }
+        }
+
+        if (b >= 0) {
+            block_exec[b] = true;
+            BasicBlock *bb = &f->blocks[b];
+            IR *last = &f->code[bb->end - 1];
+            for (int i = bb->start; i < bb->end; i++) {
+                visit(i);
+            }
+            if (last->kind != IR_JMP && last->kind != IR_JZ && last->kind != IR_JNZ &&
+                last->kind != IR_RET && last->kind != IR_SWITCH) {
+                mark_fallthrough(b);
+            }
+            continue;
+        }
+
+        int r = ssa_work[--nssa];
+        for (int k = count[r]; k < count[r + 1]; k++) {
+            if (block_exec[block_of[user[k]]]) {
+                visit(user[k]);
+            }
+        }
+    }
+
+    /* Drop phi operands of unreachable edges */
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind != IR_PHI || !block_exec[block_of[i]]) {
+            continue;
+        }
+        BasicBlock *bb = &f->blocks[block_of[i]];
+        int m = 0;
+        for (int k = 0; k < ir->nargs; k++) {
+            if (edge_reachable(bb->preds[k], block_of[i])) {
+                ir->args[m++] = ir->args[k];
+            }
+        }
+        ir->nargs = m;
+    }
+
+    /* Constant results become immediates, decided branches become
+     * unconditional, and unreachable blocks go away */
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (!block_exec[block_of[i]]) {
+            ir->kind = IR_NOP;
+            continue;
+        }
+        if (ir->dst && lat[ir->dst] == LAT_CONST && is_pure(ir->kind)) {
+            make_mov(ir, lat_val[ir->dst]);
+        } else if ((ir->kind == IR_JZ || ir->kind == IR_JNZ) && lat[ir->lhs] == LAT_CONST) {
+            bool taken = (lat_val[ir->lhs] == 0) == (ir->kind == IR_JZ);
+            if (taken) {
+                ir->kind = IR_JMP;
+                ir->lhs = 0;
+            } else {
+                ir->kind = IR_NOP;
+            }
+        } else if (ir->kind == IR_SWITCH && lat[ir->lhs] == LAT_CONST) {
+            ir->imm = switch_target(ir, lat_val[ir->lhs]);
+            ir->kind = IR_JMP;
+            ir->lhs = 0;
+        }
+    }
+
+    /* A jump to the label that follows it is now common. Falling through
+     * other labels on the way gives their blocks a new predecessor, and
+     * the target one fewer, which the phis of either would not match. */
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind != IR_JMP) {
+            continue;
+        }
+        bool crossed = false;
+        for (int k = i + 1; k < n; k++) {
+            IR *next = &f->code[k];
+            if (next->kind == IR_LABEL && next->imm == ir->imm) {
+                if (!crossed || !label_has_phi(f, k)) {
+                    ir->kind = IR_NOP;
+                }
+                break;
+            }
+            if (next->kind == IR_LABEL && label_has_phi(f, k)) {
+                break;
+            }
+            if (next->kind != IR_NOP && next->kind != IR_LABEL) {
+                break;
+            }
+            crossed = crossed || next->kind == IR_LABEL;
+        }
+    }
+
+    ir_remove_nops(f);
+    build_cfg(f);
+
+    free(lat);
+    free(lat_val);
+    free(block_exec);
+    free(edge_base);
+    free(edge_to);
+    free(edge_exec);
+    free(block_of);
+    free(flow_work);
+    free(ssa_work);
+    free(count);
+    free(user);
+    free(fill);
+}
+
 /* Dead code elimination */
-static IR *eliminate_dead_code(IR *ir) {
-    /* Simple implementation - just remove unreachable code after returns */
-    IR *new_head = NULL;
-    IR *new_tail = NULL;
-    bool skip = false;
-    
-    for (IR *cur = ir; cur; cur = cur->next) {
-        if (cur->kind == IR_LABEL) {
-            skip = false;
-        }
-        
-        if (skip) {
+static void eliminate_dead_code(IRFunc *f) {
+    /* Remove blocks that cannot be reached from the entry */
+    build_cfg(f);
+    int n = 0;
+
+    for (int b = 0; b < f->nblocks; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        if (bb->rpo < 0) {
             continue;
         }
-        
-        /* Add instruction to new list */
-        if (!new_head) {
-            new_head = new_tail = cur;
-        } else {
-            new_tail->next = cur;
-            new_tail = cur;
+
+        /* Keep the block, compacting the buffer in place */
+        for (int i = bb->start; i < bb->end; i++) {
+            if (n != i) {
+                memcpy(&f->code[n], &f->code[i], sizeof(IR));
+            }
+            n++;
+        }
+    }
+
+    f->ncode = n;
+    build_cfg(f);
+}
+
+/* Is value numbering enabled for f? */
+static bool gvn_enabled(IRFunc *f) {
+    char *list = compiler_state->no_gvn;
+    if (!pass_enabled(PASS_GVN)) {
+        return false;
+    }
+    if (!list) {
+        return true;
+    }
+    int len = strlen(f->fn->name);
+    for (char *p = list; *p; ) {
+        char *end = strchr(p, ',');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        if (end - p == len && strncmp(p, f->fn->name, len) == 0) {
+            return false;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+/* Main optimization function: run the enabled passes in order */
+void optimize(IRFunc *fns) {
+    if (pass_enabled(PASS_INLINE)) {
+        inline_functions(fns);
+    }
+    for (IRFunc *f = fns; f; f = f->next) {
+        bool tail = pass_enabled(PASS_TAILCALL);
+        bool dead = pass_enabled(PASS_DCE);
+        bool fold = pass_enabled(PASS_CONSTPROP);
+        bool ssa = pass_enabled(PASS_SSA);
+        if (tail) {
+            tail_recursion(f);
+        }
+        if (dead || ssa) {
+            eliminate_dead_code(f);
+        }
+        if (dead) {
+            dce(f);
+        }
+        if (ssa) {
+            insert_preheaders(f);
+            to_ssa(f);
+            if (pass_enabled(PASS_SCCP)) {
+                sccp(f);
+            }
+            if (gvn_enabled(f)) {
+                gvn(f);
+            }
+            if (pass_enabled(PASS_LOAD_ELIM)) {
+                load_elim(f);
+            }
+            if (pass_enabled(PASS_LICM)) {
+                licm(f);
+            }
+            if (fold) {
+                constant_fold(f);
+            }
+            if (pass_enabled(PASS_STRENGTH_REDUCE)) {
+                strength_reduce(f);
+                if (fold) {
+                    constant_fold(f);
+                }
+            }
+            from_ssa(f);
+            if (dead) {
+                dce(f);
+            }
         }
-        new_tail->next = NULL;
-        
-        if (cur->kind == IR_RET || cur->kind == IR_JMP) {
-            skip = true;
+        if (tail) {
+            mark_tail_calls(f);
         }
+        if (compiler_state->stats) {
+            fprintf(stderr, "%s: %d dead instructions, %d dead stores, %d loads removed\n",
+                    f->fn->name, f->dead_code, f->dead_stores, f->loads_removed);
+        }
+    }
+}
+
+/* IR operation computing a binary AST node, or IR_NOP */
+static IRKind ast_op(NodeKind kind) {
+    switch (kind) {
+        case ND_ADD: return IR_ADD;
+        case ND_SUB: return IR_SUB;
+        case ND_MUL: return IR_MUL;
+        case ND_DIV: return IR_DIV;
+        case ND_MOD: return IR_MOD;
+        case ND_EQ: return IR_EQ;
+        case ND_NE: return IR_NE;
+        case ND_LT: return IR_LT;
+        case ND_LE: return IR_LE;
+        case ND_GT: return IR_GT;
+        case ND_GE: return IR_GE;
+        case ND_AND: return IR_AND;
+        case ND_OR: return IR_OR;
+        case ND_XOR: return IR_XOR;
+        case ND_SHL: return IR_SHL;
+        case ND_SHR: return IR_SHR;
+        default: return IR_NOP;
+    }
+}
+
+/* Turn node into the integer constant val */
+static void make_num(ASTNode *node, int val) {
+    node->kind = ND_NUM;
+    node->val = val;
+    node->lhs = NULL;
+    node->rhs = NULL;
+}
+
+/* Fold the constant subexpressions of an AST, innermost first, so that
+ * both code generators see a single ND_NUM */
+static void fold_node(ASTNode *node) {
+    if (!node) {
+        return;
+    }
+
+    fold_node(node->lhs);
+    fold_node(node->rhs);
+    fold_node(node->cond);
+    fold_node(node->then);
+    fold_node(node->els);
+    fold_node(node->init);
+    fold_node(node->inc);
+    for (ASTNode *n = node->body; n; n = n->next) {
+        fold_node(n);
     }
-    
-    if (new_head) {
-        return new_head;
-    } else {
-        return ir;
+    for (ASTNode *n = node->args; n; n = n->next) {
+        fold_node(n);
+    }
+
+    ASTNode *lhs = node->lhs;
+    ASTNode *rhs = node->rhs;
+    int result;
+    IRKind op = ast_op(node->kind);
+    if (op != IR_NOP) {
+        if (lhs->kind == ND_NUM && rhs->kind == ND_NUM &&
+            fold_binary(op, lhs->val, rhs->val, &result)) {
+            make_num(node, result);
+        }
+        return;
+    }
+
+    switch (node->kind) {
+        /* A constant left side that decides the result means the right
+         * side is never evaluated */
+        case ND_LAND:
+            if (lhs->kind == ND_NUM && (lhs->val == 0 || rhs->kind == ND_NUM)) {
+                make_num(node, lhs->val != 0 && rhs->val != 0);
+            }
+            return;
+        case ND_LOR:
+            if (lhs->kind == ND_NUM && (lhs->val != 0 || rhs->kind == ND_NUM)) {
+                make_num(node, lhs->val != 0 || rhs->val != 0);
+            }
+            return;
+        case ND_LNOT:
+            if (lhs->kind == ND_NUM) {
+                make_num(node, lhs->val == 0);
+            }
+            return;
+        case ND_NOT:
+            if (lhs->kind == ND_NUM) {
+                make_num(node, -1 - lhs->val);
+            }
+            return;
+        case ND_CAST:
+            if (lhs->kind == ND_NUM && node->ty &&
+                (node->ty->kind == TY_INT || node->ty->kind == TY_CHAR)) {
+                make_num(node, fold_cast(lhs->val, node->ty->size));
+            }
+            return;
+        case ND_COND:
+            /* Keep only the arm that is taken */
+            if (node->cond->kind == ND_NUM) {
+                Type *ty = node->ty;
+                ASTNode *next = node->next;
+                ASTNode *arm = node->cond->val ? node->then : node->els;
+                memcpy(node, arm, sizeof(ASTNode));
+                node->next = next;
+                if (ty) {
+                    node->ty = ty;
+                }
+            }
+            return;
+        default:
+            return;
     }
 }
 
-/* Main optimization function */
-IR *optimize(IR *ir) {
-    if (!ir) {
-        return ir;
+/* Fold the constants in an initializer */
+static void fold_init(Initializer *init) {
+    for (; init; init = init->next) {
+        if (init->is_expr) {
+            fold_node(init->expr);
+        }
+        fold_init(init->children);
+    }
+}
+
+/* Fold constant expressions in every function body and global
+ * initializer */
+void fold_ast(Symbol *prog) {
+    for (Symbol *sym = prog; sym; sym = sym->next) {
+        if (sym->is_function && sym->body) {
+            fold_node(sym->body);
+        }
+        if (!sym->is_function && sym->init) {
+            fold_init(sym->init);
+        }
     }
-    
-    /* Apply optimization passes */
-    ir = constant_fold(ir);
-    ir = eliminate_dead_code(ir);
-    
-    return ir;
 }
@@ -46,6 +46,7 @@ typedef struct {
     bool is_typedef;
     bool is_static;
     bool is_extern;
+    bool is_inline;
 } DeclSpec;
 
 static DeclSpec *declspec(Token **rest, Token *tok);
@@ -676,6 +677,7 @@ static ASTNode *stmt(Token **rest, Token *tok) {
     /* While statement */
     if (tok->kind == TK_WHILE) {
         ASTNode *node = new_node(ND_WHILE);
+        node->unroll = tok->unroll;
         tok = skip(tok->next, "(");
         node->cond = expr(&tok, tok);
         tok = skip(tok, ")");
@@ -705,6 +707,7 @@ static ASTNode *stmt(Token **rest, Token *tok) {
     /* For statement */
     if (tok->kind == TK_FOR) {
         ASTNode *node = new_node(ND_FOR);
+        node->unroll = tok->unroll;
         tok = skip(tok->next, "(");
         
         /* Check if init is a declaration (C99 style) */
@@ -839,7 +842,7 @@ static ASTNode *stmt(Token **rest, Token *tok) {
     /* Default statement */
     if (tok->kind == TK_DEFAULT) {
         ASTNode *node = new_node(ND_CASE);
-        node->val = -1;  /* Special value for default */
+        node->is_default = true;
         tok = skip(tok->next, ":");
         node->lhs = stmt(&tok, tok);
         *rest = tok;
@@ -1198,6 +1201,12 @@ static DeclSpec *declspec(Token **rest, Token *tok) {
             tok = tok->next;
             continue;
         }
+        if (tok->kind == TK_INLINE) {
+            /* Only a hint to the inliner */
+            spec->is_inline = true;
+            tok = tok->next;
+            continue;
+        }
         if (tok->kind == TK_CONST) {
             /* Ignore const for now */
             tok = tok->next;
@@ -1247,12 +1256,7 @@ static DeclSpec *declspec(Token **rest, Token *tok) {
                 
                 /* Check for explicit value */
                 if (equal(tok, "=")) {
-                    tok = tok->next;
-                    if (tok->kind != TK_NUM) {
-                        error_tok(tok, "expected number in enum");
-                    }
-                    val = tok->val;
-                    tok = tok->next;
+                    val = eval_const_expr(conditional(&tok, tok->next));
                 }
                 
                 /* Create enum constant with current value */
@@ -1381,10 +1385,16 @@ static DeclSpec *declspec(Token **rest, Token *tok) {
 
 /* Parse declarator */
 static Type *declarator(Token **rest, Token *tok, Type *ty) {
-    /* Pointer */
+    /* Pointer, with its qualifiers */
     while (equal(tok, "*")) {
         ty = pointer_to(ty);
         tok = tok->next;
+        while (tok->kind == TK_CONST || tok->kind == TK_RESTRICT) {
+            if (tok->kind == TK_RESTRICT) {
+                ty->is_restrict = true;
+            }
+            tok = tok->next;
+        }
     }
     
     /* Identifier (we don't actually consume it here, just skip past it) */
@@ -1477,6 +1487,7 @@ static Symbol *function(Token **rest, Token *tok) {
     fn->is_function = true;
     fn->is_static = spec->is_static;
     fn->is_extern = spec->is_extern;
+    fn->is_inline = spec->is_inline;
     tok = tok->next;
     
     parse_params(&tok, tok, fn);
@@ -1512,7 +1523,8 @@ static Symbol *function(Token **rest, Token *tok) {
 static bool is_function(Token *tok) {
     /* Skip storage class specifiers and type qualifiers */
     while (tok->kind == TK_TYPEDEF || tok->kind == TK_STATIC || 
-           tok->kind == TK_EXTERN || tok->kind == TK_CONST) {
+           tok->kind == TK_EXTERN || tok->kind == TK_CONST ||
+           tok->kind == TK_INLINE) {
         tok = tok->next;
     }
     
@@ -1557,7 +1569,7 @@ static bool is_function(Token *tok) {
     }
     
     /* Skip pointers */
-    while (equal(tok, "*")) {
+    while (equal(tok, "*") || tok->kind == TK_CONST || tok->kind == TK_RESTRICT) {
         tok = tok->next;
     }
     
@@ -0,0 +1,113 @@
+#include "compiler.h"
+
+/* The pass manager: which optimization passes run, by name.
+ *
+ * Each pass has the lowest optimization level that turns it on. -O0 runs
+ * nothing, not even IR construction: the AST is compiled directly, for
+ * the fastest turnaround. -O1 adds the IR with the cheap passes, -O2 (the
+ * default) every pass, and -Os every pass that does not grow the code.
+ * -f<pass> and -fno-<pass> then turn single passes on and off, and
+ * -fpass=<list> runs exactly the passes listed. Passes on the SSA form
+ * run only when ssa does. */
+
+static char *pass_names[] = {
+    "ir", "inline", "tailcall", "dce", "ssa", "sccp", "gvn", "load-elim", "licm",
+    "constprop", "strength-reduce", "unroll", "vectorize", "mem2reg",
+    "dead-symbols", "div-const", "peephole"
+};
+
+static char *pass_help[] = {
+    "Build and optimize the IR (the AST is compiled directly without it)",
+    "Inline small functions",
+    "Turn tail recursion into loops and make tail calls as jumps",
+    "Remove unused computations and dead stores",
+    "Promote locals to registers through SSA form",
+    "Propagate constants through conditional jumps",
+    "Global value numbering",
+    "Forward stored values to loads and remove redundant loads",
+    "Hoist loop-invariant code",
+    "Fold and propagate constants and copies",
+    "Strength-reduce induction variables",
+    "Unroll counted loops",
+    "Vectorize loops over arrays with SSE2",
+    "Keep locals in registers when the AST is compiled directly",
+    "Drop static functions, static data and strings nothing uses",
+    "Divide by constants with shifts and multiplies instead of idiv",
+    "Optimize the generated assembly"
+};
+
+/* Lowest level that runs each pass */
+static int pass_levels[] = {1, 2, 1, 1, 1, 1, 2, 2, 2, 1, 2, 2, 2, 1, 1, 1, 1};
+
+/* Passes left out at -Os because they grow the code */
+static bool pass_grows[] = {
+    false, false, false, false, false, false, false, false, false,
+    false, false, true, true, false, false, true, false
+};
+
+/* Turn on the passes of an optimization level: 0 to 2, with size set
+ * for -Os */
+void set_opt_level(int level, bool size) {
+    if (!compiler_state->passes) {
+        compiler_state->passes = calloc(NUM_PASSES, sizeof(bool));
+    }
+    for (int i = 0; i < NUM_PASSES; i++) {
+        compiler_state->passes[i] = level >= pass_levels[i] && !(size && pass_grows[i]);
+    }
+}
+
+/* The pass named by the first len characters of name, or -1 */
+static int find_pass(char *name, int len) {
+    for (int i = 0; i < NUM_PASSES; i++) {
+        int n = strlen(pass_names[i]);
+        if (n == len && strncmp(pass_names[i], name, len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Turn the named pass on or off; false if there is no such pass */
+bool set_pass(char *name, bool on) {
+    int pass = find_pass(name, strlen(name));
+    if (pass < 0) {
+        return false;
+    }
+    compiler_state->passes[pass] = on;
+    return true;
+}
+
+/* Run exactly the passes in a comma-separated list; false if one of them
+ * does not exist */
+bool set_pass_list(char *list) {
+    for (int i = 0; i < NUM_PASSES; i++) {
+        compiler_state->passes[i] = false;
+    }
+    for (char *p = list; *p; ) {
+        char *end = strchr(p, ',');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        if (end > p) {
+            int pass = find_pass(p, end - p);
+            if (pass < 0) {
+                return false;
+            }
+            compiler_state->passes[pass] = true;
+        }
+        p = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+/* Does the pass run? */
+bool pass_enabled(PassKind pass) {
+    return compiler_state->passes[pass];
+}
+
+/* List the passes for the usage message */
+void print_passes(FILE *out) {
+    for (int i = 0; i < NUM_PASSES; i++) {
+        fprintf(out, "    %-16s %s (-O%d)\n", pass_names[i], pass_help[i], pass_levels[i]);
+    }
+}
@@ -0,0 +1,1029 @@
+#include "compiler.h"
+
+/* Peephole optimization of the generated assembly. The code generators
+ * append their output here line by line; at the end of each function the
+ * lines are parsed into mnemonic and operands, rewritten with the rules
+ * below, and written out.
+ *
+ * A rule is a window of consecutive instructions, its replacement, and
+ * conditions. Patterns bind $a..$z to whole operands or to the rest of a
+ * mnemonic (set$c matches sete with c = e); a replacement writes !$c for
+ * the opposite condition code. A rule whose replacement no longer writes
+ * a register or the flags the window wrote requires them to be dead,
+ * which is checked by scanning forward along every path from the window
+ * until each is overwritten. Rules never move code across a label, so
+ * push and pop pairs they remove are adjacent and the stack depth at
+ * every call is unchanged. */
+
+static char *peep_rules[] = {
+    /* A value pushed and popped straight back */
+    "push $a", "pop $a", "->", ";",
+    "push $a", "pop $b", "->", "mov $b, $a", "if reg $b", ";",
+    "mov $a, $a", "->", "if reg $a", ";",
+
+    /* Address computed only to load or store through it */
+    "lea $a, $m", "mov $a, [$a]", "->", "mov $a, $m", ";",
+    "lea $a, $m", "movsxd $a, dword ptr [$a]", "->", "movsxd $a, dword ptr $m", ";",
+    "lea $a, $m", "movsx $a, byte ptr [$a]", "->", "movsx $a, byte ptr $m", ";",
+    "lea $a, $m", "mov $b, [$a]", "->", "mov $b, $m", "if dead $a", ";",
+    "lea $a, $m", "movsxd $b, dword ptr [$a]", "->", "movsxd $b, dword ptr $m",
+        "if dead $a", ";",
+    "lea $a, $m", "movsx $b, byte ptr [$a]", "->", "movsx $b, byte ptr $m",
+        "if dead $a", ";",
+    "lea $a, $m", "mov [$a], $b", "->", "mov $m, $b", "if dead $a", "if free $a $b", ";",
+
+    /* Address copied to another register to load or store through it */
+    "mov $a, $b", "mov $a, [$a]", "->", "mov $a, [$b]", "if reg $a", "if reg $b", ";",
+    "mov $a, $b", "movsxd $a, dword ptr [$a]", "->", "movsxd $a, dword ptr [$b]",
+        "if reg $a", "if reg $b", ";",
+    "mov $a, $b", "movsx $a, byte ptr [$a]", "->", "movsx $a, byte ptr [$b]",
+        "if reg $a", "if reg $b", ";",
+    "mov $a, $b", "mov $c, [$a]", "->", "mov $c, [$b]",
+        "if reg $a", "if reg $b", "if free $a $c", "if dead $a", ";",
+    "mov $a, $b", "movsxd $c, dword ptr [$a]", "->", "movsxd $c, dword ptr [$b]",
+        "if reg $a", "if reg $b", "if free $a $c", "if dead $a", ";",
+    "mov $a, $b", "movsx $c, byte ptr [$a]", "->", "movsx $c, byte ptr [$b]",
+        "if reg $a", "if reg $b", "if free $a $c", "if dead $a", ";",
+    "mov $a, $b", "mov [$a], $c", "->", "mov [$b], $c",
+        "if reg $a", "if reg $b", "if free $a $c", "if dead $a", ";",
+
+    /* Value computed in one register and moved to another */
+    "$o $a, $b", "mov $c, $a", "->", "$o $c, $b",
+        "if move $o", "if reg $a", "if reg $c", "if dead $a", ";",
+    "mov $a, $b", "mov $c, $a", "->", "mov $c, $b",
+        "if reg $a", "if reg $b", "if mem $c", "if free $a $c", "if dead $a", ";",
+    "mov $a, $b", "push $a", "->", "push $b", "if reg $a", "if imm $b", "if dead $a", ";",
+    "mov $a, $b", "$o $a, $c", "mov $d, $a", "->", "mov $d, $b", "$o $d, $c",
+        "if arith $o", "if reg $a", "if reg $d", "if free $a $c", "if free $d $c",
+        "if dead $a", ";",
+
+    /* Operand moved to a register only to be used once */
+    "mov $c, $d", "$o $a, $c", "->", "$o $a, $d",
+        "if alu $o", "if reg $a", "if reg $c", "if free $c $a", "if dead $c", ";",
+    "mov $a, $b", "cmp $a, $c", "->", "cmp $b, $c",
+        "if reg $a", "if reg $b", "if free $a $c", "if dead $a", ";",
+
+    /* Comparisons */
+    "cmp $a, 0", "->", "test $a, $a", "if reg $a", ";",
+    "xor $c, $c", "cmp $a, $c", "->", "test $a, $a",
+        "if reg $a", "if free $c $a", "if dead $c", ";",
+    "mov $a, $b", "test $a, $a", "->", "test $b, $b",
+        "if reg $a", "if reg $b", "if dead $a", ";",
+    "set$c al", "movzb $r, al", "test $r, $r", "je $l", "->", "j!$c $l",
+        "if dead $r", "if dead rax", "if flags", ";",
+    "set$c al", "movzb $r, al", "test $r, $r", "jne $l", "->", "j$c $l",
+        "if dead $r", "if dead rax", "if flags", ";",
+
+    /* Arithmetic that does nothing, and shorter forms */
+    "add $a, 0", "->", "if flags", ";",
+    "sub $a, 0", "->", "if flags", ";",
+    "mov $a, 0", "->", "xor $a, $a", "if reg $a", "if flags", ";",
+    "movsxd rax, $b", "movsxd rax, eax", "->", "movsxd rax, $b", ";",
+    "end"
+};
+
+/* Instructions scanned, and jumps followed, to prove a register dead */
+#define PEEP_SCAN 64
+#define PEEP_DEPTH 4
+
+/* One line of assembly */
+typedef struct {
+    char *text;        /* The line as emitted */
+    char *op;          /* Mnemonic, or NULL for labels and directives */
+    char *a;           /* Operands, NULL when absent */
+    char *b;
+    char *c;
+    int nargs;
+    unsigned regs[3];  /* Registers each operand names, as bits */
+    bool regs_known;   /* regs has been filled in */
+    bool deleted;
+    int target;        /* Line of the label a jump goes to: -1 if not
+                        * found, -2 until looked up */
+    int nargs_in_regs; /* Arguments a call passes in registers, or -1 */
+    int group;         /* Rules to try on the line, or -1 until looked up */
+} AsmLine;
+
+static AsmLine *asm_lines;
+static int nasm;
+static int asm_cap;
+
+/* Rules, pre-parsed: pattern lines, replacement lines and conditions are
+ * runs of indices into peep_rules */
+static AsmLine *rule_lines;
+static int *rule_start;
+static int *rule_npat;
+static int *rule_nrep;
+static int *rule_ncond;
+static char **rule_op;     /* Mnemonics of the first two pattern lines, or */
+static char **rule_op2;    /* NULL if absent or holding a variable */
+static int nrules;
+
+/* Rules to try on a line, grouped by its mnemonic: those whose pattern
+ * starts with it or with a variable, in table order and ended by -1.
+ * Group 0 is for mnemonics no pattern starts with. */
+static char **group_op;
+static int **group_rules;
+static int ngroups;
+
+/* Operands bound to $a..$z while matching, as slices of the lines, and
+ * copied out as strings once a window matches */
+static char *bind_at[26];
+static int bind_len[26];
+static int bound[26];      /* Variables bound so far, to unbind */
+static int nbound;
+static char *bind[26];
+static int bind_cap[26];
+
+/* Labels of the buffered lines, hashed by name */
+static int *label_bucket;  /* First label line of each bucket, or -1 */
+static int *label_next;    /* Next label line in the same bucket, or -1 */
+static int nlabel_buckets;
+
+/* Register names, indexed by register number, by size */
+static char *names64[] = {"rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rbp", "rsp",
+                          "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"};
+static char *names32[] = {"eax", "ebx", "ecx", "edx", "esi", "edi", "ebp", "esp",
+                          "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"};
+static char *names8[] = {"al", "bl", "cl", "dl", "sil", "dil", "bpl", "spl",
+                         "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"};
+
+#define REG_RAX 0
+#define REG_RCX 2
+#define REG_RDX 3
+#define REG_FLAGS 16
+
+/* Condition codes and their opposites */
+static char *conds[] = {"e", "ne", "l", "ge", "le", "g", "b", "ae", "be", "a",
+                        "z", "nz", "s", "ns"};
+static char *opposite[] = {"ne", "e", "ge", "l", "g", "le", "ae", "b", "a", "be",
+                           "nz", "z", "ns", "s"};
+
+/* Is the text s of length len exactly name? */
+static bool is_name(char *s, int len, char *name) {
+    int n = strlen(name);
+    return n == len && strncmp(s, name, len) == 0;
+}
+
+/* Number of the register named s, or -1. *size gets its width. */
+static int reg_number(char *s, int len, int *size) {
+    /* Register names are 2 to 4 letters and start with one of these */
+    if (len < 2 || len > 4 || !strchr("abcders", s[0])) {
+        return -1;
+    }
+    for (int r = 0; r < 16; r++) {
+        if (is_name(s, len, names64[r])) {
+            *size = 8;
+            return r;
+        }
+        if (is_name(s, len, names32[r])) {
+            *size = 4;
+            return r;
+        }
+        if (is_name(s, len, names8[r])) {
+            *size = 1;
+            return r;
+        }
+    }
+    return -1;
+}
+
+/* Is operand s exactly a 64-bit register? */
+static bool is_reg64(char *s) {
+    int size;
+    return s && reg_number(s, strlen(s), &size) >= 0 && size == 8;
+}
+
+/* Is operand s a memory reference? */
+static bool is_mem(char *s) {
+    return s && strchr(s, '[') != NULL;
+}
+
+/* Is operand s an integer constant? */
+static bool is_imm(char *s) {
+    if (!s) {
+        return false;
+    }
+    if (*s == '-') {
+        s++;
+    }
+    if (!isdigit(*s)) {
+        return false;
+    }
+    while (isdigit(*s)) {
+        s++;
+    }
+    return *s == 0;
+}
+
+/* Does operand s name register r, in any width or inside an address? */
+static bool mentions(char *s, int r) {
+    if (!s) {
+        return false;
+    }
+    char *p = s;
+    while (*p) {
+        if (isalnum(*p)) {
+            char *q = p;
+            while (isalnum(*q)) {
+                q++;
+            }
+            int size;
+            if (reg_number(p, q - p, &size) == r) {
+                return true;
+            }
+            p = q;
+        } else {
+            p++;
+        }
+    }
+    return false;
+}
+
+/* Registers operand s names, in any width or inside an address, as a
+ * bit for each register number */
+static unsigned reg_mask(char *s) {
+    unsigned mask = 0;
+    char *p = s;
+    while (*p) {
+        if (isalnum(*p)) {
+            char *q = p;
+            while (isalnum(*q)) {
+                q++;
+            }
+            int size;
+            int r = reg_number(p, q - p, &size);
+            if (r >= 0) {
+                mask |= 1u << r;
+            }
+            p = q;
+        } else {
+            p++;
+        }
+    }
+    return mask;
+}
+
+/* Split an instruction (without indentation) into mnemonic and operands.
+ * Operands are separated by commas outside brackets. */
+static void parse_line(AsmLine *l, char *text) {
+    memset(l, 0, sizeof(AsmLine));
+    l->text = text;
+    l->target = -2;
+    l->nargs_in_regs = -1;
+    l->group = -1;
+    if (strncmp(text, "  ", 2) != 0 || text[2] == '.' || text[2] == '/') {
+        return;
+    }
+    char *s = strdup_custom(text + 2);
+    l->op = s;
+    while (*s && *s != ' ') {
+        s++;
+    }
+    if (!*s) {
+        return;
+    }
+    *s = 0;
+    s++;
+    char *args[3];
+    int n = 0;
+    int depth = 0;
+    args[n++] = s;
+    for (; *s; s++) {
+        if (*s == '[') {
+            depth++;
+        } else if (*s == ']') {
+            depth--;
+        } else if (*s == ',' && depth == 0 && n < 3) {
+            *s = 0;
+            s++;
+            while (*s == ' ') {
+                s++;
+            }
+            args[n++] = s;
+            s--;
+        }
+    }
+    l->nargs = n;
+    l->a = args[0];
+    if (n > 1) {
+        l->b = args[1];
+    }
+    if (n > 2) {
+        l->c = args[2];
+    }
+}
+
+/* Is l a label? */
+static bool is_label(AsmLine *l) {
+    int len = strlen(l->text);
+    return !l->op && len > 0 && l->text[0] != ' ' && l->text[len - 1] == ':';
+}
+
+/* Operand k of l */
+static char *operand(AsmLine *l, int k) {
+    if (k == 0) {
+        return l->a;
+    }
+    if (k == 1) {
+        return l->b;
+    }
+    return l->c;
+}
+
+/* Is the mnemonic one that only copies or computes into its first
+ * operand, without touching the flags? */
+static bool is_move(char *op) {
+    return strcmp(op, "mov") == 0 || strcmp(op, "movsx") == 0 ||
+           strcmp(op, "movsxd") == 0 || strcmp(op, "movzb") == 0 ||
+           strcmp(op, "movzx") == 0 || strcmp(op, "lea") == 0;
+}
+
+/* Is the mnemonic two-operand arithmetic that reads and writes its first
+ * operand and sets the flags? */
+static bool is_alu(char *op) {
+    return strcmp(op, "add") == 0 || strcmp(op, "sub") == 0 ||
+           strcmp(op, "and") == 0 || strcmp(op, "or") == 0 ||
+           strcmp(op, "xor") == 0 || strcmp(op, "imul") == 0;
+}
+
+/* Is the mnemonic a shift? */
+static bool is_shift(char *op) {
+    return strcmp(op, "shl") == 0 || strcmp(op, "shr") == 0 || strcmp(op, "sar") == 0;
+}
+
+/* How an instruction affects register r (REG_FLAGS for the flags) */
+#define ACC_NONE 0
+#define ACC_READ 1         /* Reads it, or might */
+#define ACC_KILL 2         /* Overwrites all of it without reading it */
+
+/* Does operand k of l name register r? The registers of each operand
+ * are found the first time they are asked for. */
+static bool names_reg(AsmLine *l, int k, int r) {
+    if (!l->regs_known) {
+        for (int j = 0; j < l->nargs; j++) {
+            l->regs[j] = reg_mask(operand(l, j));
+        }
+        l->regs_known = true;
+    }
+    return k < l->nargs && r < 16 && (l->regs[k] >> r & 1);
+}
+
+/* Access to r by writing the first operand of l, which it does not read */
+static int write_access(AsmLine *l, int r) {
+    char *dst = l->a;
+    if (is_mem(dst)) {
+        return names_reg(l, 0, r) ? ACC_READ : ACC_NONE;
+    }
+    int size;
+    if (reg_number(dst, strlen(dst), &size) == r && size >= 4) {
+        return ACC_KILL;
+    }
+    return ACC_NONE;
+}
+
+static int access(AsmLine *l, int r) {
+    char *op = l->op;
+    bool flags = r == REG_FLAGS;
+
+    if (is_move(op) || (strcmp(op, "imul") == 0 && l->nargs == 3)) {
+        if (names_reg(l, 1, r) || names_reg(l, 2, r)) {
+            return ACC_READ;
+        }
+        if (flags) {
+            return strcmp(op, "imul") == 0 ? ACC_KILL : ACC_NONE;
+        }
+        return write_access(l, r);
+    }
+    if ((strcmp(op, "xor") == 0 || strcmp(op, "sub") == 0) && l->nargs == 2 &&
+        strcmp(l->a, l->b) == 0 && !is_mem(l->a)) {
+        /* Zeroing a register does not read it */
+        return flags ? ACC_KILL : write_access(l, r);
+    }
+    if (is_alu(op) || strcmp(op, "cmp") == 0 || strcmp(op, "test") == 0 ||
+        strcmp(op, "neg") == 0) {
+        if (flags) {
+            return ACC_KILL;
+        }
+        return names_reg(l, 0, r) || names_reg(l, 1, r) ? ACC_READ : ACC_NONE;
+    }
+    if (is_shift(op)) {
+        if (flags) {
+            /* A shift by zero leaves the flags alone */
+            return is_imm(l->b) && strcmp(l->b, "0") != 0 ? ACC_KILL : ACC_NONE;
+        }
+        return names_reg(l, 0, r) || names_reg(l, 1, r) ? ACC_READ : ACC_NONE;
+    }
+    if (strcmp(op, "not") == 0) {
+        return names_reg(l, 0, r) ? ACC_READ : ACC_NONE;
+    }
+    if (strncmp(op, "set", 3) == 0) {
+        if (flags || (is_mem(l->a) && names_reg(l, 0, r))) {
+            return ACC_READ;
+        }
+        return ACC_NONE;
+    }
+    if (strcmp(op, "cqo") == 0) {
+        if (r == REG_RAX) {
+            return ACC_READ;
+        }
+        return r == REG_RDX ? ACC_KILL : ACC_NONE;
+    }
+    if (strcmp(op, "idiv") == 0 || strcmp(op, "div") == 0) {
+        if (flags) {
+            return ACC_KILL;
+        }
+        if (r == REG_RAX || r == REG_RDX || names_reg(l, 0, r)) {
+            return ACC_READ;
+        }
+        return ACC_NONE;
+    }
+    if (strcmp(op, "push") == 0) {
+        return names_reg(l, 0, r) || r == 7 ? ACC_READ : ACC_NONE;
+    }
+    if (strcmp(op, "pop") == 0) {
+        if (r == 7) {
+            return ACC_READ;
+        }
+        return flags ? ACC_NONE : write_access(l, r);
+    }
+    return ACC_READ;
+}
+
+/* Is register r preserved across calls? */
+static bool callee_saved(int r) {
+    return r == 1 || r == 6 || r == 7 || (r >= 12 && r < 16);
+}
+
+/* Argument registers, in order */
+static int arg_regs[] = {5, 4, 3, 2, 8, 9};
+
+/* Does the call l read register r? The code generators never pass a
+ * vector register count in al, so rax is not an input. */
+static bool call_reads(AsmLine *l, int r) {
+    int n = l->nargs_in_regs;
+    if (n < 0 || n > 6) {
+        n = 6;
+    }
+    for (int k = 0; k < n; k++) {
+        if (arg_regs[k] == r) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Bucket of the label name s of length len */
+static int label_hash(char *s, int len) {
+    unsigned h = 0;
+    for (int k = 0; k < len; k++) {
+        h = h * 31 + (unsigned char)s[k];
+    }
+    return h % nlabel_buckets;
+}
+
+/* Hash the labels of the buffered lines. Rules never rewrite a label,
+ * so the table stays valid while they run. */
+static void index_labels(void) {
+    nlabel_buckets = nasm * 2 + 1;
+    label_bucket = realloc(label_bucket, sizeof(int) * nlabel_buckets);
+    label_next = realloc(label_next, sizeof(int) * (nasm + 1));
+    for (int h = 0; h < nlabel_buckets; h++) {
+        label_bucket[h] = -1;
+    }
+    for (int i = 0; i < nasm; i++) {
+        AsmLine *l = &asm_lines[i];
+        if (is_label(l)) {
+            int h = label_hash(l->text, strlen(l->text) - 1);
+            label_next[i] = label_bucket[h];
+            label_bucket[h] = i;
+        }
+    }
+}
+
+/* Line of the label named name, or -1 */
+static int find_label(AsmLine *l) {
+    if (l->target != -2) {
+        return l->target;
+    }
+    l->target = -1;
+    int len = strlen(l->a);
+    for (int i = label_bucket[label_hash(l->a, len)]; i >= 0; i = label_next[i]) {
+        AsmLine *t = &asm_lines[i];
+        if (strncmp(t->text, l->a, len) == 0 &&
+            t->text[len] == ':' && t->text[len + 1] == 0) {
+            l->target = i;
+            break;
+        }
+    }
+    return l->target;
+}
+
+/* Is register r dead on entry to line i, on every path from it? */
+static bool dead_from(int i, int r, int depth) {
+    for (int steps = 0; i < nasm && steps < PEEP_SCAN; i++) {
+        AsmLine *l = &asm_lines[i];
+        if (l->deleted) {
+            continue;
+        }
+        steps++;
+        if (!l->op) {
+            if (is_label(l)) {
+                continue;
+            }
+            return false;
+        }
+        if (l->op[0] == 'j') {
+            int t = find_label(l);
+            if (t < 0 && l->nargs_in_regs >= 0) {
+                /* A tail call: the callee returns to our caller */
+                return !call_reads(l, r) && !callee_saved(r);
+            }
+            if (t < 0 || depth >= PEEP_DEPTH) {
+                return false;
+            }
+            if (strcmp(l->op, "jmp") == 0) {
+                i = t;
+                depth++;
+                continue;
+            }
+            if (!dead_from(t, r, depth + 1)) {
+                return false;
+            }
+            continue;
+        }
+        if (strcmp(l->op, "call") == 0) {
+            if (call_reads(l, r)) {
+                return false;
+            }
+            if (!callee_saved(r)) {
+                return true;
+            }
+            continue;
+        }
+        if (strcmp(l->op, "ret") == 0) {
+            return r != REG_RAX && !callee_saved(r);
+        }
+        int acc = access(l, r);
+        if (acc == ACC_READ) {
+            return false;
+        }
+        if (acc == ACC_KILL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Next line after i that is not deleted, or -1 */
+static int next_line(int i) {
+    for (i++; i < nasm; i++) {
+        if (!asm_lines[i].deleted) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Match a pattern piece against s, binding the variable in it to the
+ * part of s it covers */
+static bool match_text(char *pat, char *s) {
+    if (!pat || !s) {
+        return pat == s;
+    }
+    int v;
+    char *val;
+    int len;
+    if (pat[0] == '$' && !pat[2]) {
+        /* A whole operand, the usual case */
+        v = pat[1] - 'a';
+        if (bind_at[v]) {
+            return strncmp(bind_at[v], s, bind_len[v]) == 0 && s[bind_len[v]] == 0;
+        }
+        val = s;
+        len = strlen(s);
+        if (len == 0) {
+            return false;
+        }
+    } else {
+        char *var = strchr(pat, '$');
+        if (!var) {
+            return pat[0] == s[0] && strcmp(pat, s) == 0;
+        }
+        int pre = var - pat;
+        char *suffix = var + 2;
+        int slen = strlen(s);
+        int suf = strlen(suffix);
+        if (slen < pre + suf + 1 || strncmp(s, pat, pre) != 0 ||
+            strcmp(s + slen - suf, suffix) != 0) {
+            return false;
+        }
+        val = s + pre;
+        len = slen - pre - suf;
+        v = var[1] - 'a';
+        if (bind_at[v]) {
+            return bind_len[v] == len && strncmp(bind_at[v], val, len) == 0;
+        }
+    }
+    bind_at[v] = val;
+    bind_len[v] = len;
+    bound[nbound++] = v;
+    return true;
+}
+
+/* Copy the bound slices out as strings, for conditions and replacements */
+static void copy_binds(void) {
+    for (int k = 0; k < nbound; k++) {
+        int v = bound[k];
+        if (bind_cap[v] <= bind_len[v]) {
+            bind_cap[v] = bind_len[v] * 2 + 16;
+            bind[v] = realloc(bind[v], bind_cap[v]);
+        }
+        memcpy(bind[v], bind_at[v], bind_len[v]);
+        bind[v][bind_len[v]] = 0;
+    }
+}
+
+/* Match pattern line p against line l */
+static bool match_line(AsmLine *p, AsmLine *l) {
+    if (!p->op) {
+        return !l->op && is_label(l) && match_text(p->text, l->text);
+    }
+    if (!l->op || p->nargs != l->nargs || !match_text(p->op, l->op)) {
+        return false;
+    }
+    for (int k = 0; k < p->nargs; k++) {
+        if (!match_text(operand(p, k), operand(l, k))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* The opposite of condition code cc, or NULL */
+static char *invert(char *cc) {
+    for (int k = 0; k < 14; k++) {
+        if (strcmp(conds[k], cc) == 0) {
+            return opposite[k];
+        }
+    }
+    return NULL;
+}
+
+/* Substitute the bound variables into template t. Returns NULL if a
+ * condition code has no opposite. */
+static char *substitute(char *t) {
+    int len = 0;
+    for (char *p = t; *p; p++) {
+        len++;
+        if (*p == '$') {
+            len += strlen(bind[p[1] - 'a']) + 8;
+        }
+    }
+    char *buf = calloc(len + 3, 1);
+    strcpy(buf, "  ");
+    char *out = buf + 2;
+    for (char *p = t; *p; p++) {
+        if (*p == '!' && p[1] == '$') {
+            char *cc = invert(bind[p[2] - 'a']);
+            if (!cc) {
+                return NULL;
+            }
+            strcpy(out, cc);
+            out += strlen(cc);
+            p += 2;
+        } else if (*p == '$') {
+            strcpy(out, bind[p[1] - 'a']);
+            out += strlen(bind[p[1] - 'a']);
+            p++;
+        } else {
+            *out++ = *p;
+        }
+    }
+    /* Labels are not indented */
+    if (out > buf + 2 && out[-1] == ':') {
+        char *label = strdup_custom(buf + 2);
+        free(buf);
+        return label;
+    }
+    return buf;
+}
+
+/* The next word of a condition, or NULL. A variable stands for what it
+ * is bound to; other words are copied to buf, which holds size bytes. */
+static char *cond_word(char **p, char *buf, int size) {
+    char *s = *p;
+    while (*s == ' ') {
+        s++;
+    }
+    if (!*s) {
+        return NULL;
+    }
+    char *end = s;
+    while (*end && *end != ' ') {
+        end++;
+    }
+    *p = end;
+    if (s[0] == '$') {
+        return bind[s[1] - 'a'];
+    }
+    int len = end - s < size ? end - s : size - 1;
+    memcpy(buf, s, len);
+    buf[len] = 0;
+    return buf;
+}
+
+/* Check condition c, e.g. "if dead $a", for a window ending at line last */
+static bool check(char *c, int last) {
+    char *p = c + 3;
+    char words[3][16];
+    char *kind = cond_word(&p, words[0], 16);
+    char *x = cond_word(&p, words[1], 16);
+    char *y = cond_word(&p, words[2], 16);
+    int size;
+    if (strcmp(kind, "reg") == 0) {
+        return is_reg64(x);
+    }
+    if (strcmp(kind, "mem") == 0) {
+        return is_mem(x);
+    }
+    if (strcmp(kind, "imm") == 0) {
+        return is_imm(x);
+    }
+    if (strcmp(kind, "move") == 0) {
+        return is_move(x);
+    }
+    if (strcmp(kind, "arith") == 0) {
+        return is_alu(x) || is_shift(x);
+    }
+    if (strcmp(kind, "alu") == 0) {
+        return is_alu(x) || strcmp(x, "cmp") == 0 || strcmp(x, "test") == 0;
+    }
+    if (strcmp(kind, "free") == 0) {
+        return !mentions(y, reg_number(x, strlen(x), &size));
+    }
+    if (strcmp(kind, "dead") == 0) {
+        return dead_from(last + 1, reg_number(x, strlen(x), &size), 0);
+    }
+    if (strcmp(kind, "flags") == 0) {
+        return dead_from(last + 1, REG_FLAGS, 0);
+    }
+    return false;
+}
+
+/* Group of the rules to try on a line with mnemonic op */
+static int rule_group(char *op) {
+    if (op) {
+        for (int g = 1; g < ngroups; g++) {
+            if (strcmp(group_op[g], op) == 0) {
+                return g;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Split the rule table into rules */
+static void load_rules(void) {
+    int n = 0;
+    while (strcmp(peep_rules[n], "end") != 0) {
+        n++;
+    }
+    rule_lines = calloc(n + 1, sizeof(AsmLine));
+    rule_start = calloc(n + 1, sizeof(int));
+    rule_npat = calloc(n + 1, sizeof(int));
+    rule_nrep = calloc(n + 1, sizeof(int));
+    rule_ncond = calloc(n + 1, sizeof(int));
+    rule_op = calloc(n + 1, sizeof(char *));
+    rule_op2 = calloc(n + 1, sizeof(char *));
+    nrules = 0;
+    int i = 0;
+    while (i < n) {
+        rule_start[nrules] = i;
+        int part = 0;
+        for (; strcmp(peep_rules[i], ";") != 0; i++) {
+            char *s = peep_rules[i];
+            if (strcmp(s, "->") == 0) {
+                part = 1;
+                continue;
+            }
+            if (strncmp(s, "if ", 3) == 0) {
+                rule_ncond[nrules]++;
+                continue;
+            }
+            /* Patterns and replacements parse like emitted lines */
+            char *text = s;
+            if (s[strlen(s) - 1] != ':') {
+                text = calloc(strlen(s) + 3, 1);
+                strcpy(text, "  ");
+                strcat(text, s);
+            }
+            parse_line(&rule_lines[i], text);
+            if (part == 0) {
+                rule_npat[nrules]++;
+            } else {
+                rule_nrep[nrules]++;
+            }
+        }
+        for (int p = 0; p < 2 && p < rule_npat[nrules]; p++) {
+            char *op = rule_lines[rule_start[nrules] + p].op;
+            if (op && !strchr(op, '$')) {
+                *(p == 0 ? &rule_op[nrules] : &rule_op2[nrules]) = op;
+            }
+        }
+        i++;
+        nrules++;
+    }
+
+    group_op = calloc(nrules + 1, sizeof(char *));
+    group_rules = calloc(nrules + 1, sizeof(int *));
+    ngroups = 1;
+    for (int k = 0; k < nrules; k++) {
+        if (rule_op[k] && rule_group(rule_op[k]) == 0) {
+            group_op[ngroups++] = rule_op[k];
+        }
+    }
+    for (int g = 0; g < ngroups; g++) {
+        group_rules[g] = calloc(nrules + 1, sizeof(int));
+        int m = 0;
+        for (int k = 0; k < nrules; k++) {
+            if (!rule_op[k] || (g > 0 && strcmp(rule_op[k], group_op[g]) == 0)) {
+                group_rules[g][m++] = k;
+            }
+        }
+        group_rules[g][m] = -1;
+    }
+}
+
+/* Try rule k on the window starting at line i. Returns true if it
+ * rewrote the window. */
+static bool apply_rule(int k, int i) {
+    int base = rule_start[k];
+    int npat = rule_npat[k];
+    int at[8];
+    while (nbound > 0) {
+        bind_at[bound[--nbound]] = NULL;
+    }
+
+    int j = i;
+    for (int p = 0; p < npat; p++) {
+        if (j < 0 || !match_line(&rule_lines[base + p], &asm_lines[j])) {
+            return false;
+        }
+        at[p] = j;
+        j = next_line(j);
+    }
+    copy_binds();
+    int ncond = rule_ncond[k];
+    int cond = base + npat + 1 + rule_nrep[k];
+    for (int c = 0; c < ncond; c++) {
+        if (!check(peep_rules[cond + c], at[npat - 1])) {
+            return false;
+        }
+    }
+
+    /* Replacement lines take the places of the first pattern lines */
+    int nrep = rule_nrep[k];
+    char **texts = calloc(nrep + 1, sizeof(char *));
+    for (int r = 0; r < nrep; r++) {
+        texts[r] = substitute(peep_rules[base + npat + 1 + r]);
+        if (!texts[r]) {
+            free(texts);
+            return false;
+        }
+    }
+    for (int p = 0; p < npat; p++) {
+        AsmLine *l = &asm_lines[at[p]];
+        if (p < nrep) {
+            free(l->text);
+            free(l->op);
+            parse_line(l, texts[p]);
+        } else {
+            l->deleted = true;
+        }
+    }
+    free(texts);
+    return true;
+}
+
+/* After a jump or return at line i, delete the instructions up to the
+ * next label, which cannot be reached, and the jump itself if it goes to
+ * a label reached by falling through */
+static bool remove_jumps(int i) {
+    AsmLine *l = &asm_lines[i];
+    if (strcmp(l->op, "jmp") != 0 && strcmp(l->op, "ret") != 0) {
+        return false;
+    }
+    bool changed = false;
+    bool after_label = false;
+    int t = -1;
+    if (l->op[0] == 'j') {
+        t = find_label(l);
+    }
+    for (int j = next_line(i); j >= 0; j = next_line(j)) {
+        AsmLine *n = &asm_lines[j];
+        if (n->op) {
+            if (after_label) {
+                break;
+            }
+            n->deleted = true;
+            changed = true;
+            continue;
+        }
+        if (!is_label(n)) {
+            break;
+        }
+        after_label = true;
+        if (j == t) {
+            l->deleted = true;
+            return true;
+        }
+    }
+    return changed;
+}
+
+/* Can a pattern line with mnemonic op (NULL for any) match one with
+ * mnemonic s? */
+static bool same_op(char *op, char *s) {
+    return !op || (s && op[0] == s[0] && strcmp(op, s) == 0);
+}
+
+/* Rewrite the buffered lines until no rule applies */
+static void optimize_lines(void) {
+    if (!rule_lines) {
+        load_rules();
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < nasm; i++) {
+            AsmLine *l = &asm_lines[i];
+            if (l->deleted) {
+                continue;
+            }
+            if (l->group < 0) {
+                l->group = rule_group(l->op);
+            }
+            int n = next_line(i);
+            char *next_op = n >= 0 ? asm_lines[n].op : NULL;
+            for (int *k = group_rules[l->group]; *k >= 0; k++) {
+                /* Most rules left already differ in the second mnemonic */
+                if (!same_op(rule_op2[*k], next_op)) {
+                    continue;
+                }
+                if (apply_rule(*k, i)) {
+                    changed = true;
+                    break;
+                }
+            }
+            if (!l->deleted && l->op && remove_jumps(i)) {
+                changed = true;
+            }
+        }
+    }
+}
+
+/* Append a line of assembly to the buffer */
+void asm_append(char *line) {
+    if (nasm == asm_cap) {
+        asm_cap = asm_cap * 2 + 256;
+        asm_lines = realloc(asm_lines, sizeof(AsmLine) * asm_cap);
+    }
+    parse_line(&asm_lines[nasm], strdup_custom(line));
+    nasm++;
+}
+
+/* Record that the call (or tail call jump) just appended passes nargs
+ * arguments */
+void asm_call_args(int nargs) {
+    asm_lines[nasm - 1].nargs_in_regs = nargs;
+}
+
+/* Optimize the buffered lines and write them to out */
+void asm_flush(FILE *out) {
+    if (pass_enabled(PASS_PEEPHOLE)) {
+        index_labels();
+        optimize_lines();
+    }
+    for (int i = 0; i < nasm; i++) {
+        AsmLine *l = &asm_lines[i];
+        if (l->deleted) {
+            continue;
+        }
+        if (!l->op) {
+            fprintf(out, "%s\n", l->text);
+        } else if (l->nargs == 0) {
+            fprintf(out, "  %s\n", l->op);
+        } else if (l->nargs == 1) {
+            fprintf(out, "  %s %s\n", l->op, l->a);
+        } else if (l->nargs == 2) {
+            fprintf(out, "  %s %s, %s\n", l->op, l->a, l->b);
+        } else {
+            fprintf(out, "  %s %s, %s, %s\n", l->op, l->a, l->b, l->c);
+        }
+    }
+    for (int i = 0; i < nasm; i++) {
+        free(asm_lines[i].text);
+        free(asm_lines[i].op);
+    }
+    nasm = 0;
+}
@@ -453,7 +453,15 @@ static char *preprocess_recursive(char *input, int *out_len) {
             } else if (strncmp(p, "undef", 5) == 0) {
                 /* Skip #undef */
             } else if (strncmp(p, "pragma", 6) == 0) {
-                /* Skip #pragma */
+                /* Kept for the lexer, which reads loop hints from it.
+                 * Written as "#pragma", without blanks after the '#'. */
+                if (skip_depth < 0) {
+                    int len = line_end - p;
+                    output[(*out_len)++] = '#';
+                    memcpy(output + *out_len, p, len);
+                    *out_len += len;
+                    output[(*out_len)++] = '\n';
+                }
             } else if (strncmp(p, "error", 5) == 0) {
                 /* Skip #error */
             } else if (strncmp(p, "warning", 7) == 0) {
@@ -461,7 +469,7 @@ static char *preprocess_recursive(char *input, int *out_len) {
             } else if (strncmp(p, "line", 4) == 0) {
                 /* Skip #line */
             }
-            /* All preprocessor directives are now handled - they don't get copied to output */
+            /* Other directives are handled here and not copied to the output */
         } else if (skip_depth < 0) {
             /* Expand macros and copy line to output if not skipping */
             int line_len = line_end - line;
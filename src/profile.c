@@ -0,0 +1,330 @@
+#include "compiler.h"
+
+/* Profile-guided optimization.
+ *
+ * assign_counters() numbers the events worth counting in each function:
+ * its entry, both sides of each if and ?:, the entries and iterations of
+ * each loop, and each switch, case and call (see ASTNode). It runs on the
+ * AST as parsed, before any pass has changed it, so that a build with
+ * -fprofile-generate and a later one with -fprofile-use agree on the
+ * numbering as long as the source is the same.
+ *
+ * With -fprofile-generate, both code generators add one to a counter in
+ * .bss when its event happens, and emit_profile_data() writes a table of
+ * the functions' counters that the runtime (see runtime.c) registers
+ * before main runs. At exit the runtime adds the counts to those already
+ * in the profile file, one line per function:
+ *
+ *     <key> <checksum> <number of counters> <counts...>
+ *
+ * The key is the function's name, prefixed with the file name and a colon
+ * for static functions. Blanks, control characters, '%' and '#' in the
+ * file name are written as %XX, so that a key is a single word that does
+ * not look like a comment. The checksum covers the kinds of the nodes
+ * counted, so a function whose source has changed is ignored rather than
+ * given the counts of other nodes.
+ *
+ * With -fprofile-use, read_profile() hands the counts back to the nodes.
+ * The inliner, the loop unroller, the switch lowering and the layout of
+ * if statements and functions then consult them through the predicates
+ * at the end of this file. Counts beyond the range of int saturate. */
+
+/* A side taken at most once in this many executions is cold */
+#define PROFILE_COLD_RATIO 20
+
+/* A count within this factor of the largest one in the profile is hot */
+#define PROFILE_HOT_RATIO 100
+
+/* The node each counter counts for, and whether in its count2; the
+ * entry counter of a function has no node */
+static ASTNode **prof_nodes;
+static bool *prof_second;
+static int nprof;
+static int prof_cap;
+
+/* Functions with counters: the first counter and the number of them,
+ * the checksum and the key of each */
+static Symbol **prof_fns;
+static int *prof_first;
+static int *prof_count;
+static int *prof_sum;
+static char **prof_keys;
+static int nprof_fns;
+static int prof_fns_cap;
+
+/* Largest count read, for profile_hot() */
+static int profile_max;
+
+/* Add a counter for node (NULL for a function entry) and return its
+ * index. The kind of node goes into the function's checksum. */
+static int new_counter(ASTNode *node, bool second) {
+    if (nprof == prof_cap) {
+        prof_cap = prof_cap * 2 + 64;
+        prof_nodes = realloc(prof_nodes, sizeof(ASTNode *) * prof_cap);
+        prof_second = realloc(prof_second, sizeof(bool) * prof_cap);
+    }
+    prof_nodes[nprof] = node;
+    prof_second[nprof] = second;
+    int kind = 0;
+    if (node) {
+        kind = node->kind + 1;
+    }
+    prof_sum[nprof_fns - 1] = (prof_sum[nprof_fns - 1] * 31 + kind) % 1000003;
+    return nprof++;
+}
+
+/* Number the counters of a tree, with the list it heads */
+static void assign_tree(ASTNode *node) {
+    for (; node; node = node->next) {
+        if (!node->prof_id) {
+            switch (node->kind) {
+                case ND_IF:
+                case ND_COND:
+                case ND_WHILE:
+                case ND_FOR:
+                    node->prof_id = new_counter(node, false) + 1;
+                    new_counter(node, true);
+                    break;
+                case ND_SWITCH:
+                case ND_CALL:
+                    node->prof_id = new_counter(node, false) + 1;
+                    break;
+                case ND_CASE:
+                    if (!node->is_default) {
+                        node->prof_id = new_counter(node, false) + 1;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        assign_tree(node->lhs);
+        assign_tree(node->rhs);
+        assign_tree(node->cond);
+        assign_tree(node->then);
+        assign_tree(node->els);
+        assign_tree(node->init);
+        assign_tree(node->inc);
+        assign_tree(node->body);
+        assign_tree(node->args);
+    }
+}
+
+/* The key of fn in the profile file */
+static char *profile_key(Symbol *fn) {
+    if (!fn->is_static) {
+        return fn->name;
+    }
+    char *file = compiler_state->current_file;
+    char *key = calloc(strlen(file) * 3 + strlen(fn->name) + 2, 1);
+    char *out = key;
+    for (char *p = file; *p; p++) {
+        int c = (unsigned char)*p;
+        if (c <= ' ' || c >= 127 || c == '%' || c == '#') {
+            out += sprintf(out, "%%%02X", c);
+        } else {
+            *out++ = c;
+        }
+    }
+    sprintf(out, ":%s", fn->name);
+    return key;
+}
+
+/* Number the counters of every function with a body */
+void assign_counters(Symbol *prog) {
+    for (Symbol *fn = prog; fn; fn = fn->next) {
+        if (!fn->is_function || !fn->body) {
+            continue;
+        }
+        if (nprof_fns == prof_fns_cap) {
+            prof_fns_cap = prof_fns_cap * 2 + 16;
+            prof_fns = realloc(prof_fns, sizeof(Symbol *) * prof_fns_cap);
+            prof_first = realloc(prof_first, sizeof(int) * prof_fns_cap);
+            prof_count = realloc(prof_count, sizeof(int) * prof_fns_cap);
+            prof_sum = realloc(prof_sum, sizeof(int) * prof_fns_cap);
+            prof_keys = realloc(prof_keys, sizeof(char *) * prof_fns_cap);
+        }
+        int k = nprof_fns++;
+        prof_fns[k] = fn;
+        prof_first[k] = nprof;
+        prof_sum[k] = 0;
+        prof_keys[k] = profile_key(fn);
+        fn->prof_id = new_counter(NULL, false) + 1;
+        assign_tree(fn->body);
+        prof_count[k] = nprof - prof_first[k];
+    }
+}
+
+/* Print a warning about the profile */
+static void profile_warning(char *fmt, char *arg) {
+    fprintf(stderr, "\033[1m\033[33mwarning:\033[0m ");
+    fprintf(stderr, fmt, arg);
+    fprintf(stderr, "\n");
+}
+
+/* Read the profile file: the position in it */
+static char *prof_p;
+
+/* Skip blanks, then read the next word into a new string */
+static char *read_word(void) {
+    while (*prof_p == ' ' || *prof_p == '\t') {
+        prof_p++;
+    }
+    char *start = prof_p;
+    while (*prof_p && !isspace(*prof_p)) {
+        prof_p++;
+    }
+    return strndup_custom(start, prof_p - start);
+}
+
+/* Skip blanks, then read a number that is not negative, saturating at
+ * the largest int. -1 if there is none. */
+static int read_count(void) {
+    while (*prof_p == ' ' || *prof_p == '\t') {
+        prof_p++;
+    }
+    if (!isdigit(*prof_p)) {
+        return -1;
+    }
+    int n = 0;
+    while (isdigit(*prof_p)) {
+        int d = *prof_p - '0';
+        if (n > (2147483647 - d) / 10) {
+            n = 2147483647;
+        } else {
+            n = n * 10 + d;
+        }
+        prof_p++;
+    }
+    return n;
+}
+
+/* Hand count to the node counter i counts for */
+static void set_count(int i, Symbol *fn, int count) {
+    if (count > profile_max) {
+        profile_max = count;
+    }
+    ASTNode *node = prof_nodes[i];
+    if (!node) {
+        fn->count = count;
+        fn->profiled = true;
+    } else if (prof_second[i]) {
+        node->count2 = count;
+    } else {
+        node->count = count;
+        node->profiled = true;
+    }
+}
+
+/* Read the counts of the -fprofile-use file into the nodes they count.
+ * Functions with no line, or a line that does not match their source,
+ * keep no counts and are optimized as without a profile. */
+void read_profile(void) {
+    char *path = compiler_state->profile_use;
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        profile_warning("cannot open profile %s, compiling without it", path);
+        return;
+    }
+    fclose(fp);
+    prof_p = read_file(path);
+
+    while (*prof_p) {
+        if (*prof_p == '#' || *prof_p == '\n') {
+            while (*prof_p && *prof_p != '\n') {
+                prof_p++;
+            }
+            if (*prof_p) {
+                prof_p++;
+            }
+            continue;
+        }
+        char *key = read_word();
+        int sum = read_count();
+        int n = read_count();
+        int k = 0;
+        while (k < nprof_fns && strcmp(prof_keys[k], key) != 0) {
+            k++;
+        }
+        if (k < nprof_fns && (sum != prof_sum[k] || n != prof_count[k])) {
+            profile_warning("profile of %s does not match its source, ignored", key);
+        } else if (k < nprof_fns) {
+            for (int i = 0; i < n; i++) {
+                int count = read_count();
+                if (count < 0) {
+                    break;
+                }
+                set_count(prof_first[k] + i, prof_fns[k], count);
+            }
+        }
+        while (*prof_p && *prof_p != '\n') {
+            prof_p++;
+        }
+        free(key);
+    }
+}
+
+/* Write the counters of -fprofile-generate, the table of the functions
+ * they belong to, and the code that registers the table with the
+ * runtime before main runs */
+void emit_profile_data(FILE *out) {
+    if (!compiler_state->profile_generate || nprof_fns == 0) {
+        return;
+    }
+    fprintf(out, ".bss\n");
+    fprintf(out, "  .p2align 3\n");
+    fprintf(out, ".L.prof.cnt:\n");
+    fprintf(out, "  .zero %d\n", 8 * nprof);
+
+    fprintf(out, "  .section .rodata\n");
+    fprintf(out, ".L.prof.path:\n");
+    char *path = asm_quote(compiler_state->profile_generate);
+    fprintf(out, "  .string %s\n", path);
+    free(path);
+    for (int k = 0; k < nprof_fns; k++) {
+        char *key = asm_quote(prof_keys[k]);
+        fprintf(out, ".L.prof.key.%d:\n", k);
+        fprintf(out, "  .string %s\n", key);
+        free(key);
+    }
+
+    /* The layouts of ProfFunc and ProfUnit in runtime.c */
+    fprintf(out, ".data\n");
+    fprintf(out, "  .p2align 3\n");
+    fprintf(out, ".L.prof.funcs:\n");
+    for (int k = 0; k < nprof_fns; k++) {
+        fprintf(out, "  .quad .L.prof.key.%d\n", k);
+        fprintf(out, "  .quad %d\n", prof_sum[k]);
+        fprintf(out, "  .quad %d\n", prof_count[k]);
+        fprintf(out, "  .quad .L.prof.cnt+%d\n", 8 * prof_first[k]);
+    }
+    fprintf(out, ".L.prof.unit:\n");
+    fprintf(out, "  .quad .L.prof.path\n");
+    fprintf(out, "  .quad %d\n", nprof_fns);
+    fprintf(out, "  .quad .L.prof.funcs\n");
+
+    fprintf(out, ".text\n");
+    fprintf(out, ".L.prof.init:\n");
+    fprintf(out, "  lea rdi, .L.prof.unit[rip]\n");
+    fprintf(out, "  jmp __mycc_prof_register\n");
+    fprintf(out, "  .section .init_array,\"aw\"\n");
+    fprintf(out, "  .p2align 3\n");
+    fprintf(out, "  .quad .L.prof.init\n");
+}
+
+/* Is an event that happened count times among the hottest of the
+ * profile? */
+bool profile_hot(int count) {
+    return count > 0 && count >= profile_max / PROFILE_HOT_RATIO;
+}
+
+/* Is a path taken part out of total times rare enough to be moved out
+ * of the way of the others? */
+bool profile_cold(int part, int total) {
+    return total > 0 && part <= total / PROFILE_COLD_RATIO;
+}
+
+/* Does a path taken part out of total times take most of them? */
+bool profile_dominant(int part, int total) {
+    return part > 0 && part > total - part;
+}
@@ -0,0 +1,120 @@
+#include "compiler.h"
+
+/* Which functions and global data are emitted. Everything with external
+ * linkage is, since other files may refer to it; a static function, a
+ * static global or a string literal only when code or data that is
+ * emitted refers to it. The references are followed from the external
+ * symbols through the function bodies (their optimized IR when there is
+ * one, so calls that were inlined no longer count) and the initializers
+ * of global data. Unused helpers from shared headers disappear, and so do
+ * the literals only they used. */
+
+static Symbol *reach_prog;
+static IRFunc *reach_fns;
+static Symbol **worklist;     /* Symbols found live, not yet scanned */
+static int nwork;
+static int work_cap;
+
+/* Mark sym live, to be scanned */
+static void reach_symbol(Symbol *sym) {
+    sym->is_live = true;
+    if (nwork == work_cap) {
+        work_cap = work_cap * 2 + 16;
+        worklist = realloc(worklist, sizeof(Symbol *) * work_cap);
+    }
+    worklist[nwork++] = sym;
+}
+
+/* Mark the symbols called name live: a function may be declared before
+ * it is defined */
+static void reach_name(char *name) {
+    for (Symbol *sym = reach_prog; sym; sym = sym->next) {
+        if (!sym->is_live && strcmp(sym->name, name) == 0) {
+            reach_symbol(sym);
+        }
+    }
+}
+
+/* Mark the globals and functions a tree refers to */
+static void reach_tree(ASTNode *node) {
+    for (; node; node = node->next) {
+        if (node->kind == ND_CALL && node->funcname) {
+            reach_name(node->funcname);
+        }
+        if (node->kind == ND_VAR && node->var && !node->var->is_local) {
+            reach_name(node->var->name);
+        }
+        reach_tree(node->lhs);
+        reach_tree(node->rhs);
+        reach_tree(node->cond);
+        reach_tree(node->then);
+        reach_tree(node->els);
+        reach_tree(node->init);
+        reach_tree(node->inc);
+        reach_tree(node->body);
+        reach_tree(node->args);
+    }
+}
+
+/* Mark the globals an initializer refers to */
+static void reach_init(Initializer *init) {
+    for (; init; init = init->next) {
+        if (init->is_expr) {
+            reach_tree(init->expr);
+        }
+        reach_init(init->children);
+    }
+}
+
+/* Mark what the code of fn refers to */
+static void reach_function(Symbol *fn) {
+    for (IRFunc *f = reach_fns; f; f = f->next) {
+        if (f->fn != fn) {
+            continue;
+        }
+        for (int i = 0; i < f->ncode; i++) {
+            IR *ir = &f->code[i];
+            if (ir->kind == IR_CALL) {
+                reach_name(ir->name);
+            } else if (ir->kind == IR_ADDR && !ir->var->is_local) {
+                reach_name(ir->var->name);
+            }
+        }
+        return;
+    }
+    reach_tree(fn->body);
+}
+
+/* Is sym a string literal? */
+static bool is_literal(Symbol *sym) {
+    return strncmp(sym->name, ".LC", 3) == 0;
+}
+
+/* Set is_live on the functions and globals to emit. fns is the IR, or
+ * NULL when the AST is compiled directly. */
+void mark_live_symbols(Symbol *prog, IRFunc *fns) {
+    reach_prog = prog;
+    reach_fns = fns;
+    nwork = 0;
+    bool all = !pass_enabled(PASS_DEAD_SYMBOLS);
+    for (Symbol *sym = prog; sym; sym = sym->next) {
+        sym->is_live = all;
+    }
+    if (all) {
+        return;
+    }
+    for (Symbol *sym = prog; sym; sym = sym->next) {
+        if (!sym->is_live && !sym->is_static && !is_literal(sym)) {
+            reach_symbol(sym);
+        }
+    }
+
+    while (nwork > 0) {
+        Symbol *sym = worklist[--nwork];
+        if (sym->is_function && sym->body) {
+            reach_function(sym);
+        } else if (!sym->is_function) {
+            reach_init(sym->init);
+        }
+    }
+}
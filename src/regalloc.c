@@ -0,0 +1,281 @@
+#include "compiler.h"
+
+/* Linear scan register allocation over the virtual registers of one
+ * function. Each virtual register gets a live interval spanning its first
+ * and last occurrence in the instruction list, widened to cover every
+ * basic block the register is live in. */
+
+static int *start;      /* First position of each vreg, or -1 */
+static int *end;        /* Last position of each vreg */
+static int *order;      /* Vregs in increasing start order */
+static int norder;
+static int *call_pos;   /* Positions of call instructions */
+static int ncalls;
+
+/* Record an occurrence of vreg r at position pos */
+static void touch(int r, int pos) {
+    if (r == 0) {
+        return;
+    }
+    if (start[r] < 0) {
+        start[r] = pos;
+        order[norder++] = r;
+    }
+    end[r] = pos;
+}
+
+/* Widen the interval of each vreg to cover the blocks it is live in.
+ * Liveness is found per vreg by walking backwards from each use that is
+ * not preceded by a definition in its block, up to the definitions. */
+static void extend_live_ranges(IRFunc *f) {
+    int nb = f->nblocks;
+    int n = f->ncode;
+    int nreg = f->nreg;
+    if (nb == 0) {
+        return;
+    }
+
+    int *block_of = calloc(n + 1, sizeof(int));
+    for (int b = 0; b < nb; b++) {
+        for (int i = f->blocks[b].start; i < f->blocks[b].end; i++) {
+            block_of[i] = b;
+        }
+    }
+
+    /* Occurrences of each vreg, grouped by vreg (counting sort) */
+    int *count = calloc(nreg + 1, sizeof(int));
+    int *uses[6];
+    for (int pos = 0; pos < n; pos++) {
+        IR *ir = &f->code[pos];
+        int nuses = ir_uses(ir, uses);
+        for (int i = 0; i < nuses; i++) {
+            count[*uses[i] + 1]++;
+        }
+        if (ir->dst) {
+            count[ir->dst + 1]++;
+        }
+    }
+    for (int r = 0; r < nreg; r++) {
+        count[r + 1] = count[r + 1] + count[r];
+    }
+    int *occ = calloc(count[nreg] + 1, sizeof(int));     /* Positions */
+    bool *is_def = calloc(count[nreg] + 1, sizeof(bool));
+    int *fill = calloc(nreg + 1, sizeof(int));
+    for (int pos = 0; pos < n; pos++) {
+        IR *ir = &f->code[pos];
+        int nuses = ir_uses(ir, uses);
+        for (int i = 0; i < nuses; i++) {
+            int r = *uses[i];
+            occ[count[r] + fill[r]++] = pos;
+        }
+        if (ir->dst) {
+            int r = ir->dst;
+            is_def[count[r] + fill[r]] = true;
+            occ[count[r] + fill[r]++] = pos;
+        }
+    }
+
+    /* first_def[b] is the first definition of the current vreg in block
+     * b, valid when def_stamp[b] is the vreg */
+    int *first_def = calloc(nb, sizeof(int));
+    int *def_stamp = calloc(nb, sizeof(int));
+    int *in_stamp = calloc(nb, sizeof(int));
+    int *out_stamp = calloc(nb, sizeof(int));
+    int *work = calloc(nb, sizeof(int));
+
+    for (int r = 1; r < nreg; r++) {
+        if (start[r] < 0) {
+            continue;
+        }
+        for (int k = count[r]; k < count[r + 1]; k++) {
+            int b = block_of[occ[k]];
+            if (is_def[k] && (def_stamp[b] != r || occ[k] < first_def[b])) {
+                def_stamp[b] = r;
+                first_def[b] = occ[k];
+            }
+        }
+
+        /* Blocks where r is live on entry, from upward-exposed uses */
+        int nwork = 0;
+        for (int k = count[r]; k < count[r + 1]; k++) {
+            int b = block_of[occ[k]];
+            if (is_def[k] || in_stamp[b] == r) {
+                continue;
+            }
+            if (def_stamp[b] == r && first_def[b] < occ[k]) {
+                continue;
+            }
+            in_stamp[b] = r;
+            work[nwork++] = b;
+        }
+        while (nwork > 0) {
+            BasicBlock *bb = &f->blocks[work[--nwork]];
+            if (bb->start < start[r]) {
+                start[r] = bb->start;
+            }
+            for (int i = 0; i < bb->npreds; i++) {
+                int p = bb->preds[i];
+                BasicBlock *pb = &f->blocks[p];
+                if (out_stamp[p] != r) {
+                    out_stamp[p] = r;
+                    if (pb->end - 1 > end[r]) {
+                        end[r] = pb->end - 1;
+                    }
+                }
+                if (def_stamp[p] != r && in_stamp[p] != r) {
+                    in_stamp[p] = r;
+                    work[nwork++] = p;
+                }
+            }
+        }
+    }
+
+    free(block_of);
+    free(count);
+    free(occ);
+    free(is_def);
+    free(fill);
+    free(first_def);
+    free(def_stamp);
+    free(in_stamp);
+    free(out_stamp);
+    free(work);
+}
+
+/* Compute live intervals */
+static void build_intervals(IRFunc *f) {
+    int n = f->ncode;
+    call_pos = calloc(n + 1, sizeof(int));
+    ncalls = 0;
+
+    int *uses[6];
+    for (int pos = 0; pos < n; pos++) {
+        IR *ir = &f->code[pos];
+        int nuses = ir_uses(ir, uses);
+        for (int i = 0; i < nuses; i++) {
+            touch(*uses[i], pos);
+        }
+        touch(ir->dst, pos);
+
+        if (ir->kind == IR_CALL) {
+            call_pos[ncalls++] = pos;
+        }
+    }
+
+    /* A value must also keep its register through every block it is live
+     * in, wherever that block is placed */
+    build_cfg(f);
+    extend_live_ranges(f);
+
+    /* Widening may move starts earlier: restore start order. The order
+     * is nearly sorted, so insertion sort is cheap. */
+    for (int k = 1; k < norder; k++) {
+        int r = order[k];
+        int j = k - 1;
+        while (j >= 0 && start[order[j]] > start[r]) {
+            order[j + 1] = order[j];
+            j--;
+        }
+        order[j + 1] = r;
+    }
+}
+
+/* Does vreg r hold a value across a call? */
+static bool crosses_call(int r) {
+    for (int i = 0; i < ncalls; i++) {
+        if (start[r] < call_pos[i] && call_pos[i] < end[r]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Give vreg r a spill slot */
+static void spill(IRFunc *f, int r) {
+    f->reg_of[r] = -1;
+    f->slot_of[r] = f->nslots++;
+}
+
+/* Allocate physical registers for f */
+void regalloc(IRFunc *f) {
+    int nreg = f->nreg;
+    start = calloc(nreg, sizeof(int));
+    end = calloc(nreg, sizeof(int));
+    order = calloc(nreg, sizeof(int));
+    norder = 0;
+    for (int r = 0; r < nreg; r++) {
+        start[r] = -1;
+    }
+
+    f->reg_of = calloc(nreg, sizeof(int));
+    f->slot_of = calloc(nreg, sizeof(int));
+    f->used_regs = calloc(NUM_ALLOC_REGS, sizeof(bool));
+    f->nslots = 0;
+    for (int r = 0; r < nreg; r++) {
+        f->reg_of[r] = -1;
+        f->slot_of[r] = -1;
+    }
+
+    build_intervals(f);
+
+    /* holder[p] is the vreg currently in physical register p, or 0 */
+    int holder[NUM_ALLOC_REGS];
+    for (int p = 0; p < NUM_ALLOC_REGS; p++) {
+        holder[p] = 0;
+    }
+
+    for (int k = 0; k < norder; k++) {
+        int r = order[k];
+
+        /* Expire intervals that ended. Operands are read before the
+         * destination is written, so an interval ending here is free. */
+        for (int p = 0; p < NUM_ALLOC_REGS; p++) {
+            if (holder[p] && end[holder[p]] <= start[r]) {
+                holder[p] = 0;
+            }
+        }
+
+        /* Values live across a call need a callee-saved register. Other
+         * values prefer the caller-saved ones, which cost no save slot. */
+        bool need_saved = crosses_call(r);
+        int reg = -1;
+        if (!need_saved) {
+            for (int p = NUM_CALLEE_SAVED; p < NUM_ALLOC_REGS && reg < 0; p++) {
+                if (!holder[p]) {
+                    reg = p;
+                }
+            }
+        }
+        for (int p = 0; p < NUM_CALLEE_SAVED && reg < 0; p++) {
+            if (!holder[p]) {
+                reg = p;
+            }
+        }
+
+        if (reg < 0) {
+            /* Spill whichever eligible interval ends last */
+            int victim = -1;
+            int limit = need_saved ? NUM_CALLEE_SAVED : NUM_ALLOC_REGS;
+            for (int p = 0; p < limit; p++) {
+                if (victim < 0 || end[holder[p]] > end[holder[victim]]) {
+                    victim = p;
+                }
+            }
+            if (end[holder[victim]] <= end[r]) {
+                spill(f, r);
+                continue;
+            }
+            spill(f, holder[victim]);
+            reg = victim;
+        }
+
+        holder[reg] = r;
+        f->reg_of[r] = reg;
+        f->used_regs[reg] = true;
+    }
+
+    free(start);
+    free(end);
+    free(order);
+    free(call_pos);
+}
@@ -25,4 +25,151 @@ void *va_arg(void *ap, int size) {
     (void)size;
     return 0;
 }
+#else
+/* Profiling runtime, linked into programs built with -fprofile-generate
+ * (see profile.c). Each translation unit registers the table of its
+ * functions' counters before main runs. At exit, the counts are added to
+ * those the profile file already has for the same functions; a function
+ * whose line no longer matches its counters gets a new line. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The tables written by emit_profile_data() */
+typedef struct {
+    const char *key;
+    long long checksum;
+    long long ncounters;
+    long long *counters;
+} ProfFunc;
+
+typedef struct {
+    const char *path;
+    long long nfuncs;
+    ProfFunc *funcs;
+} ProfUnit;
+
+/* A line of the profile file */
+typedef struct {
+    char *key;
+    long long checksum;
+    long long ncounters;
+    long long *counters;
+} ProfRecord;
+
+static ProfUnit **prof_units;
+static int nprof_units;
+
+/* A copy of s */
+static char *prof_strdup(const char *s) {
+    char *copy = malloc(strlen(s) + 1);
+    strcpy(copy, s);
+    return copy;
+}
+
+/* Read the lines of a profile file into *records; a file that does not
+ * exist yet has none */
+static int prof_read(const char *path, ProfRecord **records) {
+    int n = 0;
+    int cap = 0;
+    *records = NULL;
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return 0;
+    }
+    char key[4096];
+    while (fscanf(fp, " %4095s", key) == 1) {
+        if (key[0] == '#') {
+            int c = fgetc(fp);
+            while (c != EOF && c != '\n') {
+                c = fgetc(fp);
+            }
+            continue;
+        }
+        ProfRecord rec;
+        if (fscanf(fp, "%lld %lld", &rec.checksum, &rec.ncounters) != 2 ||
+            rec.ncounters < 0 || rec.ncounters > 100000000) {
+            break;
+        }
+        rec.key = prof_strdup(key);
+        rec.counters = calloc(rec.ncounters + 1, sizeof(long long));
+        for (long long i = 0; i < rec.ncounters; i++) {
+            if (fscanf(fp, "%lld", &rec.counters[i]) != 1) {
+                break;
+            }
+        }
+        if (n == cap) {
+            cap = cap * 2 + 16;
+            *records = realloc(*records, sizeof(ProfRecord) * cap);
+        }
+        (*records)[n++] = rec;
+    }
+    fclose(fp);
+    return n;
+}
+
+/* Add the counts of a unit to its profile file */
+static void prof_write(ProfUnit *unit) {
+    ProfRecord *records;
+    int n = prof_read(unit->path, &records);
+    records = realloc(records, sizeof(ProfRecord) * (n + unit->nfuncs + 1));
+
+    for (long long k = 0; k < unit->nfuncs; k++) {
+        ProfFunc *fn = &unit->funcs[k];
+        int r = 0;
+        while (r < n && strcmp(records[r].key, fn->key) != 0) {
+            r++;
+        }
+        if (r < n && records[r].checksum == fn->checksum &&
+            records[r].ncounters == fn->ncounters) {
+            for (long long i = 0; i < fn->ncounters; i++) {
+                records[r].counters[i] += fn->counters[i];
+            }
+            continue;
+        }
+        if (r == n) {
+            records[n++].key = prof_strdup(fn->key);
+        } else {
+            free(records[r].counters);
+        }
+        records[r].checksum = fn->checksum;
+        records[r].ncounters = fn->ncounters;
+        records[r].counters = calloc(fn->ncounters + 1, sizeof(long long));
+        memcpy(records[r].counters, fn->counters, sizeof(long long) * fn->ncounters);
+    }
+
+    FILE *fp = fopen(unit->path, "w");
+    if (!fp) {
+        fprintf(stderr, "profiling: cannot write %s\n", unit->path);
+        return;
+    }
+    fprintf(fp, "# mycc profile\n");
+    for (int r = 0; r < n; r++) {
+        fprintf(fp, "%s %lld %lld", records[r].key, records[r].checksum, records[r].ncounters);
+        for (long long i = 0; i < records[r].ncounters; i++) {
+            fprintf(fp, " %lld", records[r].counters[i]);
+        }
+        fprintf(fp, "\n");
+        free(records[r].key);
+        free(records[r].counters);
+    }
+    fclose(fp);
+    free(records);
+}
+
+/* Write the counts of every unit at exit */
+static void prof_dump(void) {
+    for (int i = 0; i < nprof_units; i++) {
+        prof_write(prof_units[i]);
+    }
+}
+
+/* Called for each instrumented unit before main */
+void __mycc_prof_register(ProfUnit *unit) {
+    if (nprof_units == 0) {
+        atexit(prof_dump);
+    }
+    prof_units = realloc(prof_units, sizeof(ProfUnit *) * (nprof_units + 1));
+    prof_units[nprof_units++] = unit;
+}
 #endif
@@ -0,0 +1,885 @@
+#include "compiler.h"
+
+/* SSA construction (Cytron et al.) and destruction.
+ *
+ * The SSA variables of a function are its promotable locals, i.e. scalar
+ * locals whose address is only ever used directly by a load or store of
+ * the variable's own size, and the virtual registers that are assigned
+ * more than once (the results of ?:, && and ||). Phi nodes are placed at
+ * the iterated dominance frontier of each variable's definitions, then a
+ * walk over the dominator tree gives every definition a fresh register.
+ * Loads and stores of promoted locals disappear. */
+
+static IRFunc *func;
+static int orig_nreg;      /* Registers below this existed before SSA */
+
+static Symbol **locals;    /* Promotable locals are variables 0..nlocals-1 */
+static int nlocals;
+static int nvars;          /* Multi-def registers are nlocals..nvars-1 */
+static int *var_size;      /* Access size of each local variable */
+static int *addr_var;      /* Variable addressed by an IR_ADDR result, or -1 */
+static int *reg_var;       /* Variable of a multi-def register, or -1 */
+static int *narrow;        /* Smallest size whose sign extension yields the
+                            * register's value (1, 4 or 8) */
+
+/* Renaming state */
+static int **stacks;       /* Current name of each variable */
+static int *stack_len;
+static int *stack_cap;
+static int *push_log;      /* Variables pushed, in order, for popping */
+static int log_len;
+static int log_cap;
+static int *repl;          /* Replacement for results of removed loads */
+static int *undef;         /* Register standing for an undefined variable */
+static int *first_child;   /* Dominator tree */
+static int *next_sibling;
+
+/* Append v to a growable int array */
+static void push_int(int **arr, int *len, int *cap, int v) {
+    if (*len == *cap) {
+        if (*cap) {
+            *cap = *cap * 2;
+        } else {
+            *cap = 8;
+        }
+        *arr = realloc(*arr, sizeof(int) * *cap);
+    }
+    (*arr)[*len] = v;
+    *len = *len + 1;
+}
+
+/* Allocate a fresh virtual register */
+static int ssa_new_reg(void) {
+    return func->nreg++;
+}
+
+/* Is this symbol a parameter the prologue stores to the frame, outside
+ * the IR? Only variadic functions do that; other functions read their
+ * parameters with IR_PARAM. */
+static bool is_param(Symbol *var) {
+    if (!func->fn->is_variadic) {
+        return false;
+    }
+    for (Symbol *p = func->fn->params; p; p = p->next) {
+        if (strcmp(p->name, var->name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Could a local of this type live in a register? */
+static bool is_scalar(Type *ty) {
+    return ty && (ty->kind == TY_INT || ty->kind == TY_CHAR ||
+                  ty->kind == TY_PTR || ty->kind == TY_ENUM) &&
+           (ty->size == 1 || ty->size == 4 || ty->size == 8);
+}
+
+/* Index of a local in locals[], adding it if needed */
+static int local_index(Symbol *var) {
+    for (int i = 0; i < nlocals; i++) {
+        if (locals[i] == var) {
+            return i;
+        }
+    }
+    locals[nlocals] = var;
+    return nlocals++;
+}
+
+/* Find the SSA variables of func */
+static void find_variables(void) {
+    int nreg = func->nreg;
+    int n = func->ncode;
+    addr_var = calloc(nreg, sizeof(int));
+    reg_var = calloc(nreg, sizeof(int));
+    narrow = calloc(nreg, sizeof(int));
+    locals = calloc(n + 1, sizeof(Symbol *));
+    nlocals = 0;
+    bool *bad = calloc(n + 1, sizeof(bool));
+    int *ndefs = calloc(nreg, sizeof(int));
+
+    for (int r = 0; r < nreg; r++) {
+        addr_var[r] = -1;
+        reg_var[r] = -1;
+        narrow[r] = 8;
+    }
+
+    /* Candidate locals and what each register is known to hold */
+    for (int i = 0; i < n; i++) {
+        IR *ir = &func->code[i];
+        if (ir->dst) {
+            ndefs[ir->dst]++;
+        }
+        switch (ir->kind) {
+            case IR_ADDR:
+                if (ir->var->is_local && is_scalar(ir->var->ty) && !is_param(ir->var)) {
+                    addr_var[ir->dst] = local_index(ir->var);
+                }
+                break;
+            case IR_LOAD:
+            case IR_CAST:
+            case IR_PARAM:
+                narrow[ir->dst] = ir->size;
+                break;
+            case IR_EQ:
+            case IR_NE:
+            case IR_LT:
+            case IR_LE:
+            case IR_GT:
+            case IR_GE:
+                narrow[ir->dst] = 1;
+                break;
+            case IR_MOV:
+                if (ir->imm >= -128 && ir->imm <= 127) {
+                    narrow[ir->dst] = 1;
+                } else {
+                    narrow[ir->dst] = 4;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    /* A local is promotable if its address is only used as the address
+     * of a load or store of the local's own size */
+    int *uses[6];
+    for (int i = 0; i < n; i++) {
+        IR *ir = &func->code[i];
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            int v = addr_var[*uses[k]];
+            if (v < 0) {
+                continue;
+            }
+            int size = locals[v]->ty->size;
+            bool ok = false;
+            if (ir->kind == IR_LOAD && ir->size == size) {
+                ok = true;
+            }
+            if (ir->kind == IR_STORE && uses[k] == &ir->lhs && ir->rhs != ir->lhs && ir->size == size) {
+                ok = true;
+            }
+            if (!ok) {
+                bad[v] = true;
+            }
+        }
+    }
+
+    /* Compact the list of promotable locals */
+    int *renum = calloc(nlocals + 1, sizeof(int));
+    int m = 0;
+    for (int v = 0; v < nlocals; v++) {
+        if (bad[v]) {
+            renum[v] = -1;
+        } else {
+            locals[m] = locals[v];
+            renum[v] = m++;
+        }
+    }
+    for (int r = 0; r < nreg; r++) {
+        if (addr_var[r] >= 0) {
+            addr_var[r] = renum[addr_var[r]];
+        }
+    }
+    nlocals = m;
+    var_size = calloc(nlocals + 1, sizeof(int));
+    for (int v = 0; v < nlocals; v++) {
+        var_size[v] = locals[v]->ty->size;
+    }
+
+    /* Registers assigned more than once */
+    nvars = nlocals;
+    for (int r = 1; r < nreg; r++) {
+        if (ndefs[r] > 1) {
+            reg_var[r] = nvars++;
+        }
+    }
+
+    free(bad);
+    free(ndefs);
+    free(renum);
+}
+
+/* Variable defined by instruction ir, or -1 */
+static int defined_var(IR *ir) {
+    if (ir->kind == IR_STORE && addr_var[ir->lhs] >= 0) {
+        return addr_var[ir->lhs];
+    }
+    if (ir->dst && ir->dst < orig_nreg && reg_var[ir->dst] >= 0) {
+        return reg_var[ir->dst];
+    }
+    return -1;
+}
+
+/* Variable read by the use of register r, or -1 */
+static int used_var(IR *ir, int r) {
+    if (ir->kind == IR_LOAD && addr_var[r] >= 0) {
+        return addr_var[r];
+    }
+    if (r < orig_nreg && reg_var[r] >= 0) {
+        return reg_var[r];
+    }
+    return -1;
+}
+
+/* Insert phi nodes at the iterated dominance frontiers of the blocks
+ * defining each variable. Variables never read before being written in
+ * the same block are left alone (semi-pruned SSA). */
+static void insert_phis(void) {
+    IRFunc *f = func;
+    int nb = f->nblocks;
+
+    /* Dominance frontiers */
+    int **df = calloc(nb, sizeof(int *));
+    int *ndf = calloc(nb, sizeof(int));
+    int *cap_df = calloc(nb, sizeof(int));
+    for (int b = 0; b < nb; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        if (bb->rpo < 0 || bb->npreds < 2) {
+            continue;
+        }
+        for (int k = 0; k < bb->npreds; k++) {
+            int runner = bb->preds[k];
+            while (runner >= 0 && runner != bb->idom) {
+                if (ndf[runner] == 0 || df[runner][ndf[runner] - 1] != b) {
+                    push_int(&df[runner], &ndf[runner], &cap_df[runner], b);
+                }
+                runner = f->blocks[runner].idom;
+            }
+        }
+    }
+
+    /* Definition sites and upward-exposed uses */
+    int **defsites = calloc(nvars + 1, sizeof(int *));
+    int *ndefsites = calloc(nvars + 1, sizeof(int));
+    int *cap_defsites = calloc(nvars + 1, sizeof(int));
+    bool *global = calloc(nvars + 1, sizeof(bool));
+    int *def_stamp = calloc(nvars + 1, sizeof(int));
+    int *uses[6];
+    for (int b = 0; b < nb; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        if (bb->rpo < 0) {
+            continue;
+        }
+        for (int i = bb->start; i < bb->end; i++) {
+            IR *ir = &f->code[i];
+            int nuses = ir_uses(ir, uses);
+            for (int k = 0; k < nuses; k++) {
+                int v = used_var(ir, *uses[k]);
+                if (v >= 0 && def_stamp[v] != b + 1) {
+                    global[v] = true;
+                }
+            }
+            int v = defined_var(ir);
+            if (v >= 0 && def_stamp[v] != b + 1) {
+                def_stamp[v] = b + 1;
+                push_int(&defsites[v], &ndefsites[v], &cap_defsites[v], b);
+            }
+        }
+    }
+
+    /* Place phis with a worklist per variable */
+    int **phis = calloc(nb, sizeof(int *));
+    int *nphis = calloc(nb, sizeof(int));
+    int *cap_phis = calloc(nb, sizeof(int));
+    int *has_phi = calloc(nb, sizeof(int));
+    int *in_work = calloc(nb, sizeof(int));
+    int *work = NULL;
+    int nwork = 0;
+    int cap_work = 0;
+    for (int v = 0; v < nvars; v++) {
+        if (!global[v]) {
+            continue;
+        }
+        nwork = 0;
+        for (int k = 0; k < ndefsites[v]; k++) {
+            in_work[defsites[v][k]] = v + 1;
+            push_int(&work, &nwork, &cap_work, defsites[v][k]);
+        }
+        while (nwork > 0) {
+            int x = work[--nwork];
+            for (int k = 0; k < ndf[x]; k++) {
+                int y = df[x][k];
+                if (has_phi[y] == v + 1) {
+                    continue;
+                }
+                has_phi[y] = v + 1;
+                push_int(&phis[y], &nphis[y], &cap_phis[y], v);
+                if (in_work[y] != v + 1) {
+                    in_work[y] = v + 1;
+                    push_int(&work, &nwork, &cap_work, y);
+                }
+            }
+        }
+    }
+
+    /* Materialize the phis after each block's label */
+    int ncode = f->ncode;
+    IR **before = calloc(ncode + 1, sizeof(IR *));
+    int *nbefore = calloc(ncode + 1, sizeof(int));
+    for (int b = 0; b < nb; b++) {
+        if (nphis[b] == 0) {
+            continue;
+        }
+        BasicBlock *bb = &f->blocks[b];
+        int at = bb->start;
+        if (f->code[at].kind == IR_LABEL) {
+            at++;
+        }
+        before[at] = calloc(nphis[b], sizeof(IR));
+        nbefore[at] = nphis[b];
+        for (int k = 0; k < nphis[b]; k++) {
+            IR *phi = &before[at][k];
+            phi->kind = IR_PHI;
+            phi->imm = phis[b][k];
+            phi->nargs = bb->npreds;
+            phi->args = calloc(bb->npreds, sizeof(int));
+        }
+    }
+    ir_insert_before(f, before, nbefore);
+
+    for (int b = 0; b < nb; b++) {
+        free(df[b]);
+        free(phis[b]);
+    }
+    for (int v = 0; v < nvars; v++) {
+        free(defsites[v]);
+    }
+    for (int i = 0; i <= ncode; i++) {
+        free(before[i]);
+    }
+    free(df);
+    free(ndf);
+    free(cap_df);
+    free(defsites);
+    free(ndefsites);
+    free(cap_defsites);
+    free(global);
+    free(def_stamp);
+    free(phis);
+    free(nphis);
+    free(cap_phis);
+    free(has_phi);
+    free(in_work);
+    free(work);
+    free(before);
+    free(nbefore);
+}
+
+/* Current name of variable v */
+static int top(int v) {
+    if (stack_len[v] > 0) {
+        return stacks[v][stack_len[v] - 1];
+    }
+    if (!undef[v]) {
+        undef[v] = ssa_new_reg();
+    }
+    return undef[v];
+}
+
+/* Make r the current name of variable v */
+static void push_name(int v, int r) {
+    push_int(&stacks[v], &stack_len[v], &stack_cap[v], r);
+    push_int(&push_log, &log_len, &log_cap, v);
+}
+
+/* Name that a use of register r refers to */
+static int resolve(int r) {
+    if (r >= orig_nreg) {
+        return r;
+    }
+    if (reg_var[r] >= 0) {
+        return top(reg_var[r]);
+    }
+    if (repl[r]) {
+        return repl[r];
+    }
+    return r;
+}
+
+/* Rename the variables in block b and the blocks it dominates */
+static void rename_block(int b) {
+    IRFunc *f = func;
+    BasicBlock *bb = &f->blocks[b];
+    int log_mark = log_len;
+    int *uses[6];
+
+    for (int i = bb->start; i < bb->end; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind == IR_PHI) {
+            ir->dst = ssa_new_reg();
+            push_name(ir->imm, ir->dst);
+            continue;
+        }
+
+        /* Accesses to promoted locals */
+        if (ir->kind == IR_ADDR && addr_var[ir->dst] >= 0) {
+            ir->kind = IR_NOP;
+            continue;
+        }
+        if (ir->kind == IR_LOAD && addr_var[ir->lhs] >= 0) {
+            repl[ir->dst] = top(addr_var[ir->lhs]);
+            ir->kind = IR_NOP;
+            continue;
+        }
+        if (ir->kind == IR_STORE && addr_var[ir->lhs] >= 0) {
+            int v = addr_var[ir->lhs];
+            int val = resolve(ir->rhs);
+            int size = var_size[v];
+            if (size < 8 && (val >= orig_nreg || narrow[val] > size)) {
+                /* Keep the truncation the store used to perform */
+                ir->kind = IR_CAST;
+                ir->dst = ssa_new_reg();
+                ir->lhs = val;
+                ir->rhs = 0;
+                ir->size = size;
+                push_name(v, ir->dst);
+            } else {
+                ir->kind = IR_NOP;
+                push_name(v, val);
+            }
+            continue;
+        }
+
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            *uses[k] = resolve(*uses[k]);
+        }
+        if (ir->dst && ir->dst < orig_nreg && reg_var[ir->dst] >= 0) {
+            int v = reg_var[ir->dst];
+            ir->dst = ssa_new_reg();
+            push_name(v, ir->dst);
+        }
+    }
+
+    /* Fill in this block's operand of the phis in its successors */
+    for (int k = 0; k < bb->nsuccs; k++) {
+        BasicBlock *succ = &f->blocks[bb->succs[k]];
+        int j = 0;
+        while (succ->preds[j] != b) {
+            j++;
+        }
+        for (int i = succ->start; i < succ->end; i++) {
+            IR *ir = &f->code[i];
+            if (ir->kind == IR_LABEL) {
+                continue;
+            }
+            if (ir->kind != IR_PHI) {
+                break;
+            }
+            ir->args[j] = top(ir->imm);
+        }
+    }
+
+    for (int c = first_child[b]; c >= 0; c = next_sibling[c]) {
+        rename_block(c);
+    }
+
+    while (log_len > log_mark) {
+        int v = push_log[--log_len];
+        stack_len[v]--;
+    }
+}
+
+/* Remove phis whose results are never used by anything but dead phis */
+static void remove_dead_phis(IRFunc *f) {
+    int *phi_at = calloc(f->nreg, sizeof(int));
+    bool *live = calloc(f->ncode + 1, sizeof(bool));
+    int *work = NULL;
+    int nwork = 0;
+    int cap_work = 0;
+    int *uses[6];
+
+    for (int r = 0; r < f->nreg; r++) {
+        phi_at[r] = -1;
+    }
+    for (int i = 0; i < f->ncode; i++) {
+        if (f->code[i].kind == IR_PHI) {
+            phi_at[f->code[i].dst] = i;
+        }
+    }
+
+    /* Phis used by ordinary instructions are live */
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind == IR_PHI) {
+            continue;
+        }
+        int nuses = ir_uses(ir, uses);
+        for (int k = 0; k < nuses; k++) {
+            int p = phi_at[*uses[k]];
+            if (p >= 0 && !live[p]) {
+                live[p] = true;
+                push_int(&work, &nwork, &cap_work, p);
+            }
+        }
+    }
+
+    /* So are phis used by live phis */
+    while (nwork > 0) {
+        IR *ir = &f->code[work[--nwork]];
+        for (int k = 0; k < ir->nargs; k++) {
+            int p = phi_at[ir->args[k]];
+            if (p >= 0 && !live[p]) {
+                live[p] = true;
+                push_int(&work, &nwork, &cap_work, p);
+            }
+        }
+    }
+
+    for (int i = 0; i < f->ncode; i++) {
+        if (f->code[i].kind == IR_PHI && !live[i]) {
+            f->code[i].kind = IR_NOP;
+        }
+    }
+
+    free(phi_at);
+    free(live);
+    free(work);
+}
+
+/* Convert f to SSA form */
+void to_ssa(IRFunc *f) {
+    func = f;
+    build_cfg(f);
+    if (f->nblocks == 0) {
+        return;
+    }
+
+    /* The entry block must not be a loop header: its phis would have no
+     * operand for the function entry */
+    if (f->blocks[0].npreds > 0) {
+        IR **before = calloc(f->ncode + 1, sizeof(IR *));
+        int *nbefore = calloc(f->ncode + 1, sizeof(int));
+        before[0] = calloc(1, sizeof(IR));
+        before[0][0].kind = IR_NOP;
+        nbefore[0] = 1;
+        ir_insert_before(f, before, nbefore);
+        free(before[0]);
+        free(before);
+        free(nbefore);
+        build_cfg(f);
+    }
+
+    orig_nreg = f->nreg;
+    find_variables();
+    if (nvars == 0) {
+        return;
+    }
+
+    compute_dominators(f);
+    insert_phis();
+    build_cfg(f);
+    compute_dominators(f);
+
+    /* Dominator tree as child/sibling lists */
+    int nb = f->nblocks;
+    first_child = calloc(nb, sizeof(int));
+    next_sibling = calloc(nb, sizeof(int));
+    for (int b = 0; b < nb; b++) {
+        first_child[b] = -1;
+        next_sibling[b] = -1;
+    }
+    for (int b = nb - 1; b >= 0; b--) {
+        int d = f->blocks[b].idom;
+        if (d >= 0) {
+            next_sibling[b] = first_child[d];
+            first_child[d] = b;
+        }
+    }
+
+    stacks = calloc(nvars, sizeof(int *));
+    stack_len = calloc(nvars, sizeof(int));
+    stack_cap = calloc(nvars, sizeof(int));
+    undef = calloc(nvars, sizeof(int));
+    repl = calloc(orig_nreg, sizeof(int));
+    push_log = NULL;
+    log_len = 0;
+    log_cap = 0;
+
+    rename_block(f->rpo[0]);
+
+    /* Variables read before any assignment start out as zero */
+    IR **before = calloc(f->ncode + 1, sizeof(IR *));
+    int *nbefore = calloc(f->ncode + 1, sizeof(int));
+    before[0] = calloc(nvars, sizeof(IR));
+    for (int v = 0; v < nvars; v++) {
+        if (undef[v]) {
+            IR *ir = &before[0][nbefore[0]++];
+            ir->kind = IR_MOV;
+            ir->dst = undef[v];
+        }
+    }
+    ir_insert_before(f, before, nbefore);
+    free(before[0]);
+    free(before);
+    free(nbefore);
+
+    remove_dead_phis(f);
+    ir_remove_nops(f);
+    build_cfg(f);
+
+    for (int v = 0; v < nvars; v++) {
+        free(stacks[v]);
+    }
+    free(stacks);
+    free(stack_len);
+    free(stack_cap);
+    free(undef);
+    free(repl);
+    free(push_log);
+    free(first_child);
+    free(next_sibling);
+    free(locals);
+    free(var_size);
+    free(addr_var);
+    free(reg_var);
+    free(narrow);
+}
+
+/* Append IR_COPY instructions performing the parallel copies
+ * dsts[i] = srcs[i] to out, using a temporary to break cycles */
+static void sequentialize(IRFunc *f, int *dsts, int *srcs, int n, IR **out, int *nout, int *cap) {
+    bool *done = calloc(n + 1, sizeof(bool));
+    int left = 0;
+    for (int i = 0; i < n; i++) {
+        if (dsts[i] == srcs[i]) {
+            done[i] = true;
+        } else {
+            left++;
+        }
+    }
+
+    while (left > 0) {
+        /* Emit a copy whose destination no pending copy still reads */
+        int pick = -1;
+        for (int i = 0; i < n && pick < 0; i++) {
+            if (done[i]) {
+                continue;
+            }
+            bool blocked = false;
+            for (int j = 0; j < n; j++) {
+                if (!done[j] && j != i && srcs[j] == dsts[i]) {
+                    blocked = true;
+                }
+            }
+            if (!blocked) {
+                pick = i;
+            }
+        }
+
+        if (pick < 0) {
+            /* Every pending copy is part of a cycle: save one destination
+             * in a temporary and read it from there */
+            for (int i = 0; i < n && pick < 0; i++) {
+                if (!done[i]) {
+                    pick = i;
+                }
+            }
+            int tmp = f->nreg++;
+            int saved = dsts[pick];
+            for (int j = 0; j < n; j++) {
+                if (!done[j] && srcs[j] == saved) {
+                    srcs[j] = tmp;
+                }
+            }
+            if (*nout == *cap) {
+                *cap = *cap * 2 + 4;
+                *out = realloc(*out, sizeof(IR) * *cap);
+            }
+            IR *ir = &(*out)[*nout];
+            *nout = *nout + 1;
+            memset(ir, 0, sizeof(IR));
+            ir->kind = IR_COPY;
+            ir->dst = tmp;
+            ir->lhs = saved;
+        }
+
+        if (*nout == *cap) {
+            *cap = *cap * 2 + 4;
+            *out = realloc(*out, sizeof(IR) * *cap);
+        }
+        IR *ir = &(*out)[*nout];
+        *nout = *nout + 1;
+        memset(ir, 0, sizeof(IR));
+        ir->kind = IR_COPY;
+        ir->dst = dsts[pick];
+        ir->lhs = srcs[pick];
+        done[pick] = true;
+        left--;
+    }
+
+    free(done);
+}
+
+/* Copies for the edge from block p to block s, in out */
+static void edge_copies(IRFunc *f, int p, int s, IR **out, int *nout, int *cap) {
+    BasicBlock *sb = &f->blocks[s];
+    int j = 0;
+    while (sb->preds[j] != p) {
+        j++;
+    }
+
+    int *dsts = calloc(sb->end - sb->start + 1, sizeof(int));
+    int *srcs = calloc(sb->end - sb->start + 1, sizeof(int));
+    int n = 0;
+    for (int i = sb->start; i < sb->end; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind != IR_PHI) {
+            continue;
+        }
+        dsts[n] = ir->dst;
+        srcs[n] = ir->args[j];
+        n++;
+    }
+    sequentialize(f, dsts, srcs, n, out, nout, cap);
+    free(dsts);
+    free(srcs);
+}
+
+/* Does block b have phis? Optimizations may have turned some of them
+ * into other instructions. */
+static bool has_phis(IRFunc *f, int b) {
+    BasicBlock *bb = &f->blocks[b];
+    for (int i = bb->start; i < bb->end; i++) {
+        if (f->code[i].kind == IR_PHI) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Append a copy of ir to a growable buffer */
+static void append(IR **out, int *nout, int *cap, IR *ir) {
+    if (*nout == *cap) {
+        *cap = *cap * 2 + 4;
+        *out = realloc(*out, sizeof(IR) * *cap);
+    }
+    memcpy(&(*out)[*nout], ir, sizeof(IR));
+    *nout = *nout + 1;
+}
+
+/* Append to tail a block with the copies for the edge from block b to
+ * block s, ending in a jump to s; return its label */
+static int split_edge(IRFunc *f, int b, int s, IR **tail, int *ntail, int *cap_tail) {
+    int label = new_ir_label();
+    IR ir;
+    memset(&ir, 0, sizeof(IR));
+    ir.kind = IR_LABEL;
+    ir.imm = label;
+    append(tail, ntail, cap_tail, &ir);
+    edge_copies(f, b, s, tail, ntail, cap_tail);
+    ir.kind = IR_JMP;
+    ir.imm = f->code[f->blocks[s].start].imm;
+    append(tail, ntail, cap_tail, &ir);
+    return label;
+}
+
+/* Replace the phis of f by copies on the incoming edges. An edge from a
+ * block ending in a conditional jump gets a block of its own for the
+ * copies: placed right after it for the fall-through edge, at the end of
+ * the function for the jump. So does every edge out of a switch. */
+void from_ssa(IRFunc *f) {
+    build_cfg(f);
+    int nb = f->nblocks;
+
+    IR *code = NULL;
+    int n = 0;
+    int cap = 0;
+    IR *tail = NULL;       /* Split blocks for jump edges */
+    int ntail = 0;
+    int cap_tail = 0;
+
+    for (int b = 0; b < nb; b++) {
+        BasicBlock *bb = &f->blocks[b];
+        IR *last = &f->code[bb->end - 1];
+        bool cond = last->kind == IR_JZ || last->kind == IR_JNZ;
+
+        /* Both edges of a conditional jump lead to the same block: the
+         * jump is redundant */
+        if (cond && bb->nsuccs == 1) {
+            last->kind = IR_NOP;
+            cond = false;
+        }
+
+        int body_end = bb->end;
+        bool term = last->kind == IR_JMP || last->kind == IR_RET || last->kind == IR_SWITCH || cond;
+        if (term) {
+            body_end--;
+        }
+        for (int i = bb->start; i < body_end; i++) {
+            if (f->code[i].kind != IR_PHI) {
+                append(&code, &n, &cap, &f->code[i]);
+            }
+        }
+
+        if (last->kind == IR_SWITCH) {
+            /* Table entries leading to a block with phis are redirected
+             * through a block with the copies */
+            for (int k = 0; k < bb->nsuccs; k++) {
+                int succ = bb->succs[k];
+                if (!has_phis(f, succ)) {
+                    continue;
+                }
+                int from = f->code[f->blocks[succ].start].imm;
+                int label = split_edge(f, b, succ, &tail, &ntail, &cap_tail);
+                for (int a = 0; a < last->nargs; a++) {
+                    if (last->args[a] == from) {
+                        last->args[a] = label;
+                    }
+                }
+                if (last->imm == from) {
+                    last->imm = label;
+                }
+            }
+            append(&code, &n, &cap, last);
+            continue;
+        }
+
+        if (!cond) {
+            /* Single successor: copies go before the terminator */
+            if (bb->nsuccs == 1 && has_phis(f, bb->succs[0])) {
+                edge_copies(f, b, bb->succs[0], &code, &n, &cap);
+            }
+            if (term) {
+                append(&code, &n, &cap, last);
+            }
+            continue;
+        }
+
+        /* Conditional jump: split edges that need copies */
+        int target = -1;
+        int fall = -1;
+        for (int k = 0; k < bb->nsuccs; k++) {
+            int s = bb->succs[k];
+            if (f->code[f->blocks[s].start].kind == IR_LABEL &&
+                f->code[f->blocks[s].start].imm == last->imm) {
+                target = s;
+            } else {
+                fall = s;
+            }
+        }
+
+        IR jump;
+        memcpy(&jump, last, sizeof(IR));
+        if (target >= 0 && has_phis(f, target)) {
+            jump.imm = split_edge(f, b, target, &tail, &ntail, &cap_tail);
+        }
+        append(&code, &n, &cap, &jump);
+        if (fall >= 0 && has_phis(f, fall)) {
+            edge_copies(f, b, fall, &code, &n, &cap);
+        }
+    }
+
+    for (int i = 0; i < ntail; i++) {
+        append(&code, &n, &cap, &tail[i]);
+    }
+    free(tail);
+    free(f->code);
+    f->code = code;
+    f->ncode = n;
+    f->capacity = cap;
+    ir_remove_nops(f);
+    build_cfg(f);
+}
@@ -0,0 +1,234 @@
+#include "compiler.h"
+
+/* Tail calls. A call whose result the function returns unchanged is in
+ * tail position: nothing of the caller is needed once it is made.
+ *
+ * tail_recursion() runs before SSA construction and turns calls of the
+ * function itself into a loop: the arguments are stored to the parameters
+ * and control jumps back to the start of the body. mark_tail_calls() runs
+ * last and flags the remaining calls in tail position, which the code
+ * generator makes by tearing down the frame and jumping to the callee.
+ *
+ * Neither is done when the address of a local may be passed on, since the
+ * callee could then read a frame that has been reused or popped, or in
+ * variadic functions, whose arguments live in the frame. */
+
+/* Instructions followed from a call to the return of its value */
+#define TAIL_SCAN 32
+
+static IRFunc *tc_func;
+
+/* Index of the label numbered label, or -1 */
+static int tc_label_index(int label) {
+    for (int i = 0; i < tc_func->ncode; i++) {
+        if (tc_func->code[i].kind == IR_LABEL && tc_func->code[i].imm == label) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Does the function return the value of register r, computed just before
+ * instruction i, with nothing else happening on the way? Copies of r and
+ * unconditional jumps are followed. */
+static bool returned(int i, int r) {
+    for (int steps = 0; steps < TAIL_SCAN && i >= 0 && i < tc_func->ncode; steps++) {
+        IR *ir = &tc_func->code[i];
+        switch (ir->kind) {
+            case IR_NOP:
+            case IR_LABEL:
+                i++;
+                break;
+            case IR_JMP:
+                i = tc_label_index(ir->imm);
+                break;
+            case IR_COPY:
+                if (ir->lhs == r) {
+                    r = ir->dst;
+                } else if (ir->dst == r) {
+                    return false;
+                }
+                i++;
+                break;
+            case IR_MOV:
+                if (ir->dst == r) {
+                    return false;
+                }
+                i++;
+                break;
+            case IR_RET:
+                return ir->lhs == 0 || ir->lhs == r;
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+/* May the address of one of the function's locals reach a callee? Only
+ * addresses used directly by loads and stores are known not to. */
+static bool tc_frame_escapes(void) {
+    IRFunc *f = tc_func;
+    if (f->fn->is_variadic) {
+        return true;
+    }
+    bool *is_addr = calloc(f->nreg + 1, sizeof(bool));
+    for (int i = 0; i < f->ncode; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind == IR_ADDR && ir->var->is_local) {
+            is_addr[ir->dst] = true;
+        }
+    }
+
+    bool escapes = false;
+    int *uses[6];
+    for (int i = 0; i < f->ncode && !escapes; i++) {
+        IR *ir = &f->code[i];
+        if (ir->kind == IR_LOAD || ir->kind == IR_STORE) {
+            escapes = ir->kind == IR_STORE && is_addr[ir->rhs];
+            continue;
+        }
+        int n = ir_uses(ir, uses);
+        for (int k = 0; k < n; k++) {
+            if (is_addr[*uses[k]]) {
+                escapes = true;
+            }
+        }
+    }
+    free(is_addr);
+    return escapes;
+}
+
+/* Number of parameters of fn */
+static int tc_count_params(Symbol *fn) {
+    int n = 0;
+    for (Symbol *p = fn->params; p; p = p->next) {
+        n++;
+    }
+    return n;
+}
+
+/* Is the call at i in tail position, with every argument in a register? */
+static bool tc_is_tail_call(int i) {
+    IR *ir = &tc_func->code[i];
+    return ir->kind == IR_CALL && ir->nargs <= 6 && returned(i + 1, ir->dst);
+}
+
+/* The local that holds a parameter, found the way the prologue does */
+static Symbol *tc_param_local(Symbol *param) {
+    for (Symbol *var = tc_func->fn->locals; var; var = var->next) {
+        if (strcmp(var->name, param->name) == 0) {
+            return var;
+        }
+    }
+    return NULL;
+}
+
+/* Index of the first instruction after the reading of the parameters:
+ * their IR_PARAMs, then the stores of the values read to their locals */
+static int tc_body_start(void) {
+    IRFunc *f = tc_func;
+    int nparams = 0;
+    while (nparams < f->ncode && f->code[nparams].kind == IR_PARAM) {
+        nparams++;
+    }
+    int i = nparams;
+    while (i + 1 < f->ncode && f->code[i].kind == IR_ADDR && f->code[i + 1].kind == IR_STORE &&
+           f->code[i + 1].lhs == f->code[i].dst) {
+        bool stores_param = false;
+        for (int k = 0; k < nparams; k++) {
+            if (f->code[k].dst == f->code[i + 1].rhs) {
+                stores_param = true;
+            }
+        }
+        if (!stores_param) {
+            break;
+        }
+        i += 2;
+    }
+    return i;
+}
+
+/* Turn calls of f to itself in tail position into jumps to the start of
+ * its body */
+void tail_recursion(IRFunc *f) {
+    tc_func = f;
+    int nparams = tc_count_params(f->fn);
+    if (nparams > 6 || tc_frame_escapes()) {
+        return;
+    }
+
+    int n = f->ncode;
+    IR **before = calloc(n + 1, sizeof(IR *));
+    int *nbefore = calloc(n + 1, sizeof(int));
+    int start = new_ir_label();
+    bool changed = false;
+
+    for (int i = 0; i < n; i++) {
+        IR *ir = &f->code[i];
+        if (!tc_is_tail_call(i) || strcmp(ir->name, f->fn->name) != 0 ||
+            ir->nargs != nparams) {
+            continue;
+        }
+
+        /* The arguments are all computed, so storing them in order
+         * cannot overwrite one still needed */
+        before[i] = calloc(2 * nparams + 1, sizeof(IR));
+        int k = 0;
+        for (Symbol *param = f->fn->params; param; param = param->next) {
+            Symbol *local = tc_param_local(param);
+            if (local) {
+                IR *addr = &before[i][nbefore[i]++];
+                addr->kind = IR_ADDR;
+                addr->dst = f->nreg++;
+                addr->var = local;
+                addr->name = local->name;
+                IR *store = &before[i][nbefore[i]++];
+                store->kind = IR_STORE;
+                store->lhs = addr->dst;
+                store->rhs = ir->args[k];
+                store->size = param->ty && (param->ty->size == 1 || param->ty->size == 4) ?
+                              param->ty->size : 8;
+            }
+            k++;
+        }
+        IR *jmp = &before[i][nbefore[i]++];
+        jmp->kind = IR_JMP;
+        jmp->imm = start;
+
+        /* The code after the call is left unreachable */
+        ir->kind = IR_NOP;
+        ir->dst = 0;
+        changed = true;
+    }
+
+    if (changed) {
+        int s = tc_body_start();
+        before[s] = realloc(before[s], (nbefore[s] + 1) * sizeof(IR));
+        memmove(&before[s][1], before[s], nbefore[s] * sizeof(IR));
+        memset(&before[s][0], 0, sizeof(IR));
+        before[s][0].kind = IR_LABEL;
+        before[s][0].imm = start;
+        nbefore[s]++;
+        ir_insert_before(f, before, nbefore);
+        ir_remove_nops(f);
+    }
+    for (int i = 0; i <= n; i++) {
+        free(before[i]);
+    }
+    free(before);
+    free(nbefore);
+}
+
+/* Flag the calls of f in tail position */
+void mark_tail_calls(IRFunc *f) {
+    tc_func = f;
+    if (tc_frame_escapes()) {
+        return;
+    }
+    for (int i = 0; i < f->ncode; i++) {
+        if (tc_is_tail_call(i)) {
+            f->code[i].tail = true;
+        }
+    }
+}
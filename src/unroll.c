@@ -0,0 +1,381 @@
+#include "compiler.h"
+
+/* Loop unrolling on the AST, so both code generators benefit. A for loop
+ * is counted when its condition compares an int local i with a constant
+ * or with a local the body leaves alone, its increment adds a constant
+ * step to i, and the body neither assigns i nor contains a break,
+ * continue, loop or switch. No local involved may have its address taken.
+ *
+ * A counted loop whose trip count is known and small is unrolled
+ * completely: its body and increment are repeated that many times.
+ * Otherwise the body and increment are repeated UNROLL_FACTOR times in a
+ * main loop that runs while a whole group of iterations is left, and the
+ * original loop (or, with a known trip count, straight copies) does the
+ * rest.
+ *
+ * #pragma unroll N before a loop sets the factor, #pragma unroll with no
+ * count unrolls completely whenever the trip count is known, and
+ * #pragma nounroll leaves the loop alone.
+ *
+ * Without a pragma, a profile from -fprofile-use has its say too: a loop
+ * that never ran is left alone, one that averaged fewer trips than the
+ * factor is not unrolled partially, and a hot one may have a body of up
+ * to UNROLL_HOT_BODY nodes. */
+
+/* Copies of the body in the main loop without a pragma */
+#define UNROLL_FACTOR 4
+
+/* Largest body, in nodes, unrolled without a pragma */
+#define UNROLL_BODY 40
+
+/* The same for loops the profile says are hot */
+#define UNROLL_HOT_BODY 80
+
+/* Most iterations, and nodes, unrolled completely without a pragma */
+#define UNROLL_FULL_TRIPS 8
+#define UNROLL_FULL_NODES 120
+
+/* Largest code any unrolling may produce, in nodes */
+#define UNROLL_MAX_NODES 4000
+
+/* Constants beyond this are not used to count iterations */
+#define UNROLL_MAX_CONST 1000000
+
+static ASTNode *unroll_body;  /* Body of the function being unrolled */
+static int unroll_count;      /* Loops created, to name their labels */
+
+/* A counted loop: i cmp bound, stepping i by step */
+typedef struct {
+    Symbol *var;
+    ASTNode *iv;       /* The ND_VAR reading i in the condition */
+    NodeKind cmp;      /* ND_LT, ND_LE, ND_GT, ND_GE or ND_NE */
+    ASTNode *bound;    /* ND_NUM or ND_VAR */
+    int step;
+    int trips;         /* Iterations, or -1 if not known */
+} Counted;
+
+/* Number of nodes in a tree */
+static int count_nodes(ASTNode *node) {
+    int n = 0;
+    for (; node; node = node->next) {
+        n += 1 + count_nodes(node->lhs) + count_nodes(node->rhs) +
+             count_nodes(node->cond) + count_nodes(node->then) +
+             count_nodes(node->els) + count_nodes(node->init) +
+             count_nodes(node->inc) + count_nodes(node->body) +
+             count_nodes(node->args);
+    }
+    return n;
+}
+
+/* Copy a tree, with the list it heads */
+static ASTNode *copy_tree(ASTNode *node) {
+    ASTNode head = {0};
+    ASTNode *cur = &head;
+    for (; node; node = node->next) {
+        ASTNode *copy = copy_node(node);
+        copy->lhs = copy_tree(node->lhs);
+        copy->rhs = copy_tree(node->rhs);
+        copy->cond = copy_tree(node->cond);
+        copy->then = copy_tree(node->then);
+        copy->els = copy_tree(node->els);
+        copy->init = copy_tree(node->init);
+        copy->inc = copy_tree(node->inc);
+        copy->body = copy_tree(node->body);
+        copy->args = copy_tree(node->args);
+        cur = cur->next = copy;
+    }
+    return head.next;
+}
+
+/* Is node the local var, read directly? */
+static bool is_var(ASTNode *node, Symbol *var) {
+    return node && node->kind == ND_VAR && node->var == var;
+}
+
+/* Does the tree take the address of var? */
+static bool address_taken(ASTNode *node, Symbol *var) {
+    for (; node; node = node->next) {
+        if (node->kind == ND_ADDR && is_var(node->lhs, var)) {
+            return true;
+        }
+        if (address_taken(node->lhs, var) || address_taken(node->rhs, var) ||
+            address_taken(node->cond, var) || address_taken(node->then, var) ||
+            address_taken(node->els, var) || address_taken(node->init, var) ||
+            address_taken(node->inc, var) || address_taken(node->body, var) ||
+            address_taken(node->args, var)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Can the tree be repeated as straight-line code without changing var?
+ * Control flow that refers to the loop, and nested loops and switches,
+ * whose labels are fixed in the tree, rule it out. */
+static bool can_repeat(ASTNode *node, Symbol *var) {
+    for (; node; node = node->next) {
+        switch (node->kind) {
+            case ND_BREAK:
+            case ND_CONTINUE:
+            case ND_WHILE:
+            case ND_FOR:
+            case ND_SWITCH:
+            case ND_CASE:
+                return false;
+            case ND_ASSIGN:
+                if (is_var(node->lhs, var)) {
+                    return false;
+                }
+                break;
+            default:
+                break;
+        }
+        if (!can_repeat(node->lhs, var) || !can_repeat(node->rhs, var) ||
+            !can_repeat(node->cond, var) || !can_repeat(node->then, var) ||
+            !can_repeat(node->els, var) || !can_repeat(node->init, var) ||
+            !can_repeat(node->inc, var) || !can_repeat(node->body, var) ||
+            !can_repeat(node->args, var)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Is var an int local whose address is never taken? */
+static bool is_plain_local(Symbol *var) {
+    return var->is_local && !var->is_static && var->ty && var->ty->kind == TY_INT &&
+           !address_taken(unroll_body, var);
+}
+
+/* The step of an increment of var: var = var + c, var = c + var or
+ * var = var - c, possibly inside the (var = ...) - 1 left by var++ */
+static bool find_step(ASTNode *inc, Symbol *var, int *step) {
+    if ((inc->kind == ND_ADD || inc->kind == ND_SUB) && inc->lhs->kind == ND_ASSIGN &&
+        inc->rhs->kind == ND_NUM) {
+        inc = inc->lhs;
+    }
+    if (inc->kind != ND_ASSIGN || !is_var(inc->lhs, var)) {
+        return false;
+    }
+    ASTNode *e = inc->rhs;
+    if (e->kind == ND_ADD && is_var(e->lhs, var) && e->rhs->kind == ND_NUM) {
+        *step = e->rhs->val;
+    } else if (e->kind == ND_ADD && is_var(e->rhs, var) && e->lhs->kind == ND_NUM) {
+        *step = e->lhs->val;
+    } else if (e->kind == ND_SUB && is_var(e->lhs, var) && e->rhs->kind == ND_NUM) {
+        *step = -e->rhs->val;
+    } else {
+        return false;
+    }
+    return *step != 0 && *step <= UNROLL_MAX_CONST && *step >= -UNROLL_MAX_CONST;
+}
+
+/* The comparison with its operands swapped */
+static NodeKind swap_cmp(NodeKind kind) {
+    if (kind == ND_LT) {
+        return ND_GT;
+    }
+    if (kind == ND_LE) {
+        return ND_GE;
+    }
+    if (kind == ND_GT) {
+        return ND_LT;
+    }
+    if (kind == ND_GE) {
+        return ND_LE;
+    }
+    return kind;
+}
+
+/* Is n a constant small enough to count with? */
+static bool small_const(ASTNode *n) {
+    return n->kind == ND_NUM && n->val <= UNROLL_MAX_CONST && n->val >= -UNROLL_MAX_CONST;
+}
+
+/* Iterations of a loop from start, or -1 if it may not end */
+static int trip_count(Counted *c, int start) {
+    int bound = c->bound->val;
+    int step = c->step;
+    NodeKind cmp = c->cmp;
+    if (step < 0) {
+        /* Count downwards as upwards */
+        start = -start;
+        bound = -bound;
+        step = -step;
+        cmp = swap_cmp(cmp);
+    }
+    if (cmp == ND_LT) {
+        return start < bound ? (bound - start + step - 1) / step : 0;
+    }
+    if (cmp == ND_LE) {
+        return start <= bound ? (bound - start) / step + 1 : 0;
+    }
+    if (cmp == ND_NE && start <= bound && (bound - start) % step == 0) {
+        return (bound - start) / step;
+    }
+    if ((cmp == ND_GT && start <= bound) || (cmp == ND_GE && start < bound)) {
+        return 0;
+    }
+    return -1;
+}
+
+/* Recognize a counted loop */
+static bool find_counted(ASTNode *node, Counted *c) {
+    ASTNode *cond = node->cond;
+    if (!cond || !node->inc || !node->then) {
+        return false;
+    }
+    if (cond->kind != ND_LT && cond->kind != ND_LE && cond->kind != ND_GT &&
+        cond->kind != ND_GE && cond->kind != ND_NE) {
+        return false;
+    }
+
+    /* i cmp bound, or bound cmp i: i is the variable the increment steps */
+    c->iv = cond->lhs;
+    c->bound = cond->rhs;
+    c->cmp = cond->kind;
+    if (c->iv->kind != ND_VAR || !find_step(node->inc, c->iv->var, &c->step)) {
+        c->iv = cond->rhs;
+        c->bound = cond->lhs;
+        c->cmp = swap_cmp(cond->kind);
+    }
+    if (c->iv->kind != ND_VAR || !find_step(node->inc, c->iv->var, &c->step) ||
+        !is_plain_local(c->iv->var) || !can_repeat(node->then, c->iv->var)) {
+        return false;
+    }
+    c->var = c->iv->var;
+    if (c->bound->kind == ND_VAR) {
+        if (c->bound->var == c->var || !is_plain_local(c->bound->var) ||
+            !can_repeat(node->then, c->bound->var)) {
+            return false;
+        }
+    } else if (!small_const(c->bound)) {
+        return false;
+    }
+
+    /* The trip count, when the init sets i to a constant */
+    c->trips = -1;
+    ASTNode *init = node->init;
+    if (init && init->kind == ND_EXPR_STMT && init->lhs->kind == ND_ASSIGN &&
+        is_var(init->lhs->lhs, c->var) && small_const(init->lhs->rhs) &&
+        c->bound->kind == ND_NUM) {
+        c->trips = trip_count(c, init->lhs->rhs->val);
+    }
+    return true;
+}
+
+/* Append to *cur n copies of the body and increment of a loop */
+static void append_copies(ASTNode **cur, ASTNode *loop, int n) {
+    for (int k = 0; k < n; k++) {
+        *cur = (*cur)->next = copy_tree(loop->then);
+        ASTNode *inc = new_node(ND_EXPR_STMT);
+        inc->lhs = copy_tree(loop->inc);
+        *cur = (*cur)->next = inc;
+    }
+}
+
+/* Unroll node, a counted for loop, in place */
+static void unroll(ASTNode *node, Counted *c) {
+    int hint = node->unroll;
+    int size = count_nodes(node->then) + count_nodes(node->inc) + 1;
+    bool profiled = node->profiled && hint == 0;
+    int body = UNROLL_BODY;
+    if (profiled && node->count == 0) {
+        return;
+    }
+    if (profiled && profile_hot(node->count2)) {
+        body = UNROLL_HOT_BODY;
+    }
+    if (size > body && hint == 0) {
+        return;
+    }
+
+    /* Complete unrolling */
+    bool full = c->trips >= 0 && c->trips <= UNROLL_MAX_NODES &&
+                c->trips * size <= UNROLL_MAX_NODES &&
+                ((hint == 0 && c->trips <= UNROLL_FULL_TRIPS &&
+                  c->trips * size <= UNROLL_FULL_NODES) ||
+                 hint < 0 || (hint > 1 && c->trips <= hint));
+
+    int factor = UNROLL_FACTOR;
+    if (hint > 1) {
+        factor = hint;
+    }
+    if (!full && (factor * size > UNROLL_MAX_NODES || c->cmp == ND_NE ||
+                  (c->step > 0 && (c->cmp == ND_GT || c->cmp == ND_GE)) ||
+                  (c->step < 0 && (c->cmp == ND_LT || c->cmp == ND_LE)) ||
+                  (c->trips >= 0 && c->trips < factor) ||
+                  (profiled && node->count2 / node->count < factor))) {
+        return;
+    }
+
+    ASTNode head = {0};
+    ASTNode *cur = &head;
+    if (node->init) {
+        cur = cur->next = node->init;
+    }
+
+    if (full) {
+        append_copies(&cur, node, c->trips);
+    } else {
+        /* Main loop: while i + (factor - 1) * step still passes the test */
+        ASTNode *loop = new_node(ND_FOR);
+        ASTNode *last = new_binary(ND_ADD, copy_node(c->iv), new_num((factor - 1) * c->step));
+        loop->cond = new_binary(c->cmp, last, copy_tree(c->bound));
+        add_type(loop->cond);
+        loop->unroll = 1;
+        loop->brk_label = calloc(32, 1);
+        loop->cont_label = calloc(32, 1);
+        sprintf(loop->brk_label, ".L.unroll.brk.%d", unroll_count);
+        sprintf(loop->cont_label, ".L.unroll.cont.%d", unroll_count);
+        unroll_count++;
+
+        ASTNode group = {0};
+        ASTNode *g = &group;
+        append_copies(&g, node, factor);
+        loop->then = new_node(ND_BLOCK);
+        loop->then->body = group.next;
+        cur = cur->next = loop;
+
+        /* The iterations left over */
+        if (c->trips >= 0) {
+            append_copies(&cur, node, c->trips % factor);
+        } else {
+            ASTNode *rest = copy_node(node);
+            rest->init = NULL;
+            rest->unroll = 1;
+            cur = cur->next = rest;
+        }
+    }
+
+    ASTNode *next = node->next;
+    memset(node, 0, sizeof(ASTNode));
+    node->kind = ND_BLOCK;
+    node->body = head.next;
+    node->next = next;
+}
+
+/* Unroll the loops in a tree, innermost first */
+static void unroll_tree(ASTNode *node) {
+    for (; node; node = node->next) {
+        unroll_tree(node->then);
+        unroll_tree(node->els);
+        unroll_tree(node->body);
+        if (node->kind == ND_FOR && node->unroll != 1) {
+            Counted c;
+            if (find_counted(node, &c)) {
+                unroll(node, &c);
+            }
+        }
+    }
+}
+
+/* Unroll the counted loops of every function */
+void unroll_loops(Symbol *prog) {
+    for (Symbol *fn = prog; fn; fn = fn->next) {
+        if (fn->is_function && fn->body) {
+            unroll_body = fn->body;
+            unroll_tree(fn->body);
+        }
+    }
+}
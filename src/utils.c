@@ -71,3 +71,38 @@ char *strdup_custom(const char *s) {
     }
     return new;
 }
+
+/* s as a quoted string for the assembler's .string directive */
+char *asm_quote(char *s) {
+    char *buf = calloc(strlen(s) * 4 + 3, 1);
+    char *out = buf;
+    *out++ = '"';
+    for (char *p = s; *p; p++) {
+        int c = *p;
+        /* Convert to unsigned range 0-255 */
+        if (c < 0) {
+            c = c + 256;
+        }
+        if (c == 10) {  /* \n */
+            strcpy(out, "\\n");
+        } else if (c == 9) {  /* \t */
+            strcpy(out, "\\t");
+        } else if (c == 13) {  /* \r */
+            strcpy(out, "\\r");
+        } else if (c == 92) {  /* \\ */
+            strcpy(out, "\\\\");
+        } else if (c == 34) {  /* \" */
+            strcpy(out, "\\\"");
+        } else if (c >= 32 && c < 127) {
+            /* Printable ASCII */
+            out[0] = c;
+            out[1] = 0;
+        } else {
+            /* Non-printable - use octal escape */
+            sprintf(out, "\\%03o", c);
+        }
+        out += strlen(out);
+    }
+    strcpy(out, "\"");
+    return buf;
+}
@@ -0,0 +1,395 @@
+#include "compiler.h"
+
+/* Loop vectorization with SSE2. A for loop qualifies when it steps an int
+ * local i by one while i < bound, bound being a constant or a local the
+ * body cannot change, and its body is the single statement
+ *
+ *     d[i] = a[i] op b[i];    d[i] = a[i] op k;    d[i] = a[i];
+ *
+ * over int or char arrays, where op is +, - or a comparison and k is a
+ * constant or a local. Arrays are global or local arrays, or pointer
+ * locals whose address is never taken.
+ *
+ * The vector part of such a loop becomes a call of a helper routine that
+ * the code generator writes at the end of the assembly: it handles 16
+ * bytes at a time for as many whole vectors as fit, and returns how many
+ * elements it did. The loop itself then runs on as the scalar epilogue.
+ * The helper first checks at run time that d does not overlap a source
+ * other than by being the same array, and does nothing if it does, so the
+ * loop is left to run in order. Being an ordinary call, the vector part
+ * goes through both code generators and the IR passes unchanged. */
+
+/* Loops with fewer known iterations are left scalar */
+#define VEC_MIN_TRIPS 4
+
+/* Helpers: four of each operation, for int or char with b or k */
+#define VEC_HELPERS 36
+
+/* Operations of the helpers */
+enum {
+    VEC_COPY, VEC_ADD, VEC_SUB, VEC_EQ, VEC_NE, VEC_LT, VEC_LE, VEC_GT, VEC_GE
+};
+
+static char *vec_op_names[] = {"copy", "add", "sub", "eq", "ne", "lt", "le", "gt", "ge"};
+
+/* Which helpers were called: op * 4 + (char ? 2 : 0) + (scalar ? 1 : 0) */
+static bool vec_used[VEC_HELPERS];
+
+static ASTNode *vec_body;  /* Body of the function being vectorized */
+
+/* Is node the local var, read directly? */
+static bool vec_is_var(ASTNode *node, Symbol *var) {
+    return node && node->kind == ND_VAR && node->var == var;
+}
+
+/* Does the tree take the address of var? */
+static bool vec_address_taken(ASTNode *node, Symbol *var) {
+    for (; node; node = node->next) {
+        if (node->kind == ND_ADDR && vec_is_var(node->lhs, var)) {
+            return true;
+        }
+        if (vec_address_taken(node->lhs, var) || vec_address_taken(node->rhs, var) ||
+            vec_address_taken(node->cond, var) || vec_address_taken(node->then, var) ||
+            vec_address_taken(node->els, var) || vec_address_taken(node->init, var) ||
+            vec_address_taken(node->inc, var) || vec_address_taken(node->body, var) ||
+            vec_address_taken(node->args, var)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Is var a local of one of the given kinds that only the function's own
+ * assignments can change? */
+static bool vec_plain_local(Symbol *var, TypeKind kind, TypeKind kind2) {
+    return var->is_local && !var->is_static && var->ty &&
+           (var->ty->kind == kind || var->ty->kind == kind2) &&
+           !vec_address_taken(vec_body, var);
+}
+
+/* Is inc i = i + 1, i = 1 + i, or the (i = i + 1) - 1 left by i++? */
+static bool vec_steps_by_one(ASTNode *inc, Symbol *i) {
+    if (inc->kind == ND_SUB && inc->lhs->kind == ND_ASSIGN && inc->rhs->kind == ND_NUM) {
+        inc = inc->lhs;
+    }
+    if (inc->kind != ND_ASSIGN || !vec_is_var(inc->lhs, i) || inc->rhs->kind != ND_ADD) {
+        return false;
+    }
+    ASTNode *e = inc->rhs;
+    return (vec_is_var(e->lhs, i) && e->rhs->kind == ND_NUM && e->rhs->val == 1) ||
+           (vec_is_var(e->rhs, i) && e->lhs->kind == ND_NUM && e->lhs->val == 1);
+}
+
+/* The element size of node if it is p[i] over int or char, else 0 */
+static int vec_access(ASTNode *node, Symbol *i) {
+    if (node->kind != ND_DEREF || node->lhs->kind != ND_ADD ||
+        !vec_is_var(node->lhs->rhs, i) || node->lhs->lhs->kind != ND_VAR) {
+        return 0;
+    }
+    Symbol *base = node->lhs->lhs->var;
+    Type *ty = base->ty;
+    if (!ty || !ty->base) {
+        return 0;
+    }
+    if (ty->kind != TY_ARRAY && !(ty->kind == TY_PTR && vec_plain_local(base, TY_PTR, TY_PTR))) {
+        return 0;
+    }
+    if (ty->base->kind != TY_INT && ty->base->kind != TY_CHAR) {
+        return 0;
+    }
+    return ty->base->size;
+}
+
+/* Is node a value the loop cannot change: a constant or a plain local? */
+static bool vec_invariant(ASTNode *node, Symbol *i) {
+    if (node->kind == ND_NUM) {
+        return true;
+    }
+    return node->kind == ND_VAR && node->var != i && vec_plain_local(node->var, TY_INT, TY_CHAR);
+}
+
+/* The helper operation for an operator, or -1 */
+static int vec_op(NodeKind kind) {
+    switch (kind) {
+        case ND_ADD: return VEC_ADD;
+        case ND_SUB: return VEC_SUB;
+        case ND_EQ: return VEC_EQ;
+        case ND_NE: return VEC_NE;
+        case ND_LT: return VEC_LT;
+        case ND_LE: return VEC_LE;
+        case ND_GT: return VEC_GT;
+        case ND_GE: return VEC_GE;
+        default: return -1;
+    }
+}
+
+/* Name of a helper */
+static char *vec_helper_name(int op, int size, bool scalar) {
+    char *name = calloc(32, 1);
+    sprintf(name, "__vec_%s_%s%s", vec_op_names[op], size == 1 ? "char" : "int",
+            scalar ? "_k" : "");
+    return name;
+}
+
+/* Vectorize node, a for loop, in place if it qualifies */
+static void vectorize(ASTNode *node) {
+    ASTNode *cond = node->cond;
+    if (!cond || !node->inc || !node->then) {
+        return;
+    }
+
+    /* i < bound, or bound > i */
+    ASTNode *iv = NULL;
+    ASTNode *bound = NULL;
+    if (cond->kind == ND_LT && cond->lhs->kind == ND_VAR) {
+        iv = cond->lhs;
+        bound = cond->rhs;
+    } else if (cond->kind == ND_GT && cond->rhs->kind == ND_VAR) {
+        iv = cond->rhs;
+        bound = cond->lhs;
+    } else {
+        return;
+    }
+    Symbol *i = iv->var;
+    if (!vec_plain_local(i, TY_INT, TY_INT) || !vec_steps_by_one(node->inc, i)) {
+        return;
+    }
+    if (bound->kind == ND_VAR) {
+        if (bound->var == i || !vec_plain_local(bound->var, TY_INT, TY_INT)) {
+            return;
+        }
+    } else if (bound->kind != ND_NUM) {
+        return;
+    }
+
+    /* A known trip count must fill at least one vector */
+    ASTNode *init = node->init;
+    if (init && init->kind == ND_EXPR_STMT && init->lhs->kind == ND_ASSIGN &&
+        vec_is_var(init->lhs->lhs, i) && init->lhs->rhs->kind == ND_NUM &&
+        bound->kind == ND_NUM && bound->val - init->lhs->rhs->val < VEC_MIN_TRIPS) {
+        return;
+    }
+
+    /* The body: one assignment to d[i] */
+    ASTNode *stmt = node->then;
+    if (stmt->kind == ND_BLOCK) {
+        if (!stmt->body || stmt->body->next) {
+            return;
+        }
+        stmt = stmt->body;
+    }
+    if (stmt->kind != ND_EXPR_STMT || stmt->lhs->kind != ND_ASSIGN) {
+        return;
+    }
+    ASTNode *assign = stmt->lhs;
+    int size = vec_access(assign->lhs, i);
+    if (size == 0) {
+        return;
+    }
+
+    /* The right-hand side: a[i], a[i] op b[i] or a[i] op k */
+    ASTNode *e = assign->rhs;
+    ASTNode *a = NULL;
+    ASTNode *b = NULL;
+    int op = VEC_COPY;
+    bool scalar = false;
+    if (vec_access(e, i) == size) {
+        a = e;
+    } else {
+        op = vec_op(e->kind);
+        if (op < 0) {
+            return;
+        }
+        a = e->lhs;
+        b = e->rhs;
+        if (op == VEC_ADD && vec_access(a, i) != size) {
+            a = e->rhs;
+            b = e->lhs;
+        }
+        if (vec_access(a, i) != size) {
+            return;
+        }
+        if (vec_access(b, i) != size) {
+            /* A scalar is spread over the lanes, which only keeps the
+             * meaning of operations that wrap like the stores do */
+            if ((op != VEC_ADD && op != VEC_SUB) || !vec_invariant(b, i)) {
+                return;
+            }
+            scalar = true;
+        }
+    }
+
+    /* Pointers to d[i], a[i], b[i] (or k) and the count n - i */
+    ASTNode *call = new_node(ND_CALL);
+    call->funcname = vec_helper_name(op, size, scalar);
+    call->ty = new_type(TY_INT, 4, 4);
+    ASTNode *arg = call->args = copy_node(assign->lhs->lhs);
+    arg = arg->next = copy_node(a->lhs);
+    if (!b) {
+        arg = arg->next = new_num(0);
+    } else if (scalar) {
+        arg = arg->next = copy_node(b);
+    } else {
+        arg = arg->next = copy_node(b->lhs);
+    }
+    arg->next = new_binary(ND_SUB, copy_node(bound), copy_node(iv));
+    vec_used[op * 4 + (size == 1 ? 2 : 0) + (scalar ? 1 : 0)] = true;
+
+    /* if (i >= 0 && i < bound) i = i + helper(...); then the loop */
+    ASTNode *step = new_node(ND_EXPR_STMT);
+    step->lhs = new_binary(ND_ASSIGN, copy_node(iv), new_binary(ND_ADD, copy_node(iv), call));
+    ASTNode *guard = new_node(ND_IF);
+    guard->cond = new_binary(ND_LAND, new_binary(ND_GE, copy_node(iv), new_num(0)),
+                             new_binary(ND_LT, copy_node(iv), copy_node(bound)));
+    guard->then = step;
+    add_type(guard);
+
+    ASTNode *rest = copy_node(node);
+    rest->init = NULL;
+    rest->next = NULL;
+
+    ASTNode head = {0};
+    ASTNode *cur = &head;
+    if (init) {
+        cur = cur->next = init;
+    }
+    cur = cur->next = guard;
+    cur->next = rest;
+
+    ASTNode *next = node->next;
+    memset(node, 0, sizeof(ASTNode));
+    node->kind = ND_BLOCK;
+    node->body = head.next;
+    node->next = next;
+}
+
+/* Vectorize the loops in a tree */
+static void vectorize_tree(ASTNode *node) {
+    for (; node; node = node->next) {
+        vectorize_tree(node->then);
+        vectorize_tree(node->els);
+        vectorize_tree(node->body);
+        if (node->kind == ND_FOR) {
+            vectorize(node);
+        }
+    }
+}
+
+/* Vectorize the simple array loops of every function */
+void vectorize_loops(Symbol *prog) {
+    for (Symbol *fn = prog; fn; fn = fn->next) {
+        if (fn->is_function && fn->body) {
+            vec_body = fn->body;
+            vectorize_tree(fn->body);
+        }
+    }
+}
+
+/* Check that the source in register src does not overlap the first
+ * r8 bytes of the destination rdi, unless it is the destination */
+static void vec_emit_overlap(FILE *out, char *name, char *src) {
+    fprintf(out, "  cmp %s, rdi\n", src);
+    fprintf(out, "  je .L.%s.%s\n", name, src);
+    fprintf(out, "  lea r10, [%s+r8]\n", src);
+    fprintf(out, "  cmp r10, rdi\n");
+    fprintf(out, "  jbe .L.%s.%s\n", name, src);
+    fprintf(out, "  lea r10, [rdi+r8]\n");
+    fprintf(out, "  cmp r10, %s\n", src);
+    fprintf(out, "  ja .L.%s.alias\n", name);
+    fprintf(out, ".L.%s.%s:\n", name, src);
+}
+
+/* Write one helper: (dst, a, b or k, n) -> elements done. The lanes of
+ * a are in xmm0 and those of b in xmm1; a compare leaves a mask of all
+ * ones or zero in each lane, which is turned into 1 or 0 by negating it,
+ * or into 0 or 1 by adding one. */
+static void vec_emit_helper(FILE *out, int op, int size, bool scalar) {
+    char *name = vec_helper_name(op, size, scalar);
+    char *t = size == 1 ? "b" : "d";
+    char *result = "xmm0";
+
+    fprintf(out, "%s:\n", name);
+    fprintf(out, "  movsxd rcx, ecx\n");
+    fprintf(out, "  mov rax, rcx\n");
+    fprintf(out, "  and rax, %d\n", -(16 / size));
+    fprintf(out, "  je .L.%s.done\n", name);
+    fprintf(out, "  lea r8, [rax*%d]\n", size);
+    vec_emit_overlap(out, name, "rsi");
+    if (op != VEC_COPY && !scalar) {
+        vec_emit_overlap(out, name, "rdx");
+    }
+    if (scalar) {
+        fprintf(out, "  movd xmm1, edx\n");
+        if (size == 1) {
+            fprintf(out, "  punpcklbw xmm1, xmm1\n");
+            fprintf(out, "  punpcklwd xmm1, xmm1\n");
+        }
+        fprintf(out, "  pshufd xmm1, xmm1, 0\n");
+    }
+    fprintf(out, "  xor r9d, r9d\n");
+    fprintf(out, ".L.%s.loop:\n", name);
+    fprintf(out, "  movdqu xmm0, [rsi+r9]\n");
+    if (op != VEC_COPY && !scalar) {
+        fprintf(out, "  movdqu xmm1, [rdx+r9]\n");
+    }
+    switch (op) {
+        case VEC_ADD:
+            fprintf(out, "  padd%s xmm0, xmm1\n", t);
+            break;
+        case VEC_SUB:
+            fprintf(out, "  psub%s xmm0, xmm1\n", t);
+            break;
+        case VEC_EQ:
+        case VEC_GT:
+            fprintf(out, "  pcmp%s%s xmm0, xmm1\n", op == VEC_EQ ? "eq" : "gt", t);
+            fprintf(out, "  pxor xmm2, xmm2\n");
+            fprintf(out, "  psub%s xmm2, xmm0\n", t);
+            result = "xmm2";
+            break;
+        case VEC_LT:
+            fprintf(out, "  pcmpgt%s xmm1, xmm0\n", t);
+            fprintf(out, "  pxor xmm2, xmm2\n");
+            fprintf(out, "  psub%s xmm2, xmm1\n", t);
+            result = "xmm2";
+            break;
+        case VEC_NE:
+        case VEC_LE:
+            fprintf(out, "  pcmp%s%s xmm0, xmm1\n", op == VEC_NE ? "eq" : "gt", t);
+            fprintf(out, "  pcmpeq%s xmm2, xmm2\n", t);
+            fprintf(out, "  psub%s xmm0, xmm2\n", t);
+            break;
+        case VEC_GE:
+            fprintf(out, "  pcmpgt%s xmm1, xmm0\n", t);
+            fprintf(out, "  pcmpeq%s xmm2, xmm2\n", t);
+            fprintf(out, "  psub%s xmm1, xmm2\n", t);
+            result = "xmm1";
+            break;
+        default:
+            break;
+    }
+    fprintf(out, "  movdqu [rdi+r9], %s\n", result);
+    fprintf(out, "  add r9, 16\n");
+    fprintf(out, "  cmp r9, r8\n");
+    fprintf(out, "  jb .L.%s.loop\n", name);
+    fprintf(out, ".L.%s.done:\n", name);
+    fprintf(out, "  ret\n");
+    fprintf(out, ".L.%s.alias:\n", name);
+    fprintf(out, "  xor eax, eax\n");
+    fprintf(out, "  ret\n");
+    free(name);
+}
+
+/* Write the helpers the vectorized loops call */
+void emit_vector_helpers(FILE *out) {
+    bool any = false;
+    for (int k = 0; k < VEC_HELPERS; k++) {
+        if (!vec_used[k]) {
+            continue;
+        }
+        if (!any) {
+            fprintf(out, ".text\n");
+            any = true;
+        }
+        vec_emit_helper(out, k / 4, k % 4 >= 2 ? 1 : 4, k % 2 == 1);
+    }
+}
@@ -6,6 +6,12 @@ TESTS_DIR="."
 PASS=0
 FAIL=0
 
+# Every test is compiled once per flag set, so that both the IR backend
+# (the default) and the AST backend are exercised, as are the lower
+# optimization levels. The instrumented build writes mycc.prof, which
+# the build after it is optimized with.
+FLAG_SETS=("" "-fno-ir" "-O0" "-O1" "-fprofile-generate" "-fprofile-use")
+
 # Colors
 GREEN='\033[0;32m'
 RED='\033[0;31m'
@@ -14,13 +20,14 @@ NC='\033[0m' # No Color
 # Function to run a test
 run_test() {
     local test_name=$1
+    local flags=$2
     local source_file="${test_name}.c"
     local expected_output="${test_name}.expected"
     
-    echo -n "Running test: ${test_name} ... "
+    echo -n "Running test: ${test_name}${flags:+ ($flags)} ... "
     
     # Compile with our compiler
-    ${COMPILER} -o ${test_name}_mycc ${source_file} 2>/dev/null
+    ${COMPILER} ${flags} -o ${test_name}_mycc ${source_file} 2>/dev/null
     if [ $? -ne 0 ]; then
         echo -e "${RED}FAIL${NC} (compilation failed with mycc)"
         FAIL=$((FAIL + 1))
@@ -63,7 +70,11 @@ cd ${TESTS_DIR}
 for test_file in test_*.c; do
     if [ -f "${test_file}" ]; then
         test_name="${test_file%.c}"
-        run_test ${test_name}
+        rm -f mycc.prof
+        for flags in "${FLAG_SETS[@]}"; do
+            run_test ${test_name} "${flags}"
+        done
+        rm -f mycc.prof
     fi
 done
 
@@ -0,0 +1,46 @@
+/* Test expressions that need many temporaries and calls inside expressions */
+
+int calls;
+
+int twice(int x) {
+    calls = calls + 1;
+    return x * 2;
+}
+
+int combine(int a, int b, int c, int d, int e, int f) {
+    return a * 100000 + b * 10000 + c * 1000 + d * 100 + e * 10 + f;
+}
+
+int main() {
+    int a = 1;
+    int b = 2;
+    int c = 3;
+    int d = 4;
+    int e = 5;
+    int f = 6;
+    int g = 7;
+    int h = 8;
+    
+    /* Balanced tree deeper than the number of temporary registers */
+    int r = ((((a+b)*(c+d))+((e+f)*(g+h)))*(((a+c)*(b+d))+((e+g)*(f+h)))) -
+            ((((a*b)+(c*d))*((e*f)+(g*h)))+(((a-b)*(c-d))*((e-f)*(g-h))));
+    if (r != 34507) return 1;
+    
+    /* Non-commutative operators with the heavier operand on the right */
+    if (100 - (a + (b * (c + d))) != 85) return 2;
+    if (1000 / (a + (b * (c + d))) != 66) return 3;
+    if (1000 % (a + (b * (c + d))) != 10) return 4;
+    if (a < (b * (c + d)) - 20) return 5;
+    
+    /* Calls nested in expressions and arguments */
+    int r2 = twice(a) + (twice(b) * (twice(c) - (twice(d) + twice(twice(e)))));
+    if (r2 != -86) return 6;
+    if (calls != 6) return 7;
+    if (combine(twice(1), c, a + b * c, twice(d) - 5, e, combine(0, 0, 0, 0, 1, 2) / 2) != 237356) return 8;
+    
+    /* Conditional expressions */
+    int t = a < b ? (c > d ? 10 : 20) : 30;
+    if (t != 20) return 9;
+    
+    return 0;
+}
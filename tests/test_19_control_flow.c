@@ -0,0 +1,96 @@
+/* Test control flow and values that live across loops and calls */
+#include <stdarg.h>
+
+int grid[3][4];
+
+int id(int x) {
+    return x;
+}
+
+int sum_after(int skip, int count, ...) {
+    va_list ap;
+    int total = 0;
+
+    va_start(ap, count);
+    for (int i = 0; i < count; i++) {
+        int val = va_arg(ap, int);
+        if (i == skip) continue;
+        total = total + val;
+    }
+    va_end(ap);
+    return total;
+}
+
+int classify(int x) {
+    int r = 0;
+    switch (x) {
+        case 1:
+            r = 10;
+            break;
+        case 3:
+            r = 20;
+        case 4:
+            r = r + 1;
+            break;
+        default:
+            r = -1;
+    }
+    return r;
+}
+
+int main() {
+    int a = 1;
+    int b = 2;
+    int c = 3;
+    int d = 4;
+    int e = 5;
+    int f = 6;
+    int g = 7;
+    int h = 8;
+
+    /* Many values live across calls */
+    int t = id(a) + id(b) * id(c) - id(d) + id(e) * id(f) + id(g) - id(h);
+    if (t != 32) return 1;
+    if (a + b + c + d + e + f + g + h != 36) return 2;
+
+    /* continue must still run the increment of a for loop */
+    int s = 0;
+    for (int i = 0; i < 10; i++) {
+        if (i % 3 == 0) continue;
+        if (i == 8) break;
+        s = s + i;
+    }
+    if (s != 19) return 3;
+
+    /* Nested loops writing a two-dimensional array */
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            grid[i][j] = i * 10 + j;
+        }
+    }
+    if (grid[2][3] != 23) return 4;
+    if (grid[1][0] != 10) return 5;
+
+    /* Pointer difference counts elements */
+    int arr[10];
+    int *p = &arr[7];
+    int *q = &arr[2];
+    if (p - q != 5) return 6;
+    if (*(p - 5) != *q) return 7;
+
+    /* Switch with fallthrough and default */
+    if (classify(1) != 10) return 8;
+    if (classify(3) != 21) return 9;
+    if (classify(4) != 1) return 10;
+    if (classify(9) != -1) return 11;
+
+    /* Variadic function with two named parameters */
+    if (sum_after(1, 4, 1, 2, 3, 4) != 8) return 12;
+
+    /* Logical operators and conditionals as values */
+    int x = 5;
+    if ((x > 3 && x < 10 || x == 0) != 1) return 13;
+    if (((x < 3) ? id(100) : id(200)) != 200) return 14;
+
+    return 0;
+}
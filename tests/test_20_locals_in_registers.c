@@ -0,0 +1,76 @@
+/* Test locals kept in registers across loops, branches and narrow types */
+
+int fib(int n) {
+    int a = 0;
+    int b = 1;
+    for (int i = 0; i < n; i++) {
+        int t = a;
+        a = b;
+        b = t + b;
+    }
+    return a;
+}
+
+/* Swapping in a loop needs the copies on the back edge to be ordered */
+int swap_loop(int n) {
+    int x = 1;
+    int y = 2;
+    for (int i = 0; i < n; i++) {
+        int t = x;
+        x = y;
+        y = t;
+    }
+    return x * 10 + y;
+}
+
+/* Assigning to a char must still wrap around */
+int wrap(int n) {
+    char c = 0;
+    for (int i = 0; i < n; i++) {
+        c = c + 100;
+    }
+    return c;
+}
+
+/* A local whose address is taken stays in memory */
+int through_pointer(int x) {
+    int y = 0;
+    int *p = &y;
+    *p = x;
+    y = y + 1;
+    return *p;
+}
+
+int nested(int n) {
+    int total = 0;
+    int k = 0;
+    while (k < n) {
+        int j = 0;
+        while (j < k) {
+            total = total + j;
+            j++;
+        }
+        k++;
+    }
+    return total;
+}
+
+int main() {
+    if (fib(10) != 55) return 1;
+    if (fib(0) != 0) return 2;
+    if (swap_loop(3) != 21) return 3;
+    if (swap_loop(4) != 12) return 4;
+    if (wrap(3) != 44) return 5;
+    if (wrap(2) != -56) return 6;
+    if (through_pointer(41) != 42) return 7;
+    if (nested(5) != 10) return 8;
+
+    /* A variable assigned on only one path */
+    int last;
+    for (int i = 0; i < 5; i++) {
+        if (i == 3) last = i;
+    }
+    if (last != 3) return 9;
+
+    return 0;
+}
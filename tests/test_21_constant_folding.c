@@ -0,0 +1,49 @@
+/* Test expressions with constant operands */
+
+enum { WIDTH = 8, HEIGHT = WIDTH * 2 + 1, AREA = WIDTH * HEIGHT };
+
+int cells = WIDTH * HEIGHT;
+int limits[3] = {1 + 1, 2 * 3, -4};
+
+int scale(int x) {
+    return x * 4 + 8;
+}
+
+int main() {
+    if (HEIGHT != 17) return 1;
+    if (AREA != 136) return 2;
+    if (cells != 136) return 3;
+    if (limits[0] != 2 || limits[1] != 6 || limits[2] != -4) return 4;
+
+    /* Division truncates towards zero */
+    if (-7 / 2 != -3) return 5;
+    if (-7 % 2 != -1) return 6;
+    if (7 / -2 != -3) return 7;
+
+    /* Casts and unary operators */
+    if ((char)300 != 44) return 8;
+    if ((char)200 != -56) return 9;
+    if (~5 != -6) return 10;
+    if (!0 != 1 || !7 != 0) return 11;
+    if ((3 > 2 ? 10 : 20) != 10) return 12;
+    if ((1 && 0) != 0 || (0 || 2) != 1) return 13;
+    if (sizeof(int) * 2 + 1 != 9) return 14;
+
+    /* Constants flowing through locals into a loop */
+    int k = 5;
+    int step = k * 4 + 8;
+    int s = 0;
+    for (int i = 0; i < 10; i++) {
+        s = s + step + i * 0 + 1 * i;
+    }
+    if (s != 325) return 15;
+    if (scale(3) != 20) return 16;
+
+    /* Values at the edge of the int range */
+    int big = 2147483647;
+    int small = -2147483647 - 1;
+    if (big + 0 != 2147483647) return 17;
+    if (small / 1 != small) return 18;
+
+    return 0;
+}
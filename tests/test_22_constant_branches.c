@@ -0,0 +1,56 @@
+/* Test branches whose conditions are known at compile time */
+#include <stdio.h>
+
+#define DEBUG_LEVEL 1
+#define USE_FAST_PATH 1
+
+int traced;
+
+int trace(int x) {
+    traced = traced + 1;
+    printf("trace %d\n", x);
+    return x;
+}
+
+int sum(int n) {
+    int mode = 2;
+    int acc = 0;
+    for (int i = 0; i < n; i++) {
+        if (DEBUG_LEVEL > 2) trace(i);
+        if (mode == 2) {
+            acc = acc + i;
+        } else {
+            acc = acc - i;
+        }
+    }
+    if (mode != 2) return -1;
+    return acc;
+}
+
+/* The value of x only becomes known once the loop is found to run once */
+int settle() {
+    int x = 1;
+    int done = 0;
+    while (!done) {
+        if (x != 1) x = 7;
+        done = 1;
+    }
+    return x;
+}
+
+int main() {
+    if (sum(10) != 45) return 1;
+    if (traced != 0) return 2;
+    if (settle() != 1) return 3;
+
+    int r;
+    if (USE_FAST_PATH) {
+        r = 10;
+    } else {
+        r = trace(20);
+    }
+    if (r != 10) return 4;
+
+    if (DEBUG_LEVEL >= 1) printf("level %d\n", DEBUG_LEVEL);
+    return 0;
+}
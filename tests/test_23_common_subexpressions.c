@@ -0,0 +1,65 @@
+/* Test repeated expressions with stores and calls in between */
+
+typedef struct {
+    int size;
+    int align;
+} Ty;
+
+typedef struct {
+    Ty *ty;
+    int offset;
+} Member;
+
+typedef struct {
+    Member *next;
+    int val;
+} Node;
+
+int counter;
+
+void bump(Ty *ty) {
+    ty->size = ty->size + 100;
+}
+
+int walk(Node *p, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + p->next->ty->size + p->next->ty->size * 2;
+        counter = i;
+        s = s + p->next->ty->size;
+
+        /* A store through the chain must be seen by the next load */
+        p->next->ty->size = p->next->ty->size + 1;
+        s = s + p->next->ty->size;
+    }
+    return s;
+}
+
+int main() {
+    Ty ty;
+    Member m;
+    Node node;
+    ty.size = 3;
+    m.ty = &ty;
+    node.next = &m;
+
+    if (walk(&node, 4) != 94) return 1;
+    if (ty.size != 7) return 2;
+
+    /* A call may change memory */
+    int before = node.next->ty->size;
+    bump(node.next->ty);
+    if (node.next->ty->size != before + 100) return 3;
+
+    /* Only one arm computes the value */
+    int x = counter * 3 + 1;
+    int y;
+    if (x > 5) {
+        y = counter * 3 + 1;
+    } else {
+        y = 0;
+    }
+    if (y != counter * 3 + 1) return 4;
+
+    return 0;
+}
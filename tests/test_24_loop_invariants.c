@@ -0,0 +1,80 @@
+/* Test loops whose bodies compute values that do not change */
+
+typedef struct {
+    int x;
+    int y;
+    int z;
+} Point;
+
+int table[16];
+Point points[8];
+int scale = 3;
+
+int sum_table(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + table[i] * scale;
+    }
+    return s;
+}
+
+int sum_z(Point *p, int n) {
+    int s = 0;
+    int i = 0;
+    while (i < n) {
+        s = s + p[i].z + p[i].y;
+        i++;
+    }
+    return s;
+}
+
+int nested(int a, int b) {
+    int s = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 5; j++) {
+            s = s + (a * b + 7) / 3 + i * (a - b) + j;
+        }
+    }
+    return s;
+}
+
+/* The bound is loop-invariant but the loop may not run at all */
+int guarded(int n, int d) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + 100 / d;
+    }
+    return s;
+}
+
+/* Stores in the loop change what a load of scale returns */
+int rescale(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + scale;
+        scale = scale + 1;
+    }
+    return s;
+}
+
+int main() {
+    for (int i = 0; i < 16; i++) {
+        table[i] = i;
+    }
+    for (int i = 0; i < 8; i++) {
+        points[i].x = i;
+        points[i].y = i * 2;
+        points[i].z = i * 3;
+    }
+
+    if (sum_table(16) != 360) return 1;
+    if (sum_table(0) != 0) return 2;
+    if (sum_z(points, 8) != 140) return 3;
+    if (nested(5, 2) != 310) return 4;
+    if (guarded(0, 0) != 0) return 5;
+    if (guarded(3, 7) != 42) return 6;
+    if (rescale(4) != 18) return 7;
+    if (scale != 7) return 8;
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+/* Test calls to small functions that can be inlined */
+
+typedef struct {
+    int x;
+    int y;
+} Point;
+
+static int get_x(Point *p) {
+    return p->x;
+}
+
+static int get_y(Point *p) {
+    return p->y;
+}
+
+static inline int clamp(int v, int lo, int hi) {
+    if (v < lo) return lo;
+    if (v > hi) return hi;
+    return v;
+}
+
+int square(int n) {
+    return n * n;
+}
+
+/* Called once, so inlined despite its size */
+static int checksum(char *s) {
+    int h = 0;
+    int i = 0;
+    char buf[8];
+    while (s[i]) {
+        buf[i % 8] = s[i];
+        h = h * 31 + buf[i % 8];
+        h = h % 1000003;
+        i++;
+    }
+    return h;
+}
+
+static void set(Point *p, int x, int y) {
+    p->x = x;
+    p->y = y;
+}
+
+static char low(char c) {
+    return c;
+}
+
+int fact(int n) {
+    if (n <= 1) return 1;
+    return n * fact(n - 1);
+}
+
+int is_odd(int n);
+
+int is_even(int n) {
+    if (n == 0) return 1;
+    return is_odd(n - 1);
+}
+
+int is_odd(int n) {
+    if (n == 0) return 0;
+    return is_even(n - 1);
+}
+
+/* The parameter is assigned in the body */
+static int count_down(int n) {
+    int steps = 0;
+    while (n > 0) {
+        n = n - 3;
+        steps++;
+    }
+    return steps;
+}
+
+int main() {
+    Point pts[4];
+    for (int i = 0; i < 4; i++) {
+        set(&pts[i], i, i * 10);
+    }
+    int s = 0;
+    for (int i = 0; i < 4; i++) {
+        s = s + get_x(&pts[i]) + get_y(&pts[i]);
+    }
+    if (s != 66) return 1;
+
+    if (clamp(5, 0, 3) != 3 || clamp(-2, 0, 3) != 0 || clamp(2, 0, 3) != 2) return 2;
+    if (square(square(3)) != 81) return 3;
+    if (checksum("hello") != 99162322 % 1000003) return 4;
+    if (low(300) != 44) return 5;
+    if (fact(6) != 720) return 6;
+    if (!is_even(10) || is_odd(10)) return 7;
+
+    int n = 10;
+    if (count_down(n) != 4 || n != 10) return 8;
+    if (count_down(count_down(9)) != 1) return 9;
+
+    return 0;
+}
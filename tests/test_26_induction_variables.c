@@ -0,0 +1,112 @@
+/* Test loops that index arrays with their counters */
+
+typedef struct {
+    int a;
+    int b;
+    char tag;
+} Rec;
+
+int data[32];
+Rec recs[6];
+int grid[20];
+
+int sum_up(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + data[i];
+    }
+    return s;
+}
+
+int sum_down(int n) {
+    int s = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        s = s * 3 + data[i];
+        s = s % 100000;
+    }
+    return s;
+}
+
+int sum_even(int n) {
+    int s = 0;
+    for (int i = 0; i <= n; i = i + 2) {
+        s = s + data[i];
+    }
+    return s;
+}
+
+/* The counter is still needed after the loop */
+int find(int x) {
+    int i;
+    for (i = 0; i != 32; i++) {
+        if (data[i] == x) break;
+    }
+    return i;
+}
+
+int count_chars(char *text, char c) {
+    int k = 0;
+    for (int i = 0; i < 16; i++) {
+        if (text[i] == c) k++;
+    }
+    return k;
+}
+
+int sum_recs(Rec *r, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + r[i].a * 2 + r[i].b + r[i].tag;
+    }
+    return s;
+}
+
+int sum_grid() {
+    int s = 0;
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 5; j++) {
+            s = s + grid[i * 5 + j] * (i + 1);
+        }
+    }
+    return s;
+}
+
+int scaled(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + i * 3 + i * 8 + i * 10;
+    }
+    return s;
+}
+
+int main() {
+    char text[16];
+    for (int i = 0; i < 32; i++) {
+        data[i] = i * 7 % 11;
+    }
+    for (int i = 0; i < 16; i++) {
+        text[i] = 'a' + i % 3;
+    }
+    for (int i = 0; i < 6; i++) {
+        recs[i].a = i;
+        recs[i].b = 100 - i;
+        recs[i].tag = 'x' + i;
+    }
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 5; j++) {
+            grid[i * 5 + j] = i * 5 + j;
+        }
+    }
+
+    if (sum_up(32) != 161) return 1;
+    if (sum_up(-3) != 0) return 2;
+    if (sum_down(20) != 64016) return 3;
+    if (sum_down(0) != 0) return 4;
+    if (sum_even(30) != 74) return 5;
+    if (find(9) != 6 || find(99) != 32) return 6;
+    if (count_chars(text, 'b') != 5) return 7;
+    if (sum_recs(recs, 6) != 1350) return 8;
+    if (sum_grid() != 600) return 9;
+    if (scaled(10) != 945) return 10;
+
+    return 0;
+}
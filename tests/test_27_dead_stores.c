@@ -0,0 +1,112 @@
+/* Test code whose results or stores are never read */
+
+typedef struct {
+    int x;
+    int y;
+} Pair;
+
+int calls = 0;
+
+int touch(int v) {
+    calls++;
+    return v;
+}
+
+void fill(int *p, int n) {
+    for (int i = 0; i < n; i++) {
+        p[i] = i + 1;
+    }
+}
+
+int sum(int *p, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + p[i];
+    }
+    return s;
+}
+
+/* Stores to an array that is never read again */
+int unused_array(int n) {
+    int a[4] = {1, 2, 3, 4};
+    a[n] = 9;
+    return n * 2;
+}
+
+/* The first store is overwritten before the only read */
+int overwritten(int n) {
+    Pair p;
+    p.x = n;
+    p.x = n + 1;
+    p.y = 5;
+    return p.x;
+}
+
+/* A parameter changed after its last use */
+int late_param(int a, int b) {
+    int r = a + b;
+    a = a * 3;
+    b++;
+    return r;
+}
+
+/* Calls must stay even when their result is unused */
+int side_effects(int n) {
+    int unused = touch(n) + 1;
+    touch(unused);
+    return n;
+}
+
+/* The array escapes to a call, so its stores must stay */
+int escaped(int n) {
+    int a[5];
+    a[0] = 100;
+    a[3] = 10;
+    a[4] = 20;
+    fill(a, n);
+    return sum(a, 5);
+}
+
+/* Stores in a loop that are read on the next iteration */
+int carried(int n) {
+    int a[2];
+    a[0] = 0;
+    a[1] = 1;
+    for (int i = 0; i < n; i++) {
+        int t = a[0] + a[1];
+        a[0] = a[1];
+        a[1] = t;
+    }
+    return a[0];
+}
+
+/* A pointer into the array picks which element is read */
+int through_pointer(int k) {
+    int a[3];
+    int *p = a;
+    a[0] = 7;
+    a[1] = 8;
+    a[2] = 9;
+    p = p + k;
+    *p = *p * 10;
+    return a[0] + a[1] + a[2];
+}
+
+int main() {
+    int x = 0;
+    x++;
+    x--;
+
+    if (unused_array(2) != 4) return 1;
+    if (overwritten(6) != 7) return 2;
+    if (late_param(3, 4) != 7) return 3;
+    if (side_effects(5) != 5) return 4;
+    if (calls != 2) return 5;
+    if (escaped(3) != 36) return 6;
+    if (escaped(5) != 15) return 7;
+    if (carried(10) != 55) return 8;
+    if (through_pointer(1) != 96) return 9;
+    if (x != 0) return 10;
+
+    return 0;
+}
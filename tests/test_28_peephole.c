@@ -0,0 +1,83 @@
+/* Test code whose assembly the peephole pass rewrites */
+
+typedef struct {
+    int a;
+    int b;
+    char c;
+} Rec;
+
+int g = 3;
+Rec grec;
+
+int add3(int x, int y, int z) {
+    return x + y + z;
+}
+
+/* Comparisons used both as values and as branch conditions */
+int compare(int x, int y) {
+    int r = 0;
+    if (x < y) r = r + 1;
+    if (x == y) r = r + 10;
+    if (!(x > y)) r = r + 100;
+    if (x != 0) r = r + 1000;
+    return r + (x >= y) + (x <= y) * 2;
+}
+
+/* Loads and stores through addresses of locals, globals and members */
+int through_addresses(int n) {
+    Rec r;
+    int *p = &r.b;
+    r.a = n;
+    *p = n * 2;
+    r.c = 7;
+    grec.a = r.a + r.b;
+    grec.c = r.c;
+    g = g + grec.a;
+    return grec.a + grec.c + g;
+}
+
+/* Deep expressions that push and pop intermediate values */
+int deep(int a, int b, int c) {
+    return (a + b) * (b - c) - (a * (c + (b - (a + 1)))) + add3(a, b * 2, c - 1);
+}
+
+/* Zero constants and adds of zero */
+int zeros(int x) {
+    int z = 0;
+    int s = x + z;
+    s = s - z;
+    if (s == 0) return -1;
+    return s;
+}
+
+/* Code after return and jumps to the next line */
+int early(int x) {
+    while (1) {
+        if (x > 10) return x;
+        x = x + 3;
+        continue;
+    }
+    return 0;
+}
+
+/* Values that stay live across calls in argument registers */
+int args_live(int a, int b) {
+    int t = add3(a, b, 0);
+    return add3(t, a, b) + a;
+}
+
+int main() {
+    if (compare(1, 2) != 1103) return 1;
+    if (compare(2, 2) != 1113) return 2;
+    if (compare(3, 2) != 1001) return 3;
+    if (compare(0, 0) != 113) return 4;
+    if (through_addresses(4) != 34) return 5;
+    if (g != 15) return 6;
+    if (deep(2, 5, 1) != 34) return 7;
+    if (zeros(0) != -1) return 8;
+    if (zeros(9) != 9) return 9;
+    if (early(0) != 12) return 10;
+    if (args_live(2, 3) != 12) return 11;
+
+    return 0;
+}
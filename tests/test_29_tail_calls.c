@@ -0,0 +1,112 @@
+/* Test calls in tail position */
+
+int depth = 0;
+
+/* Self recursion with an accumulator */
+int sum_to(int n, int acc) {
+    if (n == 0) return acc;
+    return sum_to(n - 1, acc + n);
+}
+
+/* Arguments swap places on each call */
+int gcd(int a, int b) {
+    if (b == 0) return a;
+    return gcd(b, a % b);
+}
+
+/* Six arguments rotated on each call */
+int rotate(int n, int a, int b, int c, int d, int e) {
+    if (n == 0) return a * 10000 + b * 1000 + c * 100 + d * 10 + e;
+    return rotate(n - 1, b, c, d, e, a);
+}
+
+/* Mutual recursion through sibling calls */
+int is_even(int n);
+
+int is_odd(int n) {
+    if (n == 0) return 0;
+    return is_even(n - 1);
+}
+
+int is_even(int n) {
+    if (n == 0) return 1;
+    return is_odd(n - 1);
+}
+
+/* Not a tail call: the result is used after the call */
+int fact(int n) {
+    if (n <= 1) return 1;
+    return n * fact(n - 1);
+}
+
+/* The callee reads a local of the caller through a pointer */
+int read_ptr(int *p) {
+    return *p + 1;
+}
+
+int pass_local(int n) {
+    int x = n * 2;
+    return read_ptr(&x);
+}
+
+/* A local array whose address reaches the recursive call */
+int walk(int *a, int i, int n) {
+    if (i == n) return 0;
+    return a[i] + walk(a, i + 1, n);
+}
+
+int nested(int n) {
+    int buf[4];
+    buf[0] = n;
+    buf[1] = n + 1;
+    buf[2] = n + 2;
+    buf[3] = n + 3;
+    if (n > 0) return walk(buf, 0, 4) + nested(n - 1);
+    return walk(buf, 0, 4);
+}
+
+/* A void function ending in a call */
+void count_down(int n) {
+    if (n == 0) return;
+    depth++;
+    count_down(n - 1);
+}
+
+/* Tail call of a function with fewer arguments */
+int twice(int x) {
+    return x * 2;
+}
+
+int pick(int flag, int a, int b) {
+    if (flag) return twice(a);
+    return twice(b) + 1;
+}
+
+/* Calls in both arms of a returned ?:, nested */
+int collatz(int n, int steps) {
+    return n == 1 ? steps : n % 2 ? collatz(3 * n + 1, steps + 1)
+                                  : collatz(n / 2, steps + 1);
+}
+
+int choose(int flag, int a, int b) {
+    return flag ? twice(a) : pick(0, a, b);
+}
+
+int main() {
+    if (sum_to(10000, 0) != 50005000) return 1;
+    if (gcd(1071, 462) != 21) return 2;
+    if (rotate(7, 1, 2, 3, 4, 5) != 34512) return 3;
+    if (!is_even(10000)) return 4;
+    if (is_odd(10000)) return 5;
+    if (fact(10) != 3628800) return 6;
+    if (pass_local(20) != 41) return 7;
+    if (nested(3) != 48) return 8;
+    count_down(5000);
+    if (depth != 5000) return 9;
+    if (pick(1, 3, 4) != 6) return 10;
+    if (pick(0, 3, 4) != 9) return 11;
+    if (collatz(27, 0) != 111) return 12;
+    if (choose(1, 3, 4) != 6 || choose(0, 3, 4) != 9) return 13;
+
+    return 0;
+}
@@ -0,0 +1,154 @@
+/* Test loops that are unrolled completely or in part */
+
+int data[64];
+
+/* Unknown trip count: main loop plus remainder */
+int sum_first(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + data[i];
+    }
+    return s;
+}
+
+/* Counting down by more than one */
+int down_by_three(int n) {
+    int s = 0;
+    for (int i = n; i > 0; i = i - 3) {
+        s = s * 3 + i;
+    }
+    return s;
+}
+
+/* Factor from a pragma, with an inclusive bound */
+int odd_squares(int n) {
+    int s = 0;
+#pragma GCC unroll 3
+    for (int i = 1; i <= n; i += 2) {
+        s = s + i * i;
+    }
+    return s;
+}
+
+/* Small constant trip count: unrolled completely */
+int tiny(void) {
+    int s = 0;
+    for (int i = 0; i < 5; i++) {
+        s = s * 2 + i;
+    }
+    return s;
+}
+
+/* Complete unrolling asked for, with a != test */
+int evens(void) {
+    int s = 0;
+#pragma unroll
+    for (int i = 0; i != 20; i = i + 2) {
+        s = s + i;
+    }
+    return s;
+}
+
+/* Unrolling turned off */
+int kept(void) {
+    int s = 0;
+#pragma nounroll
+    for (int i = 0; i < 10; i++) {
+        s = s + i;
+    }
+    return s;
+}
+
+/* Known trip count that is not a multiple of the factor */
+int known(void) {
+    int s = 0;
+    for (int i = 3; i < 30; i++) {
+        s = s + i;
+    }
+    return s;
+}
+
+/* A return inside the body */
+int find_big(int n) {
+    for (int i = 0; i < n; i++) {
+        if (data[i] > 50) return i;
+    }
+    return -1;
+}
+
+/* The loop variable is used after the loop */
+int last_index(int n) {
+    int i;
+    int s = 7;
+    for (i = 10; i < n; i++) {
+        s = s + 1;
+    }
+    return s + i;
+}
+
+/* The bound is a variable changed by the body: not unrolled */
+int moving_bound(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        n = n - 1;
+        s = s + i;
+    }
+    return s * 100 + n;
+}
+
+/* Blanks after the '#', a tab after GCC, and pragmas that are not
+ * loop hints */
+int spaced(int n) {
+    int s = 0;
+#  pragma unroll 4
+    for (int i = 0; i < n; i++) {
+        s = s + i;
+    }
+# pragma omp parallel for
+    for (int i = 0; i < n; i++) {
+        s = s + 2;
+    }
+#pragma GCC	unroll 2
+    for (int i = 0; i < n; i++) {
+        s = s + 3;
+    }
+#pragma unrolled
+    for (int i = 0; i < n; i++) {
+        s = s + 4;
+    }
+#pragma unroll_foo 8
+    for (int i = 0; i < n; i++) {
+        s = s + 5;
+    }
+    return s;
+}
+
+int main() {
+    for (int i = 0; i < 64; i++) {
+        data[i] = i * 7 % 13;
+    }
+
+    if (sum_first(0) != 0) return 1;
+    if (sum_first(3) != 8) return 2;
+    if (sum_first(11) != 60) return 3;
+    if (down_by_three(10) != 346) return 4;
+    if (down_by_three(2) != 2) return 5;
+    if (odd_squares(9) != 165) return 6;
+    if (odd_squares(10) != 165) return 7;
+    if (odd_squares(0) != 0) return 8;
+    if (tiny() != 26) return 9;
+    if (evens() != 90) return 10;
+    if (kept() != 45) return 11;
+    if (known() != 432) return 12;
+    if (find_big(64) != -1) return 13;
+    data[5] = 77;
+    if (find_big(64) != 5) return 14;
+    if (find_big(5) != -1) return 15;
+    if (last_index(5) != 17) return 16;
+    if (last_index(14) != 25) return 17;
+    if (moving_bound(10) != 1005) return 18;
+    if (spaced(7) != 119) return 19;
+    if (spaced(0) != 0) return 20;
+
+    return 0;
+}
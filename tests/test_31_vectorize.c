@@ -0,0 +1,176 @@
+/* Test loops over arrays that are run with vector instructions */
+
+int xs[100];
+int ys[100];
+int zs[100];
+
+/* Sum of the first n elements of an int array */
+int total(int *p, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + p[i];
+    }
+    return s;
+}
+
+/* The same for a char array, with weights so misplaced values show */
+int ctotal(char *p, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + p[i] * (i + 1);
+    }
+    return s;
+}
+
+/* Pointer parameters, which may overlap */
+void add_ints(int *d, int *a, int *b, int n) {
+    for (int i = 0; i < n; i++) {
+        d[i] = a[i] + b[i];
+    }
+}
+
+void sub_chars(char *d, char *a, char *b, int n) {
+    for (int i = 0; i < n; i++) {
+        d[i] = a[i] - b[i];
+    }
+}
+
+void copy_ints(int *d, int *a, int n) {
+    for (int i = 0; i < n; i++) {
+        d[i] = a[i];
+    }
+}
+
+/* A scalar spread over the lanes, on either side */
+void add_k(int *d, int *a, int k, int n) {
+    for (int i = 0; i < n; i++) {
+        d[i] = k + a[i];
+    }
+}
+
+void sub_k(char *d, char *a, int n) {
+    for (int i = 0; i < n; i++) {
+        d[i] = a[i] - 200;
+    }
+}
+
+/* Comparisons give 0 or 1 in each element */
+void compare_ints(int n) {
+    for (int i = 0; i < n; i++) zs[i] = xs[i] < ys[i];
+}
+
+void compare_chars(char *d, char *a, char *b, int op, int n) {
+    if (op == 0) {
+        for (int i = 0; i < n; i++) d[i] = a[i] == b[i];
+    } else if (op == 1) {
+        for (int i = 0; i < n; i++) d[i] = a[i] != b[i];
+    } else if (op == 2) {
+        for (int i = 0; i < n; i++) d[i] = a[i] > b[i];
+    } else if (op == 3) {
+        for (int i = 0; i < n; i++) d[i] = a[i] >= b[i];
+    } else {
+        for (int i = 0; i < n; i++) d[i] = a[i] <= b[i];
+    }
+}
+
+/* The loop starts part way and the index is used after it */
+int from_middle(int start, int n) {
+    int i;
+    for (i = start; i < n; i++) {
+        zs[i] = xs[i] + ys[i];
+    }
+    return i;
+}
+
+/* The bound is a constant */
+void fixed(void) {
+    for (int i = 0; i < 37; i++) {
+        zs[i] = ys[i] - xs[i];
+    }
+}
+
+void fill(void) {
+    for (int i = 0; i < 100; i++) {
+        xs[i] = i * 37 % 101 - 50;
+        ys[i] = i * 11 % 23 - 11;
+        zs[i] = 0;
+    }
+}
+
+void fill_chars(char *a, char *b, char *d) {
+    for (int i = 0; i < 70; i++) {
+        a[i] = i * 29 % 256 - 128;
+        b[i] = i % 5 == 0 ? a[i] : i * 13 % 7 - 3;
+        d[i] = 0;
+    }
+}
+
+int main() {
+    char ca[70];
+    char cb[70];
+    char cd[70];
+
+    fill();
+    fill_chars(ca, cb, cd);
+    add_ints(zs, xs, ys, 100);
+    if (total(zs, 100) != -1) return 1;
+    add_ints(zs, xs, ys, 7);
+    if (zs[6] != xs[6] + ys[6]) return 2;
+
+    /* Destination the same as a source */
+    fill();
+    add_ints(xs, xs, ys, 99);
+    if (total(xs, 100) != 2) return 3;
+
+    /* Destination one element past a source: each sum feeds the next */
+    fill();
+    add_ints(xs + 1, xs, ys, 50);
+    if (total(xs, 100) != -2064) return 4;
+
+    /* Destination one element before a source */
+    fill();
+    add_ints(xs, xs + 1, ys, 50);
+    if (total(xs, 100) != 17) return 5;
+
+    fill_chars(ca, cb, cd);
+    sub_chars(cd, ca, cb, 70);
+    if (ctotal(cd, 70) != -2554) return 6;
+    sub_chars(ca + 3, ca, cb, 40);
+    if (ctotal(ca, 70) != -35713) return 7;
+
+    fill();
+    copy_ints(ys + 10, ys, 80);
+    if (total(ys, 100) != 157) return 8;
+    fill();
+    copy_ints(ys, ys + 10, 80);
+    if (total(ys, 100) != -19) return 9;
+
+    fill();
+    add_k(zs, xs, 1000000, 33);
+    if (total(zs, 100) != 33000009) return 10;
+    sub_k(cd, ca, 70);
+    if (ctotal(cd, 70) != -3049) return 11;
+
+    compare_ints(100);
+    if (total(zs, 100) != 50) return 12;
+    if (zs[0] * 2 + zs[99] != 3) return 13;
+    compare_chars(cd, ca, cb, 0, 70);
+    if (ctotal(cd, 70) != 294) return 14;
+    compare_chars(cd, ca, cb, 1, 70);
+    if (ctotal(cd, 70) != 2191) return 15;
+    compare_chars(cd, ca, cb, 2, 70);
+    if (ctotal(cd, 70) != 720) return 16;
+    compare_chars(cd, ca, cb, 3, 70);
+    if (ctotal(cd, 70) != 1014) return 17;
+    compare_chars(cd, ca, cb, 4, 61);
+    if (ctotal(cd, 70) != 1775) return 18;
+
+    fill();
+    if (from_middle(5, 100) != 100) return 19;
+    if (from_middle(120, 100) != 120) return 20;
+    if (total(zs, 100) != 72) return 21;
+    fixed();
+    if (total(zs, 100) != 67) return 22;
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/* Test parameters and locals kept in registers */
+
+int counter = 0;
+
+/* Parameters used in a loop */
+int dot(int *a, int *b, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + a[i] * b[i];
+    }
+    return s;
+}
+
+/* A parameter whose address is taken stays in memory */
+void bump(int *p) {
+    *p = *p + 1;
+}
+
+int through_pointer(int x) {
+    bump(&x);
+    bump(&x);
+    return x;
+}
+
+/* char parameters are sign-extended, and truncated when assigned */
+int chars(char c, char d) {
+    int s = c + d;
+    c = c + 100;
+    return s * 1000 + c;
+}
+
+/* Parameters assigned in the body */
+int collatz(int n) {
+    int steps = 0;
+    while (n != 1) {
+        if (n % 2 == 0) {
+            n = n / 2;
+        } else {
+            n = 3 * n + 1;
+        }
+        steps++;
+    }
+    return steps;
+}
+
+/* More variables than registers, live across calls */
+int next(void) {
+    counter++;
+    return counter;
+}
+
+int many(int a, int b, int c, int d, int e, int f) {
+    int g = next();
+    int h = next();
+    int k = next();
+    int s = 0;
+    for (int i = 0; i < 3; i++) {
+        s = s + a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g + h + k + next();
+    }
+    return s + a + f;
+}
+
+/* Recursion needs the caller's parameters after the call */
+int fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+/* Tail recursion stores the new arguments to the parameters */
+int count_bits(int n, int acc) {
+    if (n == 0) return acc;
+    return count_bits(n / 2, acc + n % 2);
+}
+
+/* A sibling call in tail position */
+int plus_one(int x) {
+    return x + 1;
+}
+
+int forward(int x, int y) {
+    int z = x * y;
+    return plus_one(z);
+}
+
+/* A pointer parameter walked through a string */
+int length(char *s) {
+    int n = 0;
+    while (*s) {
+        s = s + 1;
+        n++;
+    }
+    return n;
+}
+
+int main() {
+    int a[5];
+    int b[5];
+    for (int i = 0; i < 5; i++) {
+        a[i] = i + 1;
+        b[i] = 10 - i;
+    }
+
+    if (dot(a, b, 5) != 110) return 1;
+    if (dot(a, b, 0) != 0) return 2;
+    if (through_pointer(5) != 7) return 3;
+    if (chars(3, -5) != -1897) return 4;
+    if (chars(100, 1) != 100944) return 5;
+    if (collatz(27) != 111) return 6;
+    if (many(1, 2, 3, 4, 5, 6) != 313) return 7;
+    if (counter != 6) return 8;
+    if (fib(15) != 610) return 9;
+    if (count_bits(1023, 0) != 10) return 10;
+    if (forward(6, 7) != 43) return 11;
+    if (length("registers") != 9) return 12;
+
+    return 0;
+}
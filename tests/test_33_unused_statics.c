@@ -0,0 +1,58 @@
+/* Test static functions and data, used and unused */
+
+int printf(char *fmt, ...);
+
+/* Never called: dropped along with its string */
+static int unused_helper(int x) {
+    printf("never printed\n");
+    return x * 3;
+}
+
+/* Only called by an unused function */
+static int helper_of_unused(int x) {
+    return x + 1;
+}
+
+static int unused_caller(int x) {
+    return helper_of_unused(x) * 2;
+}
+
+/* Static data nothing reads */
+static int unused_table[4] = {1, 2, 3, 4};
+
+/* Static data reached through the initializer of used data */
+static char *names[] = {"zero", "one", "two"};
+
+static int counter = 10;
+
+/* Declared first, defined later */
+static int twice(int x);
+
+static int used_helper(int x) {
+    counter = counter + x;
+    return twice(x) + 1;
+}
+
+static int twice(int x) {
+    return x * 2;
+}
+
+/* Static inline from a shared header, used once */
+static inline int square(int x) {
+    return x * x;
+}
+
+/* A non-static function is kept even if nothing here calls it */
+int exported(int x) {
+    return square(x) - 1;
+}
+
+int main() {
+    if (used_helper(5) != 11) return 1;
+    if (counter != 15) return 2;
+    if (square(7) != 49) return 3;
+    if (exported(3) != 8) return 4;
+    printf("%s %s\n", names[1], names[2]);
+
+    return 0;
+}
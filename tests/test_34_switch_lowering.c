@@ -0,0 +1,213 @@
+/* Test switch statements lowered to jump tables and compare trees */
+
+int printf(char *fmt, ...);
+
+/* Dense: a jump table, with fallthrough and a default */
+int dense(int x) {
+    int r = 0;
+    switch (x) {
+        case 0: r = 10; break;
+        case 1: r = 11; break;
+        case 2: r = 12;
+        case 3: r = r + 13; break;
+        case 4: r = 14; break;
+        case 5: r = 15; break;
+        case 7: r = 17; break;
+        case 8: r = 18; break;
+        default: r = -1; break;
+    }
+    return r;
+}
+
+/* Negative case values, without a default */
+int negative(int x) {
+    int r = 100;
+    switch (x) {
+        case -3: r = 1; break;
+        case -2: r = 2; break;
+        case -1: r = 3; break;
+        case 0: r = 4; break;
+        case 1: r = 5; break;
+        case 2: r = 6; break;
+    }
+    return r;
+}
+
+/* Sparse: a tree of compares */
+int sparse(int x) {
+    switch (x) {
+        case 1: return 1;
+        case 10: return 2;
+        case 100: return 3;
+        case 1000: return 4;
+        case 10000: return 5;
+        case 100000: return 6;
+        case -50: return 7;
+        case 123456789: return 8;
+    }
+    return 0;
+}
+
+/* Two dense clusters far apart */
+int clusters(int x) {
+    switch (x) {
+        case 0: return 1;
+        case 1: return 2;
+        case 2: return 3;
+        case 3: return 4;
+        case 4: return 5;
+        case 5000: return 6;
+        case 5001: return 7;
+        case 5002: return 8;
+        case 5003: return 9;
+        case 5004: return 10;
+        case 9999: return 11;
+        default: return 0;
+    }
+}
+
+/* The extremes of int */
+int extremes(int x) {
+    switch (x) {
+        case -2147483647 - 1: return 1;
+        case -1: return 2;
+        case 0: return 3;
+        case 1: return 4;
+        case 2147483647: return 5;
+    }
+    return 0;
+}
+
+/* Case labels inside nested statements, and a nested switch */
+int nested(int x, int y) {
+    int r = 0;
+    switch (x) {
+        case 0:
+            if (y > 0) {
+        case 1:
+                r = r + 1;
+            }
+            r = r + 10;
+            break;
+        case 2:
+            switch (y) {
+                case 0: r = 200; break;
+                case 1: r = 201; break;
+                case 2: r = 202; break;
+                case 3: r = 203; break;
+                default: r = 299; break;
+            }
+            r = r + 1000;
+            break;
+        case 3:
+            for (int i = 0; i < y; i++) {
+                r = r + 3;
+            }
+            break;
+        default:
+            r = -7;
+    }
+    return r;
+}
+
+/* A state machine over a string: many cases, on a char, in a loop */
+int classify(char *s) {
+    int words = 0;
+    int digits = 0;
+    int ops = 0;
+    int in_word = 0;
+    for (int i = 0; s[i]; i++) {
+        switch (s[i]) {
+            case 'a': case 'b': case 'c': case 'd': case 'e': case 'f':
+            case 'g': case 'h': case 'i': case 'j': case 'k': case 'l':
+            case 'm': case 'n': case 'o': case 'p': case 'q': case 'r':
+            case 's': case 't': case 'u': case 'v': case 'w': case 'x':
+            case 'y': case 'z': case '_':
+                if (!in_word) {
+                    words++;
+                }
+                in_word = 1;
+                continue;
+            case '0': case '1': case '2': case '3': case '4':
+            case '5': case '6': case '7': case '8': case '9':
+                digits++;
+                break;
+            case '+': case '-': case '*': case '/': case '=':
+                ops++;
+                break;
+            case ' ':
+                break;
+            default:
+                return -1;
+        }
+        in_word = 0;
+    }
+    return words * 10000 + digits * 100 + ops;
+}
+
+/* A switch whose value is known */
+int constant(void) {
+    int x = 3;
+    switch (x) {
+        case 1: return 10;
+        case 2: return 20;
+        case 3: return 30;
+        case 4: return 40;
+        case 5: return 50;
+    }
+    return 0;
+}
+
+/* A switch with no cases at all */
+int empty(int x) {
+    int r = 5;
+    switch (x) {
+        default:
+            r = r + x;
+    }
+    switch (x) {
+    }
+    return r;
+}
+
+int main() {
+    if (dense(0) != 10 || dense(1) != 11 || dense(2) != 25 || dense(3) != 13) return 1;
+    if (dense(4) != 14 || dense(5) != 15 || dense(6) != -1 || dense(7) != 17) return 1;
+    if (dense(8) != 18 || dense(9) != -1) return 1;
+    if (dense(-1) != -1) return 2;
+    if (dense(1000) != -1) return 3;
+
+    for (int i = -3; i <= 2; i++) {
+        if (negative(i) != i + 4) return 4;
+    }
+    if (negative(-4) != 100 || negative(3) != 100) return 5;
+
+    if (sparse(1) != 1 || sparse(10) != 2 || sparse(100) != 3) return 6;
+    if (sparse(1000) != 4 || sparse(10000) != 5 || sparse(100000) != 6) return 7;
+    if (sparse(-50) != 7 || sparse(123456789) != 8) return 8;
+    if (sparse(0) != 0 || sparse(11) != 0 || sparse(-1) != 0) return 9;
+
+    int total = 0;
+    for (int i = -2; i < 10010; i++) {
+        total = total + clusters(i) * (i % 7 + 1);
+    }
+    if (total != 309) return 10;
+
+    if (extremes(-2147483647 - 1) != 1 || extremes(-1) != 2) return 11;
+    if (extremes(0) != 3 || extremes(1) != 4 || extremes(2147483647) != 5) return 12;
+    if (extremes(2) != 0 || extremes(-2147483647) != 0) return 13;
+
+    if (nested(0, 1) != 11 || nested(0, 0) != 10 || nested(1, 0) != 11) return 14;
+    if (nested(2, 2) != 1202 || nested(2, 9) != 1299) return 15;
+    if (nested(3, 4) != 12 || nested(4, 0) != -7) return 16;
+
+    if (classify("x1 = foo_bar + 42 * y") != 30303) return 17;
+    if (classify("a;b") != -1) return 18;
+
+    if (constant() != 30) return 19;
+    if (empty(3) != 8) return 20;
+
+    printf("%d %d %d\n", dense(2), sparse(1000), classify("abc 123"));
+
+    return 0;
+}
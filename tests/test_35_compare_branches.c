@@ -0,0 +1,126 @@
+/* Test conditions compiled as compare-and-branch, and rotated loops */
+
+int printf(char *fmt, ...);
+
+int calls;
+
+int bump(int v) {
+    calls++;
+    return v;
+}
+
+/* Every comparison, with the constant on either side */
+int compare_all(int a, int b) {
+    int r = 0;
+    if (a == b) r += 1;
+    if (a != b) r += 2;
+    if (a < b) r += 4;
+    if (a <= b) r += 8;
+    if (a > b) r += 16;
+    if (a >= b) r += 32;
+    if (a < 5) r += 64;
+    if (5 < a) r += 128;
+    if (-3 >= a) r += 256;
+    if (a != 0) r += 512;
+    return r;
+}
+
+/* && and || in conditions, nested and negated */
+int logic(int a, int b, int c) {
+    int r = 0;
+    if (a > 0 && b > 0) r += 1;
+    if (a > 0 || b > 0) r += 2;
+    if (!(a > 0 && b > 0)) r += 4;
+    if (!(a > 0) || !(b > 0)) r += 8;
+    if ((a > 0 || b > 0) && c) r += 16;
+    if (a > 0 && (b > 0 || c > 0)) r += 32;
+    if (!a) r += 64;
+    if (!!c) r += 128;
+    return r;
+}
+
+/* The right side of && and || runs only when needed */
+int short_circuit(int a) {
+    calls = 0;
+    int r = 0;
+    if (a && bump(1)) r++;
+    if (a || bump(1)) r++;
+    if (!a && bump(0)) r++;
+    while (a > 0 && bump(a)) a--;
+    return r * 100 + calls;
+}
+
+/* Conditional expressions on comparisons */
+int pick(int a, int b) {
+    int lo = a < b ? a : b;
+    int hi = a < b ? b : a;
+    int both = a > 0 && b > 0 ? 1 : 0;
+    return lo * 100 + hi * 10 + both;
+}
+
+/* Loops tested at the bottom: zero trips, continue, break */
+int loops(int n) {
+    int s = 0;
+    int i = 0;
+    while (i < n) {
+        i++;
+        if (i % 3 == 0) continue;
+        s += i;
+    }
+    for (int j = n; j > 0; j--) {
+        if (j == 2) continue;
+        s += 1000;
+    }
+    for (int j = 10; j < n; j++) {
+        s += 100000;
+    }
+    int k = 0;
+    for (;;) {
+        k++;
+        if (k >= n) break;
+    }
+    while (1) {
+        if (k-- <= 0) break;
+        s++;
+    }
+    return s;
+}
+
+/* Pointers and chars compared against zero */
+int count_chars(char *s, char c) {
+    int n = 0;
+    for (char *p = s; p && *p; p++) {
+        if (*p == c || *p == c - 32) n++;
+    }
+    return n;
+}
+
+int main() {
+    if (compare_all(3, 3) != 1 + 8 + 32 + 64 + 512) return 1;
+    if (compare_all(2, 7) != 2 + 4 + 8 + 64 + 512) return 2;
+    if (compare_all(9, 7) != 2 + 16 + 32 + 128 + 512) return 3;
+    if (compare_all(-3, 0) != 2 + 4 + 8 + 64 + 256 + 512) return 4;
+    if (compare_all(0, 0) != 1 + 8 + 32 + 64) return 5;
+
+    if (logic(1, 1, 0) != 1 + 2 + 32) return 6;
+    if (logic(1, 0, 1) != 2 + 4 + 8 + 16 + 32 + 128) return 7;
+    if (logic(0, 0, 0) != 4 + 8 + 64) return 8;
+    if (logic(0, 5, 2) != 2 + 4 + 8 + 16 + 64 + 128) return 9;
+
+    if (short_circuit(0) != 102) return 10;
+    if (short_circuit(3) != 204) return 11;
+
+    if (pick(3, 8) != 381 || pick(8, 3) != 381 || pick(-1, 2) != -80) return 12;
+
+    if (loops(0) != 1) return 13;
+    if (loops(1) != 1002) return 14;
+    if (loops(7) != 6026) return 15;
+    if (loops(12) != 211060) return 16;
+
+    if (count_chars("Banana bread", 'b') != 2) return 17;
+    if (count_chars("", 'a') != 0 || count_chars(0, 'a') != 0) return 18;
+
+    printf("%d %d %d\n", compare_all(2, 7), logic(1, 0, 1), loops(7));
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/* Test && and || as values: the right side runs only when needed */
+
+int printf(char *fmt, ...);
+
+typedef struct {
+    int val;
+} Leaf;
+
+typedef struct {
+    int val;
+    Leaf *next;
+} Node;
+
+int calls;
+
+int bump(int v) {
+    calls++;
+    return v;
+}
+
+/* Guards against NULL that would crash if evaluated in full */
+int second_is_set(Node *p) {
+    return p && p->next && p->next->val;
+}
+
+int either_empty(Node *p) {
+    return !p || !p->next || p->next->val == 0;
+}
+
+/* Values of && and || used in arithmetic, stored and passed on */
+int values(int a, int b) {
+    calls = 0;
+    int x = a && bump(b);
+    int y = a || bump(b);
+    int z = (a && b) + (a || b) * 2 + !(a || b) * 4;
+    int w = bump(a > 0 && b > 0) * 8;
+    return x + y * 10 + z * 100 + w * 1000 + calls * 100000;
+}
+
+/* Nested and mixed, with the result a plain 0 or 1 */
+int mixed(int a, int b, int c) {
+    int r = (a || b) && (b || c);
+    r = r * 2 + (a && b || c);
+    r = r * 2 + (a && (b || !c));
+    r = r * 2 + (5 && a);
+    r = r * 2 + (0 || c);
+    return r;
+}
+
+/* Constant left sides decide without evaluating the right side */
+int constant_sides(void) {
+    calls = 0;
+    int r = (0 && bump(1)) + (1 || bump(1)) * 2 + (1 && bump(3)) * 4 + (0 || bump(0)) * 8;
+    return r * 10 + calls;
+}
+
+int main() {
+    Leaf leaf;
+    Node na;
+    Node nb;
+    Node *a = &na;
+    Node *b = &nb;
+    leaf.val = 0;
+    a->val = 0;
+    a->next = &leaf;
+    b->val = 0;
+    b->next = 0;
+
+    if (second_is_set(0) != 0 || second_is_set(b) != 0) return 1;
+    if (second_is_set(a) != 0) return 2;
+    leaf.val = 42;
+    if (second_is_set(a) != 1) return 3;
+    if (either_empty(0) != 1 || either_empty(b) != 1 || either_empty(a) != 0) return 4;
+
+    if (values(0, 7) != 210 + 200000) return 5;
+    if (values(3, 0) != 210 + 200000) return 6;
+    if (values(3, 7) != 8311 + 200000) return 7;
+    if (values(0, 0) != 400 + 200000) return 8;
+
+    if (mixed(0, 0, 0) != 0 || mixed(1, 1, 1) != 31 || mixed(1, 0, 0) != 6) return 9;
+    if (mixed(0, 1, 0) != 16 || mixed(0, 0, 1) != 9) return 10;
+
+    if (constant_sides() != 62) return 11;
+
+    printf("%d %d %d\n", second_is_set(a), values(3, 7), mixed(1, 0, 1));
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+/* Test division and remainder by constants without idiv */
+
+int printf(char *fmt, ...);
+
+char digits[16];
+
+typedef struct {
+    int a;
+    int b;
+    int c;
+} Triple;
+
+/* Number formatting: repeated / 10 and % 10 */
+int format(int n) {
+    int neg = n < 0;
+    int len = 0;
+    while (1) {
+        int d = n % 10;
+        if (d < 0) d = -d;
+        digits[len] = '0' + d;
+        len++;
+        n = n / 10;
+        if (n == 0) break;
+    }
+    if (neg) {
+        digits[len] = '-';
+        len++;
+    }
+    digits[len] = 0;
+    for (int i = 0; i < len / 2; i++) {
+        char t = digits[i];
+        digits[i] = digits[len - 1 - i];
+        digits[len - 1 - i] = t;
+    }
+    return len;
+}
+
+/* Hashing into a table whose size is not a power of two */
+int hash(char *s) {
+    int h = 0;
+    for (int i = 0; s[i]; i++) {
+        h = (h * 31 + s[i]) % 1021;
+    }
+    return h;
+}
+
+/* Powers of two round toward zero for negative numbers too */
+int pow2(int n) {
+    return n / 2 * 1000000 + n % 2 * 100000 + n / 16 * 1000 + n % 16 * 10 + n / -4;
+}
+
+/* Divisors that need a multiplier wider than an immediate */
+int wide(int n) {
+    return n / 7 + n % 7 + n / 641 + n % 100003 + n / -3 + n % -5;
+}
+
+/* Extremes of int */
+int extremes(int n) {
+    int r = 0;
+    if (n / 2147483647 != (n == 2147483647) - (n < -2147483646)) r += 1;
+    if (n / 1000000007 * 1000000007 + n % 1000000007 != n) r += 2;
+    if (n != -2147483647 - 1 && n / -1 + n != 0) r += 4;
+    if (n % 1 != 0 || n % -1 != 0) r += 8;
+    if (n / 65536 != n / 256 / 256) r += 16;
+    return r;
+}
+
+/* Pointer differences span more than an int's worth of bytes */
+int far_apart(Triple *base) {
+    Triple *far = base + 200000000;
+    Triple *back = base - 190000000;
+    if (far - base != 200000000 || back - base != -190000000) return 1;
+    return far - back;
+}
+
+int main() {
+    if (format(0) != 1 || digits[0] != '0') return 1;
+    if (format(1234567) != 7) return 2;
+    if (digits[0] != '1' || digits[3] != '4' || digits[6] != '7') return 3;
+    if (format(-2147483647 - 1) != 11 || digits[0] != '-' || digits[10] != '8') return 4;
+
+    if (hash("hello") != 760) return 5;
+
+    int h = 0;
+    for (int n = -100; n <= 100; n++) {
+        h = (h * 7 + pow2(n)) % 1000003;
+        h = (h * 7 + wide(n)) % 1000003;
+    }
+    if (h != 57182) return 6;
+
+    if (extremes(2147483647) || extremes(-2147483647 - 1) || extremes(-2147483647)) return 7;
+    if (extremes(0) || extremes(1000000007) || extremes(-1000000008)) return 8;
+    if (2147483647 / 7 != 306783378 || (-2147483647 - 1) % 7 != -2) return 9;
+    if (pow2(-7) != -3100069) return 10;
+
+    Triple t;
+    if (far_apart(&t) != 390000000) return 11;
+
+    format(-905);
+    printf("%s %d %d %d\n", digits, hash("switch"), pow2(-33), wide(1000));
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/* Test code with skewed branches, as built with -fprofile-generate and
+ * then optimized with -fprofile-use */
+
+int printf(char *fmt, ...);
+
+int errors;
+int table[64];
+
+/* Called once, from a branch almost never taken */
+static int fail(int code) {
+    errors++;
+    return -code;
+}
+
+static int twice(int x) {
+    return x + x;
+}
+
+/* A hot case, a warm one and cold ones, with fallthrough */
+int token(int c) {
+    int r = 0;
+    switch (c) {
+        case ' ': return 0;
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+            return 1;
+        case '+': r = 5;
+        case '-': r = r + 2; break;
+        case '(': return 3;
+        case ')': return 4;
+        case 'x': return 6;
+        default: r = -1;
+    }
+    return r;
+}
+
+/* A rare error path on either side of an if */
+int check(int i) {
+    int s = 0;
+    if (i % 97 == 96) {
+        s = fail(i);
+    } else {
+        s = twice(i);
+    }
+    if (i >= 0) {
+        s = s + 1;
+    } else {
+        s = s + fail(-i);
+    }
+    return i == 500 ? s * 2 : s;
+}
+
+/* Loops that never run, run briefly and run long */
+int loops(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        table[i % 64] = table[i % 64] + i;
+        s = s + table[i % 64];
+    }
+    for (int i = 0; i < n - 1000; i++) {
+        s = s - 1;
+    }
+    int k = n;
+    while (k > 0) {
+        k = k / 2;
+        s++;
+    }
+    return s;
+}
+
+int main() {
+    char *text = "12    +    (3    -    45)    *    x9    ;    7";
+    int sum = 0;
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; text[i]; i++) {
+            sum = sum + token(text[i]);
+        }
+    }
+    if (sum != 5400) return 1;
+    if (token('+') != 7 || token('-') != 2 || token('*') != -1) return 2;
+
+    int total = 0;
+    for (int i = 0; i < 1000; i++) {
+        total = total + check(i);
+    }
+    if (total != 985026 || errors != 10) return 3;
+    if (check(-5) != -15 || errors != 11) return 4;
+
+    if (loops(3) != 5 || loops(100) != 5593) return 5;
+
+    printf("%d %d %d %d\n", sum, total, errors, loops(10));
+
+    return 0;
+}
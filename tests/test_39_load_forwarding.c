@@ -0,0 +1,116 @@
+/* Test loads that can reuse a value stored or loaded before them, and
+ * stores and calls that must keep them from doing so */
+
+int printf(char *fmt, ...);
+
+typedef struct {
+    int x;
+    int y;
+} Point;
+
+int counter;
+int limit;
+int grid[16];
+
+/* A global read right after it is stored */
+int store_then_test(int v) {
+    counter = v * 3;
+    if (counter) {
+        return counter + 1;
+    }
+    return counter - 1;
+}
+
+/* A store through a pointer of another type leaves the member alone */
+int member_past_pointer(Point *p, int **slot) {
+    p->x = 7;
+    *slot = 0;
+    return p->x + p->y;
+}
+
+/* A store through an int pointer that may be the member */
+int member_past_int(Point *p, int *q) {
+    p->y = 4;
+    *q = 9;
+    return p->y;
+}
+
+/* Restrict pointers, so the loop reads *scale once */
+void scale_all(int *restrict out, int *restrict in, int *restrict scale, int n) {
+    for (int i = 0; i < n; i++) {
+        out[i] = in[i] * *scale;
+    }
+}
+
+static void bump(void) {
+    counter++;
+}
+
+/* A call may store to any global */
+int across_call(void) {
+    counter = 10;
+    bump();
+    return counter;
+}
+
+/* A char store may change any byte of an int */
+int through_bytes(int *p) {
+    *p = 65793;
+    char *c = (char *)p;
+    c[1] = 0;
+    return *p;
+}
+
+/* The loop stores only to grid, so limit stays in a register */
+int sum_to_limit(void) {
+    int s = 0;
+    for (int i = 0; i < 16; i++) {
+        grid[i] = i * limit;
+        s = s + grid[i] + limit;
+    }
+    return s;
+}
+
+/* The same element read twice, with an unrelated store in between */
+int reread(int *a, Point *p, int i) {
+    int first = a[i];
+    p->x = first;
+    return first + a[i];
+}
+
+int main() {
+    if (store_then_test(5) != 16 || store_then_test(0) != -1) return 1;
+
+    Point pt;
+    pt.y = 2;
+    int *cell = &pt.x;
+    if (member_past_pointer(&pt, &cell) != 9 || cell != 0) return 2;
+    if (member_past_int(&pt, &pt.y) != 9) return 3;
+
+    int in[8];
+    int out[8];
+    int scale = 3;
+    for (int i = 0; i < 8; i++) {
+        in[i] = i + 1;
+    }
+    scale_all(out, in, &scale, 8);
+    if (out[0] != 3 || out[7] != 24) return 4;
+
+    if (across_call() != 11) return 5;
+
+    int word = 0;
+    if (through_bytes(&word) != 65537) return 6;
+
+    limit = 2;
+    int total = sum_to_limit();
+    if (total != 272) return 7;
+
+    int arr[4];
+    arr[2] = 21;
+    if (reread(arr, &pt, 2) != 42 || pt.x != 21) return 8;
+
+    int last = store_then_test(4);
+    printf("%d %d %d %d %d\n", last, out[5], counter, word, total);
+
+    return 0;
+}
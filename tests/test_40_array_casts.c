@@ -0,0 +1,59 @@
+/* Test arrays cast to pointers of other types, which must decay to their
+ * address rather than be loaded */
+
+int printf(char *fmt, ...);
+
+int gwords[4];
+char gbytes[8];
+
+int sum_bytes(char *p, int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s = s + p[i];
+    }
+    return s;
+}
+
+int first_word(void *p) {
+    int *ip = (int *)p;
+    return ip[0];
+}
+
+int main() {
+    /* A local char array written through an int pointer */
+    char c[8];
+    int *ip = (int *)c;
+    *ip = 3;
+    ip[1] = 0;
+    if (c[0] != 3 || c[1] != 0) return 1;
+
+    /* A local int array read through char and void pointers */
+    int w[2];
+    w[0] = 258;
+    w[1] = 5;
+    char *cp = (char *)w;
+    if (cp[0] != 2 || cp[1] != 1) return 2;
+    if (first_word((void *)w) != 258) return 3;
+    if (sum_bytes((char *)w, 8) != 8) return 4;
+
+    /* Global arrays */
+    gwords[0] = 513;
+    gwords[1] = 7;
+    char *gp = (char *)gwords;
+    if (gp[0] != 1 || gp[1] != 2) return 5;
+    if (first_word((void *)gwords) != 513) return 6;
+    if (*(int *)gwords != 513) return 7;
+
+    int *gip = (int *)gbytes;
+    *gip = 4;
+    if (gbytes[0] != 4 || sum_bytes((char *)gbytes, 4) != 4) return 8;
+    if (first_word((void *)gbytes) != 4) return 9;
+
+    /* Arithmetic inside the cast keeps its pointer scaling */
+    char *second = (char *)(w + 1);
+    if (*second != 5) return 10;
+
+    printf("%d %d %d %d\n", c[0], cp[1], gp[0], *second);
+
+    return 0;
+}
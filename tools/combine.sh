@@ -27,7 +27,7 @@ grep -v "^#include" src/compiler.h | grep -v "^#ifndef COMPILER_H" | grep -v "^#
 echo "" >> "$OUTPUT"
 
 # Add each C file (without #includes)
-for file in src/runtime.c src/utils.c src/error.c src/ast.c src/lexer.c src/parser.c src/ir.c src/optimizer.c src/codegen.c src/preprocessor.c src/main.c; do
+for file in src/runtime.c src/utils.c src/error.c src/ast.c src/lexer.c src/parser.c src/ir.c src/cfg.c src/ssa.c src/gvn.c src/alias.c src/loop.c src/inline.c src/dce.c src/tailcall.c src/unroll.c src/vectorize.c src/passes.c src/profile.c src/reach.c src/optimizer.c src/regalloc.c src/codegen.c src/peephole.c src/preprocessor.c src/main.c; do
     echo "/* ========== $file ========== */" >> "$OUTPUT"
     grep -v "^#include" "$file" >> "$OUTPUT"
     echo "" >> "$OUTPUT"